@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace DX
+{
+	// Number of worker threads to use when a caller asks for "all of them" (0).
+	inline unsigned int ResolveWorkerCount(unsigned int workerCount)
+	{
+		if (workerCount == 0)
+		{
+			workerCount = std::thread::hardware_concurrency();
+		}
+
+		return workerCount == 0 ? 1 : workerCount;
+	}
+
+	// Calls func(i) for every i in [0, count) using up to workerCount threads, the
+	// calling thread included, and returns once all items are done. Items are handed
+	// out one at a time, so uneven work balances itself. func must not throw.
+	template <typename Func>
+	void ParallelFor(unsigned int count, unsigned int workerCount, Func func)
+	{
+		workerCount = ResolveWorkerCount(workerCount);
+		if (workerCount > count)
+		{
+			workerCount = count;
+		}
+
+		if (workerCount <= 1)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				func(i);
+			}
+			return;
+		}
+
+		std::atomic<unsigned int> next(0);
+		auto worker = [&]()
+		{
+			for (unsigned int i = next++; i < count; i = next++)
+			{
+				func(i);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(workerCount - 1);
+		for (unsigned int t = 1; t < workerCount; t++)
+		{
+			threads.emplace_back(worker);
+		}
+
+		worker();
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <cfloat>
+#include <cmath>
+
+// Bounding volumes computed once when a mesh is produced and carried with it from then on,
+// so culling, picking and sorting never have to walk the vertices again.
+namespace DX11UWA
+{
+	// Axis-aligned box and bounding sphere of a mesh in object space.
+	struct MeshBounds
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+		DirectX::XMFLOAT3 Center;
+		float Radius;
+	};
+
+	// Bounds of an empty mesh: an inverted box and a zero sphere at the origin.
+	static MeshBounds EmptyMeshBounds()
+	{
+		MeshBounds Bounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX }, { 0.0f, 0.0f, 0.0f }, 0.0f };
+		return Bounds;
+	}
+
+	// Box of Count positions spaced Stride bytes apart. Four independent running
+	// minimum/maximum pairs keep the SIMD min and max units busy.
+	static void ComputeBoundingBox(const char* Positions, size_t Stride, size_t Count, DirectX::XMFLOAT3* Min, DirectX::XMFLOAT3* Max)
+	{
+		using namespace DirectX;
+
+		if (Count == 0)
+		{
+			MeshBounds Empty = EmptyMeshBounds();
+			*Min = Empty.Min;
+			*Max = Empty.Max;
+			return;
+		}
+
+		XMVECTOR First = XMLoadFloat3((const XMFLOAT3*)Positions);
+		XMVECTOR Min0 = First, Min1 = First, Min2 = First, Min3 = First;
+		XMVECTOR Max0 = First, Max1 = First, Max2 = First, Max3 = First;
+
+		size_t i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			XMVECTOR p0 = XMLoadFloat3((const XMFLOAT3*)(Positions + Stride * i));
+			XMVECTOR p1 = XMLoadFloat3((const XMFLOAT3*)(Positions + Stride * (i + 1)));
+			XMVECTOR p2 = XMLoadFloat3((const XMFLOAT3*)(Positions + Stride * (i + 2)));
+			XMVECTOR p3 = XMLoadFloat3((const XMFLOAT3*)(Positions + Stride * (i + 3)));
+
+			Min0 = XMVectorMin(Min0, p0); Max0 = XMVectorMax(Max0, p0);
+			Min1 = XMVectorMin(Min1, p1); Max1 = XMVectorMax(Max1, p1);
+			Min2 = XMVectorMin(Min2, p2); Max2 = XMVectorMax(Max2, p2);
+			Min3 = XMVectorMin(Min3, p3); Max3 = XMVectorMax(Max3, p3);
+		}
+
+		for (; i < Count; i++)
+		{
+			XMVECTOR p = XMLoadFloat3((const XMFLOAT3*)(Positions + Stride * i));
+			Min0 = XMVectorMin(Min0, p);
+			Max0 = XMVectorMax(Max0, p);
+		}
+
+		XMStoreFloat3(Min, XMVectorMin(XMVectorMin(Min0, Min1), XMVectorMin(Min2, Min3)));
+		XMStoreFloat3(Max, XMVectorMax(XMVectorMax(Max0, Max1), XMVectorMax(Max2, Max3)));
+	}
+
+	// Bounding sphere of Count positions (Larsson, "Fast and Tight Fitting Bounding
+	// Spheres"). The initial sphere spans the most distant pair among the extreme points
+	// along the 7 EPOS-14 directions; one Ritter pass then grows it over every point.
+	static void ComputeBoundingSphere(const char* Positions, size_t Stride, size_t Count, DirectX::XMFLOAT3* Center, float* Radius)
+	{
+		using namespace DirectX;
+
+		*Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		*Radius = 0.0f;
+
+		if (Count == 0)
+		{
+			return;
+		}
+
+		auto Position = [&](size_t v) -> const XMFLOAT3& { return *(const XMFLOAT3*)(Positions + Stride * v); };
+
+		// The axes and the four cube diagonals; the diagonals are left unnormalized, which
+		// does not change which point is extreme.
+		const unsigned int DirectionCount = 7;
+		float MinDot[DirectionCount], MaxDot[DirectionCount];
+		size_t MinPoint[DirectionCount], MaxPoint[DirectionCount];
+
+		for (size_t i = 0; i < Count; i++)
+		{
+			const XMFLOAT3& p = Position(i);
+			float Dots[DirectionCount] = { p.x, p.y, p.z, p.x + p.y + p.z, p.x + p.y - p.z, p.x - p.y + p.z, p.x - p.y - p.z };
+
+			for (unsigned int d = 0; d < DirectionCount; d++)
+			{
+				if (i == 0 || Dots[d] < MinDot[d]) { MinDot[d] = Dots[d]; MinPoint[d] = i; }
+				if (i == 0 || Dots[d] > MaxDot[d]) { MaxDot[d] = Dots[d]; MaxPoint[d] = i; }
+			}
+		}
+
+		size_t Best = 0;
+		float BestDistanceSq = -1.0f;
+		for (unsigned int d = 0; d < DirectionCount; d++)
+		{
+			float DistanceSq = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(XMLoadFloat3(&Position(MaxPoint[d])), XMLoadFloat3(&Position(MinPoint[d])))));
+			if (DistanceSq > BestDistanceSq)
+			{
+				BestDistanceSq = DistanceSq;
+				Best = d;
+			}
+		}
+
+		XMVECTOR c = XMVectorScale(XMVectorAdd(XMLoadFloat3(&Position(MinPoint[Best])), XMLoadFloat3(&Position(MaxPoint[Best]))), 0.5f);
+		float r = 0.5f * sqrtf(BestDistanceSq);
+		float RadiusSq = r * r;
+
+		// Ritter: every point outside moves the centre towards it just far enough to
+		// reach it, keeping the opposite side of the old sphere inside.
+		for (size_t i = 0; i < Count; i++)
+		{
+			XMVECTOR p = XMLoadFloat3(&Position(i));
+			XMVECTOR Offset = XMVectorSubtract(p, c);
+			float DistanceSq = XMVectorGetX(XMVector3LengthSq(Offset));
+
+			if (DistanceSq > RadiusSq)
+			{
+				float Distance = sqrtf(DistanceSq);
+				float NewRadius = 0.5f * (r + Distance);
+				c = XMVectorAdd(c, XMVectorScale(Offset, (NewRadius - r) / Distance));
+				r = NewRadius;
+				RadiusSq = r * r;
+			}
+		}
+
+		// Rounding in the centre updates can leave the last point a hair outside.
+		XMStoreFloat3(Center, c);
+		*Radius = r * (1.0f + 1e-5f);
+	}
+
+	// Box around an object space box placed with World (Arvo, "Transforming Axis-Aligned
+	// Bounding Boxes"): the centre is transformed and each new half extent sums the
+	// absolute matrix entries times the old half extents.
+	static void TransformBoundingBox(const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max, DirectX::FXMMATRIX World, DirectX::XMFLOAT3* OutMin, DirectX::XMFLOAT3* OutMax)
+	{
+		using namespace DirectX;
+
+		XMVECTOR Center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&Min), XMLoadFloat3(&Max)), 0.5f);
+		XMVECTOR Extent = XMVectorScale(XMVectorSubtract(XMLoadFloat3(&Max), XMLoadFloat3(&Min)), 0.5f);
+
+		XMVECTOR NewCenter = XMVector3Transform(Center, World);
+		XMVECTOR NewExtent = XMVectorAdd(XMVectorAdd(
+			XMVectorScale(XMVectorAbs(World.r[0]), XMVectorGetX(Extent)),
+			XMVectorScale(XMVectorAbs(World.r[1]), XMVectorGetY(Extent))),
+			XMVectorScale(XMVectorAbs(World.r[2]), XMVectorGetZ(Extent)));
+
+		XMStoreFloat3(OutMin, XMVectorSubtract(NewCenter, NewExtent));
+		XMStoreFloat3(OutMax, XMVectorAdd(NewCenter, NewExtent));
+	}
+
+	static MeshBounds ComputeMeshBounds(const char* Positions, size_t Stride, size_t Count)
+	{
+		MeshBounds Bounds = EmptyMeshBounds();
+		ComputeBoundingBox(Positions, Stride, Count, &Bounds.Min, &Bounds.Max);
+		ComputeBoundingSphere(Positions, Stride, Count, &Bounds.Center, &Bounds.Radius);
+		return Bounds;
+	}
+}
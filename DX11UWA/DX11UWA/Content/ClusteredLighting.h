@@ -0,0 +1,510 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX_INTRINSICS_)
+#include <xmmintrin.h>
+#endif
+#include "../Common/ParallelFor.h"
+#include "ReportOutput.h"
+#include "ShaderStructures.h"
+
+// Clustered forward lighting. The view frustum is cut into LightClusterTilesX x
+// LightClusterTilesY screen tiles and LightClusterSlices depth slices, spaced evenly in log
+// view depth, and every light is tested against the view space box of each cluster in the
+// slices it can reach. Each cluster ends up with a range of one compact 16-bit light index
+// list, which the pixel shader finds from its screen position and depth, so a pixel only
+// evaluates the lights that can reach it. Directional lights go into every cluster.
+namespace DX11UWA
+{
+	// Matches DIR_LIGHT, POINT_LIGHT and SPOT_LIGHT in the pixel shaders.
+	enum LightType
+	{
+		LightDirectional,
+		LightPoint,
+		LightSpot,
+	};
+
+	static const unsigned int LightClusterTilesX = 16;
+	static const unsigned int LightClusterTilesY = 9;
+	static const unsigned int LightClusterSlices = 24;
+	static const unsigned int LightClusterTiles = LightClusterTilesX * LightClusterTilesY;
+	static const unsigned int LightClusterCount = LightClusterTiles * LightClusterSlices;
+
+	// A slice's tiles are tested 4 at a time with no tail.
+	static_assert(LightClusterTiles % 4 == 0, "light cluster tiles must come in fours");
+
+	// The pixel shaders read each light as LIGHT_SIZE uint4s.
+	static_assert(sizeof(Lights) == 8 * 16, "Lights must match LIGHT_SIZE in the pixel shaders");
+
+	// Lights the light buffer holds. Binning packs a light and a tile into 32 bits, and the
+	// index lists are 16-bit, so this stays well under 65536.
+	static const unsigned int MaxSceneLights = 1024;
+	// Indices all cluster lists together can hold; lists past this are cut short.
+	static const unsigned int MaxLightClusterIndices = 256 * 1024;
+
+	// Distance at which a light's attenuation, 1 / (C + L d + Q d^2), falls to 1/256; FLT_MAX
+	// for a light that does not fall off.
+	static float GetLightRange(const Lights& Light)
+	{
+		float C = Light.C_att.x - 256.0f, L = Light.L_att.x, Q = Light.Q_att.x;
+
+		if (Q > 0.0f)
+		{
+			return std::max((-L + sqrtf(std::max(L * L - 4.0f * Q * C, 0.0f))) / (2.0f * Q), 0.0f);
+		}
+		if (L > 0.0f)
+		{
+			return std::max(-C / L, 0.0f);
+		}
+		return FLT_MAX;
+	}
+
+	// Read by the pixel shader as a uint2 per cluster.
+	struct LightClusterRange
+	{
+		unsigned int Offset;
+		unsigned int Count;
+	};
+
+	enum LightClusterPath
+	{
+		LightClusterScalar,
+		LightClusterSSE,
+	};
+
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX_INTRINSICS_)
+	static const LightClusterPath LightClusterBest = LightClusterSSE;
+#else
+	static const LightClusterPath LightClusterBest = LightClusterScalar;
+#endif
+
+	class LightClusterGrid
+	{
+	public:
+		unsigned int LightsBinned = 0;
+		unsigned int IndicesDropped = 0;
+		unsigned int MaxClusterLights = 0;
+
+		// Rebuilds the cluster boxes for a perspective projection with the given x and y scales
+		// (_11 and _22 of the matrix) and view depth range, if any of them changed.
+		void SetProjection(float XScale, float YScale, float Near, float Far)
+		{
+			if (XScale == ProjectionXScale && YScale == ProjectionYScale && Near == NearZ && Far == FarZ)
+			{
+				return;
+			}
+
+			ProjectionXScale = XScale;
+			ProjectionYScale = YScale;
+			NearZ = Near;
+			FarZ = Far;
+			SliceScale = LightClusterSlices / logf(Far / Near);
+			SliceBias = -logf(Near) * SliceScale;
+
+			for (std::vector<float>* Component : { &MinX, &MinY, &MinZ, &MaxX, &MaxY, &MaxZ, &SphereX, &SphereY, &SphereZ, &SphereRadius })
+			{
+				Component->resize(LightClusterCount);
+			}
+
+			for (unsigned int Slice = 0; Slice < LightClusterSlices; Slice++)
+			{
+				float z0 = expf((Slice - SliceBias) / SliceScale);
+				float z1 = expf((Slice + 1 - SliceBias) / SliceScale);
+
+				for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile++)
+				{
+					// Pixel rows run down the screen, normalized device y up.
+					unsigned int TileX = Tile % LightClusterTilesX, TileY = Tile / LightClusterTilesX;
+					float x0 = -1.0f + 2.0f * TileX / LightClusterTilesX, x1 = -1.0f + 2.0f * (TileX + 1) / LightClusterTilesX;
+					float y1 = 1.0f - 2.0f * TileY / LightClusterTilesY, y0 = 1.0f - 2.0f * (TileY + 1) / LightClusterTilesY;
+
+					unsigned int i = Slice * LightClusterTiles + Tile;
+					MinX[i] = std::min(x0 * z0, x0 * z1) / XScale;
+					MaxX[i] = std::max(x1 * z0, x1 * z1) / XScale;
+					MinY[i] = std::min(y0 * z0, y0 * z1) / YScale;
+					MaxY[i] = std::max(y1 * z0, y1 * z1) / YScale;
+					MinZ[i] = z0;
+					MaxZ[i] = z1;
+
+					SphereX[i] = 0.5f * (MinX[i] + MaxX[i]);
+					SphereY[i] = 0.5f * (MinY[i] + MaxY[i]);
+					SphereZ[i] = 0.5f * (MinZ[i] + MaxZ[i]);
+					float dx = MaxX[i] - MinX[i], dy = MaxY[i] - MinY[i], dz = MaxZ[i] - MinZ[i];
+					SphereRadius[i] = 0.5f * sqrtf(dx * dx + dy * dy + dz * dz);
+				}
+			}
+		}
+
+		// Bins the enabled lights among the first LightCount of SceneLights, which are in world
+		// space, for a camera with View, one slice per job on up to ThreadCount threads (0 for
+		// all of them). SetProjection must have been called. The lists come out in light
+		// order, whatever ThreadCount and Path are.
+		void Bin(const Lights* SceneLights, unsigned int LightCount, DirectX::FXMMATRIX View, unsigned int ThreadCount = 0, LightClusterPath Path = LightClusterBest)
+		{
+			using namespace DirectX;
+
+			LightCount = std::min(LightCount, MaxSceneLights);
+			Binned.clear();
+			for (unsigned int i = 0; i < LightCount; i++)
+			{
+				const Lights& Light = SceneLights[i];
+				if (Light.enabled.x == 0)
+				{
+					continue;
+				}
+
+				BinLight Bounds = {};
+				Bounds.Index = i;
+				Bounds.LastSlice = LightClusterSlices - 1;
+				if (Light.type.x == LightDirectional)
+				{
+					Bounds.Everywhere = true;
+					Binned.push_back(Bounds);
+					continue;
+				}
+
+				XMFLOAT3 Center;
+				XMStoreFloat3(&Center, XMVector3Transform(XMVectorSet(Light.pos.x, Light.pos.y, Light.pos.z, 1.0f), View));
+				float Radius = GetLightRange(Light);
+				if (Radius <= 0.0f || Center.z + Radius < NearZ || Center.z - Radius > FarZ)
+				{
+					continue;
+				}
+
+				Bounds.X = Center.x;
+				Bounds.Y = Center.y;
+				Bounds.Z = Center.z;
+				Bounds.Radius = Radius;
+				Bounds.FirstSlice = GetSlice(std::max(Center.z - Radius, NearZ));
+				Bounds.LastSlice = GetSlice(std::min(Center.z + Radius, FarZ));
+
+				// Spot lights fade to nothing at angleratio.y, the cosine of the outer cone; a
+				// cone wider than a half space is binned as a point light.
+				if (Light.type.x == LightSpot && Light.angleratio.y > 0.0f)
+				{
+					XMFLOAT3 Axis;
+					XMStoreFloat3(&Axis, XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(Light.angle.x, Light.angle.y, Light.angle.z, 0.0f), View)));
+					Bounds.Spot = true;
+					Bounds.AxisX = Axis.x;
+					Bounds.AxisY = Axis.y;
+					Bounds.AxisZ = Axis.z;
+					Bounds.Cos = std::min(Light.angleratio.y, 1.0f);
+					Bounds.Sin = sqrtf(1.0f - Bounds.Cos * Bounds.Cos);
+				}
+				Binned.push_back(Bounds);
+			}
+
+			Ranges.resize(LightClusterCount);
+			SliceIndices.resize(LightClusterSlices);
+			SliceHits.resize(LightClusterSlices);
+			DX::ParallelFor(LightClusterSlices, ThreadCount, [&](unsigned int Slice)
+			{
+				BinSlice(Slice, Path);
+			});
+
+			// Gather the slices' lists into one, in cluster order.
+			Indices.clear();
+			IndicesDropped = MaxClusterLights = 0;
+			for (unsigned int Slice = 0; Slice < LightClusterSlices; Slice++)
+			{
+				const unsigned short* SliceList = SliceIndices[Slice].data();
+				for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile++)
+				{
+					LightClusterRange& Range = Ranges[Slice * LightClusterTiles + Tile];
+					unsigned int Count = std::min(Range.Count, MaxLightClusterIndices - (unsigned int)Indices.size());
+					MaxClusterLights = std::max(MaxClusterLights, Range.Count);
+					IndicesDropped += Range.Count - Count;
+
+					Indices.insert(Indices.end(), SliceList + Range.Offset, SliceList + Range.Offset + Count);
+					Range.Offset = (unsigned int)Indices.size() - Count;
+					Range.Count = Count;
+				}
+			}
+			LightsBinned = (unsigned int)Binned.size();
+		}
+
+		const std::vector<LightClusterRange>& GetRanges() const
+		{
+			return Ranges;
+		}
+
+		const std::vector<unsigned short>& GetIndices() const
+		{
+			return Indices;
+		}
+
+		// LightProp's ClusterScale and ClusterCount for a Width x Height pixel target: tiles per
+		// pixel, then the scale and bias that take log view depth to a slice.
+		void GetShaderConstants(float Width, float Height, DirectX::XMFLOAT4* Scale, DirectX::XMUINT4* Count) const
+		{
+			*Scale = DirectX::XMFLOAT4(LightClusterTilesX / Width, LightClusterTilesY / Height, SliceScale, SliceBias);
+			*Count = DirectX::XMUINT4(LightClusterTilesX, LightClusterTilesY, LightClusterSlices, 0);
+		}
+
+	private:
+		// A light's view space bounds: a sphere of its range, cut down to a cone for spot lights.
+		struct BinLight
+		{
+			float X, Y, Z, Radius;
+			float AxisX, AxisY, AxisZ, Cos, Sin;
+			unsigned int Index;
+			unsigned int FirstSlice;
+			unsigned int LastSlice;
+			bool Spot;
+			bool Everywhere;
+		};
+
+		unsigned int GetSlice(float Depth) const
+		{
+			float Slice = floorf(logf(Depth) * SliceScale + SliceBias);
+			return (unsigned int)std::min(std::max(Slice, 0.0f), (float)(LightClusterSlices - 1));
+		}
+
+		// Collects a hit per light and tile, light index in the low 16 bits, then counting sorts
+		// them by tile into the slice's list, keeping light order within each tile.
+		void BinSlice(unsigned int Slice, LightClusterPath Path)
+		{
+			std::vector<unsigned int>& Hits = SliceHits[Slice];
+			Hits.clear();
+
+			unsigned int Base = Slice * LightClusterTiles;
+			for (unsigned int l = 0; l < (unsigned int)Binned.size(); l++)
+			{
+				const BinLight& Light = Binned[l];
+				if (Slice < Light.FirstSlice || Slice > Light.LastSlice)
+				{
+					continue;
+				}
+
+				if (Light.Everywhere)
+				{
+					for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile++)
+					{
+						Hits.push_back(Tile << 16 | l);
+					}
+					continue;
+				}
+
+				switch (Path)
+				{
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX_INTRINSICS_)
+				case LightClusterSSE:
+				{
+					__m128 Zero = _mm_setzero_ps();
+					__m128 cx = _mm_set1_ps(Light.X), cy = _mm_set1_ps(Light.Y), cz = _mm_set1_ps(Light.Z);
+					__m128 RadiusSq = _mm_set1_ps(Light.Radius * Light.Radius);
+					__m128 Range = _mm_set1_ps(Light.Radius);
+					__m128 ax = _mm_set1_ps(Light.AxisX), ay = _mm_set1_ps(Light.AxisY), az = _mm_set1_ps(Light.AxisZ);
+					__m128 Cos = _mm_set1_ps(Light.Cos), Sin = _mm_set1_ps(Light.Sin);
+
+					for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile += 4)
+					{
+						unsigned int i = Base + Tile;
+
+						// Squared distance from the light to the nearest point of each box.
+						__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&MinX[i]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&MaxX[i]))), Zero);
+						__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&MinY[i]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&MaxY[i]))), Zero);
+						__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&MinZ[i]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&MaxZ[i]))), Zero);
+						__m128 DistanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+						__m128 Hit = _mm_cmple_ps(DistanceSq, RadiusSq);
+
+						if (Light.Spot)
+						{
+							// The boxes' bounding spheres against the cone: outside its side, past
+							// its range or behind its apex.
+							__m128 vx = _mm_sub_ps(_mm_loadu_ps(&SphereX[i]), cx);
+							__m128 vy = _mm_sub_ps(_mm_loadu_ps(&SphereY[i]), cy);
+							__m128 vz = _mm_sub_ps(_mm_loadu_ps(&SphereZ[i]), cz);
+							__m128 r = _mm_loadu_ps(&SphereRadius[i]);
+							__m128 LengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+							__m128 Along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, ax), _mm_mul_ps(vy, ay)), _mm_mul_ps(vz, az));
+							__m128 Across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(LengthSq, _mm_mul_ps(Along, Along)), Zero));
+							__m128 Side = _mm_sub_ps(_mm_mul_ps(Cos, Across), _mm_mul_ps(Along, Sin));
+
+							__m128 Outside = _mm_or_ps(_mm_cmpgt_ps(Side, r), _mm_or_ps(_mm_cmpgt_ps(Along, _mm_add_ps(r, Range)), _mm_cmplt_ps(Along, _mm_sub_ps(Zero, r))));
+							Hit = _mm_andnot_ps(Outside, Hit);
+						}
+
+						unsigned int Mask = (unsigned int)_mm_movemask_ps(Hit);
+						for (unsigned int k = 0; Mask != 0; k++, Mask >>= 1)
+						{
+							if (Mask & 1)
+							{
+								Hits.push_back((Tile + k) << 16 | l);
+							}
+						}
+					}
+					break;
+				}
+#endif
+				default:
+				{
+					for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile++)
+					{
+						unsigned int i = Base + Tile;
+
+						float dx = std::max(std::max(MinX[i] - Light.X, Light.X - MaxX[i]), 0.0f);
+						float dy = std::max(std::max(MinY[i] - Light.Y, Light.Y - MaxY[i]), 0.0f);
+						float dz = std::max(std::max(MinZ[i] - Light.Z, Light.Z - MaxZ[i]), 0.0f);
+						bool Hit = (dx * dx + dy * dy) + dz * dz <= Light.Radius * Light.Radius;
+
+						if (Hit && Light.Spot)
+						{
+							float vx = SphereX[i] - Light.X, vy = SphereY[i] - Light.Y, vz = SphereZ[i] - Light.Z;
+							float r = SphereRadius[i];
+							float LengthSq = (vx * vx + vy * vy) + vz * vz;
+							float Along = (vx * Light.AxisX + vy * Light.AxisY) + vz * Light.AxisZ;
+							float Across = sqrtf(std::max(LengthSq - Along * Along, 0.0f));
+							float Side = Light.Cos * Across - Along * Light.Sin;
+							Hit = !(Side > r || Along > r + Light.Radius || Along < 0.0f - r);
+						}
+
+						if (Hit)
+						{
+							Hits.push_back(Tile << 16 | l);
+						}
+					}
+					break;
+				}
+				}
+			}
+
+			LightClusterRange* SliceRanges = &Ranges[Base];
+			for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile++)
+			{
+				SliceRanges[Tile] = { 0, 0 };
+			}
+			for (unsigned int Hit : Hits)
+			{
+				SliceRanges[Hit >> 16].Count++;
+			}
+
+			unsigned int Cursor[LightClusterTiles];
+			unsigned int Offset = 0;
+			for (unsigned int Tile = 0; Tile < LightClusterTiles; Tile++)
+			{
+				SliceRanges[Tile].Offset = Cursor[Tile] = Offset;
+				Offset += SliceRanges[Tile].Count;
+			}
+
+			std::vector<unsigned short>& List = SliceIndices[Slice];
+			List.resize(Offset);
+			for (unsigned int Hit : Hits)
+			{
+				List[Cursor[Hit >> 16]++] = (unsigned short)Binned[Hit & 0xFFFF].Index;
+			}
+		}
+
+		float ProjectionXScale = 0.0f;
+		float ProjectionYScale = 0.0f;
+		float NearZ = 0.0f;
+		float FarZ = 0.0f;
+		float SliceScale = 0.0f;
+		float SliceBias = 0.0f;
+
+		// Every cluster's view space box and its bounding sphere, one array per component,
+		// indexed by slice * LightClusterTiles + tile.
+		std::vector<float> MinX, MinY, MinZ, MaxX, MaxY, MaxZ;
+		std::vector<float> SphereX, SphereY, SphereZ, SphereRadius;
+
+		std::vector<BinLight> Binned;
+		std::vector<std::vector<unsigned int>> SliceHits;
+		std::vector<std::vector<unsigned short>> SliceIndices;
+		std::vector<LightClusterRange> Ranges;
+		std::vector<unsigned short> Indices;
+	};
+
+	// Bins LightCount point and spot lights, scattered over a 200 x 200 field around cameras
+	// with random headings, with the scalar and SIMD tests on one thread and with the SIMD
+	// tests on every thread. Reports the best time of each, whether they build the same lists
+	// and how many lights a pixel evaluates against all LightCount without clusters.
+	static bool ReportLightClustering(unsigned int LightCount = 512, unsigned int SceneCount = 4, unsigned int Repeats = 20)
+	{
+		using namespace DirectX;
+
+		const LightClusterPath Paths[] = { LightClusterScalar, LightClusterBest, LightClusterBest };
+		const unsigned int Threads[] = { 1, 1, 0 };
+		const char* PathNames[] = { "scalar, 1 thread", "SIMD, 1 thread", "SIMD, all threads" };
+
+		double BestSeconds[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+		unsigned long long IndexTotal = 0;
+		unsigned int MaxClusterLights = 0;
+		bool Agree = true;
+
+		std::mt19937 Random(4321);
+		std::uniform_real_distribution<float> Coordinate(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> Height(0.5f, 8.0f);
+		std::uniform_real_distribution<float> Range(3.0f, 15.0f);
+		std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> Angle(-XM_PI, XM_PI);
+
+		std::vector<Lights> SceneLights(LightCount);
+		LightClusterGrid Grids[3];
+		XMMATRIX Projection = XMMatrixPerspectiveFovLH(70.0f * XM_PI / 180.0f, 16.0f / 9.0f, 0.01f, 100.0f);
+		for (LightClusterGrid& Grid : Grids)
+		{
+			Grid.SetProjection(XMVectorGetX(Projection.r[0]), XMVectorGetY(Projection.r[1]), 0.01f, 100.0f);
+		}
+
+		for (unsigned int Scene = 0; Scene < SceneCount; Scene++)
+		{
+			for (unsigned int i = 0; i < LightCount; i++)
+			{
+				Lights& Light = SceneLights[i];
+				Light = {};
+				float LightRange = Range(Random);
+				Light.pos = XMFLOAT4(Coordinate(Random), Height(Random), Coordinate(Random), 1.0f);
+				Light.color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+				Light.angle = XMFLOAT4(0.5f * Unit(Random), -1.0f, 0.5f * Unit(Random), 0.0f);
+				Light.angleratio = XMFLOAT2(0.95f, 0.85f);
+				Light.C_att = XMFLOAT2(1.0f, 0.0f);
+				Light.Q_att = XMFLOAT2(255.0f / (LightRange * LightRange), 0.0f);
+				Light.type = XMINT2(i % 2 == 0 ? LightPoint : LightSpot, 0);
+				Light.enabled = XMINT2(1, 0);
+			}
+
+			float Yaw = Angle(Random);
+			XMVECTOR Eye = XMVectorSet(0.5f * Coordinate(Random), 2.0f, 0.5f * Coordinate(Random), 1.0f);
+			XMVECTOR Forward = XMVectorSet(sinf(Yaw), -0.2f, cosf(Yaw), 0.0f);
+			XMMATRIX View = XMMatrixLookAtLH(Eye, XMVectorAdd(Eye, Forward), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+			for (unsigned int p = 0; p < 3; p++)
+			{
+				for (unsigned int r = 0; r < Repeats; r++)
+				{
+					auto Start = std::chrono::high_resolution_clock::now();
+					Grids[p].Bin(SceneLights.data(), LightCount, View, Threads[p], Paths[p]);
+					double Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+					BestSeconds[p] = std::min(BestSeconds[p], Seconds);
+				}
+
+				const std::vector<LightClusterRange>& Ranges = Grids[p].GetRanges();
+				const std::vector<LightClusterRange>& Reference = Grids[0].GetRanges();
+				for (unsigned int c = 0; c < LightClusterCount; c++)
+				{
+					Agree = Agree && Ranges[c].Offset == Reference[c].Offset && Ranges[c].Count == Reference[c].Count;
+				}
+				Agree = Agree && Grids[p].GetIndices() == Grids[0].GetIndices() && Grids[p].IndicesDropped == 0;
+			}
+
+			IndexTotal += Grids[0].GetIndices().size();
+			MaxClusterLights = std::max(MaxClusterLights, Grids[0].MaxClusterLights);
+		}
+
+		for (unsigned int p = 0; p < 3; p++)
+		{
+			ReportLine("Light clusters: %u lights into %u clusters, %s %.3f ms\n", LightCount, LightClusterCount, PathNames[p], BestSeconds[p] * 1000.0);
+		}
+
+		ReportLine("Light clusters: %.2f lights per cluster on average, %u at most, instead of %u; %.1f KB of indices; paths %s\n",
+			(double)IndexTotal / ((double)LightClusterCount * SceneCount), MaxClusterLights, LightCount,
+			IndexTotal * sizeof(unsigned short) / 1024.0 / SceneCount, Agree ? "agree" : "DISAGREE");
+
+		return Agree;
+	}
+}
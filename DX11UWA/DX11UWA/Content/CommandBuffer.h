@@ -0,0 +1,640 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "ReportOutput.h"
+
+// Direct3D objects are only ever carried by pointer here, so the command buffer and the
+// null backend build without the Direct3D headers.
+struct ID3D11Buffer;
+struct ID3D11InputLayout;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11DepthStencilState;
+struct ID3D11DepthStencilView;
+
+// A compact binary stream of draw submission commands. The scene renderer records a frame
+// into it and a backend replays it: D3D11CommandBackend onto a device context, or
+// NullCommandBackend, which only counts and checks the commands and runs anywhere.
+namespace DX11UWA
+{
+	enum CommandType
+	{
+		CommandSetPipeline,
+		CommandSetVertexBuffer,
+		CommandSetIndexBuffer,
+		CommandSetConstantBuffer,
+		CommandSetTextures,
+		CommandSetSamplers,
+		CommandSetDepthState,
+		CommandUpdateConstants,
+		CommandWriteConstants,
+		CommandWriteBuffer,
+		CommandDrawIndexed,
+		CommandDrawIndexedInstanced,
+		CommandClearDepth,
+		CommandTypeCount,
+	};
+
+	enum CommandStage
+	{
+		CommandStageVertex,
+		CommandStagePixel,
+	};
+
+	// Every command starts with a header and is padded to a multiple of 8 bytes, so the
+	// pointers inside stay aligned.
+	struct CommandHeader
+	{
+		unsigned int Type;
+		unsigned int Size;
+	};
+
+	static const unsigned int CommandMaxTextures = 4;
+	static const unsigned int CommandMaxSamplers = 2;
+
+	// Topology is a D3D11_PRIMITIVE_TOPOLOGY.
+	struct SetPipelineCommand
+	{
+		ID3D11InputLayout* InputLayout;
+		ID3D11VertexShader* VertexShader;
+		ID3D11PixelShader* PixelShader;
+		unsigned int Topology;
+	};
+
+	struct SetVertexBufferCommand
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Slot;
+		unsigned int Stride;
+		unsigned int Offset;
+	};
+
+	// Format is a DXGI_FORMAT.
+	struct SetIndexBufferCommand
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Format;
+		unsigned int Offset;
+	};
+
+	// FirstConstant and ConstantCount are in 16-byte constants; a count of 0 binds the whole buffer.
+	struct SetConstantBufferCommand
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Stage;
+		unsigned int Slot;
+		unsigned int FirstConstant;
+		unsigned int ConstantCount;
+	};
+
+	struct SetTexturesCommand
+	{
+		unsigned int Stage;
+		unsigned int Slot;
+		unsigned int Count;
+		ID3D11ShaderResourceView* Views[CommandMaxTextures];
+	};
+
+	struct SetSamplersCommand
+	{
+		unsigned int Stage;
+		unsigned int Slot;
+		unsigned int Count;
+		ID3D11SamplerState* Samplers[CommandMaxSamplers];
+	};
+
+	// A null State restores the default depth test: less, with depth writes.
+	struct SetDepthStateCommand
+	{
+		ID3D11DepthStencilState* State;
+		unsigned int StencilRef;
+	};
+
+	// Followed by Size bytes of constant data, copied into the stream when recorded.
+	struct UpdateConstantsCommand
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Size;
+	};
+
+	// Followed by Size bytes of constant data, written at Offset into a dynamic buffer mapped
+	// with WRITE_DISCARD when Discard is set and WRITE_NO_OVERWRITE otherwise.
+	struct WriteConstantsCommand
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Offset;
+		unsigned int Size;
+		unsigned int Discard;
+	};
+
+	// Followed by Size bytes of any data, written at Offset into a dynamic buffer the same way
+	// as WriteConstants, but with no constant block alignment: index and shader resource
+	// buffers.
+	struct WriteBufferCommand
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Offset;
+		unsigned int Size;
+		unsigned int Discard;
+	};
+
+	struct DrawIndexedCommand
+	{
+		unsigned int IndexCount;
+		unsigned int StartIndex;
+		int BaseVertex;
+	};
+
+	struct DrawIndexedInstancedCommand
+	{
+		unsigned int IndexCount;
+		unsigned int InstanceCount;
+		unsigned int StartIndex;
+		int BaseVertex;
+		unsigned int StartInstance;
+	};
+
+	struct ClearDepthCommand
+	{
+		ID3D11DepthStencilView* View;
+		float Depth;
+	};
+
+	class CommandBuffer
+	{
+	public:
+		// Empties the stream but keeps its memory, so a steady frame records without allocating.
+		void Reset()
+		{
+			Bytes.clear();
+			Count = 0;
+		}
+
+		unsigned int GetCommandCount() const
+		{
+			return Count;
+		}
+
+		size_t GetSize() const
+		{
+			return Bytes.size();
+		}
+
+		const unsigned char* GetData() const
+		{
+			return Bytes.data();
+		}
+
+		void SetPipeline(ID3D11InputLayout* InputLayout, ID3D11VertexShader* VertexShader, ID3D11PixelShader* PixelShader, unsigned int Topology)
+		{
+			SetPipelineCommand Command = { InputLayout, VertexShader, PixelShader, Topology };
+			Append(CommandSetPipeline, Command);
+		}
+
+		void SetVertexBuffer(unsigned int Slot, ID3D11Buffer* Buffer, unsigned int Stride, unsigned int Offset = 0)
+		{
+			SetVertexBufferCommand Command = { Buffer, Slot, Stride, Offset };
+			Append(CommandSetVertexBuffer, Command);
+		}
+
+		void SetIndexBuffer(ID3D11Buffer* Buffer, unsigned int Format, unsigned int Offset = 0)
+		{
+			SetIndexBufferCommand Command = { Buffer, Format, Offset };
+			Append(CommandSetIndexBuffer, Command);
+		}
+
+		void SetConstantBuffer(CommandStage Stage, unsigned int Slot, ID3D11Buffer* Buffer, unsigned int FirstConstant = 0, unsigned int ConstantCount = 0)
+		{
+			SetConstantBufferCommand Command = { Buffer, (unsigned int)Stage, Slot, FirstConstant, ConstantCount };
+			Append(CommandSetConstantBuffer, Command);
+		}
+
+		void SetTextures(CommandStage Stage, unsigned int Slot, unsigned int ViewCount, ID3D11ShaderResourceView* const* Views)
+		{
+			SetTexturesCommand Command = { (unsigned int)Stage, Slot, std::min(ViewCount, CommandMaxTextures), {} };
+			std::copy(Views, Views + Command.Count, Command.Views);
+			Append(CommandSetTextures, Command);
+		}
+
+		void SetSamplers(CommandStage Stage, unsigned int Slot, unsigned int SamplerCount, ID3D11SamplerState* const* Samplers)
+		{
+			SetSamplersCommand Command = { (unsigned int)Stage, Slot, std::min(SamplerCount, CommandMaxSamplers), {} };
+			std::copy(Samplers, Samplers + Command.Count, Command.Samplers);
+			Append(CommandSetSamplers, Command);
+		}
+
+		void SetDepthState(ID3D11DepthStencilState* State, unsigned int StencilRef = 0)
+		{
+			SetDepthStateCommand Command = { State, StencilRef };
+			Append(CommandSetDepthState, Command);
+		}
+
+		void UpdateConstants(ID3D11Buffer* Buffer, const void* Data, unsigned int Size)
+		{
+			UpdateConstantsCommand Command = { Buffer, Size };
+			Append(CommandUpdateConstants, Command, Data, Size);
+		}
+
+		void WriteConstants(ID3D11Buffer* Buffer, unsigned int Offset, bool Discard, const void* Data, unsigned int Size)
+		{
+			WriteConstantsCommand Command = { Buffer, Offset, Size, Discard ? 1u : 0u };
+			Append(CommandWriteConstants, Command, Data, Size);
+		}
+
+		void WriteBuffer(ID3D11Buffer* Buffer, unsigned int Offset, bool Discard, const void* Data, unsigned int Size)
+		{
+			WriteBufferCommand Command = { Buffer, Offset, Size, Discard ? 1u : 0u };
+			Append(CommandWriteBuffer, Command, Data, Size);
+		}
+
+		void DrawIndexed(unsigned int IndexCount, unsigned int StartIndex, int BaseVertex)
+		{
+			DrawIndexedCommand Command = { IndexCount, StartIndex, BaseVertex };
+			Append(CommandDrawIndexed, Command);
+		}
+
+		void DrawIndexedInstanced(unsigned int IndexCount, unsigned int InstanceCount, unsigned int StartIndex, int BaseVertex, unsigned int StartInstance = 0)
+		{
+			DrawIndexedInstancedCommand Command = { IndexCount, InstanceCount, StartIndex, BaseVertex, StartInstance };
+			Append(CommandDrawIndexedInstanced, Command);
+		}
+
+		void ClearDepth(ID3D11DepthStencilView* View, float Depth)
+		{
+			ClearDepthCommand Command = { View, Depth };
+			Append(CommandClearDepth, Command);
+		}
+
+		// Hands every command, in order, to Backend.Execute(const XCommand&) and, for
+		// UpdateConstants, WriteConstants and WriteBuffer, Backend.Execute(const XCommand&, const void* Data).
+		// Returns false if the stream is malformed; commands before the bad one have run.
+		template <typename Backend>
+		bool Replay(Backend& Target) const
+		{
+			size_t Offset = 0;
+			while (Offset < Bytes.size())
+			{
+				if (Bytes.size() - Offset < sizeof(CommandHeader))
+				{
+					return false;
+				}
+
+				const CommandHeader* Header = (const CommandHeader*)(Bytes.data() + Offset);
+				const unsigned char* Payload = Bytes.data() + Offset + sizeof(CommandHeader);
+				if (Header->Size < sizeof(CommandHeader) || Header->Size > Bytes.size() - Offset || Header->Size % CommandAlignment != 0 ||
+					Header->Size < sizeof(CommandHeader) + GetPayloadSize(Header->Type))
+				{
+					return false;
+				}
+
+				switch (Header->Type)
+				{
+				case CommandSetPipeline:
+					Target.Execute(*(const SetPipelineCommand*)Payload);
+					break;
+				case CommandSetVertexBuffer:
+					Target.Execute(*(const SetVertexBufferCommand*)Payload);
+					break;
+				case CommandSetIndexBuffer:
+					Target.Execute(*(const SetIndexBufferCommand*)Payload);
+					break;
+				case CommandSetConstantBuffer:
+					Target.Execute(*(const SetConstantBufferCommand*)Payload);
+					break;
+				case CommandSetTextures:
+					Target.Execute(*(const SetTexturesCommand*)Payload);
+					break;
+				case CommandSetSamplers:
+					Target.Execute(*(const SetSamplersCommand*)Payload);
+					break;
+				case CommandSetDepthState:
+					Target.Execute(*(const SetDepthStateCommand*)Payload);
+					break;
+				case CommandUpdateConstants:
+				{
+					const UpdateConstantsCommand& Command = *(const UpdateConstantsCommand*)Payload;
+					if (Header->Size < sizeof(CommandHeader) + PadCommand(sizeof(UpdateConstantsCommand)) + Command.Size)
+					{
+						return false;
+					}
+					Target.Execute(Command, Payload + PadCommand(sizeof(UpdateConstantsCommand)));
+					break;
+				}
+				case CommandWriteConstants:
+				{
+					const WriteConstantsCommand& Command = *(const WriteConstantsCommand*)Payload;
+					if (Header->Size < sizeof(CommandHeader) + PadCommand(sizeof(WriteConstantsCommand)) + Command.Size)
+					{
+						return false;
+					}
+					Target.Execute(Command, Payload + PadCommand(sizeof(WriteConstantsCommand)));
+					break;
+				}
+				case CommandWriteBuffer:
+				{
+					const WriteBufferCommand& Command = *(const WriteBufferCommand*)Payload;
+					if (Header->Size < sizeof(CommandHeader) + PadCommand(sizeof(WriteBufferCommand)) + Command.Size)
+					{
+						return false;
+					}
+					Target.Execute(Command, Payload + PadCommand(sizeof(WriteBufferCommand)));
+					break;
+				}
+				case CommandDrawIndexed:
+					Target.Execute(*(const DrawIndexedCommand*)Payload);
+					break;
+				case CommandDrawIndexedInstanced:
+					Target.Execute(*(const DrawIndexedInstancedCommand*)Payload);
+					break;
+				case CommandClearDepth:
+					Target.Execute(*(const ClearDepthCommand*)Payload);
+					break;
+				default:
+					return false;
+				}
+
+				Offset += Header->Size;
+			}
+
+			return true;
+		}
+
+	private:
+		static const unsigned int CommandAlignment = 8;
+
+		static size_t PadCommand(size_t Size)
+		{
+			return (Size + CommandAlignment - 1) & ~(size_t)(CommandAlignment - 1);
+		}
+
+		static size_t GetPayloadSize(unsigned int Type)
+		{
+			static const size_t Sizes[CommandTypeCount] =
+			{
+				sizeof(SetPipelineCommand), sizeof(SetVertexBufferCommand), sizeof(SetIndexBufferCommand), sizeof(SetConstantBufferCommand),
+				sizeof(SetTexturesCommand), sizeof(SetSamplersCommand), sizeof(SetDepthStateCommand), sizeof(UpdateConstantsCommand), sizeof(WriteConstantsCommand),
+				sizeof(WriteBufferCommand),
+				sizeof(DrawIndexedCommand), sizeof(DrawIndexedInstancedCommand),
+				sizeof(ClearDepthCommand),
+			};
+			return Type < CommandTypeCount ? PadCommand(Sizes[Type]) : 0;
+		}
+
+		template <typename Command>
+		void Append(CommandType Type, const Command& Payload, const void* Extra = nullptr, size_t ExtraSize = 0)
+		{
+			size_t PayloadSize = PadCommand(sizeof(Command));
+			size_t Size = sizeof(CommandHeader) + PayloadSize + PadCommand(ExtraSize);
+			size_t Offset = Bytes.size();
+			Bytes.resize(Offset + Size);
+
+			CommandHeader Header = { (unsigned int)Type, (unsigned int)Size };
+			memcpy(&Bytes[Offset], &Header, sizeof(Header));
+			memcpy(&Bytes[Offset + sizeof(CommandHeader)], &Payload, sizeof(Command));
+			if (ExtraSize > 0)
+			{
+				memcpy(&Bytes[Offset + sizeof(CommandHeader) + PayloadSize], Extra, ExtraSize);
+			}
+			Count++;
+		}
+
+		std::vector<unsigned char> Bytes;
+		unsigned int Count = 0;
+	};
+
+	// Replays nothing. Counts every command by type and checks that each draw has a
+	// pipeline, a vertex buffer in slot 0, an index buffer and a vertex stage constant
+	// buffer in slot 0 bound, and that no command carries a null object it needs.
+	// Draws keeps every draw with the state it was issued under.
+	class NullCommandBackend
+	{
+	public:
+		struct RecordedDraw
+		{
+			SetPipelineCommand Pipeline;
+			ID3D11Buffer* VertexBuffer;
+			ID3D11Buffer* IndexBuffer;
+			DrawIndexedCommand Draw;
+			unsigned int InstanceCount;
+		};
+
+		unsigned int Counts[CommandTypeCount] = {};
+		unsigned long long IndicesDrawn = 0;
+		unsigned long long InstancesDrawn = 0;
+		unsigned long long ConstantBytes = 0;
+		unsigned long long BufferBytes = 0;
+		unsigned int Errors = 0;
+		const char* FirstError = nullptr;
+		bool RecordDraws = true;
+		std::vector<RecordedDraw> Draws;
+
+		void Reset()
+		{
+			*this = NullCommandBackend();
+		}
+
+		void Execute(const SetPipelineCommand& Command)
+		{
+			Counts[CommandSetPipeline]++;
+			Check(Command.InputLayout != nullptr && Command.VertexShader != nullptr && Command.PixelShader != nullptr, "pipeline with a null shader or input layout");
+			Pipeline = Command;
+			HasPipeline = true;
+		}
+
+		void Execute(const SetVertexBufferCommand& Command)
+		{
+			Counts[CommandSetVertexBuffer]++;
+			Check(Command.Stride > 0, "vertex buffer with a zero stride");
+			if (Command.Slot == 0)
+			{
+				VertexBuffer = Command.Buffer;
+			}
+		}
+
+		void Execute(const SetIndexBufferCommand& Command)
+		{
+			Counts[CommandSetIndexBuffer]++;
+			IndexBuffer = Command.Buffer;
+		}
+
+		void Execute(const SetConstantBufferCommand& Command)
+		{
+			Counts[CommandSetConstantBuffer]++;
+			Check(Command.FirstConstant % 16 == 0 && Command.ConstantCount % 16 == 0, "constant buffer range not a multiple of 16 constants");
+			if (Command.Stage == CommandStageVertex && Command.Slot == 0)
+			{
+				VertexConstants = Command.Buffer;
+			}
+		}
+
+		void Execute(const SetTexturesCommand& Command)
+		{
+			Counts[CommandSetTextures]++;
+			Check(Command.Count > 0, "empty texture binding");
+		}
+
+		void Execute(const SetSamplersCommand& Command)
+		{
+			Counts[CommandSetSamplers]++;
+			Check(Command.Count > 0, "empty sampler binding");
+		}
+
+		void Execute(const SetDepthStateCommand&)
+		{
+			Counts[CommandSetDepthState]++;
+		}
+
+		void Execute(const UpdateConstantsCommand& Command, const void*)
+		{
+			Counts[CommandUpdateConstants]++;
+			ConstantBytes += Command.Size;
+			Check(Command.Buffer != nullptr && Command.Size > 0 && Command.Size % 16 == 0, "constant update to a null buffer or of a size not a multiple of 16");
+		}
+
+		void Execute(const WriteConstantsCommand& Command, const void*)
+		{
+			Counts[CommandWriteConstants]++;
+			ConstantBytes += Command.Size;
+			Check(Command.Buffer != nullptr && Command.Size > 0 && Command.Offset % 256 == 0, "constant write to a null buffer or an offset not a multiple of 256");
+		}
+
+		void Execute(const WriteBufferCommand& Command, const void*)
+		{
+			Counts[CommandWriteBuffer]++;
+			BufferBytes += Command.Size;
+			Check(Command.Buffer != nullptr && Command.Size > 0, "buffer write to a null buffer or of no bytes");
+		}
+
+		void Execute(const DrawIndexedCommand& Command)
+		{
+			Counts[CommandDrawIndexed]++;
+			IndicesDrawn += Command.IndexCount;
+			InstancesDrawn++;
+			Check(HasPipeline && VertexBuffer != nullptr && IndexBuffer != nullptr && VertexConstants != nullptr, "draw with unbound pipeline, buffers or constants");
+			Check(Command.IndexCount > 0 && Command.IndexCount % 3 == 0, "draw of no or partial triangles");
+
+			if (RecordDraws)
+			{
+				Draws.push_back({ Pipeline, VertexBuffer, IndexBuffer, Command, 1 });
+			}
+		}
+
+		void Execute(const DrawIndexedInstancedCommand& Command)
+		{
+			Counts[CommandDrawIndexedInstanced]++;
+			IndicesDrawn += (unsigned long long)Command.IndexCount * Command.InstanceCount;
+			InstancesDrawn += Command.InstanceCount;
+			Check(HasPipeline && VertexBuffer != nullptr && IndexBuffer != nullptr && VertexConstants != nullptr, "draw with unbound pipeline, buffers or constants");
+			Check(Command.IndexCount > 0 && Command.IndexCount % 3 == 0 && Command.InstanceCount > 0, "draw of no or partial triangles");
+
+			if (RecordDraws)
+			{
+				DrawIndexedCommand Draw = { Command.IndexCount, Command.StartIndex, Command.BaseVertex };
+				Draws.push_back({ Pipeline, VertexBuffer, IndexBuffer, Draw, Command.InstanceCount });
+			}
+		}
+
+		void Execute(const ClearDepthCommand& Command)
+		{
+			Counts[CommandClearDepth]++;
+			Check(Command.View != nullptr && Command.Depth >= 0.0f && Command.Depth <= 1.0f, "depth clear of a null view or out of range");
+		}
+
+	private:
+		void Check(bool Condition, const char* Error)
+		{
+			if (!Condition)
+			{
+				Errors++;
+				FirstError = FirstError != nullptr ? FirstError : Error;
+			}
+		}
+
+		SetPipelineCommand Pipeline = {};
+		bool HasPipeline = false;
+		ID3D11Buffer* VertexBuffer = nullptr;
+		ID3D11Buffer* IndexBuffer = nullptr;
+		ID3D11Buffer* VertexConstants = nullptr;
+	};
+
+	// Records FrameCount frames of DrawCount objects the way the scene renderer does (pipeline
+	// and buffers per mesh, constants and a draw per object, and every 16th object's indices
+	// written into a dynamic buffer as meshlet culling does) with made up object pointers,
+	// replays them through the null backend, and reports recording and replay throughput.
+	static bool ReportCommandBuffer(unsigned int DrawCount = 10000, unsigned int FrameCount = 20)
+	{
+		auto Fake = [](size_t Id) { return (void*)(0x1000 + 0x100 * Id); };
+
+		const unsigned int MeshCount = 4;
+		const unsigned int ConstantSize = 192;
+		unsigned char Constants[ConstantSize] = {};
+		unsigned short Indices[300] = {};
+
+		CommandBuffer Commands;
+		NullCommandBackend Null;
+		Null.RecordDraws = false;
+
+		double RecordSeconds = 1e30, ReplaySeconds = 1e30;
+		bool Valid = true;
+
+		for (unsigned int Frame = 0; Frame < FrameCount; Frame++)
+		{
+			auto RecordStart = std::chrono::high_resolution_clock::now();
+			Commands.Reset();
+			Commands.ClearDepth((ID3D11DepthStencilView*)Fake(1), 1.0f);
+
+			for (unsigned int Draw = 0; Draw < DrawCount; Draw++)
+			{
+				unsigned int Mesh = Draw * MeshCount / DrawCount;
+				if (Draw == 0 || Mesh != (Draw - 1) * MeshCount / DrawCount)
+				{
+					ID3D11ShaderResourceView* Views[2] = { (ID3D11ShaderResourceView*)Fake(10 + Mesh), (ID3D11ShaderResourceView*)Fake(20 + Mesh) };
+					ID3D11SamplerState* Sampler = (ID3D11SamplerState*)Fake(2);
+
+					Commands.SetPipeline((ID3D11InputLayout*)Fake(3), (ID3D11VertexShader*)Fake(4), (ID3D11PixelShader*)Fake(5), 4);
+					Commands.SetVertexBuffer(0, (ID3D11Buffer*)Fake(30 + Mesh), 52);
+					Commands.SetIndexBuffer((ID3D11Buffer*)Fake(40 + Mesh), 57);
+					Commands.SetConstantBuffer(CommandStageVertex, 0, (ID3D11Buffer*)Fake(50 + Mesh));
+					Commands.SetTextures(CommandStagePixel, 0, 2, Views);
+					Commands.SetSamplers(CommandStagePixel, 0, 1, &Sampler);
+				}
+
+				if (Draw % 16 == 0)
+				{
+					unsigned int Copy = Draw / 16 % 4;
+					Commands.WriteBuffer((ID3D11Buffer*)Fake(60), Copy * sizeof(Indices), Copy == 0, Indices, sizeof(Indices));
+				}
+
+				Constants[0] = (unsigned char)Draw;
+				Commands.UpdateConstants((ID3D11Buffer*)Fake(50 + Mesh), Constants, ConstantSize);
+				Commands.DrawIndexed(3 * (100 + Draw % 50), 0, 0);
+			}
+
+			double Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - RecordStart).count();
+			RecordSeconds = std::min(RecordSeconds, Seconds);
+
+			auto ReplayStart = std::chrono::high_resolution_clock::now();
+			Null.Reset();
+			Null.RecordDraws = false;
+			Valid = Commands.Replay(Null) && Valid;
+			Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - ReplayStart).count();
+			ReplaySeconds = std::min(ReplaySeconds, Seconds);
+		}
+
+		Valid = Valid && Null.Errors == 0 && Null.Counts[CommandDrawIndexed] == DrawCount && Null.Counts[CommandSetPipeline] == MeshCount &&
+			Null.Counts[CommandWriteBuffer] == (DrawCount + 15) / 16 && Null.BufferBytes == Null.Counts[CommandWriteBuffer] * sizeof(Indices);
+
+		ReportLine("Command buffer: %u draws as %u commands (%.1f KB), recorded in %.3f ms (%.1f M commands/s), null replay %.3f ms\n",
+			DrawCount, Commands.GetCommandCount(), Commands.GetSize() / 1024.0, RecordSeconds * 1000.0,
+			Commands.GetCommandCount() / std::max(RecordSeconds, 1e-9) / 1000000.0, ReplaySeconds * 1000.0);
+		ReportLine("Command buffer: %s, %u errors%s%s\n", Valid ? "replay valid" : "REPLAY INVALID", Null.Errors,
+			Null.FirstError != nullptr ? ", first: " : "", Null.FirstError != nullptr ? Null.FirstError : "");
+
+		return Valid;
+	}
+}
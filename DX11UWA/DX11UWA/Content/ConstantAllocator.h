@@ -0,0 +1,279 @@
+#pragma once
+#include "CommandBuffer.h"
+
+// Per frame constants sub-allocated from one large dynamic constant buffer. The first
+// allocation of a frame maps the buffer with WRITE_DISCARD, so the driver hands back fresh
+// memory while the GPU still reads last frame's; every later one maps with NO_OVERWRITE and
+// writes past what the frame already used. A frame that runs off the end discards again and
+// starts over, writing the frame's own constants again first, since the discard took the
+// copies its earlier draws were bound to. Allocations are bound with VSSetConstantBuffers1
+// offsets, which come in blocks of 16 constants, so every allocation is rounded up to
+// ConstantBlockSize bytes.
+namespace DX11UWA
+{
+	static const unsigned int ConstantBlockSize = 256;
+
+	struct ConstantAllocation
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Offset;
+		unsigned int FirstConstant;
+		unsigned int ConstantCount;
+		bool Discard;
+	};
+
+	class LinearConstantAllocator
+	{
+	public:
+		unsigned int Allocations = 0;
+		unsigned int Discards = 0;
+		unsigned int BytesAllocated = 0;
+
+		// Capacity is in bytes and is rounded down to whole blocks.
+		void Reset(ID3D11Buffer* ConstantBuffer, unsigned int Capacity)
+		{
+			Buffer = ConstantBuffer;
+			BufferCapacity = Capacity / ConstantBlockSize * ConstantBlockSize;
+			Offset = 0;
+			FrameStart = true;
+		}
+
+		unsigned int GetCapacity() const
+		{
+			return BufferCapacity;
+		}
+
+		// Forgets last frame's frame constants; the next allocation discards.
+		void BeginFrame()
+		{
+			FrameStart = true;
+			FrameBlocks.clear();
+			FrameData.clear();
+		}
+
+		void ResetCounts()
+		{
+			Allocations = Discards = BytesAllocated = 0;
+		}
+
+		// Reserves Size bytes. Returns an allocation with no constants if Size does not fit
+		// in the buffer at all. Use Write, which restores the frame constants after a discard,
+		// once any are bound.
+		ConstantAllocation Allocate(unsigned int Size)
+		{
+			unsigned int Rounded = (Size + ConstantBlockSize - 1) / ConstantBlockSize * ConstantBlockSize;
+			if (Rounded == 0 || Rounded > BufferCapacity)
+			{
+				return { Buffer, 0, 0, 0, false };
+			}
+
+			bool Discard = FrameStart || Offset + Rounded > BufferCapacity;
+			if (Discard)
+			{
+				Offset = 0;
+				FrameStart = false;
+				Discards++;
+			}
+
+			ConstantAllocation Allocation = { Buffer, Offset, Offset / 16, Rounded / 16, Discard };
+			Offset += Rounded;
+			Allocations++;
+			BytesAllocated += Rounded;
+			return Allocation;
+		}
+
+		// Allocates room for Data and records the write into Commands.
+		ConstantAllocation Write(CommandBuffer& Commands, const void* Data, unsigned int Size)
+		{
+			ConstantAllocation Allocation = Allocate(Size);
+			if (Allocation.ConstantCount > 0)
+			{
+				Commands.WriteConstants(Allocation.Buffer, Allocation.Offset, Allocation.Discard, Data, Size);
+				if (Allocation.Discard)
+				{
+					RestoreFrameConstants(Commands);
+				}
+			}
+			return Allocation;
+		}
+
+		// Writes and binds constants every draw of the frame reads. They are kept until the
+		// next BeginFrame and written and bound again whenever the buffer wraps.
+		ConstantAllocation WriteFrameConstants(CommandBuffer& Commands, CommandStage Stage, unsigned int Slot, const void* Data, unsigned int Size)
+		{
+			ConstantAllocation Allocation = Write(Commands, Data, Size);
+			Bind(Commands, Stage, Slot, Allocation);
+
+			FrameBlock Block = { Stage, Slot, (unsigned int)FrameData.size(), Size };
+			FrameBlocks.push_back(Block);
+			FrameData.insert(FrameData.end(), (const unsigned char*)Data, (const unsigned char*)Data + Size);
+			return Allocation;
+		}
+
+		static void Bind(CommandBuffer& Commands, CommandStage Stage, unsigned int Slot, const ConstantAllocation& Allocation)
+		{
+			Commands.SetConstantBuffer(Stage, Slot, Allocation.Buffer, Allocation.FirstConstant, Allocation.ConstantCount);
+		}
+
+	private:
+		struct FrameBlock
+		{
+			CommandStage Stage;
+			unsigned int Slot;
+			unsigned int DataOffset;
+			unsigned int Size;
+		};
+
+		// A ring too small to hold an object and the frame constants together is not
+		// supported; it would discard again here and the restored constants would be lost.
+		void RestoreFrameConstants(CommandBuffer& Commands)
+		{
+			for (const FrameBlock& Block : FrameBlocks)
+			{
+				ConstantAllocation Allocation = Allocate(Block.Size);
+				Commands.WriteConstants(Allocation.Buffer, Allocation.Offset, Allocation.Discard, &FrameData[Block.DataOffset], Block.Size);
+				Bind(Commands, Block.Stage, Block.Slot, Allocation);
+			}
+		}
+
+		ID3D11Buffer* Buffer = nullptr;
+		unsigned int BufferCapacity = 0;
+		unsigned int Offset = 0;
+		bool FrameStart = true;
+		std::vector<FrameBlock> FrameBlocks;
+		std::vector<unsigned char> FrameData;
+	};
+
+	// Plays a constant ring the way the driver renames it: a discard swaps in fresh memory and
+	// a no-overwrite write must not touch bytes written since the last discard. At every draw
+	// the first word of the vertex stage ranges in FrameSlot and ObjectSlot is read back, so the
+	// caller can check they hold what was written for that draw.
+	class ConstantRingChecker
+	{
+	public:
+		unsigned int Errors = 0;
+		std::vector<unsigned int> FrameValues;
+		std::vector<unsigned int> ObjectValues;
+
+		ConstantRingChecker(unsigned int Capacity, unsigned int FrameSlot, unsigned int ObjectSlot) : Memory(Capacity, 0xCD), Written(Capacity, false),
+			FrameSlot(FrameSlot), ObjectSlot(ObjectSlot)
+		{
+		}
+
+		void Execute(const WriteConstantsCommand& Command, const void* Data)
+		{
+			if (Command.Discard)
+			{
+				std::fill(Memory.begin(), Memory.end(), (unsigned char)0xCD);
+				std::fill(Written.begin(), Written.end(), false);
+			}
+
+			if (Command.Offset % ConstantBlockSize != 0 || (size_t)Command.Offset + Command.Size > Memory.size())
+			{
+				Errors++;
+				return;
+			}
+
+			for (unsigned int i = 0; i < Command.Size; i++)
+			{
+				Errors += Written[Command.Offset + i] ? 1 : 0;
+				Written[Command.Offset + i] = true;
+			}
+			memcpy(&Memory[Command.Offset], Data, Command.Size);
+		}
+
+		void Execute(const SetConstantBufferCommand& Command)
+		{
+			if (Command.Stage == CommandStageVertex && Command.Slot == FrameSlot)
+			{
+				FrameOffset = Command.FirstConstant * 16;
+			}
+			if (Command.Stage == CommandStageVertex && Command.Slot == ObjectSlot)
+			{
+				ObjectOffset = Command.FirstConstant * 16;
+			}
+		}
+
+		void Execute(const DrawIndexedCommand&)
+		{
+			FrameValues.push_back(Read(FrameOffset));
+			ObjectValues.push_back(Read(ObjectOffset));
+		}
+
+		template <typename Command>
+		void Execute(const Command&)
+		{
+		}
+
+		void Execute(const UpdateConstantsCommand&, const void*)
+		{
+		}
+
+		void Execute(const WriteBufferCommand&, const void*)
+		{
+		}
+
+	private:
+		unsigned int Read(unsigned int Offset) const
+		{
+			unsigned int Value = 0;
+			memcpy(&Value, &Memory[Offset], sizeof(Value));
+			return Value;
+		}
+
+		std::vector<unsigned char> Memory;
+		std::vector<bool> Written;
+		unsigned int FrameSlot;
+		unsigned int ObjectSlot;
+		unsigned int FrameOffset = 0;
+		unsigned int ObjectOffset = 0;
+	};
+
+	// Records FrameCount frames of per frame constants and ObjectCount objects, each writing its
+	// index into a 64-byte model block, into a ring of Capacity bytes small enough to wrap.
+	// Replays them through ConstantRingChecker and checks every draw reads its own frame's and
+	// object's constants and nothing in flight is overwritten.
+	static bool ReportConstantAllocator(unsigned int ObjectCount = 1000, unsigned int FrameCount = 4, unsigned int Capacity = 64 * 1024)
+	{
+		ID3D11Buffer* Ring = (ID3D11Buffer*)(void*)0x1000;
+		LinearConstantAllocator Allocator;
+		Allocator.Reset(Ring, Capacity);
+
+		bool Valid = true;
+		double RecordSeconds = 0.0;
+		unsigned int Draws = 0;
+		for (unsigned int Frame = 0; Frame < FrameCount; Frame++)
+		{
+			CommandBuffer Commands;
+			unsigned int FrameData[32] = { 0xF000 + Frame };
+			unsigned char LightData[400] = {};
+
+			auto Start = std::chrono::high_resolution_clock::now();
+			Allocator.BeginFrame();
+			Allocator.WriteFrameConstants(Commands, CommandStageVertex, 0, FrameData, sizeof(FrameData));
+			Allocator.WriteFrameConstants(Commands, CommandStagePixel, 1, LightData, sizeof(LightData));
+			for (unsigned int Object = 0; Object < ObjectCount; Object++)
+			{
+				unsigned int Model[16] = { Object + Frame * ObjectCount };
+				LinearConstantAllocator::Bind(Commands, CommandStageVertex, 2, Allocator.Write(Commands, Model, sizeof(Model)));
+				Commands.DrawIndexed(3, 0, 0);
+			}
+			RecordSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+			ConstantRingChecker Checker(Allocator.GetCapacity(), 0, 2);
+			Valid = Commands.Replay(Checker) && Valid && Checker.Errors == 0 && Checker.ObjectValues.size() == ObjectCount;
+			for (unsigned int Object = 0; Valid && Object < ObjectCount; Object++)
+			{
+				Valid = Checker.ObjectValues[Object] == Object + Frame * ObjectCount && Checker.FrameValues[Object] == 0xF000 + Frame;
+			}
+			Draws += ObjectCount;
+		}
+
+		char Line[256];
+		sprintf_s(Line, "Constant ring: %u draws over %u frames in a %u KB ring, %u allocations, %u discards, %.1f ns per object, %s\n", Draws, FrameCount,
+			Allocator.GetCapacity() / 1024, Allocator.Allocations, Allocator.Discards, RecordSeconds * 1e9 / Draws, Valid ? "every draw read its constants" : "CONSTANT MISMATCH");
+		OutputDebugStringA(Line);
+
+		return Valid;
+	}
+}
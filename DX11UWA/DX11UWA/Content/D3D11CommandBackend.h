@@ -0,0 +1,131 @@
+#pragma once
+#include "StateFilter.h"
+
+// Replays a command buffer onto a Direct3D 11.1 device context. D3D11Context turns the
+// portable context calls of ContextCommandBackend into device context calls, one each.
+namespace DX11UWA
+{
+	class D3D11Context
+	{
+	public:
+		explicit D3D11Context(ID3D11DeviceContext1* DeviceContext) : Context(DeviceContext)
+		{
+		}
+
+		void SetInputLayout(ID3D11InputLayout* InputLayout)
+		{
+			Context->IASetInputLayout(InputLayout);
+		}
+
+		void SetTopology(unsigned int Topology)
+		{
+			Context->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)Topology);
+		}
+
+		void SetVertexShader(ID3D11VertexShader* Shader)
+		{
+			Context->VSSetShader(Shader, nullptr, 0);
+		}
+
+		void SetPixelShader(ID3D11PixelShader* Shader)
+		{
+			Context->PSSetShader(Shader, nullptr, 0);
+		}
+
+		void SetVertexBuffer(unsigned int Slot, ID3D11Buffer* Buffer, unsigned int Stride, unsigned int Offset)
+		{
+			Context->IASetVertexBuffers(Slot, 1, &Buffer, &Stride, &Offset);
+		}
+
+		void SetIndexBuffer(ID3D11Buffer* Buffer, unsigned int Format, unsigned int Offset)
+		{
+			Context->IASetIndexBuffer(Buffer, (DXGI_FORMAT)Format, Offset);
+		}
+
+		void SetConstantBuffer(unsigned int Stage, unsigned int Slot, ID3D11Buffer* Buffer, unsigned int FirstConstant, unsigned int ConstantCount)
+		{
+			const UINT* First = ConstantCount > 0 ? &FirstConstant : nullptr;
+			const UINT* Count = ConstantCount > 0 ? &ConstantCount : nullptr;
+
+			if (Stage == CommandStageVertex)
+			{
+				Context->VSSetConstantBuffers1(Slot, 1, &Buffer, First, Count);
+			}
+			else
+			{
+				Context->PSSetConstantBuffers1(Slot, 1, &Buffer, First, Count);
+			}
+		}
+
+		void SetTextures(unsigned int Stage, unsigned int Slot, unsigned int Count, ID3D11ShaderResourceView* const* Views)
+		{
+			if (Stage == CommandStageVertex)
+			{
+				Context->VSSetShaderResources(Slot, Count, Views);
+			}
+			else
+			{
+				Context->PSSetShaderResources(Slot, Count, Views);
+			}
+		}
+
+		void SetSamplers(unsigned int Stage, unsigned int Slot, unsigned int Count, ID3D11SamplerState* const* Samplers)
+		{
+			if (Stage == CommandStageVertex)
+			{
+				Context->VSSetSamplers(Slot, Count, Samplers);
+			}
+			else
+			{
+				Context->PSSetSamplers(Slot, Count, Samplers);
+			}
+		}
+
+		void SetDepthState(ID3D11DepthStencilState* State, unsigned int StencilRef)
+		{
+			Context->OMSetDepthStencilState(State, StencilRef);
+		}
+
+		void UpdateConstants(ID3D11Buffer* Buffer, const void* Data, unsigned int)
+		{
+			Context->UpdateSubresource1(Buffer, 0, nullptr, Data, 0, 0, 0);
+		}
+
+		// A write into a buffer that has not been created yet is dropped rather than mapped.
+		void WriteConstants(ID3D11Buffer* Buffer, unsigned int Offset, bool Discard, const void* Data, unsigned int Size)
+		{
+			D3D11_MAPPED_SUBRESOURCE Mapped;
+			if (Buffer != nullptr && SUCCEEDED(Context->Map(Buffer, 0, Discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &Mapped)))
+			{
+				memcpy((unsigned char*)Mapped.pData + Offset, Data, Size);
+				Context->Unmap(Buffer, 0);
+			}
+		}
+
+		// Constant and plain buffer writes map, and skip a null buffer, the same way.
+		void WriteBuffer(ID3D11Buffer* Buffer, unsigned int Offset, bool Discard, const void* Data, unsigned int Size)
+		{
+			WriteConstants(Buffer, Offset, Discard, Data, Size);
+		}
+
+		void DrawIndexed(unsigned int IndexCount, unsigned int StartIndex, int BaseVertex)
+		{
+			Context->DrawIndexed(IndexCount, StartIndex, BaseVertex);
+		}
+
+		void DrawIndexedInstanced(unsigned int IndexCount, unsigned int InstanceCount, unsigned int StartIndex, int BaseVertex, unsigned int StartInstance)
+		{
+			Context->DrawIndexedInstanced(IndexCount, InstanceCount, StartIndex, BaseVertex, StartInstance);
+		}
+
+		void ClearDepth(ID3D11DepthStencilView* View, float Depth)
+		{
+			Context->ClearDepthStencilView(View, D3D11_CLEAR_DEPTH, Depth, 0);
+		}
+
+	private:
+		ID3D11DeviceContext1* Context;
+	};
+
+	typedef ContextCommandBackend<D3D11Context> D3D11CommandBackend;
+}
@@ -0,0 +1,318 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cfloat>
+#if defined(_XM_AVX_INTRINSICS_)
+#include <immintrin.h>
+#elif defined(_XM_SSE_INTRINSICS_)
+#include <xmmintrin.h>
+#endif
+#include "BoundingVolumes.h"
+#include "ReportOutput.h"
+
+// Whole-object frustum culling. Object bounding spheres are kept in structure-of-arrays
+// form so one SIMD register holds the same coordinate of 4 (SSE) or 8 (AVX) objects and
+// each plane test covers that many objects at once.
+namespace DX11UWA
+{
+	// Frustum planes (normalized, pointing inwards) of a row-vector view * projection style
+	// matrix with D3D depth from 0 to 1, in the space the matrix maps from: world space for
+	// view * projection, object space for world * view * projection.
+	static void GetFrustumPlanes(DirectX::FXMMATRIX WorldViewProjection, DirectX::XMFLOAT4 Planes[6])
+	{
+		using namespace DirectX;
+
+		XMMATRIX m = XMMatrixTranspose(WorldViewProjection);
+
+		XMVECTOR Raw[6] =
+		{
+			XMVectorAdd(m.r[3], m.r[0]),
+			XMVectorSubtract(m.r[3], m.r[0]),
+			XMVectorAdd(m.r[3], m.r[1]),
+			XMVectorSubtract(m.r[3], m.r[1]),
+			m.r[2],
+			XMVectorSubtract(m.r[3], m.r[2]),
+		};
+
+		for (unsigned int p = 0; p < 6; p++)
+		{
+			XMStoreFloat4(&Planes[p], XMPlaneNormalize(Raw[p]));
+		}
+	}
+
+	// World space sphere of a mesh placed with World, scaled by the largest axis scale.
+	static void TransformBoundingSphere(const MeshBounds& Bounds, DirectX::FXMMATRIX World, DirectX::XMFLOAT3* Center, float* Radius)
+	{
+		using namespace DirectX;
+
+		float ScaleSq = XMVectorGetX(XMVector3LengthSq(World.r[0]));
+		ScaleSq = fmaxf(ScaleSq, XMVectorGetX(XMVector3LengthSq(World.r[1])));
+		ScaleSq = fmaxf(ScaleSq, XMVectorGetX(XMVector3LengthSq(World.r[2])));
+
+		XMStoreFloat3(Center, XMVector3Transform(XMLoadFloat3(&Bounds.Center), World));
+		*Radius = Bounds.Radius * sqrtf(ScaleSq);
+	}
+
+	// Objects are padded to a multiple of this many slots so the SIMD loops need no tail.
+	static const unsigned int CullingSpheresPadding = 8;
+
+	// Bounding spheres of a set of objects, one array per component. Padding slots hold a
+	// negative infinite radius, which every plane rejects.
+	struct CullingSpheres
+	{
+		std::vector<float> CenterX;
+		std::vector<float> CenterY;
+		std::vector<float> CenterZ;
+		std::vector<float> Radius;
+		unsigned int Count = 0;
+
+		// Returns the index of the new object.
+		unsigned int Add(const DirectX::XMFLOAT3& Center, float SphereRadius)
+		{
+			if (Count == CenterX.size())
+			{
+				size_t Padded = CenterX.size() + CullingSpheresPadding;
+				CenterX.resize(Padded, 0.0f);
+				CenterY.resize(Padded, 0.0f);
+				CenterZ.resize(Padded, 0.0f);
+				Radius.resize(Padded, -FLT_MAX);
+			}
+
+			Set(Count, Center, SphereRadius);
+			return Count++;
+		}
+
+		void Set(unsigned int Index, const DirectX::XMFLOAT3& Center, float SphereRadius)
+		{
+			CenterX[Index] = Center.x;
+			CenterY[Index] = Center.y;
+			CenterZ[Index] = Center.z;
+			Radius[Index] = SphereRadius;
+		}
+
+		void Reserve(unsigned int Objects)
+		{
+			size_t Padded = (Objects + CullingSpheresPadding - 1) / CullingSpheresPadding * CullingSpheresPadding;
+			CenterX.reserve(Padded);
+			CenterY.reserve(Padded);
+			CenterZ.reserve(Padded);
+			Radius.reserve(Padded);
+		}
+
+		void Clear()
+		{
+			CenterX.clear();
+			CenterY.clear();
+			CenterZ.clear();
+			Radius.clear();
+			Count = 0;
+		}
+
+		size_t PaddedCount() const
+		{
+			return CenterX.size();
+		}
+	};
+
+	enum FrustumCullPath
+	{
+		FrustumCullScalar,
+		FrustumCullSSE,
+		FrustumCullAVX,
+	};
+
+#if defined(_XM_AVX_INTRINSICS_)
+	static const FrustumCullPath FrustumCullBest = FrustumCullAVX;
+#elif defined(_XM_SSE_INTRINSICS_)
+	static const FrustumCullPath FrustumCullBest = FrustumCullSSE;
+#else
+	static const FrustumCullPath FrustumCullBest = FrustumCullScalar;
+#endif
+
+	// Writes the indices of the spheres that are not entirely behind one of the planes to
+	// Visible, in index order, and returns how many there are. Visible is sized to the
+	// padded count while writing and trimmed to the result.
+	static unsigned int CullSpheres(const CullingSpheres& Spheres, const DirectX::XMFLOAT4 Planes[6], std::vector<unsigned int>* Visible, FrustumCullPath Path = FrustumCullBest)
+	{
+		size_t Padded = Spheres.PaddedCount();
+		Visible->resize(Padded);
+
+		const float* X = Spheres.CenterX.data();
+		const float* Y = Spheres.CenterY.data();
+		const float* Z = Spheres.CenterZ.data();
+		const float* R = Spheres.Radius.data();
+		unsigned int* Out = Visible->data();
+		unsigned int n = 0;
+
+		switch (Path)
+		{
+#if defined(_XM_AVX_INTRINSICS_)
+		case FrustumCullAVX:
+		{
+			__m256 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+			for (unsigned int p = 0; p < 6; p++)
+			{
+				PlaneX[p] = _mm256_set1_ps(Planes[p].x);
+				PlaneY[p] = _mm256_set1_ps(Planes[p].y);
+				PlaneZ[p] = _mm256_set1_ps(Planes[p].z);
+				PlaneW[p] = _mm256_set1_ps(Planes[p].w);
+			}
+
+			for (size_t i = 0; i < Padded; i += 8)
+			{
+				__m256 cx = _mm256_loadu_ps(X + i);
+				__m256 cy = _mm256_loadu_ps(Y + i);
+				__m256 cz = _mm256_loadu_ps(Z + i);
+				__m256 NegRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(R + i));
+
+				__m256 Outside = _mm256_setzero_ps();
+				for (unsigned int p = 0; p < 6; p++)
+				{
+					__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, PlaneX[p]), _mm256_mul_ps(cy, PlaneY[p])),
+						_mm256_add_ps(_mm256_mul_ps(cz, PlaneZ[p]), PlaneW[p]));
+					Outside = _mm256_or_ps(Outside, _mm256_cmp_ps(d, NegRadius, _CMP_LT_OQ));
+				}
+
+				// Store every candidate and advance past the visible ones only.
+				unsigned int Mask = ~(unsigned int)_mm256_movemask_ps(Outside);
+				for (unsigned int k = 0; k < 8; k++)
+				{
+					Out[n] = (unsigned int)i + k;
+					n += (Mask >> k) & 1;
+				}
+			}
+			break;
+		}
+#endif
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX_INTRINSICS_)
+		case FrustumCullSSE:
+		{
+			__m128 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+			for (unsigned int p = 0; p < 6; p++)
+			{
+				PlaneX[p] = _mm_set1_ps(Planes[p].x);
+				PlaneY[p] = _mm_set1_ps(Planes[p].y);
+				PlaneZ[p] = _mm_set1_ps(Planes[p].z);
+				PlaneW[p] = _mm_set1_ps(Planes[p].w);
+			}
+
+			for (size_t i = 0; i < Padded; i += 4)
+			{
+				__m128 cx = _mm_loadu_ps(X + i);
+				__m128 cy = _mm_loadu_ps(Y + i);
+				__m128 cz = _mm_loadu_ps(Z + i);
+				__m128 NegRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(R + i));
+
+				__m128 Outside = _mm_setzero_ps();
+				for (unsigned int p = 0; p < 6; p++)
+				{
+					__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, PlaneX[p]), _mm_mul_ps(cy, PlaneY[p])),
+						_mm_add_ps(_mm_mul_ps(cz, PlaneZ[p]), PlaneW[p]));
+					Outside = _mm_or_ps(Outside, _mm_cmplt_ps(d, NegRadius));
+				}
+
+				unsigned int Mask = ~(unsigned int)_mm_movemask_ps(Outside);
+				for (unsigned int k = 0; k < 4; k++)
+				{
+					Out[n] = (unsigned int)i + k;
+					n += (Mask >> k) & 1;
+				}
+			}
+			break;
+		}
+#endif
+		default:
+		{
+			for (size_t i = 0; i < Padded; i++)
+			{
+				bool Outside = false;
+				for (unsigned int p = 0; p < 6; p++)
+				{
+					float d = (X[i] * Planes[p].x + Y[i] * Planes[p].y) + (Z[i] * Planes[p].z + Planes[p].w);
+					Outside |= d < -R[i];
+				}
+
+				Out[n] = (unsigned int)i;
+				n += !Outside;
+			}
+			break;
+		}
+		}
+
+		Visible->resize(n);
+		return n;
+	}
+
+	// Culls randomized scenes of ObjectCount spheres, scattered through a cube around a
+	// camera with a random heading, with every available path. Reports the best time per
+	// cull of each path and whether all paths agree on the visible lists, and returns
+	// false if they do not.
+	static bool ReportFrustumCulling(unsigned int ObjectCount = 100000, unsigned int SceneCount = 8, unsigned int Repeats = 20)
+	{
+		using namespace DirectX;
+
+		const FrustumCullPath Paths[] = { FrustumCullScalar, FrustumCullSSE, FrustumCullAVX };
+		const char* PathNames[] = { "scalar", "SSE", "AVX" };
+		const unsigned int PathCount = (unsigned int)FrustumCullBest + 1;
+
+		double BestSeconds[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+		unsigned long long VisibleTotal = 0;
+		bool Agree = true;
+
+		std::mt19937 Random(1234);
+		std::uniform_real_distribution<float> Coordinate(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> SphereRadius(0.5f, 5.0f);
+		std::uniform_real_distribution<float> Angle(-XM_PI, XM_PI);
+
+		XMMATRIX Projection = XMMatrixPerspectiveFovLH(70.0f * XM_PI / 180.0f, 16.0f / 9.0f, 0.01f, 400.0f);
+
+		CullingSpheres Spheres;
+		std::vector<unsigned int> Visible[3];
+
+		for (unsigned int Scene = 0; Scene < SceneCount; Scene++)
+		{
+			Spheres.Clear();
+			Spheres.Reserve(ObjectCount);
+			for (unsigned int i = 0; i < ObjectCount; i++)
+			{
+				Spheres.Add(XMFLOAT3(Coordinate(Random), Coordinate(Random), Coordinate(Random)), SphereRadius(Random));
+			}
+
+			float Yaw = Angle(Random);
+			float Pitch = 0.25f * Angle(Random);
+			XMVECTOR Eye = XMVectorSet(0.2f * Coordinate(Random), 0.2f * Coordinate(Random), 0.2f * Coordinate(Random), 1.0f);
+			XMVECTOR Forward = XMVectorSet(cosf(Pitch) * sinf(Yaw), sinf(Pitch), cosf(Pitch) * cosf(Yaw), 0.0f);
+			XMMATRIX View = XMMatrixLookAtLH(Eye, XMVectorAdd(Eye, Forward), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+			XMFLOAT4 Planes[6];
+			GetFrustumPlanes(XMMatrixMultiply(View, Projection), Planes);
+
+			for (unsigned int p = 0; p < PathCount; p++)
+			{
+				for (unsigned int r = 0; r < Repeats; r++)
+				{
+					auto Start = std::chrono::high_resolution_clock::now();
+					CullSpheres(Spheres, Planes, &Visible[p], Paths[p]);
+					double Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+					BestSeconds[p] = Seconds < BestSeconds[p] ? Seconds : BestSeconds[p];
+				}
+
+				Agree = Agree && Visible[p] == Visible[0];
+			}
+
+			VisibleTotal += Visible[0].size();
+		}
+
+		for (unsigned int p = 0; p < PathCount; p++)
+		{
+			ReportLine("Frustum culling: %u objects, %s %.3f ms (%.0f M objects/s)\n", ObjectCount, PathNames[p],
+				BestSeconds[p] * 1000.0, ObjectCount / BestSeconds[p] / 1000000.0);
+		}
+
+		ReportLine("Frustum culling: %.1f%% visible on average over %u scenes, paths %s\n",
+			100.0 * VisibleTotal / ((double)ObjectCount * SceneCount), SceneCount, Agree ? "agree" : "DISAGREE");
+
+		return Agree;
+	}
+}
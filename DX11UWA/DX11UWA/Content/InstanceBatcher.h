@@ -0,0 +1,186 @@
+#pragma once
+#include "ConstantAllocator.h"
+
+// Copies of one mesh gathered over a run of the render queue and drawn instanced, a level of
+// detail at a time. Each copy's world matrix, already transposed for the shader, is packed
+// with up to InstanceBatchSize others into one constant ring allocation, which
+// NormalTexturingInstancedVertexShader indexes by SV_InstanceID.
+namespace DX11UWA
+{
+	// Matches INSTANCE_BATCH_SIZE in NormalTexturingInstancedVertexShader.hlsl. 256 matrices
+	// are 16 KB, a quarter of what one constant buffer binding can hold.
+	static const unsigned int InstanceBatchSize = 256;
+
+	class InstanceBatcher
+	{
+	public:
+		unsigned int Batches = 0;
+		unsigned int Instances = 0;
+
+		// Drops what was gathered but keeps the memory.
+		void Clear()
+		{
+			for (std::vector<DirectX::XMFLOAT4X4>& Worlds : Levels)
+			{
+				Worlds.clear();
+			}
+			Pending = 0;
+		}
+
+		void ResetCounts()
+		{
+			Batches = Instances = 0;
+		}
+
+		bool IsEmpty() const
+		{
+			return Pending == 0;
+		}
+
+		void Add(unsigned int Lod, const DirectX::XMFLOAT4X4& ShaderWorld)
+		{
+			if (Lod >= Levels.size())
+			{
+				Levels.resize(Lod + 1);
+			}
+			Levels[Lod].push_back(ShaderWorld);
+			Pending++;
+		}
+
+		// Writes the gathered matrices into Allocator's ring, binds each batch to the vertex
+		// stage at Slot and calls Draw(Lod, InstanceCount) to record its draws, then clears.
+		template <typename DrawLod>
+		void Flush(CommandBuffer& Commands, LinearConstantAllocator& Allocator, unsigned int Slot, DrawLod&& Draw)
+		{
+			for (unsigned int Lod = 0; Lod < Levels.size(); Lod++)
+			{
+				const std::vector<DirectX::XMFLOAT4X4>& Worlds = Levels[Lod];
+				for (size_t First = 0; First < Worlds.size(); First += InstanceBatchSize)
+				{
+					unsigned int Count = (unsigned int)std::min(Worlds.size() - First, (size_t)InstanceBatchSize);
+					LinearConstantAllocator::Bind(Commands, CommandStageVertex, Slot, Allocator.Write(Commands, &Worlds[First], Count * sizeof(DirectX::XMFLOAT4X4)));
+					Draw(Lod, Count);
+
+					Batches++;
+					Instances += Count;
+				}
+			}
+			Clear();
+		}
+
+	private:
+		std::vector<std::vector<DirectX::XMFLOAT4X4>> Levels;
+		unsigned int Pending = 0;
+	};
+
+	// Records FrameCount frames of ObjectCount copies of a mesh of SubmeshCount parts spread
+	// over LodCount levels of detail, once with a model block and a draw per part per copy
+	// and once through InstanceBatcher, replays both through the null backend and reports the
+	// draws, commands and time each takes. Fails if they draw different index or instance
+	// totals.
+	static bool ReportInstancing(unsigned int ObjectCount = 4096, unsigned int LodCount = 4, unsigned int SubmeshCount = 3, unsigned int FrameCount = 20)
+	{
+		auto Fake = [](size_t Id) { return (void*)(0x1000 + 0x100 * Id); };
+
+		DirectX::XMFLOAT4X4 Identity = {};
+		Identity._11 = Identity._22 = Identity._33 = Identity._44 = 1.0f;
+		std::vector<DirectX::XMFLOAT4X4> Worlds(ObjectCount, Identity);
+		for (unsigned int Object = 0; Object < ObjectCount; Object++)
+		{
+			Worlds[Object]._14 = (float)(Object % 64);
+			Worlds[Object]._34 = (float)(Object / 64);
+		}
+
+		auto RecordFrame = [&](CommandBuffer& Commands, LinearConstantAllocator& Allocator, InstanceBatcher* Batcher)
+		{
+			unsigned char FrameData[128] = {};
+			Commands.Reset();
+			Allocator.BeginFrame();
+			Allocator.WriteFrameConstants(Commands, CommandStageVertex, 0, FrameData, sizeof(FrameData));
+			Commands.SetPipeline((ID3D11InputLayout*)Fake(1), (ID3D11VertexShader*)Fake(Batcher != nullptr ? 3 : 2), (ID3D11PixelShader*)Fake(4), 4);
+			Commands.SetVertexBuffer(0, (ID3D11Buffer*)Fake(5), 52);
+			Commands.SetIndexBuffer((ID3D11Buffer*)Fake(6), 57);
+
+			auto DrawParts = [&](unsigned int Lod, unsigned int InstanceCount)
+			{
+				for (unsigned int Part = 0; Part < SubmeshCount; Part++)
+				{
+					unsigned int IndexCount = 3 * (1000 >> Lod) * (Part + 1);
+					if (InstanceCount == 1)
+					{
+						Commands.DrawIndexed(IndexCount, 0, 0);
+					}
+					else
+					{
+						Commands.DrawIndexedInstanced(IndexCount, InstanceCount, 0, 0);
+					}
+				}
+			};
+
+			for (unsigned int Object = 0; Object < ObjectCount; Object++)
+			{
+				unsigned int Lod = Object * 7 % LodCount;
+				if (Batcher != nullptr)
+				{
+					Batcher->Add(Lod, Worlds[Object]);
+					continue;
+				}
+
+				LinearConstantAllocator::Bind(Commands, CommandStageVertex, 2, Allocator.Write(Commands, &Worlds[Object], sizeof(Worlds[Object])));
+				DrawParts(Lod, 1);
+			}
+
+			if (Batcher != nullptr)
+			{
+				Batcher->Flush(Commands, Allocator, 2, DrawParts);
+			}
+		};
+
+		ID3D11Buffer* Ring = (ID3D11Buffer*)Fake(7);
+		LinearConstantAllocator Allocator;
+		Allocator.Reset(Ring, 256 * 1024);
+		InstanceBatcher Batcher;
+		CommandBuffer Single, Instanced;
+		NullCommandBackend SingleNull, InstancedNull;
+		double SingleRecord = 1e30, SingleReplay = 1e30, InstancedRecord = 1e30, InstancedReplay = 1e30;
+		bool Valid = true;
+
+		for (unsigned int Frame = 0; Frame < FrameCount; Frame++)
+		{
+			auto Start = std::chrono::high_resolution_clock::now();
+			RecordFrame(Single, Allocator, nullptr);
+			SingleRecord = std::min(SingleRecord, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+
+			Start = std::chrono::high_resolution_clock::now();
+			RecordFrame(Instanced, Allocator, &Batcher);
+			InstancedRecord = std::min(InstancedRecord, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+
+			Start = std::chrono::high_resolution_clock::now();
+			SingleNull.Reset();
+			SingleNull.RecordDraws = false;
+			Valid = Single.Replay(SingleNull) && Valid;
+			SingleReplay = std::min(SingleReplay, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+
+			Start = std::chrono::high_resolution_clock::now();
+			InstancedNull.Reset();
+			InstancedNull.RecordDraws = false;
+			Valid = Instanced.Replay(InstancedNull) && Valid;
+			InstancedReplay = std::min(InstancedReplay, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+		}
+
+		unsigned int SingleDraws = SingleNull.Counts[CommandDrawIndexed] + SingleNull.Counts[CommandDrawIndexedInstanced];
+		unsigned int InstancedDraws = InstancedNull.Counts[CommandDrawIndexed] + InstancedNull.Counts[CommandDrawIndexedInstanced];
+		Valid = Valid && SingleNull.Errors == 0 && InstancedNull.Errors == 0 && SingleNull.IndicesDrawn == InstancedNull.IndicesDrawn &&
+			SingleNull.InstancesDrawn == InstancedNull.InstancesDrawn && Batcher.Instances == ObjectCount * FrameCount;
+
+		char Line[256];
+		sprintf_s(Line, "Instancing: %u objects in %u draws instead of %u, %u commands (%.1f KB) instead of %u (%.1f KB)\n", ObjectCount, InstancedDraws, SingleDraws,
+			Instanced.GetCommandCount(), Instanced.GetSize() / 1024.0, Single.GetCommandCount(), Single.GetSize() / 1024.0);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Instancing: recorded in %.3f ms instead of %.3f ms, null replay %.3f ms instead of %.3f ms, %s\n", InstancedRecord * 1000.0, SingleRecord * 1000.0,
+			InstancedReplay * 1000.0, SingleReplay * 1000.0, Valid ? "same indices drawn" : "DRAW MISMATCH");
+		OutputDebugStringA(Line);
+
+		return Valid;
+	}
+}
@@ -0,0 +1,345 @@
+#pragma once
+#include "ClusteredLighting.h"
+
+// Per-object light selection, a lighter alternative to clustering. Once a frame the enabled
+// lights are laid out four to a block, one array per component, and for every draw one pass
+// over all of them tests each light's range against the draw's box, four lights at a time,
+// and scores the ones that reach it by their attenuation at the box's nearest point. The
+// MaxObjectLights strongest go into a small per-draw list, which the pixel shader walks
+// instead of its cluster's.
+namespace DX11UWA
+{
+	// Matches OBJECT_LIGHTS in the pixel shaders.
+	static const unsigned int MaxObjectLights = 8;
+
+	static_assert(sizeof(ObjectLightConstantBuffer) == (MaxObjectLights + 1) * 16, "ObjectLightConstantBuffer must hold MaxObjectLights indices");
+
+	class LightSelector
+	{
+	public:
+		unsigned int Selections = 0;
+		unsigned int LightsInRange = 0;
+		unsigned int LightsSelected = 0;
+
+		void ResetCounts()
+		{
+			Selections = LightsInRange = LightsSelected = 0;
+		}
+
+		// Lays out the enabled lights among the first Count of SceneLights, which are in world
+		// space, for Select.
+		void Prepare(const Lights* SceneLights, unsigned int Count)
+		{
+			Count = std::min(Count, MaxSceneLights);
+			Blocks.clear();
+			LightCount = 0;
+
+			for (unsigned int i = 0; i < Count; i++)
+			{
+				const Lights& Light = SceneLights[i];
+				if (Light.enabled.x == 0)
+				{
+					continue;
+				}
+
+				// Directional lights reach everything and do not fall off, so they sit at the
+				// origin with an endless range and a constant attenuation of 1. The axis of a
+				// light that is not a spot light is zero and its cone wider than any box.
+				float X = 0.0f, Y = 0.0f, Z = 0.0f, Range = FLT_MAX;
+				float C = 1.0f, L = 0.0f, Q = 0.0f;
+				float AxisX = 0.0f, AxisY = 0.0f, AxisZ = 0.0f, Cos = -1.0f, Sin = 0.0f;
+				if (Light.type.x != LightDirectional)
+				{
+					Range = GetLightRange(Light);
+					if (Range <= 0.0f)
+					{
+						continue;
+					}
+
+					X = Light.pos.x;
+					Y = Light.pos.y;
+					Z = Light.pos.z;
+					C = Light.C_att.x;
+					L = Light.L_att.x;
+					Q = Light.Q_att.x;
+
+					float AxisLength = sqrtf(Light.angle.x * Light.angle.x + Light.angle.y * Light.angle.y + Light.angle.z * Light.angle.z);
+					if (Light.type.x == LightSpot && Light.angleratio.y > 0.0f && AxisLength > 0.0f)
+					{
+						AxisX = Light.angle.x / AxisLength;
+						AxisY = Light.angle.y / AxisLength;
+						AxisZ = Light.angle.z / AxisLength;
+						Cos = std::min(Light.angleratio.y, 1.0f);
+						Sin = sqrtf(1.0f - Cos * Cos);
+					}
+				}
+
+				if (LightCount % 4 == 0)
+				{
+					Blocks.push_back(EmptyBlock());
+				}
+
+				LightBlock& Block = Blocks.back();
+				unsigned int k = LightCount % 4;
+				Block.X[k] = X;
+				Block.Y[k] = Y;
+				Block.Z[k] = Z;
+				Block.Range[k] = Range;
+				Block.RangeSq[k] = Range * Range;
+				Block.C[k] = C;
+				Block.L[k] = L;
+				Block.Q[k] = Q;
+				Block.Intensity[k] = std::max(std::max(Light.color.x, Light.color.y), Light.color.z);
+				Block.AxisX[k] = AxisX;
+				Block.AxisY[k] = AxisY;
+				Block.AxisZ[k] = AxisZ;
+				Block.Cos[k] = Cos;
+				Block.Sin[k] = Sin;
+				Block.Index[k] = i;
+				LightCount++;
+			}
+		}
+
+		// Writes the scene indices of up to MaxObjectLights of the prepared lights that reach the
+		// world space box Min-Max to Out, strongest first, and returns how many. A light's
+		// strength is the brightest channel of its colour times its attenuation at the box's
+		// nearest point; spot lights are also tested against the box's bounding sphere.
+		unsigned int Select(const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max, unsigned int* Out, LightClusterPath Path = LightClusterBest)
+		{
+			// Keeps a light with no constant attenuation from scoring infinitely at distance 0.
+			const float MinAttenuationDenominator = 1e-6f;
+
+			float Scores[MaxObjectLights];
+			unsigned int Count = 0, InRange = 0;
+
+			auto Keep = [&](float Score, unsigned int Index)
+			{
+				InRange++;
+				if (Count == MaxObjectLights && Score <= Scores[Count - 1])
+				{
+					return;
+				}
+
+				unsigned int i = Count < MaxObjectLights ? Count++ : Count - 1;
+				for (; i > 0 && Scores[i - 1] < Score; i--)
+				{
+					Scores[i] = Scores[i - 1];
+					Out[i] = Out[i - 1];
+				}
+				Scores[i] = Score;
+				Out[i] = Index;
+			};
+
+			float SphereX = 0.5f * (Min.x + Max.x), SphereY = 0.5f * (Min.y + Max.y), SphereZ = 0.5f * (Min.z + Max.z);
+			float ex = Max.x - Min.x, ey = Max.y - Min.y, ez = Max.z - Min.z;
+			float SphereRadius = 0.5f * sqrtf(ex * ex + ey * ey + ez * ez);
+
+			switch (Path)
+			{
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX_INTRINSICS_)
+			case LightClusterSSE:
+			{
+				__m128 Zero = _mm_setzero_ps(), MinDenominator = _mm_set1_ps(MinAttenuationDenominator);
+				__m128 MinX = _mm_set1_ps(Min.x), MinY = _mm_set1_ps(Min.y), MinZ = _mm_set1_ps(Min.z);
+				__m128 MaxX = _mm_set1_ps(Max.x), MaxY = _mm_set1_ps(Max.y), MaxZ = _mm_set1_ps(Max.z);
+				__m128 sx = _mm_set1_ps(SphereX), sy = _mm_set1_ps(SphereY), sz = _mm_set1_ps(SphereZ), r = _mm_set1_ps(SphereRadius);
+
+				for (const LightBlock& Block : Blocks)
+				{
+					// Squared distance from each light to the nearest point of the box.
+					__m128 cx = _mm_loadu_ps(Block.X), cy = _mm_loadu_ps(Block.Y), cz = _mm_loadu_ps(Block.Z);
+					__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(MinX, cx), _mm_sub_ps(cx, MaxX)), Zero);
+					__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(MinY, cy), _mm_sub_ps(cy, MaxY)), Zero);
+					__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(MinZ, cz), _mm_sub_ps(cz, MaxZ)), Zero);
+					__m128 DistanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					__m128 Hit = _mm_cmple_ps(DistanceSq, _mm_loadu_ps(Block.RangeSq));
+
+					// The same cone test LightClusterGrid uses, against the box's bounding sphere.
+					__m128 vx = _mm_sub_ps(sx, cx), vy = _mm_sub_ps(sy, cy), vz = _mm_sub_ps(sz, cz);
+					__m128 LengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+					__m128 Along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(Block.AxisX)), _mm_mul_ps(vy, _mm_loadu_ps(Block.AxisY))), _mm_mul_ps(vz, _mm_loadu_ps(Block.AxisZ)));
+					__m128 Across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(LengthSq, _mm_mul_ps(Along, Along)), Zero));
+					__m128 Side = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(Block.Cos), Across), _mm_mul_ps(Along, _mm_loadu_ps(Block.Sin)));
+					__m128 Outside = _mm_or_ps(_mm_cmpgt_ps(Side, r), _mm_or_ps(_mm_cmpgt_ps(Along, _mm_add_ps(r, _mm_loadu_ps(Block.Range))), _mm_cmplt_ps(Along, _mm_sub_ps(Zero, r))));
+					Hit = _mm_andnot_ps(Outside, Hit);
+
+					unsigned int Mask = (unsigned int)_mm_movemask_ps(Hit);
+					if (Mask == 0)
+					{
+						continue;
+					}
+
+					__m128 Distance = _mm_sqrt_ps(DistanceSq);
+					__m128 Denominator = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(Block.C), _mm_mul_ps(_mm_loadu_ps(Block.L), Distance)), _mm_mul_ps(_mm_loadu_ps(Block.Q), DistanceSq));
+					float BlockScores[4];
+					_mm_storeu_ps(BlockScores, _mm_div_ps(_mm_loadu_ps(Block.Intensity), _mm_max_ps(Denominator, MinDenominator)));
+
+					for (unsigned int k = 0; Mask != 0; k++, Mask >>= 1)
+					{
+						if (Mask & 1)
+						{
+							Keep(BlockScores[k], Block.Index[k]);
+						}
+					}
+				}
+				break;
+			}
+#endif
+			default:
+			{
+				for (const LightBlock& Block : Blocks)
+				{
+					for (unsigned int k = 0; k < 4; k++)
+					{
+						float dx = std::max(std::max(Min.x - Block.X[k], Block.X[k] - Max.x), 0.0f);
+						float dy = std::max(std::max(Min.y - Block.Y[k], Block.Y[k] - Max.y), 0.0f);
+						float dz = std::max(std::max(Min.z - Block.Z[k], Block.Z[k] - Max.z), 0.0f);
+						float DistanceSq = (dx * dx + dy * dy) + dz * dz;
+						if (!(DistanceSq <= Block.RangeSq[k]))
+						{
+							continue;
+						}
+
+						float vx = SphereX - Block.X[k], vy = SphereY - Block.Y[k], vz = SphereZ - Block.Z[k];
+						float LengthSq = (vx * vx + vy * vy) + vz * vz;
+						float Along = (vx * Block.AxisX[k] + vy * Block.AxisY[k]) + vz * Block.AxisZ[k];
+						float Across = sqrtf(std::max(LengthSq - Along * Along, 0.0f));
+						float Side = Block.Cos[k] * Across - Along * Block.Sin[k];
+						if (Side > SphereRadius || Along > SphereRadius + Block.Range[k] || Along < 0.0f - SphereRadius)
+						{
+							continue;
+						}
+
+						float Denominator = (Block.C[k] + Block.L[k] * sqrtf(DistanceSq)) + Block.Q[k] * DistanceSq;
+						Keep(Block.Intensity[k] / std::max(Denominator, MinAttenuationDenominator), Block.Index[k]);
+					}
+				}
+				break;
+			}
+			}
+
+			Selections++;
+			LightsInRange += InRange;
+			LightsSelected += Count;
+			return Count;
+		}
+
+	private:
+		// Four prepared lights. The slots past the last light never reach anything.
+		struct LightBlock
+		{
+			float X[4], Y[4], Z[4], Range[4], RangeSq[4];
+			float C[4], L[4], Q[4], Intensity[4];
+			float AxisX[4], AxisY[4], AxisZ[4], Cos[4], Sin[4];
+			unsigned int Index[4];
+		};
+
+		static LightBlock EmptyBlock()
+		{
+			LightBlock Block = {};
+			for (unsigned int k = 0; k < 4; k++)
+			{
+				Block.RangeSq[k] = -1.0f;
+				Block.C[k] = 1.0f;
+				Block.Cos[k] = -1.0f;
+			}
+			return Block;
+		}
+
+		std::vector<LightBlock> Blocks;
+		unsigned int LightCount = 0;
+	};
+
+	// Selects lights for ObjectCount castle sized boxes out of LightCount point and spot lights
+	// and a directional light, all scattered over a 200 x 200 field, with the scalar and SIMD
+	// tests. Reports the best time of each, whether they pick the same lists and how many
+	// lights a draw evaluates against all LightCount without selection.
+	static bool ReportLightSelection(unsigned int LightCount = 512, unsigned int ObjectCount = 1024, unsigned int Repeats = 10)
+	{
+		using namespace DirectX;
+
+		const LightClusterPath Paths[] = { LightClusterScalar, LightClusterBest };
+		const char* PathNames[] = { "scalar", "SIMD" };
+
+		std::mt19937 Random(8765);
+		std::uniform_real_distribution<float> Coordinate(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> Height(0.5f, 8.0f);
+		std::uniform_real_distribution<float> Range(3.0f, 15.0f);
+		std::uniform_real_distribution<float> Unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> Size(1.0f, 4.0f);
+
+		std::vector<Lights> SceneLights(LightCount + 1);
+		for (unsigned int i = 0; i < LightCount; i++)
+		{
+			Lights& Light = SceneLights[i];
+			Light = {};
+			float LightRange = Range(Random);
+			Light.pos = XMFLOAT4(Coordinate(Random), Height(Random), Coordinate(Random), 1.0f);
+			Light.color = XMFLOAT4(0.5f + 0.5f * Unit(Random), 0.5f + 0.5f * Unit(Random), 0.5f + 0.5f * Unit(Random), 1.0f);
+			Light.angle = XMFLOAT4(0.5f * Unit(Random), -1.0f, 0.5f * Unit(Random), 0.0f);
+			Light.angleratio = XMFLOAT2(0.95f, 0.85f);
+			Light.C_att = XMFLOAT2(1.0f, 0.0f);
+			Light.Q_att = XMFLOAT2(255.0f / (LightRange * LightRange), 0.0f);
+			Light.type = XMINT2(i % 2 == 0 ? LightPoint : LightSpot, 0);
+			Light.enabled = XMINT2(1, 0);
+		}
+
+		Lights& Sun = SceneLights[LightCount];
+		Sun = {};
+		Sun.direction = XMFLOAT4(0.0f, -1.0f, 0.0f, 0.0f);
+		Sun.color = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
+		Sun.type = XMINT2(LightDirectional, 0);
+		Sun.enabled = XMINT2(1, 0);
+
+		std::vector<XMFLOAT3> Mins(ObjectCount), Maxs(ObjectCount);
+		for (unsigned int Object = 0; Object < ObjectCount; Object++)
+		{
+			float x = Coordinate(Random), z = Coordinate(Random), Extent = Size(Random);
+			Mins[Object] = XMFLOAT3(x - Extent, 0.0f, z - Extent);
+			Maxs[Object] = XMFLOAT3(x + Extent, 2.0f * Extent, z + Extent);
+		}
+
+		LightSelector Selectors[2];
+		std::vector<unsigned int> Lists[2];
+		double BestSeconds[2] = { DBL_MAX, DBL_MAX };
+		for (unsigned int p = 0; p < 2; p++)
+		{
+			Lists[p].resize(ObjectCount * (MaxObjectLights + 1));
+			for (unsigned int r = 0; r < Repeats; r++)
+			{
+				Selectors[p].ResetCounts();
+				auto Start = std::chrono::high_resolution_clock::now();
+				Selectors[p].Prepare(SceneLights.data(), LightCount + 1);
+				for (unsigned int Object = 0; Object < ObjectCount; Object++)
+				{
+					unsigned int* List = &Lists[p][Object * (MaxObjectLights + 1)];
+					List[0] = Selectors[p].Select(Mins[Object], Maxs[Object], List + 1, Paths[p]);
+				}
+				BestSeconds[p] = std::min(BestSeconds[p], std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+			}
+		}
+
+		// The directional light reaches everything, so every list must hold it.
+		bool Agree = Lists[0] == Lists[1] && Selectors[0].LightsInRange == Selectors[1].LightsInRange;
+		for (unsigned int Object = 0; Agree && Object < ObjectCount; Object++)
+		{
+			const unsigned int* List = &Lists[0][Object * (MaxObjectLights + 1)];
+			Agree = std::find(List + 1, List + 1 + List[0], LightCount) != List + 1 + List[0];
+		}
+
+		char Line[256];
+		for (unsigned int p = 0; p < 2; p++)
+		{
+			sprintf_s(Line, "Light selection: %u objects against %u lights, %s %.3f ms\n", ObjectCount, LightCount + 1, PathNames[p], BestSeconds[p] * 1000.0);
+			OutputDebugStringA(Line);
+		}
+
+		const LightSelector& Selector = Selectors[0];
+		sprintf_s(Line, "Light selection: %.2f lights per object in range, %.2f kept of at most %u, instead of %u; paths %s\n",
+			(double)Selector.LightsInRange / Selector.Selections, (double)Selector.LightsSelected / Selector.Selections, MaxObjectLights, LightCount + 1,
+			Agree ? "agree" : "DISAGREE");
+		OutputDebugStringA(Line);
+
+		return Agree;
+	}
+}
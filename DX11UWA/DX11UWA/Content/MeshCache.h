@@ -0,0 +1,782 @@
+#pragma once
+#include <string>
+#include "OBJModelLoader.h"
+#include "MeshOptimizer.h"
+#include "VertexQuantization.h"
+#include "TangentFrames.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "OcclusionCulling.h"
+#include "TriangleBvh.h"
+
+// Cooked meshes are the final GPU vertex and index streams of an OBJ file, written
+// once to a binary cache and memory-mapped on every later load. The cache is keyed
+// on a hash of the source file, so editing the OBJ rebuilds it automatically.
+namespace DX11UWA
+{
+	// Bump whenever the file layout or the cooking steps change.
+	static const unsigned int CookedMeshVersion = 10;
+	static const unsigned int CookedMeshMagic = 0x4348534D; // "MSHC"
+
+	// Vertex stream layouts a mesh can be cooked to.
+	enum CookedVertexFormat
+	{
+		CookedVertexFull = 0,		// VertexPositionUVNormalTan
+		CookedVertexQuantized = 1,	// VertexQuantized, positions relative to the bounds
+	};
+
+	static unsigned int GetCookedVertexStride(unsigned int Format)
+	{
+		return Format == CookedVertexQuantized ? sizeof(VertexQuantized) : sizeof(VertexPositionUVNormalTan);
+	}
+
+	// Meshes with more unique vertices than this are split so every part stays 16-bit addressable.
+	static const unsigned int MaxShortIndexVertices = 65536;
+
+	// One DrawIndexed worth of a cooked mesh. Indices are relative to BaseVertex.
+	struct CookedSubmesh
+	{
+		unsigned int IndexStart;
+		unsigned int IndexCount;
+		unsigned int BaseVertex;
+		unsigned int VertexCount;
+	};
+
+	// One level of detail: a run of submeshes in the submesh table. Level 0 is the full mesh.
+	struct CookedLod
+	{
+		unsigned int SubmeshStart;
+		unsigned int SubmeshCount;
+		unsigned int IndexCount;
+		// Largest surface deviation from the full detail mesh, in object space units.
+		float Error;
+	};
+
+	struct CookedMeshHeader
+	{
+		unsigned int Magic;
+		unsigned int Version;
+		unsigned long long SourceHash;
+		unsigned long long SourceSize;
+		unsigned long long FileSize;
+		unsigned int VertexFormat;
+		unsigned int VertexStride;
+		unsigned int VertexCount;
+		unsigned int IndexStride;
+		unsigned int IndexCount;
+		unsigned int SubmeshCount;
+		unsigned int LodCount;
+		unsigned int MeshletCount;
+		unsigned int BvhNodeCount;
+		unsigned int BvhPacketCount;
+		MeshBounds Bounds;
+	};
+
+	// Cache image layout: header, LOD table, submesh table, meshlet table, triangle BVH
+	// nodes and packets, vertex stream, index stream (4-byte aligned).
+	static size_t CookedLodOffset()
+	{
+		return sizeof(CookedMeshHeader);
+	}
+
+	static size_t CookedSubmeshOffset(const CookedMeshHeader& Header)
+	{
+		return CookedLodOffset() + sizeof(CookedLod) * Header.LodCount;
+	}
+
+	static size_t CookedMeshletOffset(const CookedMeshHeader& Header)
+	{
+		return CookedSubmeshOffset(Header) + sizeof(CookedSubmesh) * Header.SubmeshCount;
+	}
+
+	static size_t CookedBvhNodeOffset(const CookedMeshHeader& Header)
+	{
+		return CookedMeshletOffset(Header) + sizeof(Meshlet) * Header.MeshletCount;
+	}
+
+	static size_t CookedBvhPacketOffset(const CookedMeshHeader& Header)
+	{
+		return CookedBvhNodeOffset(Header) + sizeof(TriangleBvhNode) * Header.BvhNodeCount;
+	}
+
+	static size_t CookedVertexOffset(const CookedMeshHeader& Header)
+	{
+		return CookedBvhPacketOffset(Header) + sizeof(TrianglePacket) * Header.BvhPacketCount;
+	}
+
+	// Object space position of a quantized vertex, decoded against the mesh bounds.
+	static XMFLOAT3 DecodeCookedPosition(const VertexQuantized& Vertex, const MeshBounds& Bounds)
+	{
+		const unsigned short* q = Vertex.pos;
+		return XMFLOAT3(Bounds.Min.x + q[0] / 65535.0f * (Bounds.Max.x - Bounds.Min.x),
+			Bounds.Min.y + q[1] / 65535.0f * (Bounds.Max.y - Bounds.Min.y),
+			Bounds.Min.z + q[2] / 65535.0f * (Bounds.Max.z - Bounds.Min.z));
+	}
+
+	static size_t CookedIndexOffset(const CookedMeshHeader& Header)
+	{
+		return (CookedVertexOffset(Header) + (size_t)Header.VertexStride * Header.VertexCount + 3) & ~(size_t)3;
+	}
+
+	// A cooked mesh either points into the mapped cache file or into Blob when it was
+	// just cooked. Vertices and Indices can be handed straight to buffer creation;
+	// VertexFormat says whether Vertices holds VertexPositionUVNormalTan or VertexQuantized.
+	struct CookedMesh
+	{
+		const void* Vertices = nullptr;
+		const void* Indices = nullptr;
+		const CookedSubmesh* Submeshes = nullptr;
+		const CookedLod* Lods = nullptr;
+		// Meshlets of the full detail level, in index order.
+		const Meshlet* Meshlets = nullptr;
+		// Triangles of the full detail level, for ray casts in object space. Triangle ids
+		// are index stream positions / 3.
+		TriangleBvh Bvh;
+		unsigned int VertexFormat = CookedVertexFull;
+		unsigned int VertexStride = 0;
+		unsigned int VertexCount = 0;
+		unsigned int IndexCount = 0;
+		unsigned int IndexStride = 0;
+		unsigned int SubmeshCount = 0;
+		unsigned int LodCount = 0;
+		unsigned int MeshletCount = 0;
+		MeshBounds Bounds = EmptyMeshBounds();
+		bool FromCache = false;
+		double LoadSeconds = 0.0;
+		MeshOptimizeStats Optimize;
+
+		MappedFile File;
+		vector<char> Blob;
+
+		void Reset()
+		{
+			Vertices = nullptr;
+			Indices = nullptr;
+			Submeshes = nullptr;
+			Lods = nullptr;
+			Meshlets = nullptr;
+			Bvh = TriangleBvh();
+			VertexFormat = CookedVertexFull;
+			VertexStride = 0;
+			VertexCount = 0;
+			IndexCount = 0;
+			IndexStride = 0;
+			SubmeshCount = 0;
+			LodCount = 0;
+			MeshletCount = 0;
+			FromCache = false;
+			File.Close();
+			Blob.clear();
+			Blob.shrink_to_fit();
+		}
+
+		// Object space position of a vertex, decoded against the bounds when quantized.
+		XMFLOAT3 GetPosition(unsigned int Vertex) const
+		{
+			if (VertexFormat == CookedVertexQuantized)
+			{
+				return DecodeCookedPosition(((const VertexQuantized*)Vertices)[Vertex], Bounds);
+			}
+
+			return ((const VertexPositionUVNormalTan*)Vertices)[Vertex].pos;
+		}
+
+		// Expands the submesh-relative indices of every LOD into one 32-bit list over the whole vertex stream.
+		void ExpandIndices(vector<unsigned int>* Out) const
+		{
+			Out->resize(IndexCount);
+
+			for (unsigned int s = 0; s < SubmeshCount; s++)
+			{
+				const CookedSubmesh& Part = Submeshes[s];
+				for (unsigned int i = Part.IndexStart; i < Part.IndexStart + Part.IndexCount; i++)
+				{
+					unsigned int Local = IndexStride == 2 ? ((const unsigned short*)Indices)[i] : ((const unsigned int*)Indices)[i];
+					(*Out)[i] = Part.BaseVertex + Local;
+				}
+			}
+		}
+	};
+
+	// 64-bit FNV-1a over 8-byte words, with the tail folded in byte by byte.
+	static unsigned long long HashMeshSource(const char* data, size_t size)
+	{
+		const unsigned long long Prime = 0x100000001B3ULL;
+		unsigned long long Hash = 0xCBF29CE484222325ULL;
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			unsigned long long Word;
+			memcpy(&Word, data + i, sizeof(Word));
+			Hash = (Hash ^ Word) * Prime;
+		}
+
+		for (; i < size; i++)
+		{
+			Hash = (Hash ^ (unsigned char)data[i]) * Prime;
+		}
+
+		return Hash ^ size;
+	}
+
+	static bool WriteWholeFile(const char* filepath, const void* data, size_t size)
+	{
+#if defined(_WIN32)
+		wchar_t WidePath[MAX_PATH];
+		if (MultiByteToWideChar(CP_UTF8, 0, filepath, -1, WidePath, MAX_PATH) == 0)
+		{
+			return false;
+		}
+
+		HANDLE File = CreateFile2(WidePath, GENERIC_WRITE, 0, CREATE_ALWAYS, nullptr);
+		if (File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		DWORD Written = 0;
+		BOOL Ok = WriteFile(File, data, (DWORD)size, &Written, nullptr);
+		CloseHandle(File);
+
+		return Ok && Written == size;
+#else
+		FILE* File = fopen(filepath, "wb");
+		if (File == nullptr)
+		{
+			return false;
+		}
+
+		size_t Written = fwrite(data, 1, size, File);
+		return fclose(File) == 0 && Written == size;
+#endif
+	}
+
+	// Splits a mesh in triangle order into parts that each reference at most
+	// MaxShortIndexVertices vertices. Vertices used by several parts are duplicated.
+	// The parts are appended to the output streams, so several index lists over the
+	// same vertices (levels of detail) can be split one after another.
+	static void SplitForShortIndices(const vector<VertexPositionUVNormalTan>& Vertices, const vector<unsigned int>& Indices,
+		vector<VertexPositionUVNormalTan>* OutVertices, vector<unsigned short>* OutIndices, vector<CookedSubmesh>* Submeshes)
+	{
+		const unsigned int NoPart = 0xFFFFFFFF;
+
+		vector<unsigned int> LocalIndex(Vertices.size());
+		vector<unsigned int> Owner(Vertices.size(), NoPart);
+
+		OutIndices->reserve(OutIndices->size() + Indices.size());
+
+		CookedSubmesh Part = { (unsigned int)OutIndices->size(), 0, (unsigned int)OutVertices->size(), 0 };
+		unsigned int PartId = 0;
+		size_t FirstSubmesh = Submeshes->size();
+
+		for (size_t t = 0; t + 2 < Indices.size(); t += 3)
+		{
+			unsigned int NewVertices = 0;
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				NewVertices += Owner[Indices[t + c]] != PartId;
+			}
+
+			if (Part.VertexCount + NewVertices > MaxShortIndexVertices)
+			{
+				Submeshes->push_back(Part);
+				PartId++;
+				Part.IndexStart = (unsigned int)OutIndices->size();
+				Part.IndexCount = 0;
+				Part.BaseVertex = (unsigned int)OutVertices->size();
+				Part.VertexCount = 0;
+			}
+
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				unsigned int v = Indices[t + c];
+				if (Owner[v] != PartId)
+				{
+					Owner[v] = PartId;
+					LocalIndex[v] = Part.VertexCount++;
+					OutVertices->push_back(Vertices[v]);
+				}
+
+				OutIndices->push_back((unsigned short)LocalIndex[v]);
+			}
+
+			Part.IndexCount += 3;
+		}
+
+		if (Part.IndexCount > 0 || Submeshes->size() == FirstSubmesh)
+		{
+			Submeshes->push_back(Part);
+		}
+	}
+
+	// Builds the cache file image for a loaded OBJ and its simplified levels. Meshes that
+	// fit use 16-bit indices; larger ones are split into 16-bit submeshes per level, or
+	// kept whole with 32-bit indices when SplitLargeMeshes is false. The vertex stream is
+	// written in VertexFormat. The full detail submeshes are reordered into meshlets, each
+	// inside one submesh, and a triangle BVH is built over them from the positions as stored.
+	static void CookMesh(const ObjectData& Source, const vector<MeshLod>& Lods, unsigned long long SourceHash, unsigned long long SourceSize, vector<char>* Blob,
+		unsigned int VertexFormat = CookedVertexFull, bool SplitLargeMeshes = true)
+	{
+		vector<VertexPositionUVNormalTan> Vertices(Source.MeshVerts.size());
+		const vector<unsigned int>& Indices = Source.MeshIndecies;
+
+		// The loader already bounded the source; splitting and simplifying only reuse its vertices.
+		const MeshBounds& Bounds = Source.Bounds;
+
+		for (size_t i = 0; i < Vertices.size(); i++)
+		{
+			const ObjectVertices& In = Source.MeshVerts[i];
+
+			Vertices[i].pos = In.Position;
+			Vertices[i].uv = In.UVW;
+			Vertices[i].normal = In.Normals;
+			Vertices[i].tangent = { 0.0f, 0.0f, 0.0f, 1.0f };
+		}
+
+		BuildTangentFrames(Vertices.data(), (unsigned int)Vertices.size(), Indices.data(), (unsigned int)Indices.size());
+
+		vector<CookedLod> LodTable;
+		vector<CookedSubmesh> Submeshes;
+		vector<unsigned short> ShortIndices;
+		vector<unsigned int> LongIndices;
+		vector<VertexPositionUVNormalTan> SplitVertices;
+
+		bool Short = Vertices.size() <= MaxShortIndexVertices;
+		bool Split = !Short && SplitLargeMeshes;
+		unsigned int IndexStride = Short || Split ? sizeof(unsigned short) : sizeof(unsigned int);
+
+		for (size_t Level = 0; Level <= Lods.size(); Level++)
+		{
+			const vector<unsigned int>& LevelIndices = Level == 0 ? Indices : Lods[Level - 1].Indices;
+
+			CookedLod Lod = { (unsigned int)Submeshes.size(), 0, (unsigned int)LevelIndices.size(), Level == 0 ? 0.0f : Lods[Level - 1].Error };
+
+			if (Split)
+			{
+				SplitForShortIndices(Vertices, LevelIndices, &SplitVertices, &ShortIndices, &Submeshes);
+			}
+			else if (Short)
+			{
+				Submeshes.push_back({ (unsigned int)ShortIndices.size(), (unsigned int)LevelIndices.size(), 0, (unsigned int)Vertices.size() });
+				ShortIndices.insert(ShortIndices.end(), LevelIndices.begin(), LevelIndices.end());
+			}
+			else
+			{
+				Submeshes.push_back({ (unsigned int)LongIndices.size(), (unsigned int)LevelIndices.size(), 0, (unsigned int)Vertices.size() });
+				LongIndices.insert(LongIndices.end(), LevelIndices.begin(), LevelIndices.end());
+			}
+
+			Lod.SubmeshCount = (unsigned int)Submeshes.size() - Lod.SubmeshStart;
+			LodTable.push_back(Lod);
+		}
+
+		if (Split)
+		{
+			Vertices.swap(SplitVertices);
+		}
+
+		vector<Meshlet> Meshlets;
+		vector<unsigned int> PartIndices;
+
+		for (unsigned int s = LodTable[0].SubmeshStart; s < LodTable[0].SubmeshStart + LodTable[0].SubmeshCount; s++)
+		{
+			const CookedSubmesh& Part = Submeshes[s];
+			if (Part.IndexCount == 0)
+			{
+				continue;
+			}
+
+			if (IndexStride == sizeof(unsigned short))
+			{
+				PartIndices.assign(ShortIndices.begin() + Part.IndexStart, ShortIndices.begin() + Part.IndexStart + Part.IndexCount);
+			}
+			else
+			{
+				PartIndices.assign(LongIndices.begin() + Part.IndexStart, LongIndices.begin() + Part.IndexStart + Part.IndexCount);
+			}
+
+			size_t First = Meshlets.size();
+			BuildMeshlets(PartIndices.data(), PartIndices.size(), &Vertices[Part.BaseVertex].pos, sizeof(VertexPositionUVNormalTan), Part.VertexCount, &Meshlets);
+
+			for (size_t m = First; m < Meshlets.size(); m++)
+			{
+				Meshlets[m].IndexStart += Part.IndexStart;
+				Meshlets[m].Submesh = s;
+			}
+
+			if (IndexStride == sizeof(unsigned short))
+			{
+				copy(PartIndices.begin(), PartIndices.end(), ShortIndices.begin() + Part.IndexStart);
+			}
+			else
+			{
+				copy(PartIndices.begin(), PartIndices.end(), LongIndices.begin() + Part.IndexStart);
+			}
+		}
+
+		unsigned int VertexCount = (unsigned int)Vertices.size();
+		unsigned int IndexCount = (unsigned int)(IndexStride == sizeof(unsigned short) ? ShortIndices.size() : LongIndices.size());
+		unsigned int SubmeshCount = (unsigned int)Submeshes.size();
+		unsigned int LodCount = (unsigned int)LodTable.size();
+		unsigned int MeshletCount = (unsigned int)Meshlets.size();
+		unsigned int VertexStride = GetCookedVertexStride(VertexFormat);
+
+		vector<VertexQuantized> Quantized;
+		if (VertexFormat == CookedVertexQuantized)
+		{
+			QuantizationConstantBuffer Constants = GetQuantizationConstants(Bounds.Min, Bounds.Max);
+
+			Quantized.resize(VertexCount);
+			for (unsigned int v = 0; v < VertexCount; v++)
+			{
+				Quantized[v] = QuantizeVertex(Vertices[v], Constants);
+			}
+		}
+
+		vector<XMFLOAT3> Positions(VertexCount);
+		for (unsigned int v = 0; v < VertexCount; v++)
+		{
+			Positions[v] = Quantized.empty() ? Vertices[v].pos : DecodeCookedPosition(Quantized[v], Bounds);
+		}
+
+		vector<unsigned int> FullIndices;
+		FullIndices.reserve(LodTable[0].IndexCount);
+		for (unsigned int s = LodTable[0].SubmeshStart; s < LodTable[0].SubmeshStart + LodTable[0].SubmeshCount; s++)
+		{
+			const CookedSubmesh& Part = Submeshes[s];
+			for (unsigned int i = Part.IndexStart; i < Part.IndexStart + Part.IndexCount; i++)
+			{
+				FullIndices.push_back(Part.BaseVertex + (IndexStride == sizeof(unsigned short) ? ShortIndices[i] : LongIndices[i]));
+			}
+		}
+
+		vector<TriangleBvhNode> BvhNodes;
+		vector<TrianglePacket> BvhPackets;
+		BuildTriangleBvh(Positions.data(), FullIndices.data(), (unsigned int)FullIndices.size() / 3, &BvhNodes, &BvhPackets);
+		unsigned int BvhNodeCount = (unsigned int)BvhNodes.size();
+		unsigned int BvhPacketCount = (unsigned int)BvhPackets.size();
+
+		CookedMeshHeader Layout = {};
+		Layout.VertexStride = VertexStride;
+		Layout.VertexCount = VertexCount;
+		Layout.SubmeshCount = SubmeshCount;
+		Layout.LodCount = LodCount;
+		Layout.MeshletCount = MeshletCount;
+		Layout.BvhNodeCount = BvhNodeCount;
+		Layout.BvhPacketCount = BvhPacketCount;
+
+		size_t IndexOffset = CookedIndexOffset(Layout);
+		Blob->assign(IndexOffset + IndexStride * IndexCount, 0);
+
+		CookedMeshHeader* Header = (CookedMeshHeader*)Blob->data();
+		Header->Magic = CookedMeshMagic;
+		Header->Version = CookedMeshVersion;
+		Header->SourceHash = SourceHash;
+		Header->SourceSize = SourceSize;
+		Header->FileSize = Blob->size();
+		Header->VertexFormat = VertexFormat;
+		Header->VertexStride = VertexStride;
+		Header->VertexCount = VertexCount;
+		Header->IndexStride = IndexStride;
+		Header->IndexCount = IndexCount;
+		Header->SubmeshCount = SubmeshCount;
+		Header->LodCount = LodCount;
+		Header->MeshletCount = MeshletCount;
+		Header->BvhNodeCount = BvhNodeCount;
+		Header->BvhPacketCount = BvhPacketCount;
+		Header->Bounds = Bounds;
+
+		memcpy(Blob->data() + CookedLodOffset(), LodTable.data(), sizeof(CookedLod) * LodCount);
+		memcpy(Blob->data() + CookedSubmeshOffset(*Header), Submeshes.data(), sizeof(CookedSubmesh) * SubmeshCount);
+		if (MeshletCount > 0)
+		{
+			memcpy(Blob->data() + CookedMeshletOffset(*Header), Meshlets.data(), sizeof(Meshlet) * MeshletCount);
+		}
+		if (BvhNodeCount > 0)
+		{
+			memcpy(Blob->data() + CookedBvhNodeOffset(*Header), BvhNodes.data(), sizeof(TriangleBvhNode) * BvhNodeCount);
+			memcpy(Blob->data() + CookedBvhPacketOffset(*Header), BvhPackets.data(), sizeof(TrianglePacket) * BvhPacketCount);
+		}
+		if (VertexCount > 0)
+		{
+			memcpy(Blob->data() + CookedVertexOffset(*Header), Quantized.empty() ? (const void*)Vertices.data() : (const void*)Quantized.data(), (size_t)VertexStride * VertexCount);
+		}
+		if (IndexCount > 0)
+		{
+			memcpy(Blob->data() + IndexOffset, IndexStride == sizeof(unsigned short) ? (const void*)ShortIndices.data() : (const void*)LongIndices.data(), IndexStride * IndexCount);
+		}
+	}
+
+	// Points the mesh at the streams inside a cache image. Returns false if the image is
+	// stale, truncated, from another version or cooked to another vertex format.
+	static bool BindCookedImage(const char* Image, size_t Size, unsigned long long SourceHash, unsigned long long SourceSize, unsigned int VertexFormat, CookedMesh* Mesh)
+	{
+		if (Image == nullptr || Size < sizeof(CookedMeshHeader))
+		{
+			return false;
+		}
+
+		const CookedMeshHeader* Header = (const CookedMeshHeader*)Image;
+
+		if (Header->Magic != CookedMeshMagic || Header->Version != CookedMeshVersion ||
+			Header->SourceHash != SourceHash || Header->SourceSize != SourceSize ||
+			Header->VertexFormat != VertexFormat || Header->VertexStride != GetCookedVertexStride(VertexFormat) ||
+			(Header->IndexStride != sizeof(unsigned short) && Header->IndexStride != sizeof(unsigned int)) ||
+			Header->SubmeshCount == 0 || Header->LodCount == 0 || Header->FileSize != Size)
+		{
+			return false;
+		}
+
+		unsigned long long Expected = CookedIndexOffset(*Header) + (unsigned long long)Header->IndexStride * Header->IndexCount;
+
+		if (Expected != Size)
+		{
+			return false;
+		}
+
+		// Every submesh and level has to stay inside the index and vertex streams, and every
+		// submesh-local index inside its submesh's vertices, since the batchers, occluder
+		// builder and index expansion read vertices through them unchecked. The BVH check
+		// below leans on level 0's index count.
+		const CookedSubmesh* Submeshes = (const CookedSubmesh*)(Image + CookedSubmeshOffset(*Header));
+		const char* Indices = Image + CookedIndexOffset(*Header);
+		for (unsigned int s = 0; s < Header->SubmeshCount; s++)
+		{
+			const CookedSubmesh& Part = Submeshes[s];
+			if ((unsigned long long)Part.IndexStart + Part.IndexCount > Header->IndexCount ||
+				(unsigned long long)Part.BaseVertex + Part.VertexCount > Header->VertexCount)
+			{
+				return false;
+			}
+
+			unsigned int Largest = 0;
+			if (Header->IndexStride == sizeof(unsigned short))
+			{
+				const unsigned short* Part16 = (const unsigned short*)Indices + Part.IndexStart;
+				for (unsigned int i = 0; i < Part.IndexCount; i++) Largest = max(Largest, (unsigned int)Part16[i]);
+			}
+			else
+			{
+				const unsigned int* Part32 = (const unsigned int*)Indices + Part.IndexStart;
+				for (unsigned int i = 0; i < Part.IndexCount; i++) Largest = max(Largest, Part32[i]);
+			}
+
+			if (Part.IndexCount > 0 && Largest >= Part.VertexCount)
+			{
+				return false;
+			}
+		}
+
+		const CookedLod* Lods = (const CookedLod*)(Image + CookedLodOffset());
+		for (unsigned int l = 0; l < Header->LodCount; l++)
+		{
+			if ((unsigned long long)Lods[l].SubmeshStart + Lods[l].SubmeshCount > Header->SubmeshCount || Lods[l].IndexCount > Header->IndexCount)
+			{
+				return false;
+			}
+		}
+
+		const Meshlet* Meshlets = (const Meshlet*)(Image + CookedMeshletOffset(*Header));
+		for (unsigned int m = 0; m < Header->MeshletCount; m++)
+		{
+			if (Meshlets[m].Submesh >= Header->SubmeshCount)
+			{
+				return false;
+			}
+
+			// Meshlets are drawn with their submesh's base vertex, so they must stay in its index range.
+			const CookedSubmesh& Part = Submeshes[Meshlets[m].Submesh];
+			if (Meshlets[m].IndexStart < Part.IndexStart ||
+				(unsigned long long)Meshlets[m].IndexStart + Meshlets[m].IndexCount > (unsigned long long)Part.IndexStart + Part.IndexCount)
+			{
+				return false;
+			}
+		}
+
+		// Every child has to name a node or packet inside the image, and every packet
+		// triangle one of the full detail level.
+		const TriangleBvhNode* BvhNodes = (const TriangleBvhNode*)(Image + CookedBvhNodeOffset(*Header));
+		const TrianglePacket* BvhPackets = (const TrianglePacket*)(Image + CookedBvhPacketOffset(*Header));
+		for (unsigned int n = 0; n < Header->BvhNodeCount; n++)
+		{
+			for (unsigned int Lane = 0; Lane < 4; Lane++)
+			{
+				unsigned int Child = BvhNodes[n].Child[Lane];
+				if (Child != TriangleBvhNone && ((Child & TriangleBvhLeaf) ? (Child & ~TriangleBvhLeaf) >= Header->BvhPacketCount : Child <= n || Child >= Header->BvhNodeCount))
+				{
+					return false;
+				}
+			}
+		}
+
+		// Trace walks the tree on a fixed stack, so a tree too deep for it is rejected.
+		if (GetTriangleBvhStackNeed(BvhNodes, Header->BvhNodeCount) > TriangleBvhStackSize)
+		{
+			return false;
+		}
+
+		for (unsigned int k = 0; k < Header->BvhPacketCount; k++)
+		{
+			for (unsigned int Lane = 0; Lane < 4; Lane++)
+			{
+				unsigned int Triangle = BvhPackets[k].Triangle[Lane];
+				if (Triangle != TriangleBvhNone && Triangle >= Lods[0].IndexCount / 3)
+				{
+					return false;
+				}
+			}
+		}
+
+		Mesh->Lods = Lods;
+		Mesh->Meshlets = Meshlets;
+		Mesh->Bvh.Nodes = BvhNodes;
+		Mesh->Bvh.Packets = BvhPackets;
+		Mesh->Bvh.NodeCount = Header->BvhNodeCount;
+		Mesh->Bvh.PacketCount = Header->BvhPacketCount;
+		Mesh->Submeshes = Submeshes;
+		Mesh->Vertices = Image + CookedVertexOffset(*Header);
+		Mesh->Indices = Indices;
+		Mesh->VertexFormat = Header->VertexFormat;
+		Mesh->VertexStride = Header->VertexStride;
+		Mesh->VertexCount = Header->VertexCount;
+		Mesh->IndexCount = Header->IndexCount;
+		Mesh->IndexStride = Header->IndexStride;
+		Mesh->SubmeshCount = Header->SubmeshCount;
+		Mesh->LodCount = Header->LodCount;
+		Mesh->MeshletCount = Header->MeshletCount;
+		Mesh->Bounds = Header->Bounds;
+		return true;
+	}
+
+	// Loads sourcePath through the cache at cachePath, re-cooking it when the source
+	// hash or the requested vertex format no longer matches. Stats is only filled when
+	// the OBJ had to be parsed.
+	static bool LoadCookedMesh(const char* sourcePath, const char* cachePath, CookedMesh* Mesh, ObjectLoadStats* Stats = nullptr, unsigned int ThreadCount = 0,
+		unsigned int VertexFormat = CookedVertexFull)
+	{
+		auto LoadStart = chrono::high_resolution_clock::now();
+
+		Mesh->Reset();
+
+		MappedFile Source;
+		if (!Source.Open(sourcePath))
+		{
+			return false;
+		}
+
+		unsigned long long SourceHash = HashMeshSource(Source.Data, Source.Size);
+
+		if (Mesh->File.Open(cachePath) &&
+			BindCookedImage(Mesh->File.Data, Mesh->File.Size, SourceHash, Source.Size, VertexFormat, Mesh))
+		{
+			Mesh->FromCache = true;
+		}
+		else
+		{
+			Mesh->File.Close();
+
+			ObjectData Parsed;
+			if (!LoadOBJData(Source.Data, Source.Size, &Parsed, Stats, ThreadCount))
+			{
+				return false;
+			}
+
+#if defined(_DEBUG)
+			Mesh->Optimize.OverdrawViews = 16;
+#endif
+			OptimizeMesh(&Parsed, &Mesh->Optimize);
+
+			vector<MeshLod> Lods;
+			BuildLodChain(Parsed, &Lods);
+
+			CookMesh(Parsed, Lods, SourceHash, Source.Size, &Mesh->Blob, VertexFormat);
+			if (!BindCookedImage(Mesh->Blob.data(), Mesh->Blob.size(), SourceHash, Source.Size, VertexFormat, Mesh))
+			{
+				return false;
+			}
+
+			// A failed write only costs a re-cook on the next load.
+			WriteWholeFile(cachePath, Mesh->Blob.data(), Mesh->Blob.size());
+		}
+
+		Mesh->LoadSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - LoadStart).count();
+		return true;
+	}
+
+	// One level of a cooked mesh as an occluder: just the positions that level uses and
+	// its triangles.
+	static void BuildOccluderMesh(const CookedMesh& Mesh, unsigned int Lod, OccluderMesh* Out)
+	{
+		Out->Positions.clear();
+		Out->Indices.clear();
+
+		if (Lod >= Mesh.LodCount)
+		{
+			return;
+		}
+
+		vector<unsigned int> Remap(Mesh.VertexCount, ~0u);
+		const CookedLod& Level = Mesh.Lods[Lod];
+		Out->Indices.reserve(Level.IndexCount);
+
+		for (unsigned int s = Level.SubmeshStart; s < Level.SubmeshStart + Level.SubmeshCount; s++)
+		{
+			const CookedSubmesh& Part = Mesh.Submeshes[s];
+			for (unsigned int i = Part.IndexStart; i < Part.IndexStart + Part.IndexCount; i++)
+			{
+				unsigned int Local = Mesh.IndexStride == 2 ? ((const unsigned short*)Mesh.Indices)[i] : ((const unsigned int*)Mesh.Indices)[i];
+				unsigned int Vertex = Part.BaseVertex + Local;
+
+				if (Remap[Vertex] == ~0u)
+				{
+					Remap[Vertex] = (unsigned int)Out->Positions.size();
+					Out->Positions.push_back(Mesh.GetPosition(Vertex));
+				}
+				Out->Indices.push_back(Remap[Vertex]);
+			}
+		}
+	}
+
+	static void ReportCookedMesh(const char* name, const CookedMesh& Mesh)
+	{
+		char Line[256];
+		sprintf_s(Line, "%s: %s in %.3f ms, %u x %u-byte vertices (%.1f KB), %u x %u-bit indices, %u submeshes\n",
+			name, Mesh.FromCache ? "mapped cooked cache" : "cooked from source", Mesh.LoadSeconds * 1000.0,
+			Mesh.VertexCount, Mesh.VertexStride, Mesh.VertexStride * Mesh.VertexCount / 1024.0,
+			Mesh.IndexCount, Mesh.IndexStride * 8, Mesh.SubmeshCount);
+		OutputDebugStringA(Line);
+
+		for (unsigned int l = 1; l < Mesh.LodCount; l++)
+		{
+			sprintf_s(Line, "%s: LOD %u: %u triangles (%.1f%%), error %.4f\n", name, l, Mesh.Lods[l].IndexCount / 3,
+				100.0 * Mesh.Lods[l].IndexCount / max(Mesh.Lods[0].IndexCount, 1u), Mesh.Lods[l].Error);
+			OutputDebugStringA(Line);
+		}
+
+		XMVECTOR Extent = XMVectorSubtract(XMLoadFloat3(&Mesh.Bounds.Max), XMLoadFloat3(&Mesh.Bounds.Min));
+		float HalfDiagonal = 0.5f * XMVectorGetX(XMVector3Length(Extent));
+		sprintf_s(Line, "%s: bounding sphere radius %.4f (%.1f%% of the box's half diagonal)\n", name, Mesh.Bounds.Radius,
+			100.0 * Mesh.Bounds.Radius / max(HalfDiagonal, FLT_MIN));
+		OutputDebugStringA(Line);
+
+		if (Mesh.MeshletCount > 0)
+		{
+			sprintf_s(Line, "%s: %u meshlets, %.1f triangles each on average\n", name, Mesh.MeshletCount,
+				Mesh.Lods[0].IndexCount / 3.0 / Mesh.MeshletCount);
+			OutputDebugStringA(Line);
+		}
+
+		if (Mesh.Bvh.NodeCount > 0)
+		{
+			sprintf_s(Line, "%s: triangle BVH with %u nodes and %u packets (%.1f KB)\n", name, Mesh.Bvh.NodeCount, Mesh.Bvh.PacketCount,
+				Mesh.Bvh.GetMemorySize() / 1024.0);
+			OutputDebugStringA(Line);
+		}
+
+		if (!Mesh.FromCache)
+		{
+			ReportMeshOptimize(name, Mesh.Optimize);
+		}
+	}
+}
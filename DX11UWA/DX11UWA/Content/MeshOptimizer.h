@@ -0,0 +1,629 @@
+#pragma once
+#include "OBJModelLoader.h"
+#include <algorithm>
+#include <cfloat>
+
+// Index and vertex reordering passes that run on a loaded ObjectData before it is
+// cooked. They only change the order of triangles and vertices, never the geometry.
+namespace DX11UWA
+{
+	// Post-transform cache efficiency of an index buffer under a FIFO cache.
+	struct VertexCacheStats
+	{
+		// Average cache miss ratio: transformed vertices per triangle (0.5 to 3.0).
+		float ACMR = 0.0f;
+		// Average transform to vertex ratio: transformed vertices per unique vertex (1.0 is ideal).
+		float ATVR = 0.0f;
+	};
+
+	struct MeshOptimizeStats
+	{
+		VertexCacheStats Before;
+		VertexCacheStats After;
+		double Seconds = 0.0;
+
+		// Set OverdrawViews before optimizing to also measure overdraw from that many viewpoints.
+		unsigned int OverdrawViews = 0;
+		float OverdrawBefore = 0.0f;
+		float OverdrawAfter = 0.0f;
+		unsigned int OverdrawClusters = 0;
+	};
+
+	// Size of the FIFO cache modeled when reporting ACMR/ATVR.
+	static const unsigned int ReportedCacheSize = 16;
+
+	static VertexCacheStats AnalyzeVertexCache(const unsigned int* Indices, size_t IndexCount, size_t VertexCount, unsigned int CacheSize = ReportedCacheSize)
+	{
+		VertexCacheStats Stats;
+		if (IndexCount < 3 || VertexCount == 0)
+		{
+			return Stats;
+		}
+
+		// A vertex is cached while fewer than CacheSize misses happened since it was loaded.
+		vector<unsigned int> LoadedAt(VertexCount, 0);
+		vector<unsigned char> Used(VertexCount, 0);
+		unsigned int Misses = 0;
+		unsigned int UniqueVertices = 0;
+
+		for (size_t i = 0; i < IndexCount; i++)
+		{
+			unsigned int v = Indices[i];
+
+			if (!Used[v] || Misses - LoadedAt[v] >= CacheSize)
+			{
+				UniqueVertices += !Used[v];
+				Used[v] = 1;
+				LoadedAt[v] = ++Misses;
+			}
+		}
+
+		Stats.ACMR = (float)Misses / (float)(IndexCount / 3);
+		Stats.ATVR = UniqueVertices > 0 ? (float)Misses / (float)UniqueVertices : 0.0f;
+		return Stats;
+	}
+
+	// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle
+	// whose vertices score highest, favoring vertices recently used and vertices with
+	// few triangles left so they drop out of the working set.
+	static void OptimizeVertexCache(unsigned int* Indices, size_t IndexCount, size_t VertexCount)
+	{
+		const int CacheSize = 32;
+		const float CacheDecayPower = 1.5f;
+		const float LastTriScore = 0.75f;
+		const float ValenceBoostScale = 2.0f;
+		const float ValenceBoostPower = 0.5f;
+
+		size_t TriangleCount = IndexCount / 3;
+		if (TriangleCount < 2 || VertexCount == 0)
+		{
+			return;
+		}
+
+		// Scores are tabulated by cache position and by remaining valence.
+		const unsigned int MaxValenceScore = 64;
+		float CacheScore[CacheSize];
+		float ValenceScore[MaxValenceScore];
+
+		for (int i = 0; i < CacheSize; i++)
+		{
+			if (i < 3)
+			{
+				CacheScore[i] = LastTriScore;
+			}
+			else
+			{
+				float Scaler = 1.0f / (CacheSize - 3);
+				CacheScore[i] = powf(1.0f - (i - 3) * Scaler, CacheDecayPower);
+			}
+		}
+
+		ValenceScore[0] = 0.0f;
+		for (unsigned int i = 1; i < MaxValenceScore; i++)
+		{
+			ValenceScore[i] = ValenceBoostScale * powf((float)i, -ValenceBoostPower);
+		}
+
+		// Vertex -> triangle adjacency in one flat array.
+		vector<unsigned int> TriangleStart(VertexCount + 1, 0);
+		for (size_t i = 0; i < TriangleCount * 3; i++)
+		{
+			TriangleStart[Indices[i] + 1]++;
+		}
+		for (size_t v = 0; v < VertexCount; v++)
+		{
+			TriangleStart[v + 1] += TriangleStart[v];
+		}
+
+		vector<unsigned int> Adjacency(TriangleCount * 3);
+		vector<unsigned int> Fill(TriangleStart.begin(), TriangleStart.end() - 1);
+		for (size_t t = 0; t < TriangleCount; t++)
+		{
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				Adjacency[Fill[Indices[t * 3 + c]]++] = (unsigned int)t;
+			}
+		}
+
+		// Remaining valence doubles as the count of live entries at the front of each adjacency list.
+		vector<unsigned int> Remaining(VertexCount);
+		vector<int> CachePosition(VertexCount, -1);
+		vector<float> VertexScore(VertexCount);
+
+		auto ScoreVertex = [&](size_t v) -> float
+		{
+			if (Remaining[v] == 0)
+			{
+				return -1.0f;
+			}
+
+			float Score = CachePosition[v] >= 0 ? CacheScore[CachePosition[v]] : 0.0f;
+			return Score + ValenceScore[Remaining[v] < MaxValenceScore ? Remaining[v] : MaxValenceScore - 1];
+		};
+
+		for (size_t v = 0; v < VertexCount; v++)
+		{
+			Remaining[v] = TriangleStart[v + 1] - TriangleStart[v];
+			VertexScore[v] = ScoreVertex(v);
+		}
+
+		vector<float> TriangleScore(TriangleCount);
+		vector<unsigned char> Emitted(TriangleCount, 0);
+		for (size_t t = 0; t < TriangleCount; t++)
+		{
+			TriangleScore[t] = VertexScore[Indices[t * 3]] + VertexScore[Indices[t * 3 + 1]] + VertexScore[Indices[t * 3 + 2]];
+		}
+
+		vector<unsigned int> Output;
+		Output.reserve(TriangleCount * 3);
+
+		// LRU cache with room for the three vertices pushed in by each new triangle.
+		unsigned int Cache[CacheSize + 3];
+		int CacheCount = 0;
+
+		size_t FallbackCursor = 0;
+		int BestTriangle = -1;
+		float BestScore = -1.0f;
+
+		for (size_t t = 0; t < TriangleCount; t++)
+		{
+			if (TriangleScore[t] > BestScore)
+			{
+				BestScore = TriangleScore[t];
+				BestTriangle = (int)t;
+			}
+		}
+
+		for (size_t Emit = 0; Emit < TriangleCount; Emit++)
+		{
+			if (BestTriangle < 0)
+			{
+				// Nothing adjacent to the cache: continue with the next triangle in input order.
+				while (Emitted[FallbackCursor]) FallbackCursor++;
+				BestTriangle = (int)FallbackCursor;
+			}
+
+			const unsigned int* Tri = Indices + BestTriangle * 3;
+			Emitted[BestTriangle] = 1;
+			Output.insert(Output.end(), Tri, Tri + 3);
+
+			// Drop the triangle from its vertices' live adjacency.
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				unsigned int v = Tri[c];
+				unsigned int* List = Adjacency.data() + TriangleStart[v];
+				for (unsigned int k = 0; k < Remaining[v]; k++)
+				{
+					if (List[k] == (unsigned int)BestTriangle)
+					{
+						List[k] = List[Remaining[v] - 1];
+						break;
+					}
+				}
+				Remaining[v]--;
+			}
+
+			// Move the triangle's vertices to the front of the cache.
+			unsigned int NewCache[CacheSize + 3];
+			int NewCount = 0;
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				NewCache[NewCount++] = Tri[c];
+			}
+			for (int k = 0; k < CacheCount; k++)
+			{
+				unsigned int v = Cache[k];
+				if (v != Tri[0] && v != Tri[1] && v != Tri[2])
+				{
+					NewCache[NewCount++] = v;
+				}
+			}
+
+			for (int k = 0; k < NewCount; k++)
+			{
+				CachePosition[NewCache[k]] = k < CacheSize ? k : -1;
+			}
+
+			CacheCount = NewCount < CacheSize ? NewCount : CacheSize;
+			memcpy(Cache, NewCache, sizeof(unsigned int) * CacheCount);
+
+			// Rescore everything that was in the cache and the triangles around it.
+			for (int k = 0; k < NewCount; k++)
+			{
+				unsigned int v = NewCache[k];
+				VertexScore[v] = ScoreVertex(v);
+			}
+
+			BestTriangle = -1;
+			BestScore = -1.0f;
+
+			for (int k = 0; k < CacheCount; k++)
+			{
+				unsigned int v = Cache[k];
+				const unsigned int* List = Adjacency.data() + TriangleStart[v];
+				for (unsigned int a = 0; a < Remaining[v]; a++)
+				{
+					unsigned int t = List[a];
+					const unsigned int* Other = Indices + t * 3;
+					float Score = VertexScore[Other[0]] + VertexScore[Other[1]] + VertexScore[Other[2]];
+					TriangleScore[t] = Score;
+
+					if (Score > BestScore)
+					{
+						BestScore = Score;
+						BestTriangle = (int)t;
+					}
+				}
+			}
+		}
+
+		memcpy(Indices, Output.data(), sizeof(unsigned int) * Output.size());
+	}
+
+	// Splits a cache-optimized triangle order into clusters and sorts the clusters so
+	// that outward-facing ones come first, which approximates front-to-back order from
+	// any viewpoint outside the mesh (Sander et al., "Fast Triangle Reordering for Vertex
+	// Locality and Reduced Overdraw"). Clusters only end where the ACMR of the cluster so
+	// far is within Threshold of its whole hard cluster, so the vertex cache cost grows by
+	// at most roughly that factor. Returns the number of clusters.
+	static unsigned int OptimizeOverdraw(unsigned int* Indices, size_t IndexCount, const ObjectVertices* Vertices, size_t VertexCount, float Threshold = 1.05f)
+	{
+		const unsigned int CacheSize = ReportedCacheSize;
+
+		size_t TriangleCount = IndexCount / 3;
+		if (TriangleCount < 2 || VertexCount == 0)
+		{
+			return TriangleCount > 0 ? 1 : 0;
+		}
+
+		vector<unsigned int> LoadedAt(VertexCount, 0);
+		vector<unsigned int> Stamp(VertexCount, 0);
+		unsigned int Misses = 0;
+		unsigned int Epoch = 0;
+
+		// FIFO cache misses caused by triangle t; Epoch invalidates the whole cache.
+		auto TriangleMisses = [&](size_t t) -> unsigned int
+		{
+			unsigned int Count = 0;
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				unsigned int v = Indices[t * 3 + c];
+				if (Stamp[v] != Epoch || Misses - LoadedAt[v] >= CacheSize)
+				{
+					Stamp[v] = Epoch;
+					LoadedAt[v] = ++Misses;
+					Count++;
+				}
+			}
+			return Count;
+		};
+
+		// Hard boundaries: triangles where the simulated cache starts over (three misses).
+		vector<unsigned int> Hard;
+		Epoch++;
+		for (size_t t = 0; t < TriangleCount; t++)
+		{
+			if (TriangleMisses(t) == 3 || t == 0)
+			{
+				Hard.push_back((unsigned int)t);
+			}
+		}
+		Hard.push_back((unsigned int)TriangleCount);
+
+		// Soft boundaries inside each hard cluster.
+		vector<unsigned int> Clusters;
+		for (size_t h = 0; h + 1 < Hard.size(); h++)
+		{
+			unsigned int Start = Hard[h];
+			unsigned int End = Hard[h + 1];
+
+			Epoch++;
+			unsigned int ClusterMisses = 0;
+			for (unsigned int t = Start; t < End; t++)
+			{
+				ClusterMisses += TriangleMisses(t);
+			}
+
+			float ClusterThreshold = Threshold * (float)ClusterMisses / (float)(End - Start);
+
+			Clusters.push_back(Start);
+			Epoch++;
+			unsigned int RunMisses = 0;
+			unsigned int RunStart = Start;
+
+			for (unsigned int t = Start; t < End; t++)
+			{
+				RunMisses += TriangleMisses(t);
+
+				if (t + 1 < End && (float)RunMisses / (float)(t + 1 - RunStart) <= ClusterThreshold)
+				{
+					Clusters.push_back(t + 1);
+					Epoch++;
+					RunMisses = 0;
+					RunStart = t + 1;
+				}
+			}
+		}
+		Clusters.push_back((unsigned int)TriangleCount);
+
+		unsigned int ClusterCount = (unsigned int)Clusters.size() - 1;
+
+		// Area-weighted centroid of the whole mesh.
+		float MeshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+		float MeshArea = 0.0f;
+
+		vector<float> ClusterCentroid(ClusterCount * 3, 0.0f);
+		vector<float> ClusterNormal(ClusterCount * 3, 0.0f);
+		vector<float> ClusterArea(ClusterCount, 0.0f);
+
+		for (unsigned int c = 0; c < ClusterCount; c++)
+		{
+			for (unsigned int t = Clusters[c]; t < Clusters[c + 1]; t++)
+			{
+				const XMFLOAT3& A = Vertices[Indices[t * 3]].Position;
+				const XMFLOAT3& B = Vertices[Indices[t * 3 + 1]].Position;
+				const XMFLOAT3& C = Vertices[Indices[t * 3 + 2]].Position;
+
+				float E1[3] = { B.x - A.x, B.y - A.y, B.z - A.z };
+				float E2[3] = { C.x - A.x, C.y - A.y, C.z - A.z };
+				float N[3] = { E1[1] * E2[2] - E1[2] * E2[1], E1[2] * E2[0] - E1[0] * E2[2], E1[0] * E2[1] - E1[1] * E2[0] };
+				float Area = sqrtf(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+
+				float Center[3] = { (A.x + B.x + C.x) / 3.0f, (A.y + B.y + C.y) / 3.0f, (A.z + B.z + C.z) / 3.0f };
+
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					ClusterCentroid[c * 3 + k] += Center[k] * Area;
+					ClusterNormal[c * 3 + k] += N[k];
+					MeshCentroid[k] += Center[k] * Area;
+				}
+				ClusterArea[c] += Area;
+				MeshArea += Area;
+			}
+		}
+
+		if (MeshArea > 0.0f)
+		{
+			for (unsigned int k = 0; k < 3; k++) MeshCentroid[k] /= MeshArea;
+		}
+
+		vector<float> SortKey(ClusterCount);
+		for (unsigned int c = 0; c < ClusterCount; c++)
+		{
+			float* Centroid = &ClusterCentroid[c * 3];
+			float* Normal = &ClusterNormal[c * 3];
+
+			float InvArea = ClusterArea[c] > 0.0f ? 1.0f / ClusterArea[c] : 0.0f;
+			float NormalLength = sqrtf(Normal[0] * Normal[0] + Normal[1] * Normal[1] + Normal[2] * Normal[2]);
+			float InvNormal = NormalLength > 0.0f ? 1.0f / NormalLength : 0.0f;
+
+			float Key = 0.0f;
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				Key += (Centroid[k] * InvArea - MeshCentroid[k]) * Normal[k] * InvNormal;
+			}
+			SortKey[c] = Key;
+		}
+
+		vector<unsigned int> Order(ClusterCount);
+		for (unsigned int c = 0; c < ClusterCount; c++) Order[c] = c;
+		stable_sort(Order.begin(), Order.end(), [&](unsigned int a, unsigned int b) { return SortKey[a] > SortKey[b]; });
+
+		vector<unsigned int> Output;
+		Output.reserve(TriangleCount * 3);
+		for (unsigned int c : Order)
+		{
+			Output.insert(Output.end(), Indices + Clusters[c] * 3, Indices + Clusters[c + 1] * 3);
+		}
+
+		memcpy(Indices, Output.data(), sizeof(unsigned int) * Output.size());
+		return ClusterCount;
+	}
+
+	// Rasterizes the mesh orthographically from ViewCount directions spread over the sphere
+	// and returns the average ratio of shaded pixels (fragments that passed the depth test)
+	// to covered pixels. 1.0 means every pixel was shaded exactly once. Back faces are
+	// culled with Direct3D's default clockwise-front rule.
+	static float MeasureOverdraw(const unsigned int* Indices, size_t IndexCount, const ObjectVertices* Vertices, size_t VertexCount, unsigned int ViewCount = 16, int Resolution = 256)
+	{
+		if (IndexCount < 3 || VertexCount == 0 || ViewCount == 0)
+		{
+			return 0.0f;
+		}
+
+		vector<float> Depth(Resolution * Resolution);
+		vector<float> Projected(VertexCount * 3);
+
+		double RatioSum = 0.0;
+		unsigned int ViewsWithCoverage = 0;
+
+		for (unsigned int View = 0; View < ViewCount; View++)
+		{
+			// Fibonacci sphere directions.
+			float y = 1.0f - 2.0f * (View + 0.5f) / ViewCount;
+			float r = sqrtf(max(0.0f, 1.0f - y * y));
+			float Phi = View * 2.39996323f;
+			float Dir[3] = { r * cosf(Phi), y, r * sinf(Phi) };
+
+			// Same basis as XMMatrixLookToLH: right = up x forward, up' = forward x right.
+			float Up[3] = { 0.0f, 1.0f, 0.0f };
+			if (fabsf(Dir[1]) > 0.99f)
+			{
+				Up[0] = 1.0f; Up[1] = 0.0f;
+			}
+
+			float Right[3] = { Up[1] * Dir[2] - Up[2] * Dir[1], Up[2] * Dir[0] - Up[0] * Dir[2], Up[0] * Dir[1] - Up[1] * Dir[0] };
+			float RightLength = sqrtf(Right[0] * Right[0] + Right[1] * Right[1] + Right[2] * Right[2]);
+			for (unsigned int k = 0; k < 3; k++) Right[k] /= RightLength;
+			float ViewUp[3] = { Dir[1] * Right[2] - Dir[2] * Right[1], Dir[2] * Right[0] - Dir[0] * Right[2], Dir[0] * Right[1] - Dir[1] * Right[0] };
+
+			float MinX = FLT_MAX, MinY = FLT_MAX, MaxX = -FLT_MAX, MaxY = -FLT_MAX;
+			for (size_t v = 0; v < VertexCount; v++)
+			{
+				const XMFLOAT3& P = Vertices[v].Position;
+				float X = P.x * Right[0] + P.y * Right[1] + P.z * Right[2];
+				float Y = -(P.x * ViewUp[0] + P.y * ViewUp[1] + P.z * ViewUp[2]);
+				float Z = P.x * Dir[0] + P.y * Dir[1] + P.z * Dir[2];
+
+				Projected[v * 3] = X;
+				Projected[v * 3 + 1] = Y;
+				Projected[v * 3 + 2] = Z;
+
+				MinX = min(MinX, X); MaxX = max(MaxX, X);
+				MinY = min(MinY, Y); MaxY = max(MaxY, Y);
+			}
+
+			// Fit the projected bounds to the target, keeping the aspect ratio.
+			float Extent = max(MaxX - MinX, MaxY - MinY);
+			float Scale = Extent > 0.0f ? (Resolution - 1) / Extent : 1.0f;
+			for (size_t v = 0; v < VertexCount; v++)
+			{
+				Projected[v * 3] = (Projected[v * 3] - MinX) * Scale;
+				Projected[v * 3 + 1] = (Projected[v * 3 + 1] - MinY) * Scale;
+			}
+
+			fill(Depth.begin(), Depth.end(), FLT_MAX);
+			unsigned long long Shaded = 0;
+
+			for (size_t t = 0; t + 2 < IndexCount; t += 3)
+			{
+				const float* A = &Projected[Indices[t] * 3];
+				const float* B = &Projected[Indices[t + 1] * 3];
+				const float* C = &Projected[Indices[t + 2] * 3];
+
+				// With y pointing down, clockwise triangles have positive area.
+				float Area = (B[0] - A[0]) * (C[1] - A[1]) - (C[0] - A[0]) * (B[1] - A[1]);
+				if (Area <= 0.0f)
+				{
+					continue;
+				}
+
+				int X0 = max(0, (int)floorf(min(A[0], min(B[0], C[0]))));
+				int X1 = min(Resolution - 1, (int)ceilf(max(A[0], max(B[0], C[0]))));
+				int Y0 = max(0, (int)floorf(min(A[1], min(B[1], C[1]))));
+				int Y1 = min(Resolution - 1, (int)ceilf(max(A[1], max(B[1], C[1]))));
+
+				float InvArea = 1.0f / Area;
+
+				for (int py = Y0; py <= Y1; py++)
+				{
+					float Py = py + 0.5f;
+					for (int px = X0; px <= X1; px++)
+					{
+						float Px = px + 0.5f;
+
+						float W0 = (C[0] - B[0]) * (Py - B[1]) - (Px - B[0]) * (C[1] - B[1]);
+						float W1 = (A[0] - C[0]) * (Py - C[1]) - (Px - C[0]) * (A[1] - C[1]);
+						float W2 = (B[0] - A[0]) * (Py - A[1]) - (Px - A[0]) * (B[1] - A[1]);
+
+						if (W0 < 0.0f || W1 < 0.0f || W2 < 0.0f)
+						{
+							continue;
+						}
+
+						float Z = (W0 * A[2] + W1 * B[2] + W2 * C[2]) * InvArea;
+						float& Stored = Depth[py * Resolution + px];
+						if (Z < Stored)
+						{
+							Stored = Z;
+							Shaded++;
+						}
+					}
+				}
+			}
+
+			unsigned long long Covered = 0;
+			for (float d : Depth)
+			{
+				Covered += d != FLT_MAX;
+			}
+
+			if (Covered > 0)
+			{
+				RatioSum += (double)Shaded / (double)Covered;
+				ViewsWithCoverage++;
+			}
+		}
+
+		return ViewsWithCoverage > 0 ? (float)(RatioSum / ViewsWithCoverage) : 0.0f;
+	}
+
+	// Renumbers vertices in order of first use so vertex fetch walks memory linearly.
+	// Vertices no index refers to are dropped.
+	static void OptimizeVertexFetch(ObjectData* Mesh)
+	{
+		const unsigned int Unassigned = 0xFFFFFFFF;
+
+		vector<unsigned int> Remap(Mesh->MeshVerts.size(), Unassigned);
+		vector<ObjectVertices> Reordered;
+		Reordered.reserve(Mesh->MeshVerts.size());
+
+		for (unsigned int& Index : Mesh->MeshIndecies)
+		{
+			if (Remap[Index] == Unassigned)
+			{
+				Remap[Index] = (unsigned int)Reordered.size();
+				Reordered.push_back(Mesh->MeshVerts[Index]);
+			}
+
+			Index = Remap[Index];
+		}
+
+		Mesh->MeshVerts.swap(Reordered);
+	}
+
+	// Reorders triangles for the post-transform cache and for overdraw, then vertices for
+	// fetch locality. OverdrawThreshold is the ACMR growth the overdraw pass may trade
+	// away; 1.0 keeps the cache order as it is.
+	static void OptimizeMesh(ObjectData* Mesh, MeshOptimizeStats* Stats = nullptr, float OverdrawThreshold = 1.05f)
+	{
+		auto Start = chrono::high_resolution_clock::now();
+
+		unsigned int* Indices = Mesh->MeshIndecies.data();
+		size_t IndexCount = Mesh->MeshIndecies.size() - Mesh->MeshIndecies.size() % 3;
+
+		bool Overdraw = Stats != nullptr && Stats->OverdrawViews > 0;
+
+		if (Stats != nullptr)
+		{
+			Stats->Before = AnalyzeVertexCache(Indices, IndexCount, Mesh->MeshVerts.size());
+		}
+
+		if (Overdraw)
+		{
+			Stats->OverdrawBefore = MeasureOverdraw(Indices, IndexCount, Mesh->MeshVerts.data(), Mesh->MeshVerts.size(), Stats->OverdrawViews);
+			Start = chrono::high_resolution_clock::now();
+		}
+
+		OptimizeVertexCache(Indices, IndexCount, Mesh->MeshVerts.size());
+		unsigned int Clusters = OptimizeOverdraw(Indices, IndexCount, Mesh->MeshVerts.data(), Mesh->MeshVerts.size(), OverdrawThreshold);
+		OptimizeVertexFetch(Mesh);
+
+		if (Stats != nullptr)
+		{
+			Stats->Seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - Start).count();
+			Stats->After = AnalyzeVertexCache(Mesh->MeshIndecies.data(), IndexCount, Mesh->MeshVerts.size());
+			Stats->OverdrawClusters = Clusters;
+		}
+
+		if (Overdraw)
+		{
+			Stats->OverdrawAfter = MeasureOverdraw(Mesh->MeshIndecies.data(), IndexCount, Mesh->MeshVerts.data(), Mesh->MeshVerts.size(), Stats->OverdrawViews);
+		}
+	}
+
+	static void ReportMeshOptimize(const char* name, const MeshOptimizeStats& Stats)
+	{
+		char Line[256];
+		sprintf_s(Line, "%s: vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u-entry FIFO), optimized in %.3f ms\n",
+			name, Stats.Before.ACMR, Stats.After.ACMR, Stats.Before.ATVR, Stats.After.ATVR, ReportedCacheSize, Stats.Seconds * 1000.0);
+		OutputDebugStringA(Line);
+
+		if (Stats.OverdrawViews > 0)
+		{
+			sprintf_s(Line, "%s: overdraw %.3f -> %.3f shaded/covered pixels over %u views, %u clusters\n",
+				name, Stats.OverdrawBefore, Stats.OverdrawAfter, Stats.OverdrawViews, Stats.OverdrawClusters);
+			OutputDebugStringA(Line);
+		}
+	}
+}
@@ -0,0 +1,546 @@
+#pragma once
+#include <algorithm>
+#include <unordered_set>
+#include "MeshOptimizer.h"
+
+// Quadric error mesh simplification (Garland & Heckbert, "Surface Simplification Using
+// Quadric Error Metrics") by half-edge collapse: a vertex is only ever merged into one
+// of its neighbours, so every level of detail indexes the original vertex buffer.
+namespace DX11UWA
+{
+	// Position error quadric, a symmetric 4x4 matrix plus the total weight of its planes.
+	struct ErrorQuadric
+	{
+		float a00, a11, a22, a01, a02, a12;
+		float b0, b1, b2;
+		float c;
+		float Weight;
+
+		void AddPlane(float nx, float ny, float nz, float d, float w)
+		{
+			a00 += nx * nx * w; a11 += ny * ny * w; a22 += nz * nz * w;
+			a01 += nx * ny * w; a02 += nx * nz * w; a12 += ny * nz * w;
+			b0 += nx * d * w; b1 += ny * d * w; b2 += nz * d * w;
+			c += d * d * w;
+			Weight += w;
+		}
+
+		void Add(const ErrorQuadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			Weight += q.Weight;
+		}
+
+		// Weighted mean squared distance from p to the planes.
+		float Evaluate(const XMFLOAT3& p) const
+		{
+			float rx = a00 * p.x + a01 * p.y + a02 * p.z + b0;
+			float ry = a01 * p.x + a11 * p.y + a12 * p.z + b1;
+			float rz = a02 * p.x + a12 * p.y + a22 * p.z + b2;
+
+			float e = rx * p.x + ry * p.y + rz * p.z + b0 * p.x + b1 * p.y + b2 * p.z + c;
+			return Weight > 0.0f && e > 0.0f ? e / Weight : 0.0f;
+		}
+	};
+
+	// How a vertex may move. Seam vertices share their position with exactly one other
+	// vertex (a UV seam or a hard normal edge) and must collapse together with it, so
+	// only along an edge both of them have.
+	enum SimplifyVertexKind
+	{
+		SimplifyManifold,
+		SimplifyBorder,
+		SimplifySeam,
+		SimplifyLocked,
+	};
+
+	struct MeshLod
+	{
+		vector<unsigned int> Indices;
+		// Largest collapse error in object space units.
+		float Error;
+	};
+
+	// Extra weight on the planes that hold borders and seams in place.
+	static const float SimplifyBorderWeight = 10.0f;
+
+	static unsigned long long SimplifyEdgeKey(unsigned int a, unsigned int b)
+	{
+		return ((unsigned long long)a << 32) | b;
+	}
+
+	// Simplifies the triangle list through a series of descending index count targets,
+	// recording a level each time one is reached or the next collapse would move the
+	// surface by more than that level's entry in TargetErrors (relative to the mesh
+	// extent). Level errors are relative to the extent and cumulative, since each level
+	// continues from the one before.
+	static void SimplifyMeshLevels(const ObjectData& Mesh, const unsigned int* Indices, size_t IndexCount, const size_t* Targets, const float* TargetErrors, size_t TargetCount, vector<MeshLod>* Levels)
+	{
+		const vector<ObjectVertices>& Verts = Mesh.MeshVerts;
+		unsigned int VertexCount = (unsigned int)Verts.size();
+
+		Levels->clear();
+		if (TargetCount == 0 || IndexCount <= Targets[TargetCount - 1] || VertexCount == 0)
+		{
+			Levels->resize(TargetCount);
+			for (MeshLod& Level : *Levels)
+			{
+				Level.Indices.assign(Indices, Indices + IndexCount);
+				Level.Error = 0.0f;
+			}
+			return;
+		}
+
+		// Work in a unit box so errors are relative to the mesh size.
+		XMFLOAT3 Min = Verts[0].Position;
+		XMFLOAT3 Max = Verts[0].Position;
+		for (const ObjectVertices& v : Verts)
+		{
+			Min = XMFLOAT3(min(Min.x, v.Position.x), min(Min.y, v.Position.y), min(Min.z, v.Position.z));
+			Max = XMFLOAT3(max(Max.x, v.Position.x), max(Max.y, v.Position.y), max(Max.z, v.Position.z));
+		}
+
+		float Extent = max(Max.x - Min.x, max(Max.y - Min.y, Max.z - Min.z));
+		float InvExtent = Extent > 0.0f ? 1.0f / Extent : 0.0f;
+
+		vector<XMFLOAT3> Positions(VertexCount);
+		for (unsigned int v = 0; v < VertexCount; v++)
+		{
+			const XMFLOAT3& p = Verts[v].Position;
+			Positions[v] = XMFLOAT3((p.x - Min.x) * InvExtent, (p.y - Min.y) * InvExtent, (p.z - Min.z) * InvExtent);
+		}
+
+		// Group vertices that share a position; Wedge links each group into a ring.
+		vector<unsigned int> Sorted(VertexCount);
+		for (unsigned int v = 0; v < VertexCount; v++) Sorted[v] = v;
+		sort(Sorted.begin(), Sorted.end(), [&](unsigned int a, unsigned int b)
+		{
+			const XMFLOAT3& p = Verts[a].Position;
+			const XMFLOAT3& q = Verts[b].Position;
+			if (p.x != q.x) return p.x < q.x;
+			if (p.y != q.y) return p.y < q.y;
+			if (p.z != q.z) return p.z < q.z;
+			return a < b;
+		});
+
+		vector<unsigned int> Remap(VertexCount);
+		vector<unsigned int> Wedge(VertexCount);
+		vector<unsigned int> GroupSize(VertexCount, 0);
+
+		for (unsigned int i = 0; i < VertexCount;)
+		{
+			unsigned int j = i;
+			const XMFLOAT3& p = Verts[Sorted[i]].Position;
+			while (j < VertexCount && Verts[Sorted[j]].Position.x == p.x && Verts[Sorted[j]].Position.y == p.y && Verts[Sorted[j]].Position.z == p.z)
+			{
+				j++;
+			}
+
+			for (unsigned int k = i; k < j; k++)
+			{
+				Remap[Sorted[k]] = Sorted[i];
+				Wedge[Sorted[k]] = Sorted[k + 1 < j ? k + 1 : i];
+			}
+			GroupSize[Sorted[i]] = j - i;
+			i = j;
+		}
+
+		// Half-edges present at the vertex level and at the position level.
+		unordered_set<unsigned long long> Edges;
+		unordered_set<unsigned long long> PositionEdges;
+		Edges.reserve(IndexCount);
+		PositionEdges.reserve(IndexCount);
+
+		for (size_t t = 0; t + 2 < IndexCount; t += 3)
+		{
+			for (unsigned int e = 0; e < 3; e++)
+			{
+				unsigned int a = Indices[t + e];
+				unsigned int b = Indices[t + (e + 1) % 3];
+				Edges.insert(SimplifyEdgeKey(a, b));
+				PositionEdges.insert(SimplifyEdgeKey(Remap[a], Remap[b]));
+			}
+		}
+
+		auto IsOpen = [&](unsigned int a, unsigned int b)
+		{
+			return Edges.count(SimplifyEdgeKey(b, a)) == 0;
+		};
+		auto IsPositionOpen = [&](unsigned int a, unsigned int b)
+		{
+			return PositionEdges.count(SimplifyEdgeKey(Remap[b], Remap[a])) == 0;
+		};
+
+		vector<unsigned int> OpenOut(VertexCount, 0), OpenIn(VertexCount, 0);
+		vector<unsigned int> PositionOpenOut(VertexCount, 0), PositionOpenIn(VertexCount, 0);
+
+		vector<ErrorQuadric> Quadrics(VertexCount);
+		memset(Quadrics.data(), 0, sizeof(ErrorQuadric) * VertexCount);
+
+		for (size_t t = 0; t + 2 < IndexCount; t += 3)
+		{
+			const XMFLOAT3& p0 = Positions[Indices[t]];
+			const XMFLOAT3& p1 = Positions[Indices[t + 1]];
+			const XMFLOAT3& p2 = Positions[Indices[t + 2]];
+
+			float e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			float e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float Area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			if (Area > 0.0f)
+			{
+				n[0] /= Area; n[1] /= Area; n[2] /= Area;
+			}
+
+			float d = -(n[0] * p0.x + n[1] * p0.y + n[2] * p0.z);
+
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				Quadrics[Remap[Indices[t + c]]].AddPlane(n[0], n[1], n[2], d, Area);
+			}
+
+			for (unsigned int e = 0; e < 3; e++)
+			{
+				unsigned int a = Indices[t + e];
+				unsigned int b = Indices[t + (e + 1) % 3];
+
+				bool Open = IsOpen(a, b);
+				bool PositionOpen = IsPositionOpen(a, b);
+
+				OpenOut[a] += Open;
+				OpenIn[b] += Open;
+				PositionOpenOut[Remap[a]] += PositionOpen;
+				PositionOpenIn[Remap[b]] += PositionOpen;
+
+				if (Open)
+				{
+					// A plane through the edge, perpendicular to the triangle, keeps borders
+					// and seams from sliding sideways.
+					const XMFLOAT3& pa = Positions[a];
+					const XMFLOAT3& pb = Positions[b];
+					float Edge[3] = { pb.x - pa.x, pb.y - pa.y, pb.z - pa.z };
+					float Length = sqrtf(Edge[0] * Edge[0] + Edge[1] * Edge[1] + Edge[2] * Edge[2]);
+
+					float m[3] = { Edge[1] * n[2] - Edge[2] * n[1], Edge[2] * n[0] - Edge[0] * n[2], Edge[0] * n[1] - Edge[1] * n[0] };
+					float mLength = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+
+					if (mLength > 0.0f)
+					{
+						m[0] /= mLength; m[1] /= mLength; m[2] /= mLength;
+						float md = -(m[0] * pa.x + m[1] * pa.y + m[2] * pa.z);
+						float w = Length * Length * SimplifyBorderWeight;
+
+						Quadrics[Remap[a]].AddPlane(m[0], m[1], m[2], md, w);
+						Quadrics[Remap[b]].AddPlane(m[0], m[1], m[2], md, w);
+					}
+				}
+			}
+		}
+
+		vector<unsigned char> Kind(VertexCount);
+		for (unsigned int v = 0; v < VertexCount; v++)
+		{
+			unsigned int g = Remap[v];
+			bool PositionClosed = PositionOpenOut[g] == 0 && PositionOpenIn[g] == 0;
+
+			if (GroupSize[g] == 1)
+			{
+				Kind[v] = PositionClosed ? SimplifyManifold :
+					(PositionOpenOut[g] == 1 && PositionOpenIn[g] == 1 ? SimplifyBorder : SimplifyLocked);
+			}
+			else if (GroupSize[g] == 2 &&
+				OpenOut[v] == 1 && OpenIn[v] == 1 && OpenOut[Wedge[v]] == 1 && OpenIn[Wedge[v]] == 1)
+			{
+				Kind[v] = SimplifySeam;
+			}
+			else
+			{
+				Kind[v] = SimplifyLocked;
+			}
+		}
+
+		// For a seam collapse v -> u, the partner of u that v's partner collapses into.
+		auto SeamPartner = [&](unsigned int v, unsigned int u) -> unsigned int
+		{
+			unsigned int v2 = Wedge[v];
+			unsigned int u2 = Wedge[u];
+
+			bool Connected = Edges.count(SimplifyEdgeKey(v2, u2)) || Edges.count(SimplifyEdgeKey(u2, v2));
+			return Connected && (IsOpen(v2, u2) || IsOpen(u2, v2)) ? u2 : ~0u;
+		};
+
+		auto CanCollapse = [&](unsigned int v, unsigned int u) -> bool
+		{
+			if (Remap[v] == Remap[u])
+			{
+				return false;
+			}
+
+			switch (Kind[v])
+			{
+			case SimplifyManifold:
+				return true;
+			case SimplifyBorder:
+				return (Kind[u] == SimplifyBorder || Kind[u] == SimplifyLocked) && (IsPositionOpen(v, u) || IsPositionOpen(u, v));
+			case SimplifySeam:
+				return Kind[u] == SimplifySeam && (IsOpen(v, u) || IsOpen(u, v)) && SeamPartner(v, u) != ~0u;
+			default:
+				return false;
+			}
+		};
+
+		struct Collapse
+		{
+			unsigned int From;
+			unsigned int To;
+			float Error;
+		};
+
+		vector<unsigned int> Result(Indices, Indices + IndexCount);
+		vector<Collapse> Candidates;
+		vector<unsigned int> Target(VertexCount);
+		vector<unsigned char> Touched(VertexCount);
+		vector<unsigned int> TriangleStart(VertexCount + 1);
+		vector<unsigned int> Adjacency;
+
+		float ReachedError = 0.0f;
+
+		for (size_t Level = 0; Level < TargetCount; Level++)
+		{
+			size_t TargetIndexCount = Targets[Level];
+			float TargetErrorSq = TargetErrors[Level] * TargetErrors[Level];
+
+			while (Result.size() > TargetIndexCount)
+			{
+				size_t TriangleCount = Result.size() / 3;
+
+				// Position group -> triangle adjacency for the flip test.
+				fill(TriangleStart.begin(), TriangleStart.end(), 0);
+				for (unsigned int i : Result)
+				{
+					TriangleStart[Remap[i] + 1]++;
+				}
+				for (unsigned int v = 0; v < VertexCount; v++)
+				{
+					TriangleStart[v + 1] += TriangleStart[v];
+				}
+
+				Adjacency.resize(Result.size());
+				vector<unsigned int> Fill(TriangleStart.begin(), TriangleStart.end() - 1);
+				for (size_t i = 0; i < Result.size(); i++)
+				{
+					Adjacency[Fill[Remap[Result[i]]]++] = (unsigned int)(i / 3);
+				}
+
+				// The cheaper allowed direction of every edge.
+				Candidates.clear();
+				for (size_t t = 0; t < TriangleCount; t++)
+				{
+					for (unsigned int e = 0; e < 3; e++)
+					{
+						unsigned int a = Result[t * 3 + e];
+						unsigned int b = Result[t * 3 + (e + 1) % 3];
+
+						float ErrorAB = CanCollapse(a, b) ? Quadrics[Remap[a]].Evaluate(Positions[b]) : FLT_MAX;
+						float ErrorBA = CanCollapse(b, a) ? Quadrics[Remap[b]].Evaluate(Positions[a]) : FLT_MAX;
+
+						if (ErrorAB <= ErrorBA && ErrorAB <= TargetErrorSq)
+						{
+							Candidates.push_back({ a, b, ErrorAB });
+						}
+						else if (ErrorBA < ErrorAB && ErrorBA <= TargetErrorSq)
+						{
+							Candidates.push_back({ b, a, ErrorBA });
+						}
+					}
+				}
+
+				if (Candidates.empty())
+				{
+					break;
+				}
+
+				sort(Candidates.begin(), Candidates.end(), [](const Collapse& a, const Collapse& b) { return a.Error < b.Error; });
+
+				for (unsigned int v = 0; v < VertexCount; v++) Target[v] = v;
+				fill(Touched.begin(), Touched.end(), 0);
+
+				size_t Remaining = TriangleCount;
+				size_t TargetTriangles = TargetIndexCount / 3;
+				unsigned int Applied = 0;
+
+				for (const Collapse& c : Candidates)
+				{
+					if (Remaining <= TargetTriangles)
+					{
+						break;
+					}
+
+					unsigned int gv = Remap[c.From];
+					unsigned int gu = Remap[c.To];
+					if (Touched[gv] || Touched[gu] || Target[c.From] != c.From)
+					{
+						continue;
+					}
+
+					// Reject collapses that flip a surviving triangle around the removed vertex.
+					const XMFLOAT3& NewPosition = Positions[c.To];
+					bool Flips = false;
+					size_t Removed = 0;
+
+					for (unsigned int a = TriangleStart[gv]; a < TriangleStart[gv + 1] && !Flips; a++)
+					{
+						const unsigned int* Tri = &Result[Adjacency[a] * 3];
+						unsigned int g0 = Remap[Tri[0]], g1 = Remap[Tri[1]], g2 = Remap[Tri[2]];
+
+						if (g0 == gu || g1 == gu || g2 == gu)
+						{
+							Removed++;
+							continue;
+						}
+
+						XMFLOAT3 p[3] = { Positions[Tri[0]], Positions[Tri[1]], Positions[Tri[2]] };
+						XMFLOAT3 q[3] = { p[0], p[1], p[2] };
+						if (g0 == gv) q[0] = NewPosition;
+						if (g1 == gv) q[1] = NewPosition;
+						if (g2 == gv) q[2] = NewPosition;
+
+						auto Normal = [](const XMFLOAT3* t, float n[3])
+						{
+							float e1[3] = { t[1].x - t[0].x, t[1].y - t[0].y, t[1].z - t[0].z };
+							float e2[3] = { t[2].x - t[0].x, t[2].y - t[0].y, t[2].z - t[0].z };
+							n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+							n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+							n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+						};
+
+						float n0[3], n1[3];
+						Normal(p, n0);
+						Normal(q, n1);
+
+						float Dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+						float Lengths = sqrtf((n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]) * (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]));
+						Flips = Dot <= 0.25f * Lengths;
+					}
+
+					if (Flips)
+					{
+						continue;
+					}
+
+					Target[c.From] = c.To;
+					if (Kind[c.From] == SimplifySeam)
+					{
+						Target[Wedge[c.From]] = SeamPartner(c.From, c.To);
+					}
+
+					// Lock the whole one-ring so later collapses in this pass see final positions.
+					for (unsigned int a = TriangleStart[gv]; a < TriangleStart[gv + 1]; a++)
+					{
+						const unsigned int* Tri = &Result[Adjacency[a] * 3];
+						Touched[Remap[Tri[0]]] = Touched[Remap[Tri[1]]] = Touched[Remap[Tri[2]]] = 1;
+					}
+					Touched[gv] = Touched[gu] = 1;
+
+					Quadrics[gu].Add(Quadrics[gv]);
+					ReachedError = max(ReachedError, c.Error);
+					Remaining -= min(Remaining, Removed);
+					Applied++;
+				}
+
+				if (Applied == 0)
+				{
+					break;
+				}
+
+				// Apply the collapses and drop the triangles that became degenerate.
+				size_t Write = 0;
+				for (size_t t = 0; t < TriangleCount; t++)
+				{
+					unsigned int a = Target[Result[t * 3]];
+					unsigned int b = Target[Result[t * 3 + 1]];
+					unsigned int c = Target[Result[t * 3 + 2]];
+
+					if (Remap[a] != Remap[b] && Remap[b] != Remap[c] && Remap[a] != Remap[c])
+					{
+						Result[Write++] = a;
+						Result[Write++] = b;
+						Result[Write++] = c;
+					}
+				}
+				Result.resize(Write);
+			}
+
+			Levels->push_back({ Result, sqrtf(ReachedError) });
+		}
+	}
+
+	// Single target form of SimplifyMeshLevels. Returns the error reached, relative to the
+	// mesh extent.
+	static float SimplifyMesh(const ObjectData& Mesh, const unsigned int* Indices, size_t IndexCount, size_t TargetIndexCount, float TargetError, vector<unsigned int>* Out)
+	{
+		vector<MeshLod> Levels;
+		SimplifyMeshLevels(Mesh, Indices, IndexCount, &TargetIndexCount, &TargetError, 1, &Levels);
+
+		Out->swap(Levels[0].Indices);
+		return Levels[0].Error;
+	}
+
+	// Builds successively coarser index lists for Mesh, each targeting Ratio times the
+	// triangles of the one before. The error budget (relative to the mesh extent) doubles
+	// per level up to MaxError, so meshes that cannot reach the triangle targets still get
+	// a gradual chain rather than one level at the full budget. Levels that are not
+	// meaningfully smaller than the last one kept are skipped. Lods does not include the
+	// full detail mesh.
+	static void BuildLodChain(const ObjectData& Mesh, vector<MeshLod>* Lods, unsigned int MaxLods = 4, float Ratio = 0.5f, float MaxError = 0.05f)
+	{
+		Lods->clear();
+
+		const vector<unsigned int>& Indices = Mesh.MeshIndecies;
+		if (Indices.empty())
+		{
+			return;
+		}
+
+		XMFLOAT3 Min = Mesh.MeshVerts[0].Position;
+		XMFLOAT3 Max = Mesh.MeshVerts[0].Position;
+		for (const ObjectVertices& v : Mesh.MeshVerts)
+		{
+			Min = XMFLOAT3(min(Min.x, v.Position.x), min(Min.y, v.Position.y), min(Min.z, v.Position.z));
+			Max = XMFLOAT3(max(Max.x, v.Position.x), max(Max.y, v.Position.y), max(Max.z, v.Position.z));
+		}
+		float Extent = max(Max.x - Min.x, max(Max.y - Min.y, Max.z - Min.z));
+
+		vector<size_t> Targets;
+		vector<float> Errors;
+		size_t Target = Indices.size() / 3;
+		for (unsigned int Level = 1; Level <= MaxLods; Level++)
+		{
+			Target = (size_t)(Target * Ratio);
+			Targets.push_back(Target * 3);
+			Errors.push_back(MaxError / (float)(1u << (MaxLods - Level)));
+		}
+
+		vector<MeshLod> Levels;
+		SimplifyMeshLevels(Mesh, Indices.data(), Indices.size(), Targets.data(), Errors.data(), Targets.size(), &Levels);
+
+		size_t PreviousCount = Indices.size();
+		for (MeshLod& Lod : Levels)
+		{
+			if (Lod.Indices.empty() || Lod.Indices.size() * 10 > PreviousCount * 9)
+			{
+				continue;
+			}
+
+			OptimizeVertexCache(Lod.Indices.data(), Lod.Indices.size(), Mesh.MeshVerts.size());
+
+			Lod.Error *= Extent;
+			PreviousCount = Lod.Indices.size();
+			Lods->push_back(std::move(Lod));
+		}
+	}
+}
@@ -0,0 +1,305 @@
+#pragma once
+#include "OBJModelLoader.h"
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <cfloat>
+
+// Meshlets are small clusters of triangles, stored as consecutive runs of an index list,
+// that can be culled one by one on the CPU: a bounding sphere for the frustum test and a
+// normal cone for the backface test.
+namespace DX11UWA
+{
+	static const unsigned int MeshletMaxVertices = 64;
+	static const unsigned int MeshletMaxTriangles = 124;
+
+	// Smallest cosine between a triangle normal and its meshlet's mean normal. Tighter
+	// cones cull more triangles as backfacing at the cost of smaller meshlets.
+	static const float MeshletMinNormalDot = 0.5f;
+
+	struct Meshlet
+	{
+		// Index range in the cooked index stream, and the submesh it draws with.
+		unsigned int IndexStart;
+		unsigned int IndexCount;
+		unsigned int Submesh;
+		unsigned int VertexCount;
+
+		XMFLOAT3 Center;
+		float Radius;
+
+		// Every triangle normal is within the cone around ConeAxis. The whole meshlet faces
+		// away from any viewpoint where the direction to the sphere lies within the cone
+		// by more than asin(ConeCutoff); a cutoff of 1 means it can never be backface culled.
+		XMFLOAT3 ConeAxis;
+		float ConeCutoff;
+	};
+
+	// Sphere and normal cone of the triangles Indices[0, IndexCount).
+	static void ComputeMeshletBounds(const unsigned int* Indices, size_t IndexCount, const char* Positions, size_t PositionStride, Meshlet* Out)
+	{
+		auto Position = [&](unsigned int v) -> const XMFLOAT3& { return *(const XMFLOAT3*)(Positions + PositionStride * v); };
+
+		XMFLOAT3 Min = { FLT_MAX, FLT_MAX, FLT_MAX };
+		XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		XMFLOAT3 Axis = { 0.0f, 0.0f, 0.0f };
+
+		for (size_t t = 0; t + 2 < IndexCount; t += 3)
+		{
+			const XMFLOAT3& p0 = Position(Indices[t]);
+			const XMFLOAT3& p1 = Position(Indices[t + 1]);
+			const XMFLOAT3& p2 = Position(Indices[t + 2]);
+
+			for (const XMFLOAT3* p : { &p0, &p1, &p2 })
+			{
+				Min = XMFLOAT3(min(Min.x, p->x), min(Min.y, p->y), min(Min.z, p->z));
+				Max = XMFLOAT3(max(Max.x, p->x), max(Max.y, p->y), max(Max.z, p->z));
+			}
+
+			XMVECTOR n = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&p1), XMLoadFloat3(&p0)), XMVectorSubtract(XMLoadFloat3(&p2), XMLoadFloat3(&p0)));
+
+			if (XMVectorGetX(XMVector3LengthSq(n)) > 0.0f)
+			{
+				XMFLOAT3 Normal;
+				XMStoreFloat3(&Normal, XMVector3Normalize(n));
+				Axis = XMFLOAT3(Axis.x + Normal.x, Axis.y + Normal.y, Axis.z + Normal.z);
+			}
+		}
+
+		Out->Center = XMFLOAT3(0.5f * (Min.x + Max.x), 0.5f * (Min.y + Max.y), 0.5f * (Min.z + Max.z));
+
+		XMVECTOR Center = XMLoadFloat3(&Out->Center);
+		float RadiusSq = 0.0f;
+		for (size_t i = 0; i < IndexCount; i++)
+		{
+			RadiusSq = max(RadiusSq, XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(XMLoadFloat3(&Position(Indices[i])), Center))));
+		}
+		Out->Radius = sqrtf(RadiusSq);
+
+		// Cone half angle from the normal furthest from the mean direction.
+		XMVECTOR ConeAxis = XMVector3Normalize(XMLoadFloat3(&Axis));
+		float MinDot = XMVectorGetX(XMVector3LengthSq(ConeAxis)) > 0.0f ? 1.0f : -1.0f;
+
+		for (size_t t = 0; t + 2 < IndexCount && MinDot > 0.0f; t += 3)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&Position(Indices[t]));
+			XMVECTOR n = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&Position(Indices[t + 1])), p0), XMVectorSubtract(XMLoadFloat3(&Position(Indices[t + 2])), p0));
+
+			if (XMVectorGetX(XMVector3LengthSq(n)) > 0.0f)
+			{
+				MinDot = min(MinDot, XMVectorGetX(XMVector3Dot(XMVector3Normalize(n), ConeAxis)));
+			}
+		}
+
+		XMStoreFloat3(&Out->ConeAxis, ConeAxis);
+		Out->ConeCutoff = MinDot <= 0.0f ? 1.0f : sqrtf(1.0f - MinDot * MinDot);
+	}
+
+	// Greedily grows meshlets over triangle adjacency and rewrites Indices in meshlet order.
+	// A meshlet starts at the first unassigned triangle in the current order (so the cache
+	// ordered stream still decides roughly where clusters go) and then takes the adjacent
+	// triangle that adds the fewest new vertices, breaking ties by how well its normal
+	// matches the meshlet's so far. Triangles further than MeshletMinNormalDot from the
+	// mean normal are left for another meshlet, keeping the cones narrow enough to cull.
+	// Positions are read PositionStride bytes apart, so both ObjectVertices and cooked
+	// vertices work. Meshlets are appended with IndexStart relative to Indices and
+	// Submesh left at 0.
+	static void BuildMeshlets(unsigned int* Indices, size_t IndexCount, const XMFLOAT3* Positions, size_t PositionStride, size_t VertexCount, vector<Meshlet>* Meshlets)
+	{
+		const char* PositionBytes = (const char*)Positions;
+		auto Position = [&](unsigned int v) -> XMVECTOR { return XMLoadFloat3((const XMFLOAT3*)(PositionBytes + PositionStride * v)); };
+
+		unsigned int TriangleCount = (unsigned int)(IndexCount / 3);
+
+		// Vertices split along hard edges or UV seams still neighbour each other, so
+		// adjacency is built over one representative vertex per position.
+		vector<unsigned int> Sorted(VertexCount);
+		for (unsigned int v = 0; v < VertexCount; v++) Sorted[v] = v;
+		sort(Sorted.begin(), Sorted.end(), [&](unsigned int a, unsigned int b)
+		{
+			const XMFLOAT3& p = *(const XMFLOAT3*)(PositionBytes + PositionStride * a);
+			const XMFLOAT3& q = *(const XMFLOAT3*)(PositionBytes + PositionStride * b);
+			if (p.x != q.x) return p.x < q.x;
+			if (p.y != q.y) return p.y < q.y;
+			return p.z < q.z;
+		});
+
+		vector<unsigned int> Welded(VertexCount);
+		for (size_t i = 0; i < VertexCount; i++)
+		{
+			const XMFLOAT3& p = *(const XMFLOAT3*)(PositionBytes + PositionStride * Sorted[i]);
+			const XMFLOAT3& q = *(const XMFLOAT3*)(PositionBytes + PositionStride * Sorted[i > 0 ? i - 1 : 0]);
+			Welded[Sorted[i]] = i > 0 && p.x == q.x && p.y == q.y && p.z == q.z ? Welded[Sorted[i - 1]] : Sorted[i];
+		}
+
+		// Welded vertex -> triangle adjacency.
+		vector<unsigned int> TriangleStart(VertexCount + 1, 0);
+		for (size_t i = 0; i < TriangleCount * 3; i++)
+		{
+			TriangleStart[Welded[Indices[i]] + 1]++;
+		}
+		for (size_t v = 0; v < VertexCount; v++)
+		{
+			TriangleStart[v + 1] += TriangleStart[v];
+		}
+
+		vector<unsigned int> Adjacency(TriangleCount * 3);
+		vector<unsigned int> Fill(TriangleStart.begin(), TriangleStart.end() - 1);
+		for (size_t i = 0; i < TriangleCount * 3; i++)
+		{
+			Adjacency[Fill[Welded[Indices[i]]]++] = (unsigned int)(i / 3);
+		}
+
+		vector<XMFLOAT3> Normals(TriangleCount);
+		for (unsigned int t = 0; t < TriangleCount; t++)
+		{
+			XMVECTOR p0 = Position(Indices[t * 3]);
+			XMVECTOR n = XMVector3Cross(XMVectorSubtract(Position(Indices[t * 3 + 1]), p0), XMVectorSubtract(Position(Indices[t * 3 + 2]), p0));
+			XMStoreFloat3(&Normals[t], XMVector3Normalize(n));
+		}
+
+		// Meshlet number + 1 that last used each vertex, or that last considered each triangle.
+		vector<unsigned int> UsedBy(VertexCount, 0);
+		vector<unsigned int> SeenBy(TriangleCount, 0);
+		vector<unsigned char> Emitted(TriangleCount, 0);
+		vector<unsigned int> Candidates;
+		vector<unsigned int> Ordered;
+		Ordered.reserve(TriangleCount * 3);
+
+		unsigned int Id = 0;
+		unsigned int Seed = 0;
+
+		while (Ordered.size() < TriangleCount * 3)
+		{
+			while (Emitted[Seed])
+			{
+				Seed++;
+			}
+
+			Id++;
+			Meshlet Current = {};
+			Current.IndexStart = (unsigned int)Ordered.size();
+			XMFLOAT3 Axis = { 0.0f, 0.0f, 0.0f };
+
+			Candidates.assign(1, Seed);
+			SeenBy[Seed] = Id;
+
+			for (;;)
+			{
+				// Best candidate: fewest new vertices, then closest normal.
+				size_t Best = Candidates.size();
+				float BestScore = FLT_MAX;
+				XMVECTOR AxisDirection = XMVector3Normalize(XMLoadFloat3(&Axis));
+				bool HasAxis = XMVectorGetX(XMVector3LengthSq(AxisDirection)) > 0.0f;
+
+				for (size_t c = 0; c < Candidates.size(); c++)
+				{
+					unsigned int t = Candidates[c];
+					unsigned int a = Indices[t * 3], b = Indices[t * 3 + 1], d = Indices[t * 3 + 2];
+					unsigned int NewVertices = (UsedBy[a] != Id) + (UsedBy[b] != Id && b != a) + (UsedBy[d] != Id && d != a && d != b);
+
+					if (Current.VertexCount + NewVertices > MeshletMaxVertices)
+					{
+						continue;
+					}
+
+					float Alignment = HasAxis ? XMVectorGetX(XMVector3Dot(XMLoadFloat3(&Normals[t]), AxisDirection)) : 1.0f;
+					if (Alignment < MeshletMinNormalDot)
+					{
+						continue;
+					}
+
+					float Score = NewVertices + (1.0f - Alignment);
+					if (Score < BestScore)
+					{
+						BestScore = Score;
+						Best = c;
+					}
+				}
+
+				if (Best == Candidates.size())
+				{
+					break;
+				}
+
+				unsigned int t = Candidates[Best];
+				Candidates[Best] = Candidates.back();
+				Candidates.pop_back();
+
+				Emitted[t] = 1;
+				Axis = XMFLOAT3(Axis.x + Normals[t].x, Axis.y + Normals[t].y, Axis.z + Normals[t].z);
+
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					unsigned int v = Indices[t * 3 + c];
+					Ordered.push_back(v);
+
+					if (UsedBy[v] != Id)
+					{
+						UsedBy[v] = Id;
+						Current.VertexCount++;
+
+						for (unsigned int k = TriangleStart[Welded[v]]; k < TriangleStart[Welded[v] + 1]; k++)
+						{
+							unsigned int Neighbour = Adjacency[k];
+							if (!Emitted[Neighbour] && SeenBy[Neighbour] != Id)
+							{
+								SeenBy[Neighbour] = Id;
+								Candidates.push_back(Neighbour);
+							}
+						}
+					}
+				}
+
+				Current.IndexCount += 3;
+				if (Current.IndexCount / 3 == MeshletMaxTriangles)
+				{
+					break;
+				}
+			}
+
+			ComputeMeshletBounds(Ordered.data() + Current.IndexStart, Current.IndexCount, PositionBytes, PositionStride, &Current);
+			Meshlets->push_back(Current);
+		}
+
+		memcpy(Indices, Ordered.data(), sizeof(unsigned int) * Ordered.size());
+	}
+
+	static void BuildMeshlets(ObjectData* Mesh, vector<Meshlet>* Meshlets)
+	{
+		Meshlets->clear();
+		if (Mesh->MeshVerts.empty())
+		{
+			return;
+		}
+
+		BuildMeshlets(Mesh->MeshIndecies.data(), Mesh->MeshIndecies.size(), &Mesh->MeshVerts[0].Position, sizeof(ObjectVertices), Mesh->MeshVerts.size(), Meshlets);
+	}
+
+	enum MeshletCullResult
+	{
+		MeshletVisible,
+		MeshletOutsideFrustum,
+		MeshletBackfacing,
+	};
+
+	// Planes from GetFrustumPlanes and the camera, both in the meshlet's object space.
+	// Backfacing assumes clockwise front faces with back face culling.
+	static MeshletCullResult CullMeshlet(const Meshlet& Cluster, const XMFLOAT4 Planes[6], const XMFLOAT3& CameraPosition)
+	{
+		const XMFLOAT3& c = Cluster.Center;
+
+		for (unsigned int p = 0; p < 6; p++)
+		{
+			if (Planes[p].x * c.x + Planes[p].y * c.y + Planes[p].z * c.z + Planes[p].w < -Cluster.Radius)
+			{
+				return MeshletOutsideFrustum;
+			}
+		}
+
+		XMFLOAT3 View = XMFLOAT3(c.x - CameraPosition.x, c.y - CameraPosition.y, c.z - CameraPosition.z);
+		float Distance = sqrtf(View.x * View.x + View.y * View.y + View.z * View.z);
+		float Along = View.x * Cluster.ConeAxis.x + View.y * Cluster.ConeAxis.y + View.z * Cluster.ConeAxis.z;
+
+		return Along >= Cluster.ConeCutoff * Distance + Cluster.Radius ? MeshletBackfacing : MeshletVisible;
+	}
+}
@@ -0,0 +1,78 @@
+// Per frame camera matrices, column-major.
+cbuffer ViewProjectionConstantBuffer : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+// Matches InstanceBatchSize in InstanceBatcher.h.
+#define INSTANCE_BATCH_SIZE 256
+
+// World matrices of a batch of instances, column-major. A batch binds only as many as it
+// has instances.
+cbuffer InstanceConstantBuffer : register(b2)
+{
+	matrix models[INSTANCE_BATCH_SIZE];
+};
+
+struct VertexShaderInput
+{
+	float3 pos : POSITION;
+	float3 uv : UV;
+	float3 norm : NORMAL;
+	float4 tan : TANGENT;
+};
+
+// Per-pixel color data passed through the pixel shader.
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 uv : UV;
+	float3 norm : NORMAL;
+	float3 tan : TANGENT;
+	float4 posWS : POSITIONWS;
+	float4x4 tbn : TBN;
+};
+
+// NormalTexturingVertexShader for instanced draws: the model matrix comes from the batch.
+PixelShaderInput main(VertexShaderInput input, uint instance : SV_InstanceID)
+{
+	PixelShaderInput output;
+	matrix model = models[instance];
+	float4 pos = float4(input.pos, 1.0f);
+
+	// Transform the vertex position into projected space.
+	pos = mul(pos, model);
+
+	output.posWS = pos;
+
+	pos = mul(pos, view);
+	pos = mul(pos, projection);
+	output.pos = pos;
+
+	// Pass the color through without modification.
+	output.uv = input.uv;
+
+	float3 normWS = input.norm;
+	normWS = mul(normWS, model);
+	//normWS = normalize(normWS);
+	output.norm = normWS;
+
+	float3 tanWS = input.tan.xyz;
+	tanWS = mul(tanWS, model);
+	//tanWS = normalize(tanWS);
+	output.tan = tanWS;
+
+	float3 bitWS = cross(normWS, tanWS) * input.tan.w;
+
+	float4x4 TBN = { tanWS.x, tanWS.y, tanWS.z, 0.0f,
+					bitWS.x, bitWS.y, bitWS.z, 0.0f,
+					normWS.x, normWS.y, normWS.z, 0.0f,
+					0.0f, 0.0f, 0.0f, 1.0f };
+
+	//TBN = transpose(TBN);
+
+	output.tbn = TBN;
+
+	return output;
+}
\ No newline at end of file
@@ -1,4 +1,3 @@
-#define LIGHT_AMOUNT 3
 #define DIR_LIGHT 0
 #define POINT_LIGHT 1
 #define SPOT_LIGHT 2
@@ -20,12 +19,32 @@ struct Lights
 	int4 padding;
 };
 
+// ClusterScale.xy are clusters per pixel and ClusterScale.zw the scale and bias that take
+// log view depth to a depth slice.
 cbuffer LightProp : register (b1)
 {
 	float4 CameraPos;
-	Lights LightArray[LIGHT_AMOUNT];
+	float4 ClusterScale;
+	uint4 ClusterCount;
+	uint4 LightSelection;
 }
 
+// When LightSelection.x is set, the draw's own strongest lights, picked on the CPU, instead
+// of its clusters'. Each index is in the x of its slot.
+#define OBJECT_LIGHTS 8
+cbuffer ObjectLights : register (b2)
+{
+	uint4 ObjectLightCount;
+	uint4 ObjectLightIndices[OBJECT_LIGHTS];
+}
+
+// Every light as LIGHT_SIZE uint4s, and for every cluster the offset and count of its run
+// of ClusterLightIndices. Typed buffers keep the shader at model 4.0.
+#define LIGHT_SIZE 8
+Buffer<uint4> SceneLights : register(t2);
+Buffer<uint2> ClusterLights : register(t3);
+Buffer<uint> ClusterLightIndices : register(t4);
+
 texture2D ModelTexture : register(t0);
 
 texture2D NormalMap : register(t1);
@@ -92,34 +111,88 @@ float4 Spot_Light(Lights light, float3 Norm, float4 SurfaceColor, float4 Positio
 	return result;
 }
 
-float4 TotalLighting(float4 WSPos, float3 Norm, float4 SurfaceColor)
+// The buffer is unsigned so the integer members keep their bits.
+Lights LoadLight(uint Index)
+{
+	uint Base = Index * LIGHT_SIZE;
+	uint4 Attenuation = SceneLights[Base + 4];
+	uint4 Falloff = SceneLights[Base + 5];
+	uint4 Flags = SceneLights[Base + 6];
+
+	Lights light;
+	light.pos = asfloat(SceneLights[Base]);
+	light.direction = asfloat(SceneLights[Base + 1]);
+	light.color = asfloat(SceneLights[Base + 2]);
+	light.angle = asfloat(SceneLights[Base + 3]);
+	light.angleratio = asfloat(Attenuation.xy);
+	light.C_att = asfloat(Attenuation.zw);
+	light.L_att = asfloat(Falloff.xy);
+	light.Q_att = asfloat(Falloff.zw);
+	light.type = asint(Flags.xy);
+	light.enabled = asint(Flags.zw);
+	light.padding = asint(SceneLights[Base + 7]);
+
+	return light;
+}
+
+// SV_POSITION holds the pixel in xy and the view depth in w.
+uint GetCluster(float4 ScreenPos)
+{
+	uint3 Cluster;
+	Cluster.xy = min((uint2)(ScreenPos.xy * ClusterScale.xy), ClusterCount.xy - 1);
+	Cluster.z = (uint)clamp(floor(log(ScreenPos.w) * ClusterScale.z + ClusterScale.w), 0.0f, ClusterCount.z - 1.0f);
+
+	return (Cluster.z * ClusterCount.y + Cluster.y) * ClusterCount.x + Cluster.x;
+}
+
+float4 TotalLighting(float4 ScreenPos, float4 WSPos, float3 Norm, float4 SurfaceColor)
 {
 	float3 view = normalize(CameraPos - WSPos).xyz;
 
 	float4 result = { 0.0f, 0.0f, 0.0f, 0.0f };
 
-	[unroll]
-	for (unsigned int i = 0; i < LIGHT_AMOUNT; i++)
+	// Only enabled lights are binned or selected.
+	bool Selected = LightSelection.x != 0;
+	uint2 Range = uint2(0, min(ObjectLightCount.x, OBJECT_LIGHTS));
+	[branch]
+	if (!Selected)
+	{
+		Range = ClusterLights[GetCluster(ScreenPos)];
+	}
+
+	[loop]
+	for (unsigned int i = 0; i < Range.y; i++)
 	{
 		float4 TempResult = { 0.0f, 0.0f, 0.0f, 0.0f };
 
-		if (LightArray[i].enabled.x == 0) continue;
+		uint Index;
+		[branch]
+		if (Selected)
+		{
+			Index = ObjectLightIndices[i].x;
+		}
+		else
+		{
+			Index = ClusterLightIndices[Range.x + i];
+		}
+
+		Lights light = LoadLight(Index);
 
-		switch (LightArray[i].type.x)
+		switch (light.type.x)
 		{
 		case DIR_LIGHT:
 		{
-			TempResult = Directional_Light(LightArray[i], Norm, SurfaceColor);
+			TempResult = Directional_Light(light, Norm, SurfaceColor);
 		}
 		break;
 		case POINT_LIGHT:
 		{
-			TempResult = Point_Light(LightArray[i], Norm, SurfaceColor, WSPos);
+			TempResult = Point_Light(light, Norm, SurfaceColor, WSPos);
 		}
 		break;
 		case SPOT_LIGHT:
 		{
-			TempResult = Spot_Light(LightArray[i], Norm, SurfaceColor, WSPos);
+			TempResult = Spot_Light(light, Norm, SurfaceColor, WSPos);
 		}
 		break;
 		}
@@ -142,7 +215,7 @@ float4 main(PixelShaderInput input) : SV_TARGET
 
 	Normal = mul(Normal, input.tbn);
 
-	float4 FinalColor = TotalLighting(input.posWS, normalize(Normal), Color);
+	float4 FinalColor = TotalLighting(input.pos, input.posWS, normalize(Normal), Color);
 
 	float4 Ambiance = { 0.30f, 0.30f, 0.30f, 1.0f };
 
@@ -1,17 +1,22 @@
-// A constant buffer that stores the three basic column-major matrices for composing geometry.
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+// Per frame camera matrices, column-major.
+cbuffer ViewProjectionConstantBuffer : register(b0)
 {
-	matrix model;
 	matrix view;
 	matrix projection;
 };
 
+// Per object world matrix, column-major.
+cbuffer ModelConstantBuffer : register(b2)
+{
+	matrix model;
+};
+
 struct VertexShaderInput
 {
 	float3 pos : POSITION;
 	float3 uv : UV;
 	float3 norm : NORMAL;
-	float3 tan : TANGENT;
+	float4 tan : TANGENT;
 };
 
 // Per-pixel color data passed through the pixel shader.
@@ -48,12 +53,12 @@ PixelShaderInput main(VertexShaderInput input)
 	//normWS = normalize(normWS);
 	output.norm = normWS;
 
-	float3 tanWS = input.tan;
+	float3 tanWS = input.tan.xyz;
 	tanWS = mul(tanWS, model);
 	//tanWS = normalize(tanWS);
 	output.tan = tanWS;
 
-	float3 bitWS = cross(normWS, tanWS);
+	float3 bitWS = cross(normWS, tanWS) * input.tan.w;
 
 	float4x4 TBN = { tanWS.x, tanWS.y, tanWS.z, 0.0f,
 					bitWS.x, bitWS.y, bitWS.z, 0.0f,
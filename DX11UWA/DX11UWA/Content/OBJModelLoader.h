@@ -2,11 +2,21 @@
 #pragma warning(disable : 4996)
 #include <vector>
 #include <fstream>
+#include <chrono>
+#include <climits>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 //#include "pch.h"
 #include "..\Common\StepTimer.h"
 #include "..\Common\DirectXHelper.h"
 #include "..\Common\DeviceResources.h"
+#include "..\Common\ParallelFor.h"
 #include "ShaderStructures.h"
+#include "BoundingVolumes.h"
 
 using namespace std;
 using namespace DirectX;
@@ -37,132 +47,752 @@ struct ObjectData
 {
 	vector<ObjectVertices> MeshVerts;
 	vector<unsigned int> MeshIndecies;
+	// Box and sphere around MeshVerts, filled in by the loader.
+	DX11UWA::MeshBounds Bounds = DX11UWA::EmptyMeshBounds();
 };
 
-static bool LoadOBJFile(const char* filepath, ObjectData* Mesh)
+// Timings and counts gathered while loading a mesh, reported after each load.
+struct ObjectLoadStats
 {
-	vector<unsigned int> TempVertIndies;
-	vector<unsigned int> TempUVIndies;
-	vector<unsigned int> TempNormalIndies;
-
-	vector<XMFLOAT3> TempVerts;
-	vector<XMFLOAT3> TempUVs;
-	vector<XMFLOAT3> TempNormals;
+	unsigned int Corners = 0;
+	unsigned int Vertices = 0;
+	unsigned int Indices = 0;
+	unsigned int Threads = 1;
+	unsigned int Chunks = 1;
+	size_t FileBytes = 0;
+	double ParseSeconds = 0.0;
+	double WeldSeconds = 0.0;
+	double BoundsSeconds = 0.0;
+
+	// Text parsed per second, in megabytes.
+	double ParseRate() const
+	{
+		return ParseSeconds > 0.0 ? FileBytes / ParseSeconds / 1000000.0 : 0.0;
+	}
 
-	FILE* objFile = fopen(filepath, "r");
-	if (objFile == NULL)
+	// Face corners welded per second.
+	double WeldRate() const
 	{
-		return false;
+		return WeldSeconds > 0.0 ? Corners / WeldSeconds : 0.0;
 	}
+};
 
-	while (true)
+static void ReportLoadStats(const char* name, const ObjectLoadStats& stats)
+{
+	char Line[256];
+	sprintf_s(Line, "%s: parse %.3f ms (%.0f MB/s, %u threads, %u chunks), %u corners -> %u vertices, %u indices, weld %.3f ms (%.1f M corners/s), sphere %.3f ms\n",
+		name, stats.ParseSeconds * 1000.0, stats.ParseRate(), stats.Threads, stats.Chunks, stats.Corners, stats.Vertices, stats.Indices,
+		stats.WeldSeconds * 1000.0, stats.WeldRate() / 1000000.0, stats.BoundsSeconds * 1000.0);
+	OutputDebugStringA(Line);
+}
+
+// Open-addressing hash table that maps a (position, uv, normal) index triple
+// to the unique vertex built for it, so welding is O(n) in the corner count.
+struct VertexWeldTable
+{
+	struct Slot
 	{
-		char FileHeader[128];
+		unsigned int Position;
+		unsigned int UV;
+		unsigned int Normal;
+		unsigned int Index;
+	};
 
-		int fword = fscanf(objFile, "%s", FileHeader);
+	static const unsigned int EmptySlot = 0xFFFFFFFF;
 
-		if (fword == EOF)
+	vector<Slot> Slots;
+	unsigned int Mask;
+
+	VertexWeldTable(unsigned int expectedCount)
+	{
+		// Keep the load factor at or below one half. The doubled count is taken in
+		// size_t and clamped to the largest power of two the 32-bit mask can address.
+		const size_t MaxCapacity = (size_t)1 << 31;
+		size_t Wanted = min((size_t)expectedCount * 2, MaxCapacity);
+		size_t Capacity = 16;
+		while (Capacity < Wanted)
 		{
-			break;
+			Capacity <<= 1;
 		}
 
-		if (strcmp(FileHeader, "v") == 0)
+		Slot Empty = { 0, 0, 0, EmptySlot };
+		Slots.assign(Capacity, Empty);
+		Mask = (unsigned int)(Capacity - 1);
+	}
+
+	static unsigned int Hash(unsigned int p, unsigned int t, unsigned int n)
+	{
+		unsigned int h = p * 0x9E3779B1u;
+		h ^= t * 0x85EBCA77u;
+		h ^= n * 0xC2B2AE3Du;
+		h ^= h >> 15;
+		h *= 0x2C1B3C6Du;
+		h ^= h >> 13;
+		return h;
+	}
+
+	// Returns the index already assigned to the triple, or stores and returns nextIndex.
+	unsigned int FindOrInsert(unsigned int p, unsigned int t, unsigned int n, unsigned int nextIndex)
+	{
+		unsigned int i = Hash(p, t, n) & Mask;
+
+		while (true)
 		{
-			XMFLOAT3 tempVertex;
+			Slot& s = Slots[i];
 
-			fscanf(objFile, "%f %f %f\n", &tempVertex.x, &tempVertex.y, &tempVertex.z);
+			if (s.Index == EmptySlot)
+			{
+				s.Position = p;
+				s.UV = t;
+				s.Normal = n;
+				s.Index = nextIndex;
+				return nextIndex;
+			}
 
-			TempVerts.push_back(tempVertex);
+			if (s.Position == p && s.UV == t && s.Normal == n)
+			{
+				return s.Index;
+			}
+
+			i = (i + 1) & Mask;
 		}
+	}
+};
 
-		else if (strcmp(FileHeader, "vt") == 0)
+// Read-only view of a whole file mapped into memory.
+struct MappedFile
+{
+	const char* Data = nullptr;
+	size_t Size = 0;
+
+#if defined(_WIN32)
+	HANDLE File = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = NULL;
+#else
+	int File = -1;
+#endif
+
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	bool Open(const char* filepath)
+	{
+		Close();
+
+#if defined(_WIN32)
+		wchar_t WidePath[MAX_PATH];
+		if (MultiByteToWideChar(CP_UTF8, 0, filepath, -1, WidePath, MAX_PATH) == 0)
 		{
-			XMFLOAT3 tempUV;
+			return false;
+		}
 
-			fscanf(objFile, "%f %f\n", &tempUV.x, &tempUV.y);
+		File = CreateFile2(WidePath, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+		if (File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
 
-			TempUVs.push_back(tempUV);
+		FILE_STANDARD_INFO FileInfo;
+		if (!GetFileInformationByHandleEx(File, FileStandardInfo, &FileInfo, sizeof(FileInfo)))
+		{
+			return false;
 		}
 
-		else if (strcmp(FileHeader, "vn") == 0)
+		Size = (size_t)FileInfo.EndOfFile.QuadPart;
+		if (Size == 0)
 		{
-			XMFLOAT3 tempNormal;
+			return true;
+		}
 
-			fscanf(objFile, "%f %f %f\n", &tempNormal.x, &tempNormal.y, &tempNormal.z);
+		Mapping = CreateFileMappingFromApp(File, nullptr, PAGE_READONLY, 0, nullptr);
+		if (Mapping == NULL)
+		{
+			return false;
+		}
 
-			TempNormals.push_back(tempNormal);
+		Data = (const char*)MapViewOfFileFromApp(Mapping, FILE_MAP_READ, 0, 0);
+#else
+		File = open(filepath, O_RDONLY);
+		if (File < 0)
+		{
+			return false;
 		}
 
-		else if (strcmp(FileHeader, "f") == 0)
+		struct stat FileInfo;
+		if (fstat(File, &FileInfo) != 0)
+		{
+			return false;
+		}
+
+		Size = (size_t)FileInfo.st_size;
+		if (Size == 0)
+		{
+			return true;
+		}
+
+		void* View = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, File, 0);
+		Data = View == MAP_FAILED ? nullptr : (const char*)View;
+#endif
+		return Data != nullptr;
+	}
+
+	void Close()
+	{
+#if defined(_WIN32)
+		if (Data != nullptr) UnmapViewOfFile(Data);
+		if (Mapping != NULL) CloseHandle(Mapping);
+		if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+		Mapping = NULL;
+		File = INVALID_HANDLE_VALUE;
+#else
+		if (Data != nullptr) munmap((void*)Data, Size);
+		if (File >= 0) close(File);
+		File = -1;
+#endif
+		Data = nullptr;
+		Size = 0;
+	}
+};
+
+// One face corner as 1-based indices into the position, uv and normal lists.
+struct OBJCorner
+{
+	int Position;
+	int UV;
+	int Normal;
+
+	// Bit c is set when component c came from a negative OBJ index. Such indices are
+	// stored relative to the start of the parsed range and must be offset by the
+	// element counts of all preceding ranges when ranges are merged.
+	unsigned int Relative;
+};
+
+// Raw records of an OBJ file (or a line-aligned chunk of one) before welding.
+struct OBJRecords
+{
+	vector<XMFLOAT3> Verts;
+	vector<XMFLOAT3> UVs;
+	vector<XMFLOAT3> Normals;
+	vector<OBJCorner> Corners;
+};
+
+static inline bool IsOBJSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* SkipOBJSpace(const char* p, const char* end)
+{
+	while (p < end && IsOBJSpace(*p)) p++;
+	return p;
+}
+
+static inline const char* SkipOBJLine(const char* p, const char* end)
+{
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+// Locale-independent decimal float parser. Digits are gathered into an integer
+// mantissa and scaled once by an exact power of ten, which matches strtof for
+// the short fixed-point values exporters write.
+static inline const char* ParseOBJFloat(const char* p, const char* end, float* out)
+{
+	static const double Pow10[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	p = SkipOBJSpace(p, end);
+
+	bool Negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		Negative = *p == '-';
+		p++;
+	}
+
+	// Digits past what fits in the mantissa only shift the exponent.
+	const unsigned long long MantissaLimit = 100000000000000000ULL;
+
+	unsigned long long Mantissa = 0;
+	int Exponent = 0;
+	const char* Start = p;
+
+	while (p < end && (unsigned)(*p - '0') < 10)
+	{
+		if (Mantissa < MantissaLimit) Mantissa = Mantissa * 10 + (*p - '0');
+		else Exponent++;
+		p++;
+	}
+
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && (unsigned)(*p - '0') < 10)
 		{
-			unsigned int vertIndex[3];
-			unsigned int uvIndex[3];
-			unsigned int normalIndex[3];
+			if (Mantissa < MantissaLimit) { Mantissa = Mantissa * 10 + (*p - '0'); Exponent--; }
+			p++;
+		}
+	}
+
+	if (p == Start)
+	{
+		return nullptr;
+	}
 
-			int Indexes = fscanf(objFile, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertIndex[0], &uvIndex[0],
-				&normalIndex[0], &vertIndex[1], &uvIndex[1], &normalIndex[1],
-				&vertIndex[2], &uvIndex[2], &normalIndex[2]);
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool NegativeExp = false;
+		if (q < end && (*q == '-' || *q == '+'))
+		{
+			NegativeExp = *q == '-';
+			q++;
+		}
 
-			if (Indexes != 9)
+		if (q < end && (unsigned)(*q - '0') < 10)
+		{
+			int Exp = 0;
+			while (q < end && (unsigned)(*q - '0') < 10)
 			{
-				return false;
+				if (Exp < 10000) Exp = Exp * 10 + (*q - '0');
+				q++;
 			}
+			Exponent += NegativeExp ? -Exp : Exp;
+			p = q;
+		}
+	}
 
-			TempVertIndies.push_back(vertIndex[0]);
-			TempVertIndies.push_back(vertIndex[1]);
-			TempVertIndies.push_back(vertIndex[2]);
+	double Value = (double)Mantissa;
+	if (Mantissa != 0)
+	{
+		if (Exponent < 0)
+		{
+			while (Exponent < -22) { Value /= 1e22; Exponent += 22; }
+			Value /= Pow10[-Exponent];
+		}
+		else
+		{
+			while (Exponent > 22) { Value *= 1e22; Exponent -= 22; }
+			Value *= Pow10[Exponent];
+		}
+	}
 
-			TempUVIndies.push_back(uvIndex[0]);
-			TempUVIndies.push_back(uvIndex[1]);
-			TempUVIndies.push_back(uvIndex[2]);
+	*out = (float)(Negative ? -Value : Value);
+	return p;
+}
+
+static inline const char* ParseOBJIndex(const char* p, const char* end, int* out)
+{
+	bool Negative = false;
+	if (p < end && *p == '-')
+	{
+		Negative = true;
+		p++;
+	}
 
-			TempNormalIndies.push_back(normalIndex[0]);
-			TempNormalIndies.push_back(normalIndex[1]);
-			TempNormalIndies.push_back(normalIndex[2]);
+	const char* Start = p;
+	int Value = 0;
+	while (p < end && (unsigned)(*p - '0') < 10)
+	{
+		// Reject indices past INT_MAX rather than letting them wrap to a valid-looking value.
+		int Digit = *p - '0';
+		if (Value > (INT_MAX - Digit) / 10)
+		{
+			return nullptr;
 		}
+
+		Value = Value * 10 + Digit;
+		p++;
 	}
 
-	for (unsigned int i = 0; i < TempVertIndies.size(); i++)
+	if (p == Start)
 	{
-		unsigned int vertexIn = TempVertIndies[i];
-		unsigned int uvIndex = TempUVIndies[i];
-		unsigned int normalIndex = TempNormalIndies[i];
+		return nullptr;
+	}
+
+	*out = Negative ? -Value : Value;
+	return p;
+}
+
+// Parses one "v/vt/vn" face corner.
+static inline const char* ParseOBJCorner(const char* p, const char* end, OBJCorner* out)
+{
+	p = ParseOBJIndex(p, end, &out->Position);
+	if (p == nullptr || p >= end || *p != '/') return nullptr;
+	p = ParseOBJIndex(p + 1, end, &out->UV);
+	if (p == nullptr || p >= end || *p != '/') return nullptr;
+	return ParseOBJIndex(p + 1, end, &out->Normal);
+}
+
+// Tokenizes [begin, end) in place and appends its v/vt/vn/f records.
+// Polygons are fan-triangulated. Returns false on a malformed face.
+static bool ParseOBJRange(const char* begin, const char* end, OBJRecords* Records)
+{
+	const char* p = begin;
 
-		ObjectVertices temp;
+	while (p < end)
+	{
+		p = SkipOBJSpace(p, end);
+		if (p >= end) break;
 
-		XMFLOAT3 vert = TempVerts[vertexIn - 1];
-		XMFLOAT3 uv = TempUVs[uvIndex - 1];
-		XMFLOAT3 normal = TempNormals[normalIndex - 1];
+		const char* Next = SkipOBJLine(p, end);
 
-		temp.Position = vert;
-		temp.UVW = uv;
-		temp.UVW.z = 0.0;
-		temp.Normals = normal;
+		if (p[0] == 'v' && p + 1 < end && IsOBJSpace(p[1]))
+		{
+			XMFLOAT3 tempVertex;
+			const char* q = ParseOBJFloat(p + 1, Next, &tempVertex.x);
+			if (q) q = ParseOBJFloat(q, Next, &tempVertex.y);
+			if (q) q = ParseOBJFloat(q, Next, &tempVertex.z);
+			if (q == nullptr) return false;
 
-		if (Mesh->MeshVerts.size() == 0)
+			Records->Verts.push_back(tempVertex);
+		}
+		else if (p[0] == 'v' && p + 2 < end && p[1] == 't' && IsOBJSpace(p[2]))
 		{
-			Mesh->MeshVerts.push_back(temp);
-			Mesh->MeshIndecies.push_back(0);
+			XMFLOAT3 tempUV = { 0.0f, 0.0f, 0.0f };
+			const char* q = ParseOBJFloat(p + 2, Next, &tempUV.x);
+			if (q) q = ParseOBJFloat(q, Next, &tempUV.y);
+			if (q == nullptr) return false;
+
+			Records->UVs.push_back(tempUV);
 		}
-		else
+		else if (p[0] == 'v' && p + 2 < end && p[1] == 'n' && IsOBJSpace(p[2]))
+		{
+			XMFLOAT3 tempNormal;
+			const char* q = ParseOBJFloat(p + 2, Next, &tempNormal.x);
+			if (q) q = ParseOBJFloat(q, Next, &tempNormal.y);
+			if (q) q = ParseOBJFloat(q, Next, &tempNormal.z);
+			if (q == nullptr) return false;
+
+			Records->Normals.push_back(tempNormal);
+		}
+		else if (p[0] == 'f' && p + 1 < end && IsOBJSpace(p[1]))
 		{
-			for (unsigned int j = 0; j < Mesh->MeshVerts.size(); j++)
+			OBJCorner First, Previous, Current;
+			int CornerCount = 0;
+			const char* q = SkipOBJSpace(p + 1, Next);
+
+			while (q < Next && *q != '\n' && *q != '#')
 			{
-				if (Mesh->MeshVerts[j] == temp)
+				q = ParseOBJCorner(q, Next, &Current);
+				if (q == nullptr) return false;
+
+				// Negative indices count back from the records parsed so far.
+				int* Components[3] = { &Current.Position, &Current.UV, &Current.Normal };
+				size_t Counts[3] = { Records->Verts.size(), Records->UVs.size(), Records->Normals.size() };
+				Current.Relative = 0;
+				for (unsigned int c = 0; c < 3; c++)
 				{
-					Mesh->MeshIndecies.push_back(j);
-					break;
+					if (*Components[c] < 0)
+					{
+						*Components[c] += (int)Counts[c] + 1;
+						Current.Relative |= 1u << c;
+					}
 				}
-				else
-				{
-						Mesh->MeshIndecies.push_back(Mesh->MeshVerts.size());
-						Mesh->MeshVerts.push_back(temp);
 
-						break;
+				if (CornerCount == 0) First = Current;
+				else if (CornerCount >= 2)
+				{
+					Records->Corners.push_back(First);
+					Records->Corners.push_back(Previous);
+					Records->Corners.push_back(Current);
 				}
+
+				Previous = Current;
+				CornerCount++;
+				q = SkipOBJSpace(q, Next);
 			}
+
+			if (CornerCount < 3) return false;
+		}
+
+		p = Next;
+	}
+
+	return true;
+}
+
+// Converts a 1-based OBJ index to a 0-based one. Returns false if out of range.
+static inline bool ResolveOBJIndex(int index, size_t count, unsigned int* out)
+{
+	if (index <= 0 || (size_t)index > count)
+	{
+		return false;
+	}
+
+	*out = (unsigned int)(index - 1);
+	return true;
+}
+
+// Parses the file in line-aligned chunks on up to ThreadCount threads and merges the
+// chunks in file order, so the records match a serial ParseOBJRange exactly.
+static bool ParseOBJParallel(const char* begin, const char* end, unsigned int ThreadCount, OBJRecords* Records, unsigned int* ChunkCountOut = nullptr)
+{
+	const size_t MinChunkBytes = 64 * 1024;
+
+	ThreadCount = DX::ResolveWorkerCount(ThreadCount);
+
+	// A few chunks per thread keeps the threads busy when line density varies.
+	size_t Size = end - begin;
+	size_t ChunkCount = ThreadCount > 1 ? ThreadCount * 4 : 1;
+	if (ChunkCount > 1 && Size / ChunkCount < MinChunkBytes)
+	{
+		ChunkCount = Size / MinChunkBytes > 1 ? Size / MinChunkBytes : 1;
+	}
+
+	if (ChunkCountOut != nullptr)
+	{
+		*ChunkCountOut = (unsigned int)ChunkCount;
+	}
+
+	if (ChunkCount == 1)
+	{
+		return ParseOBJRange(begin, end, Records);
+	}
+
+	vector<const char*> Bounds(ChunkCount + 1);
+	Bounds[0] = begin;
+	Bounds[ChunkCount] = end;
+	for (size_t i = 1; i < ChunkCount; i++)
+	{
+		const char* Split = begin + Size * i / ChunkCount;
+		Split = Split > Bounds[i - 1] ? SkipOBJLine(Split, end) : Bounds[i - 1];
+		Bounds[i] = Split;
+	}
+
+	vector<OBJRecords> Chunks(ChunkCount);
+	vector<unsigned char> ChunkOk(ChunkCount, 0);
+
+	DX::ParallelFor((unsigned int)ChunkCount, ThreadCount, [&](unsigned int i)
+	{
+		ChunkOk[i] = ParseOBJRange(Bounds[i], Bounds[i + 1], &Chunks[i]);
+	});
+
+	for (size_t i = 0; i < ChunkCount; i++)
+	{
+		if (!ChunkOk[i])
+		{
+			return false;
+		}
+	}
+
+	// Element offsets of each chunk in the merged lists.
+	struct ChunkBase
+	{
+		size_t Verts, UVs, Normals, Corners;
+	};
+
+	vector<ChunkBase> Bases(ChunkCount + 1);
+	Bases[0] = { 0, 0, 0, 0 };
+	for (size_t i = 0; i < ChunkCount; i++)
+	{
+		Bases[i + 1].Verts = Bases[i].Verts + Chunks[i].Verts.size();
+		Bases[i + 1].UVs = Bases[i].UVs + Chunks[i].UVs.size();
+		Bases[i + 1].Normals = Bases[i].Normals + Chunks[i].Normals.size();
+		Bases[i + 1].Corners = Bases[i].Corners + Chunks[i].Corners.size();
+	}
+
+	Records->Verts.resize(Bases[ChunkCount].Verts);
+	Records->UVs.resize(Bases[ChunkCount].UVs);
+	Records->Normals.resize(Bases[ChunkCount].Normals);
+	Records->Corners.resize(Bases[ChunkCount].Corners);
+
+	DX::ParallelFor((unsigned int)ChunkCount, ThreadCount, [&](unsigned int i)
+	{
+		const OBJRecords& Chunk = Chunks[i];
+		const ChunkBase& Base = Bases[i];
+
+		copy(Chunk.Verts.begin(), Chunk.Verts.end(), Records->Verts.begin() + Base.Verts);
+		copy(Chunk.UVs.begin(), Chunk.UVs.end(), Records->UVs.begin() + Base.UVs);
+		copy(Chunk.Normals.begin(), Chunk.Normals.end(), Records->Normals.begin() + Base.Normals);
+
+		OBJCorner* Out = Records->Corners.data() + Base.Corners;
+		for (size_t c = 0; c < Chunk.Corners.size(); c++)
+		{
+			OBJCorner Corner = Chunk.Corners[c];
+			if (Corner.Relative != 0)
+			{
+				if (Corner.Relative & 1) Corner.Position += (int)Base.Verts;
+				if (Corner.Relative & 2) Corner.UV += (int)Base.UVs;
+				if (Corner.Relative & 4) Corner.Normal += (int)Base.Normals;
+				Corner.Relative = 0;
+			}
+			Out[c] = Corner;
+		}
+	});
+
+	return true;
+}
+
+// Welds the parsed corners into unique vertices and an index list, and bounds the mesh:
+// the box grows as each vertex is created and the sphere takes one more pass at the end.
+static bool WeldOBJRecords(const OBJRecords& Records, ObjectData* Mesh, ObjectLoadStats* Stats)
+{
+	auto WeldStart = chrono::high_resolution_clock::now();
+
+	unsigned int CornerCount = (unsigned int)Records.Corners.size();
+
+	Mesh->MeshVerts.reserve(CornerCount);
+	Mesh->MeshIndecies.reserve(CornerCount);
+
+	VertexWeldTable WeldTable(CornerCount);
+
+	XMVECTOR BoundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR BoundsMax = XMVectorReplicate(-FLT_MAX);
+
+	for (unsigned int i = 0; i < CornerCount; i++)
+	{
+		const OBJCorner& Corner = Records.Corners[i];
+
+		unsigned int vertexIn, uvIndex, normalIndex;
+		if (!ResolveOBJIndex(Corner.Position, Records.Verts.size(), &vertexIn) ||
+			!ResolveOBJIndex(Corner.UV, Records.UVs.size(), &uvIndex) ||
+			!ResolveOBJIndex(Corner.Normal, Records.Normals.size(), &normalIndex))
+		{
+			return false;
 		}
+
+		unsigned int NextIndex = (unsigned int)Mesh->MeshVerts.size();
+		unsigned int WeldedIndex = WeldTable.FindOrInsert(vertexIn, uvIndex, normalIndex, NextIndex);
+
+		if (WeldedIndex == NextIndex)
+		{
+			ObjectVertices temp;
+
+			temp.Position = Records.Verts[vertexIn];
+			temp.UVW = Records.UVs[uvIndex];
+			temp.UVW.z = 0.0;
+			temp.Normals = Records.Normals[normalIndex];
+
+			XMVECTOR Position = XMLoadFloat3(&temp.Position);
+			BoundsMin = XMVectorMin(BoundsMin, Position);
+			BoundsMax = XMVectorMax(BoundsMax, Position);
+
+			Mesh->MeshVerts.push_back(temp);
+		}
+
+		Mesh->MeshIndecies.push_back(WeldedIndex);
+	}
+
+	auto WeldEnd = chrono::high_resolution_clock::now();
+
+	Mesh->Bounds = DX11UWA::EmptyMeshBounds();
+	if (!Mesh->MeshVerts.empty())
+	{
+		XMStoreFloat3(&Mesh->Bounds.Min, BoundsMin);
+		XMStoreFloat3(&Mesh->Bounds.Max, BoundsMax);
+		DX11UWA::ComputeBoundingSphere((const char*)&Mesh->MeshVerts[0].Position, sizeof(ObjectVertices), Mesh->MeshVerts.size(), &Mesh->Bounds.Center, &Mesh->Bounds.Radius);
 	}
 
+	if (Stats != nullptr)
+	{
+		Stats->Corners = CornerCount;
+		Stats->Vertices = (unsigned int)Mesh->MeshVerts.size();
+		Stats->Indices = (unsigned int)Mesh->MeshIndecies.size();
+		Stats->WeldSeconds = chrono::duration<double>(WeldEnd - WeldStart).count();
+		Stats->BoundsSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - WeldEnd).count();
+	}
+
+	return true;
+}
+
+// Parses OBJ text that is already in memory. ThreadCount > 1 (or 0 for every hardware
+// thread) parses line-aligned chunks in parallel; the result is identical to the serial path.
+static bool LoadOBJData(const char* data, size_t size, ObjectData* Mesh, ObjectLoadStats* Stats = nullptr, unsigned int ThreadCount = 1)
+{
+	auto ParseStart = chrono::high_resolution_clock::now();
+
+	OBJRecords Records;
+	unsigned int ChunkCount = 1;
+	if (!ParseOBJParallel(data, data + size, ThreadCount, &Records, &ChunkCount))
+	{
+		return false;
+	}
+
+	if (Stats != nullptr)
+	{
+		Stats->Threads = DX::ResolveWorkerCount(ThreadCount);
+		Stats->Chunks = ChunkCount;
+		Stats->FileBytes = size;
+		Stats->ParseSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - ParseStart).count();
+	}
+
+	return WeldOBJRecords(Records, Mesh, Stats);
+}
+
+// Loads a triangulated OBJ file. See LoadOBJData for ThreadCount.
+static bool LoadOBJFile(const char* filepath, ObjectData* Mesh, ObjectLoadStats* Stats = nullptr, unsigned int ThreadCount = 1)
+{
+	MappedFile objFile;
+	if (!objFile.Open(filepath))
+	{
+		return false;
+	}
+
+	return LoadOBJData(objFile.Data, objFile.Size, Mesh, Stats, ThreadCount);
+}
+
+// Loads the file with 1 to 16 threads and reports the parse throughput of each run.
+static void ReportOBJImportScaling(const char* filepath)
+{
+	for (unsigned int Threads = 1; Threads <= 16; Threads *= 2)
+	{
+		ObjectData Mesh;
+		ObjectLoadStats Stats;
+		if (!LoadOBJFile(filepath, &Mesh, &Stats, Threads))
+		{
+			return;
+		}
+
+		ReportLoadStats(filepath, Stats);
+	}
+}
+
+// Times the single-threaded tokenizer alone over the mapped file, keeping the best of
+// Repeats runs, and reports its throughput against TargetRate megabytes per second.
+// Returns false when the file cannot be mapped or parsed.
+static bool ReportOBJParseThroughput(const char* filepath, double TargetRate = 500.0, unsigned int Repeats = 5)
+{
+	MappedFile objFile;
+	if (!objFile.Open(filepath))
+	{
+		return false;
+	}
+
+	double Best = 0.0;
+	size_t Corners = 0;
+	for (unsigned int r = 0; r < Repeats; r++)
+	{
+		OBJRecords Records;
+		unsigned int ChunkCount = 1;
+		auto Start = chrono::high_resolution_clock::now();
+		if (!ParseOBJParallel(objFile.Data, objFile.Data + objFile.Size, 1, &Records, &ChunkCount))
+		{
+			return false;
+		}
+
+		double Seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - Start).count();
+		if (r == 0 || Seconds < Best)
+		{
+			Best = Seconds;
+		}
+		Corners = Records.Corners.size();
+	}
+
+	double Rate = Best > 0.0 ? objFile.Size / Best / 1000000.0 : 0.0;
+
+	char Line[256];
+	sprintf_s(Line, "%s: single-thread parse %.3f ms for %.1f MB, %zu corners, %.0f MB/s (target %.0f MB/s, %s)\n",
+		filepath, Best * 1000.0, objFile.Size / 1000000.0, Corners, Rate, TargetRate, Rate >= TargetRate ? "met" : "missed");
+	OutputDebugStringA(Line);
 	return true;
 }
@@ -0,0 +1,854 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#if defined(_XM_AVX_INTRINSICS_)
+#include <immintrin.h>
+#elif defined(_XM_SSE_INTRINSICS_)
+#include <xmmintrin.h>
+#endif
+#include "../Common/ParallelFor.h"
+#include "BoundingVolumes.h"
+#include "ReportOutput.h"
+
+// Masked software occlusion culling (Andersson et al., "Masked Software Occlusion Culling").
+// Occluder triangles are rasterized on the CPU into a small depth buffer of 8x4 pixel
+// tiles. Instead of a depth per pixel, a tile keeps a coverage mask and two far depth
+// bounds, one for the whole tile and one for the pixels in the mask, which keeps it
+// conservative however the triangles overlap. Object boxes are then tested tile by tile.
+// Nothing here touches Direct3D, so the buffer can be rendered and checked headless.
+namespace DX11UWA
+{
+	static const unsigned int OcclusionTileWidth = 8;
+	static const unsigned int OcclusionTileHeight = 4;
+	static const unsigned int OcclusionFullMask = 0xFFFFFFFFu;
+
+	// Tile rows per rasterization job. Each job owns its rows, so threads never share a tile.
+	static const unsigned int OcclusionBandRows = 2;
+
+	// Triangles per setup job.
+	static const unsigned int OcclusionSetupBatch = 1024;
+
+	struct OcclusionTile
+	{
+		// Farthest depth of any pixel in the tile.
+		float Z0;
+		// Farthest depth of the pixels in Mask.
+		float Z1;
+		// Bit y * 8 + x is pixel (x, y) of the tile.
+		unsigned int Mask;
+	};
+
+	// A triangle list drawn into the occlusion buffer.
+	struct OccluderMesh
+	{
+		std::vector<DirectX::XMFLOAT3> Positions;
+		std::vector<unsigned int> Indices;
+	};
+
+	struct OccluderDraw
+	{
+		const OccluderMesh* Mesh;
+		DirectX::XMFLOAT4X4 WorldViewProjection;
+	};
+
+	// A clipped, projected triangle ready to rasterize.
+	struct OcclusionTriangle
+	{
+		// Edge functions a x + b y + c, positive inside.
+		float EdgeA[3];
+		float EdgeB[3];
+		float EdgeC[3];
+		// Depth plane z = a x + b y + c and the vertex depth range.
+		float DepthA;
+		float DepthB;
+		float DepthC;
+		float ZMin;
+		float ZMax;
+		unsigned short TileX0;
+		unsigned short TileX1;
+		unsigned short TileY0;
+		unsigned short TileY1;
+	};
+
+	enum OcclusionPath
+	{
+		OcclusionScalar,
+		OcclusionSSE,
+		OcclusionAVX,
+	};
+
+#if defined(_XM_AVX_INTRINSICS_)
+	static const OcclusionPath OcclusionBest = OcclusionAVX;
+#elif defined(_XM_SSE_INTRINSICS_)
+	static const OcclusionPath OcclusionBest = OcclusionSSE;
+#else
+	static const OcclusionPath OcclusionBest = OcclusionScalar;
+#endif
+
+	// Pixels of the tile at PixelX, PixelY whose centres are inside the triangle. Every path
+	// evaluates a x + (b y + c) in the same order, so they agree bit for bit.
+	static unsigned int GetTileCoverage(const OcclusionTriangle& Triangle, unsigned int PixelX, unsigned int PixelY, OcclusionPath Path)
+	{
+		float x0 = (float)PixelX + 0.5f;
+		float y0 = (float)PixelY + 0.5f;
+		unsigned int Mask = 0;
+
+		switch (Path)
+		{
+#if defined(_XM_AVX_INTRINSICS_)
+		case OcclusionAVX:
+		{
+			__m256 x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+			__m256 a[3], b[3], c[3];
+			for (unsigned int e = 0; e < 3; e++)
+			{
+				a[e] = _mm256_mul_ps(_mm256_set1_ps(Triangle.EdgeA[e]), x);
+				b[e] = _mm256_set1_ps(Triangle.EdgeB[e]);
+				c[e] = _mm256_set1_ps(Triangle.EdgeC[e]);
+			}
+
+			for (unsigned int Row = 0; Row < OcclusionTileHeight; Row++)
+			{
+				__m256 y = _mm256_set1_ps(y0 + (float)Row);
+				__m256 Inside = _mm256_cmp_ps(_mm256_add_ps(a[0], _mm256_add_ps(_mm256_mul_ps(b[0], y), c[0])), _mm256_setzero_ps(), _CMP_GE_OQ);
+				Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(_mm256_add_ps(a[1], _mm256_add_ps(_mm256_mul_ps(b[1], y), c[1])), _mm256_setzero_ps(), _CMP_GE_OQ));
+				Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(_mm256_add_ps(a[2], _mm256_add_ps(_mm256_mul_ps(b[2], y), c[2])), _mm256_setzero_ps(), _CMP_GE_OQ));
+				Mask |= (unsigned int)_mm256_movemask_ps(Inside) << (Row * OcclusionTileWidth);
+			}
+			return Mask;
+		}
+#endif
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX_INTRINSICS_)
+		case OcclusionSSE:
+		{
+			__m128 Left = _mm_add_ps(_mm_set1_ps(x0), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+			__m128 Right = _mm_add_ps(_mm_set1_ps(x0), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f));
+			__m128 aLeft[3], aRight[3], b[3], c[3];
+			for (unsigned int e = 0; e < 3; e++)
+			{
+				__m128 a = _mm_set1_ps(Triangle.EdgeA[e]);
+				aLeft[e] = _mm_mul_ps(a, Left);
+				aRight[e] = _mm_mul_ps(a, Right);
+				b[e] = _mm_set1_ps(Triangle.EdgeB[e]);
+				c[e] = _mm_set1_ps(Triangle.EdgeC[e]);
+			}
+
+			for (unsigned int Row = 0; Row < OcclusionTileHeight; Row++)
+			{
+				__m128 y = _mm_set1_ps(y0 + (float)Row);
+				__m128 InsideLeft = _mm_set1_ps(-1.0f);
+				__m128 InsideRight = InsideLeft;
+				for (unsigned int e = 0; e < 3; e++)
+				{
+					__m128 by = _mm_add_ps(_mm_mul_ps(b[e], y), c[e]);
+					InsideLeft = _mm_and_ps(InsideLeft, _mm_cmpge_ps(_mm_add_ps(aLeft[e], by), _mm_setzero_ps()));
+					InsideRight = _mm_and_ps(InsideRight, _mm_cmpge_ps(_mm_add_ps(aRight[e], by), _mm_setzero_ps()));
+				}
+				unsigned int RowMask = (unsigned int)_mm_movemask_ps(InsideLeft) | ((unsigned int)_mm_movemask_ps(InsideRight) << 4);
+				Mask |= RowMask << (Row * OcclusionTileWidth);
+			}
+			return Mask;
+		}
+#endif
+		default:
+			for (unsigned int Row = 0; Row < OcclusionTileHeight; Row++)
+			{
+				float y = y0 + (float)Row;
+				for (unsigned int Column = 0; Column < OcclusionTileWidth; Column++)
+				{
+					float x = x0 + (float)Column;
+					bool Inside = true;
+					for (unsigned int e = 0; e < 3; e++)
+					{
+						Inside = Inside && Triangle.EdgeA[e] * x + (Triangle.EdgeB[e] * y + Triangle.EdgeC[e]) >= 0.0f;
+					}
+					Mask |= (Inside ? 1u : 0u) << (Row * OcclusionTileWidth + Column);
+				}
+			}
+			return Mask;
+		}
+	}
+
+	// Merges a triangle covering Coverage with depths up to ZMax into a tile. A triangle
+	// much farther than the working layer would drag its bound back, so in that case the
+	// working layer is dropped and the triangle starts a new one. A full working layer
+	// becomes the new tile bound.
+	static void MergeTile(OcclusionTile& Tile, unsigned int Coverage, float ZMin, float ZMax)
+	{
+		if (Coverage == 0 || ZMin >= Tile.Z0)
+		{
+			return;
+		}
+
+		if (ZMax - Tile.Z1 > Tile.Z0 - ZMax)
+		{
+			Tile.Z1 = 0.0f;
+			Tile.Mask = 0;
+		}
+
+		Tile.Z1 = Tile.Z1 > ZMax ? Tile.Z1 : ZMax;
+		Tile.Mask |= Coverage;
+
+		if (Tile.Mask == OcclusionFullMask)
+		{
+			Tile.Z0 = Tile.Z0 < Tile.Z1 ? Tile.Z0 : Tile.Z1;
+			Tile.Z1 = 0.0f;
+			Tile.Mask = 0;
+		}
+	}
+
+	struct MaskedOcclusionBuffer
+	{
+		unsigned int Width = 0;
+		unsigned int Height = 0;
+		unsigned int TilesX = 0;
+		unsigned int TilesY = 0;
+		std::vector<OcclusionTile> Tiles;
+
+		// Per setup job triangle lists, kept between frames to avoid reallocating.
+		std::vector<std::vector<OcclusionTriangle>> Batches;
+
+		// Rounds the size up to whole tiles and clears.
+		void Resize(unsigned int BufferWidth, unsigned int BufferHeight)
+		{
+			TilesX = (BufferWidth + OcclusionTileWidth - 1) / OcclusionTileWidth;
+			TilesY = (BufferHeight + OcclusionTileHeight - 1) / OcclusionTileHeight;
+			Width = TilesX * OcclusionTileWidth;
+			Height = TilesY * OcclusionTileHeight;
+			Tiles.resize(TilesX * TilesY);
+			Clear();
+		}
+
+		void Clear()
+		{
+			for (OcclusionTile& Tile : Tiles)
+			{
+				Tile.Z0 = 1.0f;
+				Tile.Z1 = 0.0f;
+				Tile.Mask = 0;
+			}
+		}
+
+		// Farthest depth the occluders leave at a pixel.
+		float GetPixelDepth(unsigned int x, unsigned int y) const
+		{
+			const OcclusionTile& Tile = Tiles[(y / OcclusionTileHeight) * TilesX + x / OcclusionTileWidth];
+			unsigned int Bit = 1u << ((y % OcclusionTileHeight) * OcclusionTileWidth + x % OcclusionTileWidth);
+			return (Tile.Mask & Bit) != 0 && Tile.Z1 < Tile.Z0 ? Tile.Z1 : Tile.Z0;
+		}
+
+		// Rasterizes the draws in order. Triangles are set up in parallel batches, then each
+		// band of tile rows is filled by one thread walking every batch in order, so the
+		// result does not depend on ThreadCount or Path. Returns the triangles rasterized.
+		unsigned int RenderOccluders(const OccluderDraw* Draws, unsigned int DrawCount, unsigned int ThreadCount = 0, OcclusionPath Path = OcclusionBest)
+		{
+			if (Tiles.empty())
+			{
+				return 0;
+			}
+
+			struct SetupJob
+			{
+				unsigned int Draw;
+				unsigned int FirstTriangle;
+			};
+
+			std::vector<SetupJob> Jobs;
+			for (unsigned int d = 0; d < DrawCount; d++)
+			{
+				unsigned int TriangleCount = (unsigned int)Draws[d].Mesh->Indices.size() / 3;
+				for (unsigned int t = 0; t < TriangleCount; t += OcclusionSetupBatch)
+				{
+					Jobs.push_back({ d, t });
+				}
+			}
+
+			if (Batches.size() < Jobs.size())
+			{
+				Batches.resize(Jobs.size());
+			}
+
+			DX::ParallelFor((unsigned int)Jobs.size(), ThreadCount, [&](unsigned int j)
+			{
+				const OccluderDraw& Draw = Draws[Jobs[j].Draw];
+				unsigned int TriangleCount = (unsigned int)Draw.Mesh->Indices.size() / 3;
+				unsigned int End = Jobs[j].FirstTriangle + OcclusionSetupBatch < TriangleCount ? Jobs[j].FirstTriangle + OcclusionSetupBatch : TriangleCount;
+
+				Batches[j].clear();
+				SetupTriangles(*Draw.Mesh, DirectX::XMLoadFloat4x4(&Draw.WorldViewProjection), Jobs[j].FirstTriangle, End, &Batches[j]);
+			});
+
+			unsigned int BandCount = (TilesY + OcclusionBandRows - 1) / OcclusionBandRows;
+			unsigned int JobCount = (unsigned int)Jobs.size();
+
+			DX::ParallelFor(BandCount, ThreadCount, [&](unsigned int Band)
+			{
+				unsigned int BandY0 = Band * OcclusionBandRows;
+				unsigned int BandY1 = BandY0 + OcclusionBandRows - 1 < TilesY - 1 ? BandY0 + OcclusionBandRows - 1 : TilesY - 1;
+
+				for (unsigned int j = 0; j < JobCount; j++)
+				{
+					for (const OcclusionTriangle& Triangle : Batches[j])
+					{
+						unsigned int y0 = Triangle.TileY0 > BandY0 ? Triangle.TileY0 : BandY0;
+						unsigned int y1 = Triangle.TileY1 < BandY1 ? Triangle.TileY1 : BandY1;
+						for (unsigned int ty = y0; ty <= y1 && y0 <= y1; ty++)
+						{
+							for (unsigned int tx = Triangle.TileX0; tx <= Triangle.TileX1; tx++)
+							{
+								RasterizeTile(Triangle, tx, ty, Path);
+							}
+						}
+					}
+				}
+			});
+
+			unsigned int Rasterized = 0;
+			for (unsigned int j = 0; j < JobCount; j++)
+			{
+				Rasterized += (unsigned int)Batches[j].size();
+			}
+			return Rasterized;
+		}
+
+		unsigned int RenderOccluder(const OccluderMesh& Mesh, DirectX::FXMMATRIX WorldViewProjection, unsigned int ThreadCount = 0, OcclusionPath Path = OcclusionBest)
+		{
+			OccluderDraw Draw;
+			Draw.Mesh = &Mesh;
+			DirectX::XMStoreFloat4x4(&Draw.WorldViewProjection, WorldViewProjection);
+			return RenderOccluders(&Draw, 1, ThreadCount, Path);
+		}
+
+		// False only when the box is hidden everywhere it covers: its nearest depth is behind
+		// the far bound of each tile it overlaps. Boxes crossing the near plane are visible.
+		bool TestBox(const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max, DirectX::FXMMATRIX ViewProjection) const
+		{
+			using namespace DirectX;
+
+			if (Tiles.empty())
+			{
+				return true;
+			}
+
+			float MinX = FLT_MAX, MinY = FLT_MAX, MaxX = -FLT_MAX, MaxY = -FLT_MAX, MinZ = FLT_MAX;
+			for (unsigned int c = 0; c < 8; c++)
+			{
+				XMVECTOR Corner = XMVectorSet((c & 1) ? Max.x : Min.x, (c & 2) ? Max.y : Min.y, (c & 4) ? Max.z : Min.z, 1.0f);
+				XMFLOAT4 Clip;
+				XMStoreFloat4(&Clip, XMVector4Transform(Corner, ViewProjection));
+
+				if (Clip.z < 0.0f)
+				{
+					return true;
+				}
+
+				float x = (Clip.x / Clip.w * 0.5f + 0.5f) * Width;
+				float y = (0.5f - Clip.y / Clip.w * 0.5f) * Height;
+				float z = Clip.z / Clip.w;
+				MinX = x < MinX ? x : MinX;
+				MaxX = x > MaxX ? x : MaxX;
+				MinY = y < MinY ? y : MinY;
+				MaxY = y > MaxY ? y : MaxY;
+				MinZ = z < MinZ ? z : MinZ;
+			}
+
+			// Every pixel the box's screen rectangle touches.
+			if (MaxX < 0.0f || MaxY < 0.0f || MinX >= (float)Width || MinY >= (float)Height)
+			{
+				return false;
+			}
+
+			unsigned int x0 = MinX > 0.0f ? (unsigned int)MinX : 0;
+			unsigned int y0 = MinY > 0.0f ? (unsigned int)MinY : 0;
+			unsigned int x1 = MaxX < (float)(Width - 1) ? (unsigned int)MaxX : Width - 1;
+			unsigned int y1 = MaxY < (float)(Height - 1) ? (unsigned int)MaxY : Height - 1;
+
+			for (unsigned int ty = y0 / OcclusionTileHeight; ty <= y1 / OcclusionTileHeight; ty++)
+			{
+				for (unsigned int tx = x0 / OcclusionTileWidth; tx <= x1 / OcclusionTileWidth; tx++)
+				{
+					const OcclusionTile& Tile = Tiles[ty * TilesX + tx];
+
+					// Pixels of the rectangle inside this tile.
+					unsigned int ColumnFirst = tx * OcclusionTileWidth > x0 ? 0 : x0 - tx * OcclusionTileWidth;
+					unsigned int ColumnLast = tx * OcclusionTileWidth + OcclusionTileWidth - 1 < x1 ? OcclusionTileWidth - 1 : x1 - tx * OcclusionTileWidth;
+					unsigned int RowFirst = ty * OcclusionTileHeight > y0 ? 0 : y0 - ty * OcclusionTileHeight;
+					unsigned int RowLast = ty * OcclusionTileHeight + OcclusionTileHeight - 1 < y1 ? OcclusionTileHeight - 1 : y1 - ty * OcclusionTileHeight;
+
+					unsigned int RowMask = (0xFFu >> (OcclusionTileWidth - 1 - ColumnLast)) & (0xFFu << ColumnFirst);
+					unsigned int RectMask = 0;
+					for (unsigned int Row = RowFirst; Row <= RowLast; Row++)
+					{
+						RectMask |= RowMask << (Row * OcclusionTileWidth);
+					}
+
+					float Bound = Tile.Z0;
+					if ((RectMask & ~Tile.Mask) == 0 && Tile.Z1 < Bound)
+					{
+						Bound = Tile.Z1;
+					}
+
+					if (MinZ <= Bound)
+					{
+						return true;
+					}
+				}
+			}
+
+			return false;
+		}
+
+		// Far depth bound of every pixel as 16-bit values, 65535 at the near plane and 0 where
+		// nothing was drawn.
+		void GetDepthImage(std::vector<unsigned short>* Pixels) const
+		{
+			Pixels->resize(Width * Height);
+			for (unsigned int y = 0; y < Height; y++)
+			{
+				for (unsigned int x = 0; x < Width; x++)
+				{
+					float z = GetPixelDepth(x, y);
+					z = z < 0.0f ? 0.0f : (z > 1.0f ? 1.0f : z);
+					(*Pixels)[y * Width + x] = (unsigned short)((1.0f - z) * 65535.0f + 0.5f);
+				}
+			}
+		}
+
+		// The clipped, projected triangles of a whole mesh, as RenderOccluders sees them.
+		void SetupOccluder(const OccluderMesh& Mesh, DirectX::FXMMATRIX WorldViewProjection, std::vector<OcclusionTriangle>* Out) const
+		{
+			SetupTriangles(Mesh, WorldViewProjection, 0, (unsigned int)Mesh.Indices.size() / 3, Out);
+		}
+
+	private:
+		// Transforms, clips against the near plane, projects and sets up triangles
+		// [First, End) of the mesh. Both windings are kept: an occluder hides what is behind
+		// it whichever way it faces.
+		void SetupTriangles(const OccluderMesh& Mesh, DirectX::FXMMATRIX WorldViewProjection, unsigned int First, unsigned int End, std::vector<OcclusionTriangle>* Out) const
+		{
+			using namespace DirectX;
+
+			for (unsigned int t = First; t < End; t++)
+			{
+				XMFLOAT4 Clip[3];
+				for (unsigned int v = 0; v < 3; v++)
+				{
+					XMStoreFloat4(&Clip[v], XMVector3Transform(XMLoadFloat3(&Mesh.Positions[Mesh.Indices[t * 3 + v]]), WorldViewProjection));
+				}
+
+				// Outside one of the side planes.
+				bool Outside = false;
+				for (unsigned int Axis = 0; Axis < 2 && !Outside; Axis++)
+				{
+					const float* c0 = &Clip[0].x + Axis;
+					const float* c1 = &Clip[1].x + Axis;
+					const float* c2 = &Clip[2].x + Axis;
+					Outside = (*c0 > Clip[0].w && *c1 > Clip[1].w && *c2 > Clip[2].w) || (*c0 < -Clip[0].w && *c1 < -Clip[1].w && *c2 < -Clip[2].w);
+				}
+				if (Outside || (Clip[0].z < 0.0f && Clip[1].z < 0.0f && Clip[2].z < 0.0f))
+				{
+					continue;
+				}
+
+				// Clip to z >= 0 (Sutherland-Hodgman), leaving a triangle or a quad.
+				XMFLOAT4 Polygon[4];
+				unsigned int Count = 0;
+				for (unsigned int v = 0; v < 3; v++)
+				{
+					const XMFLOAT4& a = Clip[v];
+					const XMFLOAT4& b = Clip[(v + 1) % 3];
+					if (a.z >= 0.0f)
+					{
+						Polygon[Count++] = a;
+					}
+					if ((a.z >= 0.0f) != (b.z >= 0.0f))
+					{
+						float s = a.z / (a.z - b.z);
+						Polygon[Count++] = XMFLOAT4(a.x + (b.x - a.x) * s, a.y + (b.y - a.y) * s, 0.0f, a.w + (b.w - a.w) * s);
+					}
+				}
+
+				for (unsigned int v = 2; v < Count; v++)
+				{
+					AddTriangle(Polygon[0], Polygon[v - 1], Polygon[v], Out);
+				}
+			}
+		}
+
+		void AddTriangle(const DirectX::XMFLOAT4& c0, const DirectX::XMFLOAT4& c1, const DirectX::XMFLOAT4& c2, std::vector<OcclusionTriangle>* Out) const
+		{
+			if (c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f)
+			{
+				return;
+			}
+
+			float x[3], y[3], z[3];
+			const DirectX::XMFLOAT4* Clip[3] = { &c0, &c1, &c2 };
+			for (unsigned int v = 0; v < 3; v++)
+			{
+				x[v] = (Clip[v]->x / Clip[v]->w * 0.5f + 0.5f) * Width;
+				y[v] = (0.5f - Clip[v]->y / Clip[v]->w * 0.5f) * Height;
+				z[v] = Clip[v]->z / Clip[v]->w;
+			}
+
+			float Area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (fabsf(Area) < 1e-6f)
+			{
+				return;
+			}
+
+			// Pixel centres the triangle's box can contain.
+			float MinX = fminf(x[0], fminf(x[1], x[2])), MaxX = fmaxf(x[0], fmaxf(x[1], x[2]));
+			float MinY = fminf(y[0], fminf(y[1], y[2])), MaxY = fmaxf(y[0], fmaxf(y[1], y[2]));
+			float FirstX = ceilf(MinX - 0.5f), LastX = floorf(MaxX - 0.5f);
+			float FirstY = ceilf(MinY - 0.5f), LastY = floorf(MaxY - 0.5f);
+			FirstX = FirstX > 0.0f ? FirstX : 0.0f;
+			FirstY = FirstY > 0.0f ? FirstY : 0.0f;
+			LastX = LastX < (float)(Width - 1) ? LastX : (float)(Width - 1);
+			LastY = LastY < (float)(Height - 1) ? LastY : (float)(Height - 1);
+			if (FirstX > LastX || FirstY > LastY)
+			{
+				return;
+			}
+
+			// Edge e runs between the other two vertices; its function equals Area at vertex e,
+			// so scaling by the sign of Area makes every edge positive inside.
+			OcclusionTriangle Triangle;
+			float Sign = Area > 0.0f ? 1.0f : -1.0f;
+			for (unsigned int e = 0; e < 3; e++)
+			{
+				unsigned int i = (e + 1) % 3, j = (e + 2) % 3;
+				Triangle.EdgeA[e] = Sign * (y[i] - y[j]);
+				Triangle.EdgeB[e] = Sign * (x[j] - x[i]);
+				Triangle.EdgeC[e] = Sign * (x[i] * y[j] - x[j] * y[i]);
+			}
+
+			Triangle.DepthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / Area;
+			Triangle.DepthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / Area;
+			Triangle.DepthC = z[0] - Triangle.DepthA * x[0] - Triangle.DepthB * y[0];
+			Triangle.ZMin = fminf(z[0], fminf(z[1], z[2]));
+			Triangle.ZMax = fmaxf(z[0], fmaxf(z[1], z[2]));
+
+			Triangle.TileX0 = (unsigned short)((unsigned int)FirstX / OcclusionTileWidth);
+			Triangle.TileX1 = (unsigned short)((unsigned int)LastX / OcclusionTileWidth);
+			Triangle.TileY0 = (unsigned short)((unsigned int)FirstY / OcclusionTileHeight);
+			Triangle.TileY1 = (unsigned short)((unsigned int)LastY / OcclusionTileHeight);
+
+			Out->push_back(Triangle);
+		}
+
+		void RasterizeTile(const OcclusionTriangle& Triangle, unsigned int tx, unsigned int ty, OcclusionPath Path)
+		{
+			OcclusionTile& Tile = Tiles[ty * TilesX + tx];
+			unsigned int PixelX = tx * OcclusionTileWidth;
+			unsigned int PixelY = ty * OcclusionTileHeight;
+
+			// Depth range of the plane over the tile's pixel centres, within the vertex range.
+			float Left = (float)PixelX + 0.5f, Right = Left + (float)(OcclusionTileWidth - 1);
+			float Top = (float)PixelY + 0.5f, Bottom = Top + (float)(OcclusionTileHeight - 1);
+			float zx0 = Triangle.DepthA * Left, zx1 = Triangle.DepthA * Right;
+			float zy0 = Triangle.DepthB * Top + Triangle.DepthC, zy1 = Triangle.DepthB * Bottom + Triangle.DepthC;
+			float ZMin = std::max(std::min(zx0, zx1) + std::min(zy0, zy1), Triangle.ZMin);
+			float ZMax = std::min(std::max(zx0, zx1) + std::max(zy0, zy1), Triangle.ZMax);
+
+			if (ZMin >= Tile.Z0)
+			{
+				return;
+			}
+
+			// Each edge function at the tile's best and worst pixel centre: the triangle misses
+			// the tile if one edge is negative even at its best, and covers it if every edge
+			// is positive at its worst.
+			bool Covers = true;
+			for (unsigned int e = 0; e < 3; e++)
+			{
+				float a = Triangle.EdgeA[e], b = Triangle.EdgeB[e];
+				float Best = a * (a > 0.0f ? Right : Left) + (b * (b > 0.0f ? Bottom : Top) + Triangle.EdgeC[e]);
+				float Worst = a * (a > 0.0f ? Left : Right) + (b * (b > 0.0f ? Top : Bottom) + Triangle.EdgeC[e]);
+				if (Best < 0.0f)
+				{
+					return;
+				}
+				Covers = Covers && Worst >= 0.0f;
+			}
+
+			if (Covers)
+			{
+				MergeTile(Tile, OcclusionFullMask, ZMin, ZMax);
+				return;
+			}
+
+			MergeTile(Tile, GetTileCoverage(Triangle, PixelX, PixelY, Path), ZMin, ZMax);
+		}
+	};
+
+	static FILE* OpenDepthImage(const char* Path, const char* Mode)
+	{
+#if defined(_WIN32)
+		FILE* File = nullptr;
+		return fopen_s(&File, Path, Mode) == 0 ? File : nullptr;
+#else
+		return fopen(Path, Mode);
+#endif
+	}
+
+	// Writes a 16-bit binary PGM, the format of the reference image ReportOcclusionCulling
+	// compares against; used to make a new one when the test scene changes on purpose.
+	static bool WriteDepthImage(const char* Path, const std::vector<unsigned short>& Pixels, unsigned int Width, unsigned int Height)
+	{
+		FILE* File = OpenDepthImage(Path, "wb");
+		if (File == nullptr)
+		{
+			return false;
+		}
+
+		fprintf(File, "P5\n%u %u\n65535\n", Width, Height);
+		std::vector<unsigned char> Bytes(Pixels.size() * 2);
+		for (size_t i = 0; i < Pixels.size(); i++)
+		{
+			Bytes[i * 2] = (unsigned char)(Pixels[i] >> 8);
+			Bytes[i * 2 + 1] = (unsigned char)(Pixels[i] & 0xFF);
+		}
+		bool Ok = fwrite(Bytes.data(), 1, Bytes.size(), File) == Bytes.size();
+		fclose(File);
+		return Ok;
+	}
+
+	static bool ReadDepthImage(const char* Path, std::vector<unsigned short>* Pixels, unsigned int* Width, unsigned int* Height)
+	{
+		FILE* File = OpenDepthImage(Path, "rb");
+		if (File == nullptr)
+		{
+			return false;
+		}
+
+		unsigned int MaxValue = 0;
+#if defined(_WIN32)
+		bool Ok = fscanf_s(File, "P5 %u %u %u", Width, Height, &MaxValue) == 3;
+#else
+		bool Ok = fscanf(File, "P5 %u %u %u", Width, Height, &MaxValue) == 3;
+#endif
+		Ok = Ok && MaxValue == 65535 && fgetc(File) != EOF;
+		if (Ok)
+		{
+			std::vector<unsigned char> Bytes((size_t)*Width * *Height * 2);
+			Ok = fread(Bytes.data(), 1, Bytes.size(), File) == Bytes.size();
+			Pixels->resize((size_t)*Width * *Height);
+			for (size_t i = 0; Ok && i < Pixels->size(); i++)
+			{
+				(*Pixels)[i] = (unsigned short)((Bytes[i * 2] << 8) | Bytes[i * 2 + 1]);
+			}
+		}
+		fclose(File);
+		return Ok;
+	}
+
+	// Closed box of 12 triangles, appended to Mesh.
+	static void AddOccluderBox(OccluderMesh* Mesh, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max)
+	{
+		static const unsigned int Faces[36] =
+		{
+			0, 2, 1, 1, 2, 3,	4, 5, 6, 5, 7, 6,
+			0, 1, 4, 1, 5, 4,	2, 6, 3, 3, 6, 7,
+			0, 4, 2, 2, 4, 6,	1, 3, 5, 3, 7, 5,
+		};
+
+		unsigned int Base = (unsigned int)Mesh->Positions.size();
+		for (unsigned int c = 0; c < 8; c++)
+		{
+			Mesh->Positions.push_back(DirectX::XMFLOAT3((c & 1) ? Max.x : Min.x, (c & 2) ? Max.y : Min.y, (c & 4) ? Max.z : Min.z));
+		}
+		for (unsigned int i = 0; i < 36; i++)
+		{
+			Mesh->Indices.push_back(Base + Faces[i]);
+		}
+	}
+
+	// Renders a walled courtyard with a gate into a 320x192 buffer and tests boxes
+	// scattered inside and outside it. Checks that every path and thread count produce the
+	// same buffer, that no box is culled which an exact per-pixel depth buffer would show,
+	// and, given ReferencePath, compares the buffer with a reference image. A missing or
+	// unreadable reference fails. Returns whether every check passed.
+	static bool ReportOcclusionCulling(const char* ReferencePath = nullptr, unsigned int BoxCount = 2000, unsigned int Repeats = 20)
+	{
+		using namespace DirectX;
+		using Clock = std::chrono::high_resolution_clock;
+
+		const unsigned int BufferWidth = 320, BufferHeight = 192;
+
+		// Walls 20 units out on every side, 6 high, with a gate straight ahead.
+		OccluderMesh Walls;
+		AddOccluderBox(&Walls, XMFLOAT3(-20.0f, 0.0f, 20.0f), XMFLOAT3(-3.0f, 6.0f, 21.0f));
+		AddOccluderBox(&Walls, XMFLOAT3(3.0f, 0.0f, 20.0f), XMFLOAT3(20.0f, 6.0f, 21.0f));
+		AddOccluderBox(&Walls, XMFLOAT3(-20.0f, 0.0f, -21.0f), XMFLOAT3(20.0f, 6.0f, -20.0f));
+		AddOccluderBox(&Walls, XMFLOAT3(-21.0f, 0.0f, -21.0f), XMFLOAT3(-20.0f, 6.0f, 21.0f));
+		AddOccluderBox(&Walls, XMFLOAT3(20.0f, 0.0f, -21.0f), XMFLOAT3(21.0f, 6.0f, 21.0f));
+		AddOccluderBox(&Walls, XMFLOAT3(-100.0f, -1.0f, -100.0f), XMFLOAT3(100.0f, 0.0f, 100.0f));
+
+		XMMATRIX View = XMMatrixLookAtLH(XMVectorSet(0.0f, 1.7f, -5.0f, 1.0f), XMVectorSet(2.0f, 1.5f, 10.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX Projection = XMMatrixPerspectiveFovLH(70.0f * XM_PI / 180.0f, (float)BufferWidth / BufferHeight, 0.1f, 200.0f);
+		XMMATRIX ViewProjection = XMMatrixMultiply(View, Projection);
+
+		std::mt19937 Random(99);
+		std::uniform_real_distribution<float> Coordinate(-60.0f, 60.0f);
+		std::uniform_real_distribution<float> Size(0.25f, 2.0f);
+		std::vector<XMFLOAT3> Mins(BoxCount), Maxs(BoxCount);
+		for (unsigned int i = 0; i < BoxCount; i++)
+		{
+			XMFLOAT3 c(Coordinate(Random), 0.5f * Size(Random), Coordinate(Random));
+			float s = Size(Random);
+			Mins[i] = XMFLOAT3(c.x - s, 0.0f, c.z - s);
+			Maxs[i] = XMFLOAT3(c.x + s, c.y + s, c.z + s);
+		}
+
+		bool Passed = true;
+
+		// Every path, single-threaded and on all threads, must give the same tiles.
+		const OcclusionPath Paths[] = { OcclusionScalar, OcclusionSSE, OcclusionAVX };
+		const char* PathNames[] = { "scalar", "SSE", "AVX" };
+		const unsigned int PathCount = (unsigned int)OcclusionBest + 1;
+
+		MaskedOcclusionBuffer Reference;
+		Reference.Resize(BufferWidth, BufferHeight);
+		unsigned int Triangles = Reference.RenderOccluder(Walls, ViewProjection, 1, OcclusionScalar);
+
+		for (unsigned int p = 0; p < PathCount; p++)
+		{
+			for (unsigned int Threads = 1; Threads <= 2; Threads++)
+			{
+				unsigned int ThreadCount = Threads == 1 ? 1 : std::max(DX::ResolveWorkerCount(0), 4u);
+				MaskedOcclusionBuffer Buffer;
+				Buffer.Resize(BufferWidth, BufferHeight);
+
+				double Best = DBL_MAX;
+				for (unsigned int r = 0; r < Repeats; r++)
+				{
+					Buffer.Clear();
+					auto Start = Clock::now();
+					Buffer.RenderOccluder(Walls, ViewProjection, ThreadCount, Paths[p]);
+					double Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+					Best = Seconds < Best ? Seconds : Best;
+				}
+
+				bool Same = memcmp(Buffer.Tiles.data(), Reference.Tiles.data(), Reference.Tiles.size() * sizeof(OcclusionTile)) == 0;
+				Passed = Passed && Same;
+
+				ReportLine("Occlusion: %u occluder triangles into %ux%u, %s on %u threads %.3f ms%s\n", Triangles, BufferWidth, BufferHeight,
+					PathNames[p], ThreadCount, Best * 1000.0, Same ? "" : ", DIFFERS FROM scalar");
+			}
+		}
+
+		// Exact depth at every pixel centre, to check the masked tiles never hide too much.
+		std::vector<float> Exact(BufferWidth * BufferHeight, 1.0f);
+		std::vector<OcclusionTriangle> WallTriangles;
+		Reference.SetupOccluder(Walls, ViewProjection, &WallTriangles);
+		for (const OcclusionTriangle& Triangle : WallTriangles)
+		{
+			for (unsigned int y = 0; y < BufferHeight; y++)
+			{
+				for (unsigned int x = 0; x < BufferWidth; x++)
+				{
+					float px = (float)x + 0.5f, py = (float)y + 0.5f;
+					bool Inside = true;
+					for (unsigned int e = 0; e < 3; e++)
+					{
+						Inside = Inside && Triangle.EdgeA[e] * px + (Triangle.EdgeB[e] * py + Triangle.EdgeC[e]) >= 0.0f;
+					}
+					float z = fminf(fmaxf(Triangle.DepthA * px + Triangle.DepthB * py + Triangle.DepthC, Triangle.ZMin), Triangle.ZMax);
+					if (Inside && z < Exact[y * BufferWidth + x])
+					{
+						Exact[y * BufferWidth + x] = z;
+					}
+				}
+			}
+		}
+
+		unsigned int Culled = 0, ExactCulled = 0, Wrong = 0;
+		double TestSeconds = 0.0;
+		for (unsigned int i = 0; i < BoxCount; i++)
+		{
+			auto Start = Clock::now();
+			bool Visible = Reference.TestBox(Mins[i], Maxs[i], ViewProjection);
+			TestSeconds += std::chrono::duration<double>(Clock::now() - Start).count();
+
+			// The same screen rectangle and nearest depth against the exact buffer.
+			bool ExactVisible = false, OnScreen = false, Crosses = false;
+			float MinX = FLT_MAX, MinY = FLT_MAX, MaxX = -FLT_MAX, MaxY = -FLT_MAX, MinZ = FLT_MAX;
+			for (unsigned int c = 0; c < 8; c++)
+			{
+				XMFLOAT4 Clip;
+				XMStoreFloat4(&Clip, XMVector4Transform(XMVectorSet((c & 1) ? Maxs[i].x : Mins[i].x, (c & 2) ? Maxs[i].y : Mins[i].y, (c & 4) ? Maxs[i].z : Mins[i].z, 1.0f), ViewProjection));
+				Crosses = Crosses || Clip.z < 0.0f;
+				MinX = fminf(MinX, (Clip.x / Clip.w * 0.5f + 0.5f) * BufferWidth);
+				MaxX = fmaxf(MaxX, (Clip.x / Clip.w * 0.5f + 0.5f) * BufferWidth);
+				MinY = fminf(MinY, (0.5f - Clip.y / Clip.w * 0.5f) * BufferHeight);
+				MaxY = fmaxf(MaxY, (0.5f - Clip.y / Clip.w * 0.5f) * BufferHeight);
+				MinZ = fminf(MinZ, Clip.z / Clip.w);
+			}
+
+			if (Crosses)
+			{
+				ExactVisible = true;
+			}
+			else
+			{
+				for (int y = (int)fmaxf(MinY, 0.0f); y <= (int)fminf(MaxY, BufferHeight - 1.0f) && MaxY >= 0.0f; y++)
+				{
+					for (int x = (int)fmaxf(MinX, 0.0f); x <= (int)fminf(MaxX, BufferWidth - 1.0f) && MaxX >= 0.0f; x++)
+					{
+						OnScreen = true;
+						ExactVisible = ExactVisible || MinZ <= Exact[y * BufferWidth + x];
+					}
+				}
+				ExactVisible = ExactVisible && OnScreen;
+			}
+
+			Culled += Visible ? 0 : 1;
+			ExactCulled += ExactVisible ? 0 : 1;
+			Wrong += !Visible && ExactVisible ? 1 : 0;
+		}
+		Passed = Passed && Wrong == 0;
+
+		ReportLine("Occlusion: %u boxes tested in %.3f ms, %u culled (exact depth culls %u), %u wrongly culled\n", BoxCount, TestSeconds * 1000.0,
+			Culled, ExactCulled, Wrong);
+
+		if (ReferencePath != nullptr)
+		{
+			std::vector<unsigned short> Image, Expected;
+			Reference.GetDepthImage(&Image);
+
+			unsigned int ExpectedWidth = 0, ExpectedHeight = 0;
+			if (!ReadDepthImage(ReferencePath, &Expected, &ExpectedWidth, &ExpectedHeight))
+			{
+				ReportLine("Occlusion: could not read reference image %s\n", ReferencePath);
+				Passed = false;
+			}
+			else if (ExpectedWidth != Reference.Width || ExpectedHeight != Reference.Height)
+			{
+				ReportLine("Occlusion: reference image %s is %ux%u, not %ux%u\n", ReferencePath, ExpectedWidth, ExpectedHeight, Reference.Width, Reference.Height);
+				Passed = false;
+			}
+			else
+			{
+				// Allow a little rounding difference between compilers and instruction sets.
+				unsigned int Differing = 0;
+				for (size_t i = 0; i < Image.size(); i++)
+				{
+					int Difference = (int)Image[i] - (int)Expected[i];
+					Differing += Difference > 64 || Difference < -64 ? 1 : 0;
+				}
+				bool Matches = Differing <= Image.size() / 1000;
+				ReportLine("Occlusion: %u of %u pixels differ from reference image %s, %s\n", Differing, (unsigned int)Image.size(), ReferencePath,
+					Matches ? "matches" : "DIFFERS");
+				Passed = Passed && Matches;
+			}
+		}
+
+		return Passed;
+	}
+}
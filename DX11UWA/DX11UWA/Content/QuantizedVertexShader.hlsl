@@ -0,0 +1,85 @@
+// Per frame camera matrices, column-major.
+cbuffer ViewProjectionConstantBuffer : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+// Per object world matrix, column-major.
+cbuffer ModelConstantBuffer : register(b2)
+{
+	matrix model;
+};
+
+// Maps the 16-bit unorm positions back onto the mesh bounds.
+cbuffer QuantizationConstantBuffer : register(b1)
+{
+	float4 positionScale;
+	float4 positionOffset;
+};
+
+// VertexQuantized: unorm16 position with handedness in w, half UV, octahedral snorm16 normal and tangent.
+struct VertexShaderInput
+{
+	float4 pos : POSITION;
+	float2 uv : UV;
+	float2 norm : NORMAL;
+	float2 tan : TANGENT;
+};
+
+// Per-pixel color data passed through the pixel shader.
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 uv : UV;
+	float3 norm : NORMAL;
+	float3 tan : TANGENT;
+	float4 posWS : POSITIONWS;
+	float4x4 tbn : TBN;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// Same as NormalTexturingVertexShader after decoding the compact vertex.
+PixelShaderInput main(VertexShaderInput input)
+{
+	PixelShaderInput output;
+	float4 pos = float4(input.pos.xyz * positionScale.xyz + positionOffset.xyz, 1.0f);
+	float handedness = input.pos.w > 0.5f ? -1.0f : 1.0f;
+
+	// Transform the vertex position into projected space.
+	pos = mul(pos, model);
+
+	output.posWS = pos;
+
+	pos = mul(pos, view);
+	pos = mul(pos, projection);
+	output.pos = pos;
+
+	output.uv = float3(input.uv, 0.0f);
+
+	float3 normWS = DecodeOctahedral(input.norm);
+	normWS = mul(normWS, model);
+	output.norm = normWS;
+
+	float3 tanWS = DecodeOctahedral(input.tan);
+	tanWS = mul(tanWS, model);
+	output.tan = tanWS;
+
+	float3 bitWS = cross(normWS, tanWS) * handedness;
+
+	float4x4 TBN = { tanWS.x, tanWS.y, tanWS.z, 0.0f,
+					bitWS.x, bitWS.y, bitWS.z, 0.0f,
+					normWS.x, normWS.y, normWS.z, 0.0f,
+					0.0f, 0.0f, 0.0f, 1.0f };
+
+	output.tbn = TBN;
+
+	return output;
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <algorithm>
+
+// A per frame queue of draws ordered by 64-bit sort keys. The renderer pushes one entry per
+// draw with a key packing the pass, translucency, shader, material and a depth bucket, and
+// an item id of its own; the queue radix sorts the entries and hands them back in order.
+namespace DX11UWA
+{
+	// Passes draw in this order. The sky has its own pass so it goes after every scene draw
+	// and only shades the pixels nothing else covered.
+	enum RenderPass
+	{
+		RenderPassScene,
+		RenderPassSky,
+		RenderPassCount,
+	};
+
+	// Key layout, from the most significant bit:
+	//   opaque:      pass (4) | 0 | shader (11) | material (16) | depth (24) | unused (8)
+	//   translucent: pass (4) | 1 | far depth (24) | shader (11) | material (16) | unused (8)
+	// Opaque draws group by state and go roughly front to back inside a material; translucent
+	// ones go strictly back to front. The unused byte is zero in every key, so the sort skips it.
+	static const unsigned int SortKeyShaderBits = 11;
+	static const unsigned int SortKeyMaterialBits = 16;
+	static const unsigned int SortKeyDepthBits = 24;
+
+	static unsigned long long MakeSortKey(RenderPass Pass, bool Translucent, unsigned int Shader, unsigned int Material, unsigned int DepthBucket)
+	{
+		unsigned long long Key = (unsigned long long)Pass << 60;
+		Shader &= (1u << SortKeyShaderBits) - 1;
+		Material &= (1u << SortKeyMaterialBits) - 1;
+		DepthBucket &= (1u << SortKeyDepthBits) - 1;
+
+		if (!Translucent)
+		{
+			return Key | (unsigned long long)Shader << 48 | (unsigned long long)Material << 32 | (unsigned long long)DepthBucket << 8;
+		}
+
+		unsigned int FarBucket = (1u << SortKeyDepthBits) - 1 - DepthBucket;
+		return Key | 1ull << 59 | (unsigned long long)FarBucket << 35 | (unsigned long long)Shader << 24 | (unsigned long long)Material << 8;
+	}
+
+	static unsigned int GetSortKeyPass(unsigned long long Key)
+	{
+		return (unsigned int)(Key >> 60);
+	}
+
+	static bool IsSortKeyTranslucent(unsigned long long Key)
+	{
+		return (Key >> 59 & 1) != 0;
+	}
+
+	static unsigned int GetSortKeyShader(unsigned long long Key)
+	{
+		return (unsigned int)(Key >> (IsSortKeyTranslucent(Key) ? 24 : 48)) & ((1u << SortKeyShaderBits) - 1);
+	}
+
+	static unsigned int GetSortKeyMaterial(unsigned long long Key)
+	{
+		return (unsigned int)(Key >> (IsSortKeyTranslucent(Key) ? 8 : 32)) & ((1u << SortKeyMaterialBits) - 1);
+	}
+
+	// Quantizes a view space depth between Near and Far to a depth bucket, linearly.
+	static unsigned int GetDepthBucket(float ViewDepth, float Near, float Far)
+	{
+		float t = (ViewDepth - Near) / (Far - Near);
+		t = std::min(std::max(t, 0.0f), 1.0f);
+		return (unsigned int)(t * (float)((1u << SortKeyDepthBits) - 1));
+	}
+
+	struct RenderQueueEntry
+	{
+		unsigned long long Key;
+		unsigned int Item;
+	};
+
+	class RenderQueue
+	{
+	public:
+		// Empties the queue but keeps its memory.
+		void Clear()
+		{
+			Entries.clear();
+		}
+
+		void Push(unsigned long long Key, unsigned int Item)
+		{
+			Entries.push_back({ Key, Item });
+		}
+
+		size_t GetCount() const
+		{
+			return Entries.size();
+		}
+
+		const std::vector<RenderQueueEntry>& GetEntries() const
+		{
+			return Entries;
+		}
+
+		// Number of byte passes the last Sort scattered; bytes every key shares are skipped.
+		unsigned int GetSortPasses() const
+		{
+			return SortPasses;
+		}
+
+		// Stable least significant digit radix sort on the keys, a byte per pass. All eight
+		// histograms come from one read of the entries before any scatter.
+		void Sort()
+		{
+			SortPasses = 0;
+			size_t Count = Entries.size();
+			if (Count < 2)
+			{
+				return;
+			}
+
+			unsigned int Histograms[8][256] = {};
+			for (const RenderQueueEntry& Entry : Entries)
+			{
+				for (unsigned int Byte = 0; Byte < 8; Byte++)
+				{
+					Histograms[Byte][(Entry.Key >> (Byte * 8)) & 0xFF]++;
+				}
+			}
+
+			Scratch.resize(Count);
+			for (unsigned int Byte = 0; Byte < 8; Byte++)
+			{
+				unsigned int* Histogram = Histograms[Byte];
+				if (Histogram[(Entries[0].Key >> (Byte * 8)) & 0xFF] == Count)
+				{
+					continue;
+				}
+
+				unsigned int Offset = 0;
+				for (unsigned int Digit = 0; Digit < 256; Digit++)
+				{
+					unsigned int DigitCount = Histogram[Digit];
+					Histogram[Digit] = Offset;
+					Offset += DigitCount;
+				}
+
+				for (const RenderQueueEntry& Entry : Entries)
+				{
+					Scratch[Histogram[(Entry.Key >> (Byte * 8)) & 0xFF]++] = Entry;
+				}
+
+				Entries.swap(Scratch);
+				SortPasses++;
+			}
+		}
+
+	private:
+		std::vector<RenderQueueEntry> Entries;
+		std::vector<RenderQueueEntry> Scratch;
+		unsigned int SortPasses = 0;
+	};
+
+	// Sorts PacketCount draw packets with keys shaped like a scene's (two passes, a tenth
+	// translucent, 16 shaders, 256 materials, random depth) Repeats times, and reports the
+	// radix sort against std::stable_sort on the same keys. Fails if the orders differ.
+	static bool ReportRenderQueue(unsigned int PacketCount = 100000, unsigned int Repeats = 20)
+	{
+		std::mt19937 Random(19);
+		std::vector<unsigned long long> Keys(PacketCount);
+		for (unsigned long long& Key : Keys)
+		{
+			RenderPass Pass = Random() % 64 == 0 ? RenderPassSky : RenderPassScene;
+			Key = MakeSortKey(Pass, Random() % 10 == 0, Random() % 16, Random() % 256, Random() % (1u << SortKeyDepthBits));
+		}
+
+		RenderQueue Queue;
+		double RadixSeconds = 1e30, StableSeconds = 1e30;
+		std::vector<RenderQueueEntry> Reference;
+		for (unsigned int r = 0; r < Repeats; r++)
+		{
+			auto Start = std::chrono::high_resolution_clock::now();
+			Queue.Clear();
+			for (unsigned int i = 0; i < PacketCount; i++)
+			{
+				Queue.Push(Keys[i], i);
+			}
+			Queue.Sort();
+			RadixSeconds = std::min(RadixSeconds, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+
+			Start = std::chrono::high_resolution_clock::now();
+			Reference.clear();
+			for (unsigned int i = 0; i < PacketCount; i++)
+			{
+				Reference.push_back({ Keys[i], i });
+			}
+			std::stable_sort(Reference.begin(), Reference.end(), [](const RenderQueueEntry& a, const RenderQueueEntry& b) { return a.Key < b.Key; });
+			StableSeconds = std::min(StableSeconds, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+		}
+
+		bool Valid = Queue.GetCount() == Reference.size();
+		for (size_t i = 0; Valid && i < Reference.size(); i++)
+		{
+			Valid = Queue.GetEntries()[i].Key == Reference[i].Key && Queue.GetEntries()[i].Item == Reference[i].Item;
+		}
+
+		char Line[256];
+		sprintf_s(Line, "Render queue: %u packets sorted in %.3f ms (%u byte passes, %.1f M packets/s), std::stable_sort %.3f ms, %s\n", PacketCount,
+			RadixSeconds * 1000.0, Queue.GetSortPasses(), PacketCount / RadixSeconds / 1e6, StableSeconds * 1000.0, Valid ? "same order" : "ORDER MISMATCH");
+		OutputDebugStringA(Line);
+
+		return Valid;
+	}
+}
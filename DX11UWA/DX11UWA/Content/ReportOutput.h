@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdarg>
+#include <cstdio>
+
+// Output hook for the Report* self-checks and benchmarks, so the same reports run in the
+// app, which sends their lines to the debugger, and in the headless test runner under
+// Tests, which prints them.
+namespace DX11UWA
+{
+	// Receives one finished, newline-terminated report line.
+	typedef void (*ReportWriter)(const char* Line);
+
+	static void WriteReportToStdout(const char* Line)
+	{
+		fputs(Line, stdout);
+	}
+
+	// The writer every report line goes to; standard output until someone installs another.
+	inline ReportWriter& GetReportWriter()
+	{
+		static ReportWriter Writer = WriteReportToStdout;
+		return Writer;
+	}
+
+	static void SetReportWriter(ReportWriter Writer)
+	{
+		GetReportWriter() = Writer != nullptr ? Writer : WriteReportToStdout;
+	}
+
+	// Formats one report line printf style and hands it to the current writer. Lines
+	// longer than the buffer are cut short rather than overrunning it.
+	static void ReportLine(const char* Format, ...)
+	{
+		char Line[512];
+		va_list Arguments;
+		va_start(Arguments, Format);
+		vsnprintf(Line, sizeof(Line), Format, Arguments);
+		va_end(Arguments);
+		GetReportWriter()(Line);
+	}
+}
@@ -19,6 +19,9 @@ Sample3DSceneRenderer::Sample3DSceneRenderer(const std::shared_ptr<DX::DeviceRes
 	m_prevMousePos = nullptr;
 	memset(&m_camera, 0, sizeof(XMFLOAT4X4));
 
+	SceneLights.resize(FirstFieldLight + FieldLightCount);
+	PlaceFieldLights();
+
 	CreateDeviceDependentResources();
 	CreateWindowSizeDependentResources();
 }
@@ -52,6 +55,8 @@ void Sample3DSceneRenderer::CreateWindowSizeDependentResources(void)
 
 	XMStoreFloat4x4(&m_constantBufferData.projection, XMMatrixTranspose(perspectiveMatrix * orientationMatrix));
 
+	OcclusionBuffer.Resize(OcclusionBufferWidth, (unsigned int)(OcclusionBufferWidth / aspectRatio));
+
 	// Eye is at (0,0.7,1.5), looking at point (0,-0.1,0) with the up-vector along the y-axis.
 	static const XMVECTORF32 eye = { 0.0f, 0.7f, -1.5f, 0.0f };
 	static const XMVECTORF32 at = { 0.0f, -0.1f, 0.0f, 0.0f };
@@ -78,6 +83,7 @@ void Sample3DSceneRenderer::Update(DX::StepTimer const& timer)
 
 	// Update or move camera here
 	UpdateCamera(timer, 10.0f, 0.75f);
+	UpdateWalkthrough(timer);
 
 }
 
@@ -393,6 +399,76 @@ void Sample3DSceneRenderer::UpdateCamera(DX::StepTimer const& timer, float const
 		SLight = 0;
 	}
 
+	if (m_kbuttons['G'])
+	{
+		StressScene = true;
+	}
+
+	if (m_kbuttons['H'])
+	{
+		StressScene = false;
+	}
+
+	if (m_kbuttons['Z'])
+	{
+		ClusterCulling = true;
+	}
+
+	if (m_kbuttons['9'])
+	{
+		ClusterCulling = false;
+	}
+
+	if (m_kbuttons['M'])
+	{
+		InstancedCastles = true;
+	}
+
+	if (m_kbuttons['P'])
+	{
+		InstancedCastles = false;
+	}
+
+	if (m_kbuttons['R'])
+	{
+		StaticBatching = true;
+	}
+
+	if (m_kbuttons['F'])
+	{
+		StaticBatching = false;
+	}
+
+	if (m_kbuttons['Q'])
+	{
+		FieldLights = true;
+	}
+
+	if (m_kbuttons['E'])
+	{
+		FieldLights = false;
+	}
+
+	if (m_kbuttons['7'])
+	{
+		ObjectLightSelection = true;
+	}
+
+	if (m_kbuttons['8'])
+	{
+		ObjectLightSelection = false;
+	}
+
+	if (m_kbuttons['T'])
+	{
+		OcclusionCulling = true;
+	}
+
+	if (m_kbuttons['Y'])
+	{
+		OcclusionCulling = false;
+	}
+
 	if (m_currMousePos) 
 	{
 		if (m_currMousePos->Properties->IsRightButtonPressed && m_prevMousePos)
@@ -419,30 +495,44 @@ void Sample3DSceneRenderer::UpdateCamera(DX::StepTimer const& timer, float const
 			m_camera._42 = pos.y;
 			m_camera._43 = pos.z;
 		}
+
+		if (m_currMousePos->Properties->IsLeftButtonPressed)
+		{
+			if (!PickPressed)
+			{
+				PickSceneObject(m_currMousePos->Position.X, m_currMousePos->Position.Y);
+			}
+			PickPressed = true;
+		}
+		else
+		{
+			PickPressed = false;
+		}
+
 		m_prevMousePos = m_currMousePos;
 	}
 
-	if (LightProperties.LightArray[0].direction.x >= 7.5f)
+	if (SceneLights[0].direction.x >= 7.5f)
 	{
-		LightProperties.LightArray[0].direction.x = -7.5f;
+		SceneLights[0].direction.x = -7.5f;
 	}
-	LightProperties.LightArray[0].direction.x = (LightProperties.LightArray[0].direction.x + (delta_time * 2));
+	SceneLights[0].direction.x = (SceneLights[0].direction.x + (delta_time * 2));
 
-	if (LightProperties.LightArray[1].pos.x <= -10.0f && LightProperties.LightArray[1].pos.z <= -10.0f)
+	if (SceneLights[1].pos.x <= -10.0f && SceneLights[1].pos.z <= -10.0f)
 	{
-		LightProperties.LightArray[1].pos.x = 10.0f;
-		LightProperties.LightArray[1].pos.z = 10.0f;
+		SceneLights[1].pos.x = 10.0f;
+		SceneLights[1].pos.z = 10.0f;
 	}
 
-	LightProperties.LightArray[1].pos.x = (LightProperties.LightArray[1].pos.x - (delta_time));
-	LightProperties.LightArray[1].pos.z = (LightProperties.LightArray[1].pos.x - (delta_time));
+	SceneLights[1].pos.x = (SceneLights[1].pos.x - (delta_time));
+	SceneLights[1].pos.z = (SceneLights[1].pos.x - (delta_time));
 
-	if (LightProperties.LightArray[2].angle.z <= -2.0f)
+	if (SceneLights[2].angle.z <= -2.0f)
 	{
-		LightProperties.LightArray[2].angle.z = 2.0f;
+		SceneLights[2].angle.z = 2.0f;
 	}
 
-	LightProperties.LightArray[2].angle.z = LightProperties.LightArray[2].angle.z - (delta_time * 0.5f);
+	SceneLights[2].angle.z = SceneLights[2].angle.z - (delta_time * 0.5f);
 
 	m_time = (float)timer.GetElapsedSeconds();
 }
@@ -492,10 +582,6 @@ void Sample3DSceneRenderer::Render(void)
 		return;
 	}
 
-	auto context = m_deviceResources->GetD3DDeviceContext();
-
-	ID3D11ShaderResourceView* TextureArray[] = { Ground_SRV, GroundNormal_SRV, SkyboxTexture_SRV};
-	
 	D3D11_SAMPLER_DESC Sample1;
 	ZeroMemory(&Sample1, sizeof(D3D11_SAMPLER_DESC));
 	Sample1.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
@@ -512,110 +598,164 @@ void Sample3DSceneRenderer::Render(void)
 	Sample1.MinLOD = -FLT_MAX;
 	Sample1.MaxLOD = FLT_MAX;
 
-	m_deviceResources->GetD3DDevice()->CreateSamplerState(&Sample1, &WrapState);
-
-	ID3D11SamplerState* SampleStates[] = { WrapState };
+	WrapState = StateCache.GetSamplerState(m_deviceResources->GetD3DDevice(), Sample1);
 
 	XMStoreFloat4x4(&m_constantBufferData.view, XMMatrixTranspose(XMMatrixInverse(nullptr, XMLoadFloat4x4(&m_camera))));
 
-	LightProperties.CameraPos = { m_camera._41, m_camera._42, m_camera._43, m_camera._44 };
-
-	XMVECTOR CameraPos = XMLoadFloat4(&LightProperties.CameraPos);
+	CullSceneObjects();
+	OccludeSceneObjects();
 
-	LightProperties.LightArray[0].enabled.x = DLight;
-
-	LightProperties.LightArray[1].enabled.x = PLight;
-
-	LightProperties.LightArray[2].enabled.x = SLight;
-
-	context->UpdateSubresource1(Lights_constantBuffer.Get(), 0, NULL, &LightProperties, 0, 0, 0);
-
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(XMMatrixIdentity()));
-	
-	context->UpdateSubresource1(m_constantBuffer.Get(), 0, NULL, &m_constantBufferData, 0, 0, 0);
-
-	/////////////////////////////////////////////////////
-	//Skybox
-	ID3D11ShaderResourceView* SkyboxTextureArray[] = { SkyboxTexture_SRV };
-
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(XMMatrixTranslationFromVector(CameraPos)));
-
-	context->UpdateSubresource1(m_constantBuffer.Get(), 0, NULL, &m_constantBufferData, 0, 0, 0);
-
-	UINT m_stride = sizeof(VertexPositionColor);
-	UINT m_offset = 0;
-
-	context->IASetVertexBuffers(0, 1, m_vertexBuffer.GetAddressOf(), &m_stride, &m_offset);
-
-	context->IASetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-	context->IASetInputLayout(m_inputLayout.Get());
-
-	context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
-	context->VSSetConstantBuffers1(0, 1, m_constantBuffer.GetAddressOf(), nullptr, nullptr);
-
-	context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
-	context->PSSetShaderResources(0, 1, SkyboxTextureArray);
-	context->PSSetSamplers(0, 1, &SampleStates[0]);
-
-	context->DrawIndexed(m_indexCount, 0, 0);
-
-	context->ClearDepthStencilView(m_deviceResources->GetDepthStencilView(), D3D11_CLEAR_DEPTH, 1.0f, NULL);
-
-	context->PSSetConstantBuffers(1, 1, Lights_constantBuffer.GetAddressOf());
-
-	////////////////////////////////////////////////////////////
-	////Ground Model
-	ID3D11ShaderResourceView* ModelTextureArray[] = { Ground_SRV, GroundNormal_SRV };
-
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(XMMatrixMultiply(XMMatrixRotationY(XMConvertToRadians(90)), XMMatrixMultiply(XMMatrixScaling(100.0f, 100.0f, 100.0f), XMMatrixTranslation(0.0f, 0.0f, 0.0f)))));
-
-	context->UpdateSubresource1(Model_constantBuffer.Get(), 0, NULL, &m_constantBufferData, 0, 0, 0);
+	LightProperties.CameraPos = { m_camera._41, m_camera._42, m_camera._43, m_camera._44 };
 
-	UINT M_stride = sizeof(VertexPositionUVNormalTan);
-	UINT M_offset = 0;
+	SceneLights[0].enabled.x = DLight;
 
-	context->IASetVertexBuffers(0, 1, Model_vertexBuffer.GetAddressOf(), &M_stride, &M_offset);
+	SceneLights[1].enabled.x = PLight;
 
-	context->IASetIndexBuffer(Model_indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	SceneLights[2].enabled.x = SLight;
 
-	context->IASetInputLayout(Model_inputLayout.Get());
-	context->VSSetShader(Model_vertexShader.Get(), nullptr, 0);
-	context->VSSetConstantBuffers1(0, 1, Model_constantBuffer.GetAddressOf(), nullptr, nullptr);
+	// Either every cluster gets its list here, or every draw picks its own as it is recorded.
+	LightProperties.LightSelection = XMUINT4(ObjectLightSelection ? 1 : 0, 0, 0, 0);
+	if (ObjectLightSelection)
+	{
+		auto PrepareStart = chrono::high_resolution_clock::now();
+		ObjectLights.Prepare(SceneLights.data(), GetSceneLightCount());
+		FrameTriangles.LightSelectionSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - PrepareStart).count();
+	}
+	else
+	{
+		BinSceneLights();
+	}
 
-	context->PSSetShader(Model_pixelShader.Get(), nullptr, 0);
-	context->PSSetShaderResources(0, 2, ModelTextureArray);
-	context->PSSetSamplers(0, 1, &SampleStates[0]);
+	// Everything from here on is recorded into FrameCommands and replayed onto the context
+	// by SubmitCommands. The state filter starts the frame knowing nothing about the context.
+	FrameStateFilter.Invalidate();
+	auto RecordStart = chrono::high_resolution_clock::now();
+	double ReplayStart = FrameTriangles.ReplaySeconds;
+
+	// The camera and lights go into the ring once and stay bound for the whole frame.
+	FrameConstants.BeginFrame();
+	ViewProjectionConstantBuffer ViewProjection = { m_constantBufferData.view, m_constantBufferData.projection };
+	FrameConstants.WriteFrameConstants(FrameCommands, CommandStageVertex, 0, &ViewProjection, sizeof(ViewProjection));
+	FrameConstants.WriteFrameConstants(FrameCommands, CommandStagePixel, 1, &LightProperties, sizeof(LightProperties));
+
+	// The lights and cluster lists are rewritten whole every frame with a discard, once their
+	// buffers exist, and stay bound after the material textures. The cluster lists go unread
+	// while draws bring their own.
+	unsigned int LightCount = GetSceneLightCount();
+	const std::vector<unsigned short>& ClusterIndices = LightClusters.GetIndices();
+	if (SceneLightBuffer != nullptr && LightClusterRangeBuffer != nullptr && LightClusterIndexBuffer != nullptr)
+	{
+		FrameCommands.WriteBuffer(SceneLightBuffer.Get(), 0, true, SceneLights.data(), LightCount * sizeof(Lights));
+		if (!ObjectLightSelection)
+		{
+			FrameCommands.WriteBuffer(LightClusterRangeBuffer.Get(), 0, true, LightClusters.GetRanges().data(), LightClusterCount * sizeof(LightClusterRange));
+			if (!ClusterIndices.empty())
+			{
+				FrameCommands.WriteBuffer(LightClusterIndexBuffer.Get(), 0, true, ClusterIndices.data(), (unsigned int)(ClusterIndices.size() * sizeof(unsigned short)));
+			}
+		}
+		ID3D11ShaderResourceView* LightClusterViews[] = { LightCluster_SRVs[0].Get(), LightCluster_SRVs[1].Get(), LightCluster_SRVs[2].Get() };
+		FrameCommands.SetTextures(CommandStagePixel, 2, 3, LightClusterViews);
+	}
 
-	context->DrawIndexed(Model_indexCount, 0, 0);
+	QueueSceneDraws();
 
-	////////////////////////////////////////////////////
-	//BarnA Model
-	ID3D11ShaderResourceView* BarnAModelTextureArray[] = { BarnA_SRV, BarnANormal_SRV };
+	// The queue is sorted by material within each pass, so state is bound once per run.
+	unsigned int BoundMaterial = ~0u;
+	for (const RenderQueueEntry& Entry : FrameQueue.GetEntries())
+	{
+		unsigned int Material = GetSortKeyMaterial(Entry.Key);
+		if (Material != BoundMaterial)
+		{
+			DrawInstanceBatches();
+			BindSceneMaterial(Material);
+			BoundMaterial = Material;
+		}
 
-	XMStoreFloat4x4(&m_constantBufferData.model, XMMatrixTranspose(XMMatrixMultiply(XMMatrixRotationY(XMConvertToRadians(90)), XMMatrixMultiply(XMMatrixScaling(1.0f, 1.0f, 1.0f), XMMatrixTranslation(0.0f, 0.0f, 0.0f)))));
+		DrawSceneItem(Entry.Item);
+	}
+	DrawInstanceBatches();
 
-	context->UpdateSubresource1(BarnAModel_constantBuffer.Get(), 0, NULL, &m_constantBufferData, 0, 0, 0);
+	SubmitCommands();
+	FrameTriangles.RecordSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - RecordStart).count() - (FrameTriangles.ReplaySeconds - ReplayStart);
 
-	UINT BarnAM_stride = sizeof(VertexPositionUVNormalTan);
-	UINT BarnAM_offset = 0;
+	FrameTriangles.StateObjectHits += StateCache.GetHits();
+	FrameTriangles.StateObjectMisses += StateCache.GetMisses();
+	StateCache.ResetCounts();
 
-	context->IASetVertexBuffers(0, 1, BarnAModel_vertexBuffer.GetAddressOf(), &BarnAM_stride, &BarnAM_offset);
+	FrameTriangles.ConstantAllocations += FrameConstants.Allocations;
+	FrameTriangles.ConstantRingBytes += FrameConstants.BytesAllocated;
+	FrameTriangles.ConstantDiscards += FrameConstants.Discards;
+	FrameConstants.ResetCounts();
 
-	context->IASetIndexBuffer(BarnAModel_indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	FrameTriangles.InstanceBatches += CastleInstances.Batches;
+	FrameTriangles.InstancedObjects += CastleInstances.Instances;
+	CastleInstances.ResetCounts();
 
-	context->IASetInputLayout(BarnAModel_inputLayout.Get());
-	context->VSSetShader(BarnAModel_vertexShader.Get(), nullptr, 0);
-	context->VSSetConstantBuffers1(0, 1, BarnAModel_constantBuffer.GetAddressOf(), nullptr, nullptr);
+	FrameTriangles.LightSelections += ObjectLights.Selections;
+	FrameTriangles.LightsInRange += ObjectLights.LightsInRange;
+	FrameTriangles.SelectedLights += ObjectLights.LightsSelected;
+	ObjectLights.ResetCounts();
 
-	context->PSSetShader(BarnAModel_pixelShader.Get(), nullptr, 0);
-	context->PSSetShaderResources(0, 2, BarnAModelTextureArray);
-	context->PSSetSamplers(0, 1, &SampleStates[0]);
+	FrameTriangles.Frames = 1;
+	ReportTriangles.Add(FrameTriangles);
+	if (WalkthroughTime >= 0.0f)
+	{
+		WalkthroughTriangles.Add(FrameTriangles);
+	}
+	FrameTriangles = TriangleStats();
 
-	context->DrawIndexed(BarnAModel_indexCount, 0, 0);
+	TriangleReportTime += m_time;
+	if (TriangleReportTime >= 2.0f)
+	{
+		const TriangleStats& Stats = ReportTriangles;
+
+		char Line[256];
+		sprintf_s(Line, "LOD: %llu of %llu triangles per frame (%.1f%%)\n", Stats.Submitted / Stats.Frames, Stats.FullDetail / Stats.Frames,
+			100.0 * Stats.Submitted / max(Stats.FullDetail, 1ull));
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Clusters: %llu of %llu triangles culled per frame (frustum %llu, backface %llu)\n", (Stats.FrustumCulled + Stats.BackfaceCulled) / Stats.Frames,
+			Stats.ClusterTested / Stats.Frames, Stats.FrustumCulled / Stats.Frames, Stats.BackfaceCulled / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Objects: %llu of %llu visible per frame, %llu BVH nodes visited, culled in %.4f ms\n", Stats.ObjectsVisible / Stats.Frames, Stats.ObjectsTested / Stats.Frames,
+			Stats.ObjectNodesVisited / Stats.Frames, Stats.ObjectCullSeconds * 1000.0 / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Occlusion: %llu objects occluded per frame by %llu occluder triangles, %.4f ms\n", Stats.ObjectsOccluded / Stats.Frames,
+			Stats.OccluderTriangles / Stats.Frames, Stats.OcclusionSeconds * 1000.0 / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Commands: %llu per frame (%.1f KB), recorded in %.4f ms, replayed in %.4f ms\n", Stats.Commands / Stats.Frames,
+			Stats.CommandBytes / 1024.0 / Stats.Frames, Stats.RecordSeconds * 1000.0 / Stats.Frames, Stats.ReplaySeconds * 1000.0 / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "State: %llu of %llu state calls eliminated per frame\n", Stats.StateCallsEliminated / Stats.Frames, Stats.StateCalls / Stats.Frames);
+		OutputDebugStringA(Line);
+
+		// The light queries feed nothing the frame draws, so they only run for this report.
+		BvhQueryStats LightStats;
+		unsigned int LightQueries = QueryLitObjects(&LightStats);
+		sprintf_s(Line, "Lights: %u queries reaching %u objects, %u BVH nodes visited\n", LightQueries, LightStats.ObjectsFound, LightStats.NodesVisited);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Queue: %llu draws per frame, queued and sorted in %.4f ms\n", Stats.QueuedDraws / Stats.Frames, Stats.QueueSeconds * 1000.0 / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "State objects: %llu cache hits and %llu misses over %u frames, %zu objects\n", Stats.StateObjectHits, Stats.StateObjectMisses,
+			Stats.Frames, StateCache.GetCount());
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Constants: %llu allocations per frame (%.1f KB of a %u KB ring), %llu discards per frame\n", Stats.ConstantAllocations / Stats.Frames,
+			Stats.ConstantRingBytes / 1024.0 / Stats.Frames, ConstantRingSize / 1024, Stats.ConstantDiscards / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Instancing: %llu castles per frame in %llu instanced batches\n", Stats.InstancedObjects / Stats.Frames, Stats.InstanceBatches / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Static batches: %llu cell draws per frame standing in for %llu castles\n", Stats.StaticBatchDraws / Stats.Frames, Stats.StaticBatchObjects / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Light clusters: %llu lights binned per frame into %llu indices (%.2f per cluster), %.4f ms\n", Stats.ClusteredLights / Stats.Frames,
+			Stats.ClusterLightIndices / Stats.Frames, (double)Stats.ClusterLightIndices / Stats.Frames / LightClusterCount, Stats.LightClusterSeconds * 1000.0 / Stats.Frames);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "Light selection: %llu draws per frame, %.2f lights in range and %.2f kept per draw, %.4f ms\n", Stats.LightSelections / Stats.Frames,
+			(double)Stats.LightsInRange / max(Stats.LightSelections, 1ull), (double)Stats.SelectedLights / max(Stats.LightSelections, 1ull), Stats.LightSelectionSeconds * 1000.0 / Stats.Frames);
+		OutputDebugStringA(Line);
+
+		ReportTriangles = TriangleStats();
+		TriangleReportTime = 0.0f;
+	}
 }
 
 void Sample3DSceneRenderer::CreateDeviceDependentResources(void)
@@ -643,8 +783,43 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources(void)
 	{
 		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(&fileData[0], fileData.size(), nullptr, &m_pixelShader));
 
-		CD3D11_BUFFER_DESC constantBufferDesc(sizeof(ModelViewProjectionConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
-		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&constantBufferDesc, nullptr, &m_constantBuffer));
+		// The ring is created here, before m_loadingComplete is set, so Render never records into
+		// it early. Binding it at an offset and mapping it NO_OVERWRITE both need D3D11.1
+		// constant buffer support.
+		D3D11_FEATURE_DATA_D3D11_OPTIONS Options = {};
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &Options, sizeof(Options)));
+		if (!Options.ConstantBufferOffsetting || !Options.MapNoOverwriteOnDynamicConstantBuffer)
+		{
+			DX::ThrowIfFailed(DXGI_ERROR_UNSUPPORTED);
+		}
+
+		CD3D11_BUFFER_DESC ConstantRingDesc(ConstantRingSize, D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ConstantRingDesc, nullptr, &ConstantRing));
+		FrameConstants.Reset(ConstantRing.Get(), ConstantRingSize);
+
+		// The light and cluster buffers are rewritten from the first frame on, so they are created
+		// alongside the ring. Lights go up as raw uint4s, which the pixel shaders unpack; see LIGHT_SIZE.
+		CD3D11_BUFFER_DESC SceneLightDesc(MaxSceneLights * sizeof(Lights), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&SceneLightDesc, nullptr, &SceneLightBuffer));
+		CD3D11_SHADER_RESOURCE_VIEW_DESC SceneLightViewDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_R32G32B32A32_UINT, 0, MaxSceneLights * sizeof(Lights) / 16);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateShaderResourceView(SceneLightBuffer.Get(), &SceneLightViewDesc, &LightCluster_SRVs[0]));
+
+		CD3D11_BUFFER_DESC ClusterRangeDesc(LightClusterCount * sizeof(LightClusterRange), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ClusterRangeDesc, nullptr, &LightClusterRangeBuffer));
+		CD3D11_SHADER_RESOURCE_VIEW_DESC ClusterRangeViewDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_R32G32_UINT, 0, LightClusterCount);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateShaderResourceView(LightClusterRangeBuffer.Get(), &ClusterRangeViewDesc, &LightCluster_SRVs[1]));
+
+		CD3D11_BUFFER_DESC ClusterIndexDesc(MaxLightClusterIndices * sizeof(unsigned short), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ClusterIndexDesc, nullptr, &LightClusterIndexBuffer));
+		CD3D11_SHADER_RESOURCE_VIEW_DESC ClusterIndexViewDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_R16_UINT, 0, MaxLightClusterIndices);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateShaderResourceView(LightClusterIndexBuffer.Get(), &ClusterIndexViewDesc, &LightCluster_SRVs[2]));
+
+		// The skybox is drawn last at the far plane, so it passes only where the depth buffer
+		// still holds the clear value and never writes depth itself.
+		CD3D11_DEPTH_STENCIL_DESC SkyDepthDesc(D3D11_DEFAULT);
+		SkyDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		SkyDepthDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+		SkyDepthState = StateCache.GetDepthStencilState(m_deviceResources->GetD3DDevice(), SkyDepthDesc);
 
 		auto loadnewVSTask = DX::ReadDataAsync(L"TexturingVertexShader.cso");
 		auto loadnewPSTask = DX::ReadDataAsync(L"TexturingPixelShader.cso");
@@ -665,9 +840,6 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources(void)
 		// After the pixel shader file is loaded, create the shader and constant buffer.
 		auto createnewPSTask = loadnewPSTask.then([this](const std::vector<byte>& fileData)
 		{
-			CD3D11_BUFFER_DESC LightsconstantBufferDesc(sizeof(LightProp), D3D11_BIND_CONSTANT_BUFFER);
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&LightsconstantBufferDesc, nullptr, &Lights_constantBuffer));
-
 		});
 
 		CreateDDSTextureFromFile(m_deviceResources->GetD3DDevice(), L"Assets/OutputCube2.dds", (ID3D11Resource**)&SkyboxTexture, &SkyboxTexture_SRV);
@@ -718,32 +890,46 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources(void)
 			SpotLight.type = { 2, 0 };
 			SpotLight.padding = { 0, 0, 0, 0 };
 
-			LightProperties.LightArray[0] = DirLight;
-			LightProperties.LightArray[1] = PointLight;
-			LightProperties.LightArray[2] = SpotLight;
+			SceneLights[0] = DirLight;
+			SceneLights[1] = PointLight;
+			SceneLights[2] = SpotLight;
 #pragma endregion
 
 		});
 
-		auto VSTask = DX::ReadDataAsync(L"NormalTexturingVertexShader.cso");
+		auto VSTask = DX::ReadDataAsync(QuantizedModels ? L"QuantizedVertexShader.cso" : L"NormalTexturingVertexShader.cso");
 		auto PSTask = DX::ReadDataAsync(L"NormalTexturingPixelShader.cso");
 
 		// After the vertex shader file is loaded, create the shader and input layout.
 		auto cVSTask = VSTask.then([this](const std::vector<byte>& fileData)
 		{
 			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(&fileData[0], fileData.size(), nullptr, &Model_vertexShader));
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(&fileData[0], fileData.size(), nullptr, &BarnAModel_vertexShader));
+			// Both models draw with the same shaders and layout. Sharing the objects lets the state
+			// filter skip rebinding them between the two.
+			BarnAModel_vertexShader = Model_vertexShader;
 
 			static const D3D11_INPUT_ELEMENT_DESC vertDesc[] =
 			{
 				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 				{ "UV", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 				{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			};
+
+			// Matches VertexQuantized.
+			static const D3D11_INPUT_ELEMENT_DESC quantizedDesc[] =
+			{
+				{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "UV", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 			};
 
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateInputLayout(vertDesc, ARRAYSIZE(vertDesc), &fileData[0], fileData.size(), &Model_inputLayout));
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateInputLayout(vertDesc, ARRAYSIZE(vertDesc), &fileData[0], fileData.size(), &BarnAModel_inputLayout));
+			const D3D11_INPUT_ELEMENT_DESC* layoutDesc = QuantizedModels ? quantizedDesc : vertDesc;
+			UINT layoutCount = QuantizedModels ? ARRAYSIZE(quantizedDesc) : ARRAYSIZE(vertDesc);
+
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateInputLayout(layoutDesc, layoutCount, &fileData[0], fileData.size(), &Model_inputLayout));
+			BarnAModel_inputLayout = Model_inputLayout;
 
 		});
 
@@ -751,174 +937,87 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources(void)
 		auto cPSTask = PSTask.then([this](const std::vector<byte>& fileData)
 		{
 			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(&fileData[0], fileData.size(), nullptr, &Model_pixelShader));
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(&fileData[0], fileData.size(), nullptr, &BarnAModel_pixelShader));
-
-			CD3D11_BUFFER_DESC newconstantBufferDesc(sizeof(ModelViewProjectionConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&newconstantBufferDesc, nullptr, &Model_constantBuffer));
-			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&newconstantBufferDesc, nullptr, &BarnAModel_constantBuffer));
+			BarnAModel_pixelShader = Model_pixelShader;
+		});
 
+		// The instanced castle shader reads the same vertices as NormalTexturingVertexShader, so
+		// it draws with the same input layout. The quantized models have none and draw one by one.
+		auto InstancedVSTask = DX::ReadDataAsync(L"NormalTexturingInstancedVertexShader.cso");
+		auto cInstancedVSTask = InstancedVSTask.then([this](const std::vector<byte>& fileData)
+		{
+			if (!QuantizedModels)
+			{
+				DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(&fileData[0], fileData.size(), nullptr, &BarnAModel_instancedVertexShader));
+			}
 		});
 
-		auto createTask = (cVSTask && cPSTask).then([this]()
+		auto createTask = (cVSTask && cPSTask && cInstancedVSTask).then([this]()
 		{
 
 #pragma region Models
-			Loaded = LoadOBJFile("Assets/DigiFarm.obj", &FirstModel);
-
-			if (Loaded)
+#if defined(_DEBUG)
+			SetReportWriter([](const char* Line) { OutputDebugStringA(Line); });
+			ReportOBJImportScaling("Assets/DigiFarm.obj");
+			ReportOBJImportScaling("Assets/Hyrule_Castle1.obj");
+			ReportOBJParseThroughput("Assets/DigiFarm.obj");
+			ReportOBJParseThroughput("Assets/Hyrule_Castle1.obj");
+			ReportTangentGeneration("Assets/DigiFarm.obj");
+			ReportTangentGeneration("Assets/Hyrule_Castle1.obj");
+			ReportFrustumCulling();
+			ReportSceneBvh();
+			ReportOcclusionCulling("Assets/OcclusionReference.pgm");
+			ReportTriangleBvh();
+			ReportCommandBuffer();
+			ReportStateFilter();
+			ReportRenderQueue();
+			ReportStateObjectCache(m_deviceResources->GetD3DDevice());
+			ReportConstantAllocator();
+			ReportInstancing();
+			ReportLightClustering();
+			ReportLightSelection();
+#endif
+
+			unsigned int VertexFormat = QuantizedModels ? CookedVertexQuantized : CookedVertexFull;
+
+			// Render does not touch a model until its flag is set below, after the mesh and its
+			// buffers are complete, so they can be filled in here while frames are drawn.
+			ObjectLoadStats ModelStats;
+			bool ModelLoaded = LoadCookedMesh("Assets/DigiFarm.obj", GetMeshCachePath("DigiFarm").c_str(), &FirstModel, &ModelStats, 0, VertexFormat);
+
+			if (ModelLoaded)
 			{
-				unsigned int ModelSize = FirstModel.MeshVerts.size();
-				VertexPositionUVNormalTan* ModelVertices = new VertexPositionUVNormalTan[ModelSize];
-
-				for (unsigned int i = 0; i < ModelSize; i++)
-				{
-					ModelVertices[i].pos = FirstModel.MeshVerts[i].Position;
-					ModelVertices[i].uv = FirstModel.MeshVerts[i].UVW;
-					ModelVertices[i].normal = FirstModel.MeshVerts[i].Normals;
-					ModelVertices[i].tangent = { 0.0f, 0.0f, 0.0f };
-				}
-
-				unsigned int ModelIndicesSize = FirstModel.MeshIndecies.size();
-				unsigned short* ModelIndices = new unsigned short[ModelIndicesSize];
-
-				for (unsigned int i = 0; i < ModelIndicesSize; i++)
+				if (!FirstModel.FromCache)
 				{
-					ModelIndices[i] = FirstModel.MeshIndecies[i];
+					ReportLoadStats("DigiFarm.obj", ModelStats);
 				}
+				ReportCookedMesh("DigiFarm.obj", FirstModel);
+#if defined(_DEBUG)
+				ReportTriangleBvhRays("DigiFarm.obj", FirstModel.Bvh, FirstModel.Bounds.Min, FirstModel.Bounds.Max);
+#endif
 
-				for (unsigned int i = 0; i < ModelIndicesSize; i += 3)
-				{
-					float x1 = ModelVertices[ModelIndices[i + 1]].pos.x - ModelVertices[ModelIndices[i]].pos.x;
-					float x2 = ModelVertices[ModelIndices[i + 2]].pos.x - ModelVertices[ModelIndices[i]].pos.x;
-					float y1 = ModelVertices[ModelIndices[i + 1]].pos.y - ModelVertices[ModelIndices[i]].pos.y;
-					float y2 = ModelVertices[ModelIndices[i + 2]].pos.y - ModelVertices[ModelIndices[i]].pos.y;
-					float z1 = ModelVertices[ModelIndices[i + 1]].pos.z - ModelVertices[ModelIndices[i]].pos.z;
-					float z2 = ModelVertices[ModelIndices[i + 2]].pos.z - ModelVertices[ModelIndices[i]].pos.z;
-
-					float s1 = ModelVertices[ModelIndices[i + 1]].uv.x - ModelVertices[ModelIndices[i]].uv.x;
-					float s2 = ModelVertices[ModelIndices[i + 2]].uv.x - ModelVertices[ModelIndices[i]].uv.x;
-					float t1 = ModelVertices[ModelIndices[i + 1]].uv.y - ModelVertices[ModelIndices[i]].uv.y;
-					float t2 = ModelVertices[ModelIndices[i + 2]].uv.y - ModelVertices[ModelIndices[i]].uv.y;
-
-					float r = 1.0f / ((s1 * t2) - (s2 * t1));
-
-					XMFLOAT3 Sdir = { (((t2 * x1) - (t1 * x2)) * r), (((t2 * y1) - (t1 * y2)) * r), (((t2 * z1) - (t1 * z2)) * r) };
-					XMFLOAT3 Tdir = { (((s1 * x2) - (s2 * x1)) * r), (((s1 * y2) - (s2 * y1)) * r), (((s1 * z2) - (s2 * z1)) * r) };
-
-					XMVECTOR S = XMLoadFloat3(&Sdir);
-					XMVECTOR T = XMLoadFloat3(&Tdir);
-					XMVECTOR N1 = XMLoadFloat3(&ModelVertices[ModelIndices[i]].normal);
-					XMVECTOR N2 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 1]].normal);
-					XMVECTOR N3 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 2]].normal);
-
-					XMVECTOR Tangent1 = XMLoadFloat3(&ModelVertices[ModelIndices[i]].tangent);
-					XMVECTOR Tangent2 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 1]].tangent);
-					XMVECTOR Tangent3 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 2]].tangent);
-
-					XMVECTOR Tan1 = XMVector3Cross(S, N1) + Tangent1;
-					XMVECTOR Tan2 = XMVector3Cross(S, N2) + Tangent2;
-					XMVECTOR Tan3 = XMVector3Cross(S, N3) + Tangent3;
-
-					XMStoreFloat3(&ModelVertices[ModelIndices[i]].tangent, Tan1);
-					XMStoreFloat3(&ModelVertices[ModelIndices[i + 1]].tangent, Tan2);
-					XMStoreFloat3(&ModelVertices[ModelIndices[i + 2]].tangent, Tan3);
-				}
-
-				D3D11_SUBRESOURCE_DATA ModelvertexBufferData = { 0 };
-				ModelvertexBufferData.pSysMem = ModelVertices;
-				ModelvertexBufferData.SysMemPitch = 0;
-				ModelvertexBufferData.SysMemSlicePitch = 0;
-				CD3D11_BUFFER_DESC ModelvertexBufferDesc(sizeof(VertexPositionUVNormalTan) * ModelSize, D3D11_BIND_VERTEX_BUFFER);
-				DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ModelvertexBufferDesc, &ModelvertexBufferData, &Model_vertexBuffer));
-
-				Model_indexCount = ModelIndicesSize;
-
-				D3D11_SUBRESOURCE_DATA ModelindexBufferData = { 0 };
-				ModelindexBufferData.pSysMem = ModelIndices;
-				ModelindexBufferData.SysMemPitch = 0;
-				ModelindexBufferData.SysMemSlicePitch = 0;
-				CD3D11_BUFFER_DESC ModelindexBufferDesc(sizeof(unsigned short) * ModelIndicesSize, D3D11_BIND_INDEX_BUFFER);
-				DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ModelindexBufferDesc, &ModelindexBufferData, &Model_indexBuffer));
+				CreateModelBuffers(FirstModel, Model_vertexBuffer, Model_vertexStride, Model_indexBuffer, Model_indexFormat, Model_quantizationBuffer, Model_submeshes, Model_lods,
+					Model_meshlets, Model_clusterIndexBuffer);
 			}
+			Loaded = ModelLoaded;
 
-			BarnALoaded = LoadOBJFile("Assets/Hyrule_Castle1.obj", &BarnAModel);
+			ObjectLoadStats BarnAStats;
+			bool CastleLoaded = LoadCookedMesh("Assets/Hyrule_Castle1.obj", GetMeshCachePath("Hyrule_Castle1").c_str(), &BarnAModel, &BarnAStats, 0, VertexFormat);
 
-			if (BarnALoaded)
+			if (CastleLoaded)
 			{
-				unsigned int ModelSize = BarnAModel.MeshVerts.size();
-				VertexPositionUVNormalTan* ModelVertices = new VertexPositionUVNormalTan[ModelSize];
-
-				for (unsigned int i = 0; i < ModelSize; i++)
-				{
-					ModelVertices[i].pos = BarnAModel.MeshVerts[i].Position;
-					ModelVertices[i].uv = BarnAModel.MeshVerts[i].UVW;
-					ModelVertices[i].normal = BarnAModel.MeshVerts[i].Normals;
-					ModelVertices[i].tangent = { 0.0f, 0.0f, 0.0f };
-				}
-
-				unsigned int ModelIndicesSize = BarnAModel.MeshIndecies.size();
-				unsigned short* ModelIndices = new unsigned short[ModelIndicesSize];
-
-				for (unsigned int i = 0; i < ModelIndicesSize; i++)
+				if (!BarnAModel.FromCache)
 				{
-					ModelIndices[i] = BarnAModel.MeshIndecies[i];
+					ReportLoadStats("Hyrule_Castle1.obj", BarnAStats);
 				}
+				ReportCookedMesh("Hyrule_Castle1.obj", BarnAModel);
+#if defined(_DEBUG)
+				ReportTriangleBvhRays("Hyrule_Castle1.obj", BarnAModel.Bvh, BarnAModel.Bounds.Min, BarnAModel.Bounds.Max);
+#endif
 
-				for (unsigned int i = 0; i < ModelIndicesSize; i += 3)
-				{
-					float x1 = ModelVertices[ModelIndices[i + 1]].pos.x - ModelVertices[ModelIndices[i]].pos.x;
-					float x2 = ModelVertices[ModelIndices[i + 2]].pos.x - ModelVertices[ModelIndices[i]].pos.x;
-					float y1 = ModelVertices[ModelIndices[i + 1]].pos.y - ModelVertices[ModelIndices[i]].pos.y;
-					float y2 = ModelVertices[ModelIndices[i + 2]].pos.y - ModelVertices[ModelIndices[i]].pos.y;
-					float z1 = ModelVertices[ModelIndices[i + 1]].pos.z - ModelVertices[ModelIndices[i]].pos.z;
-					float z2 = ModelVertices[ModelIndices[i + 2]].pos.z - ModelVertices[ModelIndices[i]].pos.z;
-
-					float s1 = ModelVertices[ModelIndices[i + 1]].uv.x - ModelVertices[ModelIndices[i]].uv.x;
-					float s2 = ModelVertices[ModelIndices[i + 2]].uv.x - ModelVertices[ModelIndices[i]].uv.x;
-					float t1 = ModelVertices[ModelIndices[i + 1]].uv.y - ModelVertices[ModelIndices[i]].uv.y;
-					float t2 = ModelVertices[ModelIndices[i + 2]].uv.y - ModelVertices[ModelIndices[i]].uv.y;
-
-					float r = 1.0f / ((s1 * t2) - (s2 * t1));
-
-					XMFLOAT3 Sdir = { (((t2 * x1) - (t1 * x2)) * r), (((t2 * y1) - (t1 * y2)) * r), (((t2 * z1) - (t1 * z2)) * r) };
-					XMFLOAT3 Tdir = { (((s1 * x2) - (s2 * x1)) * r), (((s1 * y2) - (s2 * y1)) * r), (((s1 * z2) - (s2 * z1)) * r) };
-
-					XMVECTOR S = XMLoadFloat3(&Sdir);
-					XMVECTOR T = XMLoadFloat3(&Tdir);
-					XMVECTOR N1 = XMLoadFloat3(&ModelVertices[ModelIndices[i]].normal);
-					XMVECTOR N2 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 1]].normal);
-					XMVECTOR N3 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 2]].normal);
-
-					XMVECTOR Tangent1 = XMLoadFloat3(&ModelVertices[ModelIndices[i]].tangent);
-					XMVECTOR Tangent2 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 1]].tangent);
-					XMVECTOR Tangent3 = XMLoadFloat3(&ModelVertices[ModelIndices[i + 2]].tangent);
-
-					XMVECTOR Tan1 = XMVector3Cross(S, N1) + Tangent1;
-					XMVECTOR Tan2 = XMVector3Cross(S, N2) + Tangent2;
-					XMVECTOR Tan3 = XMVector3Cross(S, N3) + Tangent3;
-
-					XMStoreFloat3(&ModelVertices[ModelIndices[i]].tangent, Tan1);
-					XMStoreFloat3(&ModelVertices[ModelIndices[i + 1]].tangent, Tan2);
-					XMStoreFloat3(&ModelVertices[ModelIndices[i + 2]].tangent, Tan3);
-				}
-
-				D3D11_SUBRESOURCE_DATA ModelvertexBufferData = { 0 };
-				ModelvertexBufferData.pSysMem = ModelVertices;
-				ModelvertexBufferData.SysMemPitch = 0;
-				ModelvertexBufferData.SysMemSlicePitch = 0;
-				CD3D11_BUFFER_DESC ModelvertexBufferDesc(sizeof(VertexPositionUVNormalTan) * ModelSize, D3D11_BIND_VERTEX_BUFFER);
-				DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ModelvertexBufferDesc, &ModelvertexBufferData, &BarnAModel_vertexBuffer));
-
-				BarnAModel_indexCount = ModelIndicesSize;
-
-				D3D11_SUBRESOURCE_DATA ModelindexBufferData = { 0 };
-				ModelindexBufferData.pSysMem = ModelIndices;
-				ModelindexBufferData.SysMemPitch = 0;
-				ModelindexBufferData.SysMemSlicePitch = 0;
-				CD3D11_BUFFER_DESC ModelindexBufferDesc(sizeof(unsigned short) * ModelIndicesSize, D3D11_BIND_INDEX_BUFFER);
-				DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ModelindexBufferDesc, &ModelindexBufferData, &BarnAModel_indexBuffer));
+				CreateModelBuffers(BarnAModel, BarnAModel_vertexBuffer, BarnAModel_vertexStride, BarnAModel_indexBuffer, BarnAModel_indexFormat, BarnAModel_quantizationBuffer, BarnAModel_submeshes, BarnAModel_lods,
+					BarnAModel_meshlets, BarnAModel_clusterIndexBuffer);
 			}
-
+			BarnALoaded = CastleLoaded;
 
 #pragma endregion
 		});
@@ -995,16 +1094,920 @@ void Sample3DSceneRenderer::CreateDeviceDependentResources(void)
 
 }
 
+// Issues one draw per 16-bit addressable part of a model.
+// Picks the coarsest level whose simplification error projects to at most LodPixelError
+// pixels, measured at the nearest point of the world space bounding sphere.
+unsigned int Sample3DSceneRenderer::SelectLod(const std::vector<CookedLod>& Lods, const MeshBounds& Bounds, FXMMATRIX World)
+{
+	if (Lods.size() < 2)
+	{
+		return 0;
+	}
+
+	XMVECTOR Center = XMVector3Transform(XMLoadFloat3(&Bounds.Center), World);
+	float Scale = sqrtf(max(XMVectorGetX(XMVector3LengthSq(World.r[0])), max(XMVectorGetX(XMVector3LengthSq(World.r[1])), XMVectorGetX(XMVector3LengthSq(World.r[2])))));
+	float Radius = Bounds.Radius * Scale;
+
+	XMVECTOR Eye = XMVectorSet(m_camera._41, m_camera._42, m_camera._43, 1.0f);
+	float Distance = max(XMVectorGetX(XMVector3Length(XMVectorSubtract(Center, Eye))) - Radius, NearPlane);
+
+	// Pixels per world unit at that distance.
+	float PixelsPerUnit = m_deviceResources->GetOutputSize().Height / (2.0f * tanf(0.5f * fovAngleY) * Distance);
+
+	unsigned int Lod = 0;
+	while (Lod + 1 < Lods.size() && Lods[Lod + 1].Error * Scale * PixelsPerUnit <= LodPixelError)
+	{
+		Lod++;
+	}
+	return Lod;
+}
+
+// Draws every submesh of a level of detail, InstanceCount times when called for a batch.
+void Sample3DSceneRenderer::DrawSubmeshes(const std::vector<CookedSubmesh>& Submeshes, const std::vector<CookedLod>& Lods, unsigned int Lod, unsigned int InstanceCount)
+{
+	if (Lods.empty())
+	{
+		return;
+	}
+
+	const CookedLod& Level = Lods[Lod];
+	for (unsigned int s = Level.SubmeshStart; s < Level.SubmeshStart + Level.SubmeshCount; s++)
+	{
+		const CookedSubmesh& Part = Submeshes[s];
+		if (InstanceCount == 1)
+		{
+			FrameCommands.DrawIndexed(Part.IndexCount, Part.IndexStart, Part.BaseVertex);
+		}
+		else
+		{
+			FrameCommands.DrawIndexedInstanced(Part.IndexCount, InstanceCount, Part.IndexStart, Part.BaseVertex);
+		}
+	}
+
+	FrameTriangles.Submitted += Level.IndexCount / 3 * InstanceCount;
+	FrameTriangles.FullDetail += Lods[0].IndexCount / 3 * InstanceCount;
+}
+
+// Queues the sky and every visible object, or the static batch cell it belongs to. Objects
+// sort by material and then front to back by the view depth of their box centre.
+void Sample3DSceneRenderer::QueueSceneDraws(void)
+{
+	auto QueueStart = chrono::high_resolution_clock::now();
+
+	XMMATRIX View = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.view));
+
+	FrameQueue.Clear();
+	FrameQueue.Push(MakeSortKey(RenderPassSky, false, SceneShaderSky, SceneMaterialSky, 0), SkyItem);
+
+	std::fill(StressBatchLods.begin(), StressBatchLods.end(), ~0u);
+	bool Batching = StaticBatching && StressBatch_indexBuffer != nullptr;
+
+	bool GroundReady = Loaded;
+	bool CastleReady = BarnALoaded;
+
+	for (unsigned int Object : VisibleObjects)
+	{
+		// A model is drawn only once its loading task has published it.
+		if (!(Object == 0 ? GroundReady : CastleReady))
+		{
+			continue;
+		}
+
+		// A visible stress castle stands in for its whole cell, which is queued once, unless the
+		// cell needs a level that was not merged.
+		unsigned int Batch = Batching && Object >= FirstStressObject ? StressBatches.SourceBatches[Object - FirstStressObject] : ~0u;
+		if (Batch != ~0u)
+		{
+			const StaticBatch& Cell = StressBatches.Batches[Batch];
+			if (StressBatchLods[Batch] == ~0u)
+			{
+				StressBatchLods[Batch] = SelectLod(Cell.Lods, Cell.Bounds, XMMatrixIdentity());
+				if (Cell.Lods[StressBatchLods[Batch]].SubmeshCount > 0)
+				{
+					float CellDepth = XMVectorGetZ(XMVector3Transform(XMLoadFloat3(&Cell.Bounds.Center), View));
+					FrameQueue.Push(MakeSortKey(RenderPassScene, false, SceneShaderModel, SceneMaterialCastleBatch, GetDepthBucket(CellDepth, NearPlane, FarPlane)), StaticBatchItem | Batch);
+				}
+			}
+
+			if (Cell.Lods[StressBatchLods[Batch]].SubmeshCount > 0)
+			{
+				continue;
+			}
+		}
+
+		XMVECTOR Center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&SceneMins[Object]), XMLoadFloat3(&SceneMaxs[Object])), 0.5f);
+		float Depth = XMVectorGetZ(XMVector3Transform(Center, View));
+		unsigned int Material = Object == 0 ? SceneMaterialGround : SceneMaterialCastle;
+		FrameQueue.Push(MakeSortKey(RenderPassScene, false, SceneShaderModel, Material, GetDepthBucket(Depth, NearPlane, FarPlane)), Object);
+	}
+
+	FrameQueue.Sort();
+
+	FrameTriangles.QueuedDraws += FrameQueue.GetCount();
+	FrameTriangles.QueueSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - QueueStart).count();
+}
+
+// Records the pipeline, buffers, textures and samplers of a SceneMaterial.
+void Sample3DSceneRenderer::BindSceneMaterial(unsigned int Material)
+{
+	ID3D11SamplerState* SampleStates[] = { WrapState };
+
+	switch (Material)
+	{
+	case SceneMaterialSky:
+	{
+		ID3D11ShaderResourceView* SkyboxTextureArray[] = { SkyboxTexture_SRV };
+
+		FrameCommands.SetPipeline(m_inputLayout.Get(), m_vertexShader.Get(), m_pixelShader.Get(), D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		FrameCommands.SetDepthState(SkyDepthState);
+		FrameCommands.SetVertexBuffer(0, m_vertexBuffer.Get(), sizeof(VertexPositionColor));
+		FrameCommands.SetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R16_UINT);
+		FrameCommands.SetTextures(CommandStagePixel, 0, 1, SkyboxTextureArray);
+		FrameCommands.SetSamplers(CommandStagePixel, 0, 1, SampleStates);
+		break;
+	}
+	case SceneMaterialGround:
+	{
+		ID3D11ShaderResourceView* ModelTextureArray[] = { Ground_SRV, GroundNormal_SRV };
+
+		FrameCommands.SetPipeline(Model_inputLayout.Get(), Model_vertexShader.Get(), Model_pixelShader.Get(), D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		FrameCommands.SetDepthState(nullptr);
+		FrameCommands.SetVertexBuffer(0, Model_vertexBuffer.Get(), Model_vertexStride);
+		FrameCommands.SetIndexBuffer(Model_indexBuffer.Get(), Model_indexFormat);
+		FrameCommands.SetConstantBuffer(CommandStageVertex, 1, Model_quantizationBuffer.Get());
+		FrameCommands.SetTextures(CommandStagePixel, 0, 2, ModelTextureArray);
+		FrameCommands.SetSamplers(CommandStagePixel, 0, 1, SampleStates);
+		break;
+	}
+	case SceneMaterialCastle:
+	{
+		ID3D11ShaderResourceView* BarnAModelTextureArray[] = { BarnA_SRV, BarnANormal_SRV };
+
+		FrameCommands.SetPipeline(BarnAModel_inputLayout.Get(), BarnAModel_vertexShader.Get(), BarnAModel_pixelShader.Get(), D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		FrameCommands.SetDepthState(nullptr);
+		FrameCommands.SetVertexBuffer(0, BarnAModel_vertexBuffer.Get(), BarnAModel_vertexStride);
+		FrameCommands.SetIndexBuffer(BarnAModel_indexBuffer.Get(), BarnAModel_indexFormat);
+		FrameCommands.SetConstantBuffer(CommandStageVertex, 1, BarnAModel_quantizationBuffer.Get());
+		FrameCommands.SetTextures(CommandStagePixel, 0, 2, BarnAModelTextureArray);
+		FrameCommands.SetSamplers(CommandStagePixel, 0, 1, SampleStates);
+		break;
+	}
+	case SceneMaterialCastleBatch:
+	{
+		ID3D11ShaderResourceView* BarnAModelTextureArray[] = { BarnA_SRV, BarnANormal_SRV };
+
+		FrameCommands.SetPipeline(BarnAModel_inputLayout.Get(), BarnAModel_vertexShader.Get(), BarnAModel_pixelShader.Get(), D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		FrameCommands.SetDepthState(nullptr);
+		FrameCommands.SetVertexBuffer(0, StressBatch_vertexBuffer.Get(), sizeof(VertexPositionUVNormalTan));
+		FrameCommands.SetIndexBuffer(StressBatch_indexBuffer.Get(), DXGI_FORMAT_R32_UINT);
+		FrameCommands.SetTextures(CommandStagePixel, 0, 2, BarnAModelTextureArray);
+		FrameCommands.SetSamplers(CommandStagePixel, 0, 1, SampleStates);
+		break;
+	}
+	}
+}
+
+// Records the constants and draws of one queued item, under its material's state, or
+// gathers it into CastleInstances.
+void Sample3DSceneRenderer::DrawSceneItem(unsigned int Item)
+{
+	if (Item == SkyItem)
+	{
+		XMVECTOR CameraPos = XMLoadFloat4(&LightProperties.CameraPos);
+		ModelConstantBuffer SkyModel;
+		XMStoreFloat4x4(&SkyModel.model, XMMatrixTranspose(XMMatrixTranslationFromVector(CameraPos)));
+
+		LinearConstantAllocator::Bind(FrameCommands, CommandStageVertex, 2, FrameConstants.Write(FrameCommands, &SkyModel, sizeof(SkyModel)));
+		FrameCommands.DrawIndexed(m_indexCount, 0, 0);
+		return;
+	}
+
+	// Static batches are already in world space.
+	if ((Item & StaticBatchItem) != 0)
+	{
+		unsigned int Batch = Item & ~StaticBatchItem;
+		XMFLOAT4X4 Identity;
+		XMStoreFloat4x4(&Identity, XMMatrixIdentity());
+
+		BindObjectConstants(Identity, StressBatches.Batches[Batch].Bounds.Min, StressBatches.Batches[Batch].Bounds.Max);
+		DrawSubmeshes(StressBatches.Submeshes, StressBatches.Batches[Batch].Lods, StressBatchLods[Batch]);
+
+		FrameTriangles.StaticBatchDraws++;
+		FrameTriangles.StaticBatchObjects += StressBatches.Batches[Batch].Sources.size();
+		return;
+	}
+
+	XMMATRIX World = XMLoadFloat4x4(&SceneWorlds[Item]);
+	ModelConstantBuffer ObjectModel;
+	XMStoreFloat4x4(&ObjectModel.model, XMMatrixTranspose(World));
+
+	if (Item == 0)
+	{
+		BindObjectConstants(ObjectModel.model, SceneMins[Item], SceneMaxs[Item]);
+
+		unsigned int GroundLod = SelectLod(Model_lods, FirstModel.Bounds, World);
+		if (GroundLod != 0 || !DrawVisibleMeshlets(FirstModel, Model_submeshes, Model_meshlets, Model_indexBuffer.Get(), Model_clusterIndexBuffer.Get(), Model_clusterWriteOffset, Model_indexFormat, World))
+		{
+			DrawSubmeshes(Model_submeshes, Model_lods, GroundLod);
+		}
+		return;
+	}
+
+	// Castles that are not culled meshlet by meshlet wait in CastleInstances for DrawInstanceBatches,
+	// unless each draw brings its own lights; an instanced batch has one list for all its copies.
+	unsigned int BarnALod = SelectLod(BarnAModel_lods, BarnAModel.Bounds, World);
+	bool Clustered = BarnALod == 0 && ClusterCulling && !BarnAModel_meshlets.empty();
+	if (InstancedCastles && BarnAModel_instancedVertexShader != nullptr && !Clustered && !ObjectLightSelection)
+	{
+		CastleInstances.Add(BarnALod, ObjectModel.model);
+		return;
+	}
+
+	BindObjectConstants(ObjectModel.model, SceneMins[Item], SceneMaxs[Item]);
+	if (BarnALod != 0 || !DrawVisibleMeshlets(BarnAModel, BarnAModel_submeshes, BarnAModel_meshlets, BarnAModel_indexBuffer.Get(), BarnAModel_clusterIndexBuffer.Get(), BarnAModel_clusterWriteOffset, BarnAModel_indexFormat, World))
+	{
+		DrawSubmeshes(BarnAModel_submeshes, BarnAModel_lods, BarnALod);
+	}
+}
+
+// Writes a draw's world matrix, already transposed for the shader, and binds it to the vertex
+// stage at b2. With ObjectLightSelection, the strongest lights reaching the world space box
+// Min-Max go into the same ring allocation, a block further on, bound to the pixel stage at
+// b2; one allocation, so a discard between the two writes cannot lose the first.
+void Sample3DSceneRenderer::BindObjectConstants(const XMFLOAT4X4& ShaderWorld, const XMFLOAT3& Min, const XMFLOAT3& Max)
+{
+	if (!ObjectLightSelection)
+	{
+		ModelConstantBuffer ObjectModel = { ShaderWorld };
+		LinearConstantAllocator::Bind(FrameCommands, CommandStageVertex, 2, FrameConstants.Write(FrameCommands, &ObjectModel, sizeof(ObjectModel)));
+		return;
+	}
+
+	auto SelectStart = chrono::high_resolution_clock::now();
+
+	struct
+	{
+		ModelConstantBuffer Model;
+		unsigned char Padding[ConstantBlockSize - sizeof(ModelConstantBuffer)];
+		ObjectLightConstantBuffer Lights;
+	} ObjectConstants = {};
+
+	unsigned int Selected[MaxObjectLights];
+	ObjectConstants.Model.model = ShaderWorld;
+	ObjectConstants.Lights.LightCount.x = ObjectLights.Select(Min, Max, Selected);
+	for (unsigned int i = 0; i < ObjectConstants.Lights.LightCount.x; i++)
+	{
+		ObjectConstants.Lights.LightIndices[i].x = Selected[i];
+	}
+
+	ConstantAllocation Allocation = FrameConstants.Write(FrameCommands, &ObjectConstants, sizeof(ObjectConstants));
+	LinearConstantAllocator::Bind(FrameCommands, CommandStageVertex, 2, Allocation);
+	Allocation.FirstConstant += ConstantBlockSize / 16;
+	Allocation.ConstantCount -= ConstantBlockSize / 16;
+	LinearConstantAllocator::Bind(FrameCommands, CommandStagePixel, 2, Allocation);
+
+	FrameTriangles.LightSelectionSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - SelectStart).count();
+}
+
+// Draws the castles gathered since the last call as instanced batches, a level of detail at a
+// time. Runs at the end of every material run; it swaps in the instanced vertex shader, and
+// the next material binds its own.
+void Sample3DSceneRenderer::DrawInstanceBatches(void)
+{
+	if (CastleInstances.IsEmpty())
+	{
+		return;
+	}
+
+	FrameCommands.SetPipeline(BarnAModel_inputLayout.Get(), BarnAModel_instancedVertexShader.Get(), BarnAModel_pixelShader.Get(), D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	CastleInstances.Flush(FrameCommands, FrameConstants, 2, [this](unsigned int Lod, unsigned int InstanceCount)
+	{
+		DrawSubmeshes(BarnAModel_submeshes, BarnAModel_lods, Lod, InstanceCount);
+	});
+}
+
+// Replays the commands recorded so far onto the device context and starts a new buffer.
+void Sample3DSceneRenderer::SubmitCommands(void)
+{
+	auto ReplayStart = chrono::high_resolution_clock::now();
+
+	D3D11Context Context(m_deviceResources->GetD3DDeviceContext());
+	D3D11CommandBackend Backend(Context, &FrameStateFilter);
+	FrameCommands.Replay(Backend);
+
+	FrameTriangles.Commands += FrameCommands.GetCommandCount();
+	FrameTriangles.CommandBytes += FrameCommands.GetSize();
+	FrameTriangles.StateCalls += FrameStateFilter.GetForwarded() + FrameStateFilter.GetEliminated();
+	FrameTriangles.StateCallsEliminated += FrameStateFilter.GetEliminated();
+	FrameStateFilter.ResetCounts();
+	FrameTriangles.ReplaySeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - ReplayStart).count();
+	FrameCommands.Reset();
+}
+
+// Tests every meshlet of the full detail level against the view frustum and its normal cone,
+// copies the index ranges of the survivors into the cluster index buffer and draws them.
+// Returns false when the mesh has no meshlets or cluster culling is off, so the caller can
+// draw the level whole.
+bool Sample3DSceneRenderer::DrawVisibleMeshlets(const CookedMesh& Mesh, const std::vector<CookedSubmesh>& Submeshes, const std::vector<Meshlet>& Meshlets, ID3D11Buffer* IndexBuffer,
+	ID3D11Buffer* ClusterIndexBuffer, UINT& ClusterWriteOffset, DXGI_FORMAT IndexFormat, FXMMATRIX World)
+{
+	if (!ClusterCulling || Meshlets.empty() || ClusterIndexBuffer == nullptr)
+	{
+		return false;
+	}
+
+	// Both tests run in object space, so nothing per meshlet has to be transformed.
+	XMMATRIX View = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.view));
+	XMMATRIX Projection = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.projection));
+	XMFLOAT4 Planes[6];
+	GetFrustumPlanes(XMMatrixMultiply(World, XMMatrixMultiply(View, Projection)), Planes);
+
+	XMFLOAT3 Camera;
+	XMStoreFloat3(&Camera, XMVector3TransformCoord(XMVectorSet(m_camera._41, m_camera._42, m_camera._43, 1.0f), XMMatrixInverse(nullptr, World)));
+
+	// The buffer holds several frames' worth of indices. Append behind what earlier draws wrote
+	// and only discard once the next full list would not fit, so the driver need not stall.
+	// The write is recorded like any other command; a discard renames the buffer, so draws
+	// recorded before it keep reading the old contents.
+	UINT FullIndexCount = Mesh.Lods[0].IndexCount;
+	bool Discard = false;
+	if (ClusterWriteOffset == 0 || ClusterWriteOffset + FullIndexCount > FullIndexCount * ClusterBufferCopies)
+	{
+		Discard = true;
+		ClusterWriteOffset = 0;
+	}
+
+	const char* Source = (const char*)Mesh.Indices;
+	UINT WriteOffset = ClusterWriteOffset;
+	unsigned int LastSubmesh = UINT_MAX;
+
+	ClusterDraws.clear();
+	ClusterIndexData.clear();
+	for (const Meshlet& Cluster : Meshlets)
+	{
+		unsigned int Triangles = Cluster.IndexCount / 3;
+		FrameTriangles.ClusterTested += Triangles;
+
+		MeshletCullResult Result = CullMeshlet(Cluster, Planes, Camera);
+		if (Result == MeshletOutsideFrustum)
+		{
+			FrameTriangles.FrustumCulled += Triangles;
+			continue;
+		}
+		if (Result == MeshletBackfacing)
+		{
+			FrameTriangles.BackfaceCulled += Triangles;
+			continue;
+		}
+
+		ClusterIndexData.insert(ClusterIndexData.end(), Source + Cluster.IndexStart * Mesh.IndexStride, Source + (Cluster.IndexStart + Cluster.IndexCount) * Mesh.IndexStride);
+
+		// Visible neighbours of the same submesh share one draw.
+		if (Cluster.Submesh == LastSubmesh && ClusterDraws.back().IndexStart + ClusterDraws.back().IndexCount == WriteOffset)
+		{
+			ClusterDraws.back().IndexCount += Cluster.IndexCount;
+		}
+		else
+		{
+			CookedSubmesh Draw = Submeshes[Cluster.Submesh];
+			Draw.IndexStart = WriteOffset;
+			Draw.IndexCount = Cluster.IndexCount;
+			ClusterDraws.push_back(Draw);
+			LastSubmesh = Cluster.Submesh;
+		}
+
+		WriteOffset += Cluster.IndexCount;
+	}
+
+	if (!ClusterIndexData.empty())
+	{
+		FrameCommands.WriteBuffer(ClusterIndexBuffer, ClusterWriteOffset * Mesh.IndexStride, Discard, ClusterIndexData.data(), (unsigned int)ClusterIndexData.size());
+	}
+
+	FrameCommands.SetIndexBuffer(ClusterIndexBuffer, IndexFormat);
+	for (const CookedSubmesh& Draw : ClusterDraws)
+	{
+		FrameCommands.DrawIndexed(Draw.IndexCount, Draw.IndexStart, Draw.BaseVertex);
+	}
+	FrameCommands.SetIndexBuffer(IndexBuffer, IndexFormat);
+
+	FrameTriangles.Submitted += (WriteOffset - ClusterWriteOffset) / 3;
+	ClusterWriteOffset = WriteOffset;
+	FrameTriangles.FullDetail += FullIndexCount / 3;
+	return true;
+}
+
+// Places every object of both scenes and records its world space box. Until a model has
+// loaded its bounds are empty, and its objects are points where they stand.
+void Sample3DSceneRenderer::PlaceSceneObjects(void)
+{
+	unsigned int ObjectCount = FirstStressObject + StressGridSize * StressGridSize;
+	SceneWorlds.resize(ObjectCount);
+	SceneMins.resize(ObjectCount);
+	SceneMaxs.resize(ObjectCount);
+
+	auto PlaceObject = [&](unsigned int Object, const MeshBounds& Bounds, FXMMATRIX World)
+	{
+		XMStoreFloat4x4(&SceneWorlds[Object], World);
+
+		if (Bounds.Min.x > Bounds.Max.x)
+		{
+			XMStoreFloat3(&SceneMins[Object], World.r[3]);
+			XMStoreFloat3(&SceneMaxs[Object], World.r[3]);
+		}
+		else
+		{
+			TransformBoundingBox(Bounds.Min, Bounds.Max, World, &SceneMins[Object], &SceneMaxs[Object]);
+		}
+	};
+
+	// A model's bounds are only read once it has been published.
+	MeshBounds Unloaded = EmptyMeshBounds();
+	const MeshBounds& GroundBounds = Loaded ? FirstModel.Bounds : Unloaded;
+	const MeshBounds& CastleBounds = BarnALoaded ? BarnAModel.Bounds : Unloaded;
+
+	PlaceObject(0, GroundBounds, XMMatrixMultiply(XMMatrixRotationY(XMConvertToRadians(90)), XMMatrixMultiply(XMMatrixScaling(100.0f, 100.0f, 100.0f), XMMatrixTranslation(0.0f, 0.0f, 0.0f))));
+	PlaceObject(1, CastleBounds, XMMatrixMultiply(XMMatrixRotationY(XMConvertToRadians(90)), XMMatrixMultiply(XMMatrixScaling(1.0f, 1.0f, 1.0f), XMMatrixTranslation(0.0f, 0.0f, 0.0f))));
+
+	// Small castles on a grid around the origin, so most of them are far enough away to
+	// drop to a coarser level.
+	float Spacing = 10.0f;
+	float Start = -0.5f * Spacing * (StressGridSize - 1);
+
+	for (unsigned int z = 0; z < StressGridSize; z++)
+	{
+		for (unsigned int x = 0; x < StressGridSize; x++)
+		{
+			PlaceObject(FirstStressObject + z * StressGridSize + x, CastleBounds,
+				XMMatrixMultiply(XMMatrixRotationY(XMConvertToRadians(90)), XMMatrixMultiply(XMMatrixScaling(0.2f, 0.2f, 0.2f), XMMatrixTranslation(Start + x * Spacing, 0.0f, Start + z * Spacing))));
+		}
+	}
+}
+
+// Keeps SceneTree in step with the scene: built with SAH the first time, refit once the
+// models have loaded and their boxes are known, and edited in place when G or H swaps the
+// single castle for the stress grid.
+void Sample3DSceneRenderer::UpdateSceneObjects(void)
+{
+	bool ModelsReady = Loaded && BarnALoaded;
+	unsigned int StressCount = StressGridSize * StressGridSize;
+
+	if (SceneWorlds.empty())
+	{
+		PlaceSceneObjects();
+		SceneTree.Build(SceneMins.data(), SceneMaxs.data(), (unsigned int)SceneWorlds.size());
+
+		// The tree starts with the single castle scene.
+		for (unsigned int i = 0; i < StressCount; i++)
+		{
+			SceneTree.Remove(FirstStressObject + i);
+		}
+
+		SceneObjectsStress = false;
+		SceneObjectsReady = ModelsReady;
+	}
+
+	if (SceneObjectsReady != ModelsReady)
+	{
+		PlaceSceneObjects();
+		for (unsigned int Object = 0; Object < SceneWorlds.size(); Object++)
+		{
+			if (SceneTree.Contains(Object))
+			{
+				SceneTree.Refit(Object, SceneMins[Object], SceneMaxs[Object]);
+			}
+		}
+		SceneObjectsReady = ModelsReady;
+	}
+
+	if (SceneObjectsStress != StressScene)
+	{
+		if (StressScene)
+		{
+			SceneTree.Remove(1);
+			for (unsigned int i = 0; i < StressCount; i++)
+			{
+				SceneTree.Insert(FirstStressObject + i, SceneMins[FirstStressObject + i], SceneMaxs[FirstStressObject + i]);
+			}
+		}
+		else
+		{
+			for (unsigned int i = 0; i < StressCount; i++)
+			{
+				SceneTree.Remove(FirstStressObject + i);
+			}
+			SceneTree.Insert(1, SceneMins[1], SceneMaxs[1]);
+		}
+		SceneObjectsStress = StressScene;
+	}
+
+	if (SceneObjectsReady && StressBatches.SourceBatches.empty())
+	{
+		CreateStaticBatches();
+	}
+}
+
+// Merges the stress grid castles into StressBatches and uploads the merged streams. The CPU
+// copies are dropped once they are on the GPU. Quantized castles are not batched.
+void Sample3DSceneRenderer::CreateStaticBatches(void)
+{
+	unsigned int StressCount = StressGridSize * StressGridSize;
+	std::vector<StaticBatchSource> Sources(StressCount);
+	for (unsigned int i = 0; i < StressCount; i++)
+	{
+		Sources[i] = { &BarnAModel, SceneWorlds[FirstStressObject + i], SceneMaterialCastleBatch };
+	}
+
+	DX11UWA::BuildStaticBatches(Sources.data(), StressCount, StaticBatchCellSize, 1, &StressBatches);
+	StressBatchLods.assign(StressBatches.Batches.size(), ~0u);
+	if (StressBatches.Batches.empty())
+	{
+		return;
+	}
+	ReportStaticBatches("Hyrule_Castle1.obj stress grid", Sources.data(), StressBatches);
+
+	D3D11_SUBRESOURCE_DATA VertexData = { 0 };
+	VertexData.pSysMem = StressBatches.Vertices.data();
+	CD3D11_BUFFER_DESC VertexDesc((UINT)(StressBatches.Vertices.size() * sizeof(VertexPositionUVNormalTan)), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&VertexDesc, &VertexData, &StressBatch_vertexBuffer));
+
+	D3D11_SUBRESOURCE_DATA IndexData = { 0 };
+	IndexData.pSysMem = StressBatches.Indices.data();
+	CD3D11_BUFFER_DESC IndexDesc((UINT)(StressBatches.Indices.size() * sizeof(unsigned int)), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&IndexDesc, &IndexData, &StressBatch_indexBuffer));
+
+	StressBatches.Vertices.clear();
+	StressBatches.Vertices.shrink_to_fit();
+	StressBatches.Indices.clear();
+	StressBatches.Indices.shrink_to_fit();
+}
+
+// Walks SceneTree with the world space frustum of the current view and projection and
+// leaves the objects inside, in object order, in VisibleObjects.
+void Sample3DSceneRenderer::CullSceneObjects(void)
+{
+	UpdateSceneObjects();
+
+	XMMATRIX View = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.view));
+	XMMATRIX Projection = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.projection));
+	XMFLOAT4 Planes[6];
+	GetFrustumPlanes(XMMatrixMultiply(View, Projection), Planes);
+
+	BvhQueryStats Stats;
+	auto CullStart = chrono::high_resolution_clock::now();
+	VisibleObjects.clear();
+	SceneTree.QueryFrustum(Planes, &VisibleObjects, &Stats);
+	sort(VisibleObjects.begin(), VisibleObjects.end());
+	FrameTriangles.ObjectCullSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - CullStart).count();
+
+	FrameTriangles.ObjectsTested += SceneTree.ObjectCount;
+	FrameTriangles.ObjectsVisible += VisibleObjects.size();
+	FrameTriangles.ObjectNodesVisited += Stats.NodesVisited;
+}
+
+// Draws the nearest visible objects into the occlusion buffer and removes the visible
+// objects hidden behind them from VisibleObjects.
+void Sample3DSceneRenderer::OccludeSceneObjects(void)
+{
+	if (!OcclusionCulling || VisibleObjects.size() < 2)
+	{
+		return;
+	}
+
+	// Occluders are cut from the models once they have loaded.
+	auto BuildOccluder = [&](const CookedMesh& Mesh, OccluderMesh& Occluder)
+	{
+		if (Occluder.Indices.empty() && Mesh.LodCount > 0)
+		{
+			unsigned int Lod = 0;
+			while (Lod + 1 < Mesh.LodCount && Mesh.Lods[Lod + 1].Error <= OccluderError * Mesh.Bounds.Radius)
+			{
+				Lod++;
+			}
+			BuildOccluderMesh(Mesh, Lod, &Occluder);
+		}
+	};
+
+	if (Loaded)
+	{
+		BuildOccluder(FirstModel, GroundOccluder);
+	}
+	if (BarnALoaded)
+	{
+		BuildOccluder(BarnAModel, CastleOccluder);
+	}
+
+	auto OcclusionStart = chrono::high_resolution_clock::now();
+
+	XMMATRIX View = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.view));
+	XMMATRIX Projection = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.projection));
+	XMMATRIX ViewProjection = XMMatrixMultiply(View, Projection);
+	XMVECTOR Eye = XMVectorSet(m_camera._41, m_camera._42, m_camera._43, 1.0f);
+
+	// The nearest objects cover the most of the screen, so they make the best occluders.
+	OccluderCandidates.clear();
+	for (unsigned int Object : VisibleObjects)
+	{
+		XMVECTOR Center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&SceneMins[Object]), XMLoadFloat3(&SceneMaxs[Object])), 0.5f);
+		OccluderCandidates.push_back(make_pair(XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(Center, Eye))), Object));
+	}
+
+	size_t OccluderCount = min((size_t)OccluderBudget, OccluderCandidates.size());
+	partial_sort(OccluderCandidates.begin(), OccluderCandidates.begin() + OccluderCount, OccluderCandidates.end());
+
+	OccluderDraws.clear();
+	for (size_t i = 0; i < OccluderCount; i++)
+	{
+		unsigned int Object = OccluderCandidates[i].second;
+		const OccluderMesh& Mesh = Object == 0 ? GroundOccluder : CastleOccluder;
+		if (Mesh.Indices.empty())
+		{
+			continue;
+		}
+
+		OccluderDraw Draw;
+		Draw.Mesh = &Mesh;
+		XMStoreFloat4x4(&Draw.WorldViewProjection, XMMatrixMultiply(XMLoadFloat4x4(&SceneWorlds[Object]), ViewProjection));
+		OccluderDraws.push_back(Draw);
+	}
+
+	OcclusionBuffer.Clear();
+	FrameTriangles.OccluderTriangles += OcclusionBuffer.RenderOccluders(OccluderDraws.data(), (unsigned int)OccluderDraws.size());
+
+	// An object drawn as an occluder cannot hide itself: its box is nearer than any of its
+	// own triangles.
+	size_t Kept = 0;
+	for (unsigned int Object : VisibleObjects)
+	{
+		if (OcclusionBuffer.TestBox(SceneMins[Object], SceneMaxs[Object], ViewProjection))
+		{
+			VisibleObjects[Kept++] = Object;
+		}
+	}
+
+	FrameTriangles.ObjectsOccluded += VisibleObjects.size() - Kept;
+	VisibleObjects.resize(Kept);
+	FrameTriangles.OcclusionSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - OcclusionStart).count();
+}
+
+// Finds the objects each enabled point and spot light reaches through SceneTree, adds the
+// nodes visited and objects found to Stats, and returns the number of queries.
+unsigned int Sample3DSceneRenderer::QueryLitObjects(BvhQueryStats* Stats)
+{
+	unsigned int Queries = 0;
+	for (unsigned int i = 0; i < GetSceneLightCount(); i++)
+	{
+		const Lights& Light = SceneLights[i];
+		if (Light.type.x == 0 || Light.enabled.x == 0)
+		{
+			continue;
+		}
+
+		LitObjects.clear();
+		SceneTree.QuerySphere(XMFLOAT3(Light.pos.x, Light.pos.y, Light.pos.z), GetLightRange(Light), &LitObjects, Stats);
+		Queries++;
+	}
+
+	return Queries;
+}
+
+// Scatters the field lights over the stress grid, whose castles are 10 units apart:
+// alternately low point lights and spot lights shining down from above the castles, in
+// random colours and reaching 4 to 12 units.
+void Sample3DSceneRenderer::PlaceFieldLights(void)
+{
+	std::mt19937 Random(2024);
+	std::uniform_real_distribution<float> Unit(0.0f, 1.0f);
+
+	float Extent = 0.5f * 10.0f * StressGridSize;
+	for (unsigned int i = 0; i < FieldLightCount; i++)
+	{
+		bool Spot = i % 2 != 0;
+		float Range = 4.0f + 8.0f * Unit(Random);
+
+		Lights& Light = SceneLights[FirstFieldLight + i];
+		Light.pos = { Extent * (2.0f * Unit(Random) - 1.0f), Spot ? 6.0f : 0.5f + 2.0f * Unit(Random), Extent * (2.0f * Unit(Random) - 1.0f), 1.0f };
+		Light.direction = { 0.0f, 0.0f, 0.0f, 0.0f };
+		Light.color = { 0.25f + 0.75f * Unit(Random), 0.25f + 0.75f * Unit(Random), 0.25f + 0.75f * Unit(Random), 1.0f };
+		Light.angle = { 0.5f * Unit(Random) - 0.25f, -1.0f, 0.5f * Unit(Random) - 0.25f, 0.0f };
+		Light.angleratio = { 0.95f, 0.85f };
+		Light.C_att = { 1.0f, 0.0f };
+		Light.L_att = { 0.0f, 0.0f };
+		Light.Q_att = { 255.0f / (Range * Range), 0.0f };
+		Light.type = { Spot ? LightSpot : LightPoint, 0 };
+		Light.enabled = { 1, 0 };
+		Light.padding = { 0, 0, 0, 0 };
+	}
+}
+
+// Bins the enabled lights into LightClusters for this frame's camera and fills in the cluster
+// constants of LightProperties.
+void Sample3DSceneRenderer::BinSceneLights(void)
+{
+	auto BinStart = chrono::high_resolution_clock::now();
+
+	// SV_POSITION is in render target pixels, which the viewport covers.
+	D3D11_VIEWPORT Viewport = m_deviceResources->GetScreenViewport();
+	float YScale = 1.0f / tanf(0.5f * fovAngleY);
+	LightClusters.SetProjection(YScale * Viewport.Height / Viewport.Width, YScale, NearPlane, FarPlane);
+	LightClusters.Bin(SceneLights.data(), GetSceneLightCount(), XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.view)));
+	LightClusters.GetShaderConstants(Viewport.Width, Viewport.Height, &LightProperties.ClusterScale, &LightProperties.ClusterCount);
+
+	FrameTriangles.ClusteredLights += LightClusters.LightsBinned;
+	FrameTriangles.ClusterLightIndices += LightClusters.GetIndices().size();
+	FrameTriangles.LightClusterSeconds += chrono::duration<double>(chrono::high_resolution_clock::now() - BinStart).count();
+}
+
+// Casts a ray from the camera through the cursor, in DIPs, and reports the nearest triangle
+// it hits. SceneTree finds the objects whose boxes the ray enters, nearest first, and each
+// loaded mesh's triangle BVH is cast against in object space; a mesh that has not loaded
+// yet is picked by its box.
+void Sample3DSceneRenderer::PickSceneObject(float X, float Y)
+{
+	Size LogicalSize = m_deviceResources->GetLogicalSize();
+	float NdcX = 2.0f * X / LogicalSize.Width - 1.0f;
+	float NdcY = 1.0f - 2.0f * Y / LogicalSize.Height;
+
+	XMMATRIX View = XMMatrixInverse(nullptr, XMLoadFloat4x4(&m_camera));
+	XMMATRIX Projection = XMMatrixTranspose(XMLoadFloat4x4(&m_constantBufferData.projection));
+	XMMATRIX InverseViewProjection = XMMatrixInverse(nullptr, XMMatrixMultiply(View, Projection));
+
+	XMVECTOR Near = XMVector3TransformCoord(XMVectorSet(NdcX, NdcY, 0.0f, 1.0f), InverseViewProjection);
+	XMVECTOR Far = XMVector3TransformCoord(XMVectorSet(NdcX, NdcY, 1.0f, 1.0f), InverseViewProjection);
+
+	XMFLOAT3 Origin, Direction;
+	XMStoreFloat3(&Origin, Near);
+	XMStoreFloat3(&Direction, XMVector3Normalize(XMVectorSubtract(Far, Near)));
+	float Length = XMVectorGetX(XMVector3Length(XMVectorSubtract(Far, Near)));
+
+	TriangleBvhStats MeshStats;
+	TriangleHit MeshHit = { 0.0f, TriangleBvhNone, 0.0f, 0.0f };
+
+	auto HitObject = [&](unsigned int Object, float BoxT, float* ObjectT)
+	{
+		// Until a model is published only its box can be hit.
+		bool Published = Object == 0 ? Loaded : BarnALoaded;
+		const CookedMesh& Mesh = Object == 0 ? FirstModel : BarnAModel;
+		if (!Published || Mesh.Bvh.NodeCount == 0)
+		{
+			*ObjectT = BoxT;
+			MeshHit.Triangle = TriangleBvhNone;
+			return true;
+		}
+
+		// The world matrix is affine, so distances along the transformed ray carry over.
+		XMMATRIX ToObject = XMMatrixInverse(nullptr, XMLoadFloat4x4(&SceneWorlds[Object]));
+		XMFLOAT3 LocalOrigin, LocalDirection;
+		XMStoreFloat3(&LocalOrigin, XMVector3TransformCoord(XMLoadFloat3(&Origin), ToObject));
+		XMStoreFloat3(&LocalDirection, XMVector3TransformNormal(XMLoadFloat3(&Direction), ToObject));
+
+		TriangleHit Hit;
+		if (!Mesh.Bvh.RayCast(LocalOrigin, LocalDirection, *ObjectT, &Hit, &MeshStats))
+		{
+			return false;
+		}
+
+		*ObjectT = Hit.Distance;
+		MeshHit = Hit;
+		return true;
+	};
+
+	BvhQueryStats Stats;
+	unsigned int Object = 0;
+	float Distance = 0.0f;
+
+	char Line[256];
+	if (SceneTree.RayCast(Origin, Direction, Length, HitObject, &Object, &Distance, &Stats))
+	{
+		if (MeshHit.Triangle != TriangleBvhNone)
+		{
+			sprintf_s(Line, "Pick: object %u (%s) triangle %u at %.2f, barycentrics %.3f %.3f %.3f, %u BVH nodes and %u triangle BVH nodes visited\n", Object,
+				Object == 0 ? "ground" : "castle", MeshHit.Triangle, Distance, 1.0f - MeshHit.U - MeshHit.V, MeshHit.U, MeshHit.V, Stats.NodesVisited, MeshStats.NodesVisited);
+		}
+		else
+		{
+			sprintf_s(Line, "Pick: object %u (%s) box at %.2f, %u BVH nodes visited\n", Object, Object == 0 ? "ground" : "castle", Distance, Stats.NodesVisited);
+		}
+	}
+	else
+	{
+		sprintf_s(Line, "Pick: nothing, %u BVH nodes visited\n", Stats.NodesVisited);
+	}
+	OutputDebugStringA(Line);
+}
+
+// Benchmark walkthrough, started with N: the camera circles the castle once over
+// WalkthroughSeconds, then the average triangles culled per frame are reported and the
+// camera is put back where it was.
+void Sample3DSceneRenderer::UpdateWalkthrough(DX::StepTimer const& timer)
+{
+	if (WalkthroughTime < 0.0f)
+	{
+		if (m_kbuttons['N'] && BarnALoaded)
+		{
+			WalkthroughTime = 0.0f;
+			WalkthroughTriangles = TriangleStats();
+			WalkthroughSavedCamera = m_camera;
+		}
+		return;
+	}
+
+	WalkthroughTime += (float)timer.GetElapsedSeconds();
+	if (WalkthroughTime >= WalkthroughSeconds)
+	{
+		const TriangleStats& Stats = WalkthroughTriangles;
+		unsigned int Frames = max(Stats.Frames, 1u);
+
+		char Line[256];
+		sprintf_s(Line, "Walkthrough: %u frames, %llu of %llu triangles culled per frame (%.1f%%; frustum %llu, backface %llu)\n", Stats.Frames,
+			(Stats.FrustumCulled + Stats.BackfaceCulled) / Frames, Stats.ClusterTested / Frames, 100.0 * (Stats.FrustumCulled + Stats.BackfaceCulled) / max(Stats.ClusterTested, 1ull),
+			Stats.FrustumCulled / Frames, Stats.BackfaceCulled / Frames);
+		OutputDebugStringA(Line);
+
+		m_camera = WalkthroughSavedCamera;
+		WalkthroughTime = -1.0f;
+		return;
+	}
+
+	// Circle the castle's bounding sphere a little outside its radius, looking at its centre.
+	XMMATRIX BarnAWorld = XMMatrixRotationY(XMConvertToRadians(90));
+	XMVECTOR Center = XMVector3Transform(XMLoadFloat3(&BarnAModel.Bounds.Center), BarnAWorld);
+	float Radius = BarnAModel.Bounds.Radius;
+
+	float Angle = XM_2PI * WalkthroughTime / WalkthroughSeconds;
+	XMVECTOR Eye = XMVectorAdd(Center, XMVectorSet(cosf(Angle) * Radius * 1.2f, Radius * 0.3f, sinf(Angle) * Radius * 1.2f, 0.0f));
+	XMStoreFloat4x4(&m_camera, XMMatrixInverse(nullptr, XMMatrixLookAtLH(Eye, Center, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))));
+}
+
+// Cooked meshes live in the app's local folder; the install folder is read-only.
+std::string Sample3DSceneRenderer::GetMeshCachePath(const char* name)
+{
+	Platform::String^ Folder = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+
+	char FolderPath[MAX_PATH];
+	if (WideCharToMultiByte(CP_UTF8, 0, Folder->Data(), -1, FolderPath, MAX_PATH, nullptr, nullptr) == 0)
+	{
+		return std::string(name) + ".meshc";
+	}
+
+	return std::string(FolderPath) + "\\" + name + ".meshc";
+}
+
+// Creates the vertex and index buffers for a cooked mesh straight from its streams, plus
+// the position decode constants when the mesh was cooked to VertexQuantized and the dynamic
+// index buffer the visible meshlets are compacted into.
+void Sample3DSceneRenderer::CreateModelBuffers(const CookedMesh& Mesh, Microsoft::WRL::ComPtr<ID3D11Buffer>& VertexBuffer, UINT& VertexStride, Microsoft::WRL::ComPtr<ID3D11Buffer>& IndexBuffer, DXGI_FORMAT& IndexFormat,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& QuantizationBuffer, std::vector<CookedSubmesh>& Submeshes, std::vector<CookedLod>& Lods,
+	std::vector<Meshlet>& Meshlets, Microsoft::WRL::ComPtr<ID3D11Buffer>& ClusterIndexBuffer)
+{
+	D3D11_SUBRESOURCE_DATA ModelvertexBufferData = { 0 };
+	ModelvertexBufferData.pSysMem = Mesh.Vertices;
+	ModelvertexBufferData.SysMemPitch = 0;
+	ModelvertexBufferData.SysMemSlicePitch = 0;
+	CD3D11_BUFFER_DESC ModelvertexBufferDesc(Mesh.VertexStride * Mesh.VertexCount, D3D11_BIND_VERTEX_BUFFER);
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ModelvertexBufferDesc, &ModelvertexBufferData, &VertexBuffer));
+	VertexStride = Mesh.VertexStride;
+
+	if (Mesh.VertexFormat == CookedVertexQuantized)
+	{
+		QuantizationConstantBuffer Constants = GetQuantizationConstants(Mesh.Bounds.Min, Mesh.Bounds.Max);
+
+		D3D11_SUBRESOURCE_DATA QuantizationData = { 0 };
+		QuantizationData.pSysMem = &Constants;
+		CD3D11_BUFFER_DESC QuantizationDesc(sizeof(QuantizationConstantBuffer), D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_IMMUTABLE);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&QuantizationDesc, &QuantizationData, &QuantizationBuffer));
+	}
+
+	IndexFormat = Mesh.IndexStride == sizeof(unsigned short) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	Submeshes.assign(Mesh.Submeshes, Mesh.Submeshes + Mesh.SubmeshCount);
+	Lods.assign(Mesh.Lods, Mesh.Lods + Mesh.LodCount);
+
+	D3D11_SUBRESOURCE_DATA ModelindexBufferData = { 0 };
+	ModelindexBufferData.pSysMem = Mesh.Indices;
+	ModelindexBufferData.SysMemPitch = 0;
+	ModelindexBufferData.SysMemSlicePitch = 0;
+	CD3D11_BUFFER_DESC ModelindexBufferDesc(Mesh.IndexStride * Mesh.IndexCount, D3D11_BIND_INDEX_BUFFER);
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ModelindexBufferDesc, &ModelindexBufferData, &IndexBuffer));
+
+	Meshlets.assign(Mesh.Meshlets, Mesh.Meshlets + Mesh.MeshletCount);
+	if (!Meshlets.empty())
+	{
+		CD3D11_BUFFER_DESC ClusterIndexBufferDesc(Mesh.IndexStride * Mesh.Lods[0].IndexCount * ClusterBufferCopies, D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&ClusterIndexBufferDesc, nullptr, &ClusterIndexBuffer));
+	}
+}
+
 void Sample3DSceneRenderer::ReleaseDeviceDependentResources(void)
 {
 	m_loadingComplete = false;
 	loadingcomplete = false;
 	tloadingcomplete = false;
+	Loaded = false;
+	BarnALoaded = false;
 
 	m_vertexShader.Reset();
 	m_inputLayout.Reset();
 	m_pixelShader.Reset();
-	m_constantBuffer.Reset();
 	m_vertexBuffer.Reset();
 	m_indexBuffer.Reset();
 
@@ -1013,18 +2016,55 @@ void Sample3DSceneRenderer::ReleaseDeviceDependentResources(void)
 	Model_indexBuffer.Reset();
 	Model_vertexShader.Reset();
 	Model_pixelShader.Reset();
-	Model_constantBuffer.Reset();
+	Model_quantizationBuffer.Reset();
+	Model_submeshes.clear();
+	Model_lods.clear();
+	Model_meshlets.clear();
+	Model_clusterIndexBuffer.Reset();
+	Model_clusterWriteOffset = 0;
 
 	BarnAModel_inputLayout.Reset();
 	BarnAModel_vertexBuffer.Reset();
 	BarnAModel_indexBuffer.Reset();
 	BarnAModel_vertexShader.Reset();
 	BarnAModel_pixelShader.Reset();
-	BarnAModel_constantBuffer.Reset();
-
-	Lights_constantBuffer.Reset();
+	BarnAModel_instancedVertexShader.Reset();
+	CastleInstances.Clear();
+
+	StressBatch_vertexBuffer.Reset();
+	StressBatch_indexBuffer.Reset();
+	StressBatches.Clear();
+	StressBatchLods.clear();
+	BarnAModel_quantizationBuffer.Reset();
+	BarnAModel_submeshes.clear();
+	BarnAModel_lods.clear();
+	BarnAModel_meshlets.clear();
+	BarnAModel_clusterIndexBuffer.Reset();
+	BarnAModel_clusterWriteOffset = 0;
+
+	SceneTree.Clear();
+	SceneWorlds.clear();
+	SceneMins.clear();
+	SceneMaxs.clear();
+	VisibleObjects.clear();
+	LitObjects.clear();
+	GroundOccluder = OccluderMesh();
+	CastleOccluder = OccluderMesh();
+
+	ConstantRing.Reset();
+	FrameConstants.Reset(nullptr, 0);
+
+	SceneLightBuffer.Reset();
+	LightClusterRangeBuffer.Reset();
+	LightClusterIndexBuffer.Reset();
+	for (auto& View : LightCluster_SRVs)
+	{
+		View.Reset();
+	}
 
-	WrapState->Release();
+	StateCache.Clear();
+	WrapState = nullptr;
+	SkyDepthState = nullptr;
 
 	GroundTexture->Release();
 	Ground_SRV->Release();
@@ -1,6 +1,16 @@
 ﻿#pragma once
 
+#include <atomic>
 #include "OBJModelLoader.h"
+#include "MeshCache.h"
+#include "SceneBvh.h"
+#include "D3D11CommandBackend.h"
+#include "RenderQueue.h"
+#include "StateObjectCache.h"
+#include "InstanceBatcher.h"
+#include "StaticBatcher.h"
+#include "ClusteredLighting.h"
+#include "LightSelection.h"
 #include "test pyramid.h"
 #include "Common\DDSTextureLoader.h"
 
@@ -32,6 +42,31 @@ namespace DX11UWA
 	private:
 		void Rotate(float radians);
 		void UpdateCamera(DX::StepTimer const& timer, float const moveSpd, float const rotSpd);
+		void CreateModelBuffers(const CookedMesh& Mesh, Microsoft::WRL::ComPtr<ID3D11Buffer>& VertexBuffer, UINT& VertexStride, Microsoft::WRL::ComPtr<ID3D11Buffer>& IndexBuffer, DXGI_FORMAT& IndexFormat,
+			Microsoft::WRL::ComPtr<ID3D11Buffer>& QuantizationBuffer, std::vector<CookedSubmesh>& Submeshes, std::vector<CookedLod>& Lods,
+			std::vector<Meshlet>& Meshlets, Microsoft::WRL::ComPtr<ID3D11Buffer>& ClusterIndexBuffer);
+		unsigned int SelectLod(const std::vector<CookedLod>& Lods, const MeshBounds& Bounds, DirectX::FXMMATRIX World);
+		void QueueSceneDraws(void);
+		void BindSceneMaterial(unsigned int Material);
+		void DrawSceneItem(unsigned int Item);
+		void DrawInstanceBatches(void);
+		void SubmitCommands(void);
+		void DrawSubmeshes(const std::vector<CookedSubmesh>& Submeshes, const std::vector<CookedLod>& Lods, unsigned int Lod, unsigned int InstanceCount = 1);
+		bool DrawVisibleMeshlets(const CookedMesh& Mesh, const std::vector<CookedSubmesh>& Submeshes, const std::vector<Meshlet>& Meshlets, ID3D11Buffer* IndexBuffer,
+			ID3D11Buffer* ClusterIndexBuffer, UINT& ClusterWriteOffset, DXGI_FORMAT IndexFormat, DirectX::FXMMATRIX World);
+		void UpdateWalkthrough(DX::StepTimer const& timer);
+		void PlaceSceneObjects(void);
+		void UpdateSceneObjects(void);
+		void CreateStaticBatches(void);
+		void CullSceneObjects(void);
+		void OccludeSceneObjects(void);
+		unsigned int QueryLitObjects(BvhQueryStats* Stats);
+		void PlaceFieldLights(void);
+		void BinSceneLights(void);
+		void BindObjectConstants(const DirectX::XMFLOAT4X4& ShaderWorld, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max);
+		inline unsigned int GetSceneLightCount(void) const { return FieldLights ? (unsigned int)SceneLights.size() : FirstFieldLight; }
+		void PickSceneObject(float X, float Y);
+		static std::string GetMeshCachePath(const char* name);
 
 	private:
 		// Cached pointer to device resources.
@@ -43,6 +78,9 @@ namespace DX11UWA
 
 		float m_time;
 
+		// Sampler, blend, rasterizer and depth stencil states, made once per descriptor. The
+		// cache owns WrapState and SkyDepthState.
+		StateObjectCache StateCache;
 		ID3D11SamplerState* WrapState = nullptr;
 
 		//Ground Texture
@@ -74,7 +112,25 @@ namespace DX11UWA
 
 		LightProp LightProperties;
 
-		Microsoft::WRL::ComPtr<ID3D11Buffer>		Lights_constantBuffer;
+		// Every light the pixel shaders see: DirLight, PointLight and SpotLight, switched with
+		// the number keys, then FieldLightCount point and spot lights over the stress grid,
+		// shown with Q and hidden with E. Sized once up front so the load task can fill in the
+		// first three while frames read them. Each frame the enabled lights are binned into
+		// LightClusters, and the lights and cluster lists are written to the dynamic buffers
+		// behind LightCluster_SRVs, pixel shader registers t2 to t4. With ObjectLightSelection,
+		// switched on with 7 and back to clusters with 8, binning is skipped and ObjectLights
+		// picks each draw's strongest lights instead.
+		static const unsigned int FirstFieldLight = 3;
+		static const unsigned int FieldLightCount = 512;
+		bool FieldLights = false;
+		bool ObjectLightSelection = false;
+		std::vector<Lights> SceneLights;
+		LightClusterGrid LightClusters;
+		LightSelector ObjectLights;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		SceneLightBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		LightClusterRangeBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		LightClusterIndexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	LightCluster_SRVs[3];
 
 		// Direct3D resources for cube geometry.
 		Microsoft::WRL::ComPtr<ID3D11InputLayout>	m_inputLayout;
@@ -82,7 +138,6 @@ namespace DX11UWA
 		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_indexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11VertexShader>	m_vertexShader;
 		Microsoft::WRL::ComPtr<ID3D11PixelShader>	m_pixelShader;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>		m_constantBuffer;
 
 		// System resources for cube geometry.
 		ModelViewProjectionConstantBuffer	m_constantBufferData;
@@ -94,12 +149,21 @@ namespace DX11UWA
 		Microsoft::WRL::ComPtr<ID3D11Buffer>		Model_indexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11VertexShader>	Model_vertexShader;
 		Microsoft::WRL::ComPtr<ID3D11PixelShader>	Model_pixelShader;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>		Model_constantBuffer;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		Model_quantizationBuffer;
 
 		// System resources for Model geometry.
-		uint32	Model_indexCount;
-		ObjectData FirstModel;
-		bool Loaded;
+		UINT	Model_vertexStride = sizeof(VertexPositionUVNormalTan);
+		DXGI_FORMAT	Model_indexFormat = DXGI_FORMAT_R16_UINT;
+		std::vector<CookedSubmesh>	Model_submeshes;
+		std::vector<CookedLod>	Model_lods;
+		std::vector<Meshlet>	Model_meshlets;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		Model_clusterIndexBuffer;
+		UINT	Model_clusterWriteOffset = 0;
+		CookedMesh FirstModel;
+		// Set by the loading task once FirstModel and every Model_ member above are complete.
+		// Render reads none of them before it sees this.
+		std::atomic<bool> Loaded{ false };
 
 		// Direct3D resources for Model geometry.
 		Microsoft::WRL::ComPtr<ID3D11InputLayout>	BarnAModel_inputLayout;
@@ -107,12 +171,201 @@ namespace DX11UWA
 		Microsoft::WRL::ComPtr<ID3D11Buffer>		BarnAModel_indexBuffer;
 		Microsoft::WRL::ComPtr<ID3D11VertexShader>	BarnAModel_vertexShader;
 		Microsoft::WRL::ComPtr<ID3D11PixelShader>	BarnAModel_pixelShader;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>		BarnAModel_constantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>	BarnAModel_instancedVertexShader;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		BarnAModel_quantizationBuffer;
 
 		// System resources for Model geometry.
-		uint32	BarnAModel_indexCount;
-		ObjectData BarnAModel;
-		bool BarnALoaded;
+		UINT	BarnAModel_vertexStride = sizeof(VertexPositionUVNormalTan);
+		DXGI_FORMAT	BarnAModel_indexFormat = DXGI_FORMAT_R16_UINT;
+		std::vector<CookedSubmesh>	BarnAModel_submeshes;
+		std::vector<CookedLod>	BarnAModel_lods;
+		std::vector<Meshlet>	BarnAModel_meshlets;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		BarnAModel_clusterIndexBuffer;
+		UINT	BarnAModel_clusterWriteOffset = 0;
+		CookedMesh BarnAModel;
+		// Publishes BarnAModel and the BarnAModel_ members the same way Loaded does.
+		std::atomic<bool> BarnALoaded{ false };
+
+		// Cook the models to the compact VertexQuantized layout and draw them with QuantizedVertexShader.
+		bool QuantizedModels = false;
+
+		// Largest on-screen error, in pixels, allowed when picking a level of detail.
+		float LodPixelError = 1.0f;
+
+		// Stress scene: a StressGridSize x StressGridSize field of castles, toggled with G and H.
+		bool StressScene = false;
+		unsigned int StressGridSize = 16;
+
+		// Cull full detail draws meshlet by meshlet and draw the survivors from a compacted index
+		// buffer, toggled with Z and 9.
+		bool ClusterCulling = true;
+		// Copies of the full detail index list each cluster index buffer can hold before it is discarded.
+		static const UINT ClusterBufferCopies = 4;
+		std::vector<CookedSubmesh>	ClusterDraws;
+		// The surviving indices of one draw, recorded into FrameCommands as a buffer write.
+		std::vector<char>			ClusterIndexData;
+
+		// Draw the castles cluster culling leaves alone as instanced batches, one per level of
+		// detail, toggled with M and P. The quantized models have no instanced shader.
+		bool InstancedCastles = true;
+		InstanceBatcher CastleInstances;
+
+		// Render records the frame here; SubmitCommands replays it onto the device context.
+		CommandBuffer FrameCommands;
+		// Drops replayed state calls that would rebind what the context already has.
+		RedundantStateFilter FrameStateFilter;
+		// Every constant the shaders read comes out of this one dynamic buffer: the camera and
+		// lights once per frame, then a model block per draw.
+		static const UINT ConstantRingSize = 256 * 1024;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		ConstantRing;
+		LinearConstantAllocator FrameConstants;
+
+		// Render queues the sky and every visible object here and draws them in key order.
+		// Items are scene object indices, StaticBatchItem plus a StressBatches index, or SkyItem.
+		enum SceneShader { SceneShaderSky, SceneShaderModel };
+		enum SceneMaterial { SceneMaterialSky, SceneMaterialGround, SceneMaterialCastle, SceneMaterialCastleBatch };
+		static const unsigned int SkyItem = ~0u;
+		static const unsigned int StaticBatchItem = 0x80000000;
+		RenderQueue FrameQueue;
+		ID3D11DepthStencilState* SkyDepthState = nullptr;
+
+		// Every drawable object's world matrix and world space box. Object 0 is the ground,
+		// object 1 the single castle and objects from FirstStressObject on the stress grid
+		// castles. SceneTree holds the objects of the current scene; toggling the stress scene
+		// removes and inserts castles rather than rebuilding it.
+		static const unsigned int FirstStressObject = 2;
+		SceneBvh SceneTree;
+		std::vector<DirectX::XMFLOAT4X4> SceneWorlds;
+		std::vector<DirectX::XMFLOAT3> SceneMins;
+		std::vector<DirectX::XMFLOAT3> SceneMaxs;
+		std::vector<unsigned int> VisibleObjects;
+		std::vector<unsigned int> LitObjects;
+		bool SceneObjectsStress = false;
+		bool SceneObjectsReady = false;
+
+		// The stress grid castles merged per StaticBatchCellSize cell once the castle has loaded,
+		// from level 1 on, toggled with R and F. A visible castle draws its whole cell, unless the
+		// cell needs full detail; then its castles draw one by one. StressBatchLods holds every
+		// cell's level this frame, or ~0u before one is picked.
+		bool StaticBatching = true;
+		float StaticBatchCellSize = 40.0f;
+		StaticBatchSet StressBatches;
+		std::vector<unsigned int> StressBatchLods;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		StressBatch_vertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>		StressBatch_indexBuffer;
+
+		// Masked software occlusion culling, toggled with T and Y. The nearest OccluderBudget
+		// visible objects are drawn into OcclusionBuffer at their coarsest level within
+		// OccluderError of the full mesh, relative to its radius, and the visible objects
+		// whose boxes are hidden behind them are not drawn.
+		bool OcclusionCulling = true;
+		unsigned int OccluderBudget = 8;
+		float OccluderError = 0.01f;
+		static const unsigned int OcclusionBufferWidth = 320;
+		MaskedOcclusionBuffer OcclusionBuffer;
+		OccluderMesh GroundOccluder;
+		OccluderMesh CastleOccluder;
+		std::vector<OccluderDraw> OccluderDraws;
+		std::vector<std::pair<float, unsigned int>> OccluderCandidates;
+
+		// Left click picks the object under the cursor; set while the button is held.
+		bool PickPressed = false;
+
+		// Triangle and object counts summed over a number of frames.
+		struct TriangleStats
+		{
+			unsigned long long Submitted = 0;
+			unsigned long long FullDetail = 0;
+			unsigned long long ClusterTested = 0;
+			unsigned long long FrustumCulled = 0;
+			unsigned long long BackfaceCulled = 0;
+			unsigned long long ObjectsTested = 0;
+			unsigned long long ObjectsVisible = 0;
+			unsigned long long ObjectNodesVisited = 0;
+			double ObjectCullSeconds = 0.0;
+			unsigned long long ObjectsOccluded = 0;
+			unsigned long long OccluderTriangles = 0;
+			double OcclusionSeconds = 0.0;
+			unsigned long long Commands = 0;
+			unsigned long long CommandBytes = 0;
+			double RecordSeconds = 0.0;
+			double ReplaySeconds = 0.0;
+			unsigned long long StateCalls = 0;
+			unsigned long long StateCallsEliminated = 0;
+			unsigned long long QueuedDraws = 0;
+			double QueueSeconds = 0.0;
+			unsigned long long StateObjectHits = 0;
+			unsigned long long StateObjectMisses = 0;
+			unsigned long long ConstantAllocations = 0;
+			unsigned long long ConstantRingBytes = 0;
+			unsigned long long ConstantDiscards = 0;
+			unsigned long long InstanceBatches = 0;
+			unsigned long long InstancedObjects = 0;
+			unsigned long long StaticBatchDraws = 0;
+			unsigned long long StaticBatchObjects = 0;
+			unsigned long long ClusteredLights = 0;
+			unsigned long long ClusterLightIndices = 0;
+			double LightClusterSeconds = 0.0;
+			unsigned long long LightSelections = 0;
+			unsigned long long LightsInRange = 0;
+			unsigned long long SelectedLights = 0;
+			double LightSelectionSeconds = 0.0;
+			unsigned int Frames = 0;
+
+			void Add(const TriangleStats& Other)
+			{
+				Submitted += Other.Submitted;
+				FullDetail += Other.FullDetail;
+				ClusterTested += Other.ClusterTested;
+				FrustumCulled += Other.FrustumCulled;
+				BackfaceCulled += Other.BackfaceCulled;
+				ObjectsTested += Other.ObjectsTested;
+				ObjectsVisible += Other.ObjectsVisible;
+				ObjectNodesVisited += Other.ObjectNodesVisited;
+				ObjectCullSeconds += Other.ObjectCullSeconds;
+				ObjectsOccluded += Other.ObjectsOccluded;
+				OccluderTriangles += Other.OccluderTriangles;
+				OcclusionSeconds += Other.OcclusionSeconds;
+				Commands += Other.Commands;
+				CommandBytes += Other.CommandBytes;
+				RecordSeconds += Other.RecordSeconds;
+				ReplaySeconds += Other.ReplaySeconds;
+				StateCalls += Other.StateCalls;
+				StateCallsEliminated += Other.StateCallsEliminated;
+				QueuedDraws += Other.QueuedDraws;
+				QueueSeconds += Other.QueueSeconds;
+				StateObjectHits += Other.StateObjectHits;
+				StateObjectMisses += Other.StateObjectMisses;
+				ConstantAllocations += Other.ConstantAllocations;
+				ConstantRingBytes += Other.ConstantRingBytes;
+				ConstantDiscards += Other.ConstantDiscards;
+				InstanceBatches += Other.InstanceBatches;
+				InstancedObjects += Other.InstancedObjects;
+				StaticBatchDraws += Other.StaticBatchDraws;
+				StaticBatchObjects += Other.StaticBatchObjects;
+				ClusteredLights += Other.ClusteredLights;
+				ClusterLightIndices += Other.ClusterLightIndices;
+				LightClusterSeconds += Other.LightClusterSeconds;
+				LightSelections += Other.LightSelections;
+				LightsInRange += Other.LightsInRange;
+				SelectedLights += Other.SelectedLights;
+				LightSelectionSeconds += Other.LightSelectionSeconds;
+				Frames += Other.Frames;
+			}
+		};
+
+		// This frame, the running two second report and the walkthrough.
+		TriangleStats FrameTriangles;
+		TriangleStats ReportTriangles;
+		TriangleStats WalkthroughTriangles;
+		float TriangleReportTime = 0.0f;
+
+		// Benchmark walkthrough: N flies the camera once around the castle and reports the
+		// cluster culling totals. Negative while not running.
+		float WalkthroughTime = -1.0f;
+		float WalkthroughSeconds = 12.0f;
+		DirectX::XMFLOAT4X4 WalkthroughSavedCamera;
 
 		// Variables used with the rendering loop.
 		bool	m_loadingComplete;
@@ -1,11 +1,16 @@
-// A constant buffer that stores the three basic column-major matrices for composing geometry.
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+// Per frame camera matrices, column-major.
+cbuffer ViewProjectionConstantBuffer : register(b0)
 {
-	matrix model;
 	matrix view;
 	matrix projection;
 };
 
+// Per object world matrix, column-major.
+cbuffer ModelConstantBuffer : register(b2)
+{
+	matrix model;
+};
+
 // Per-vertex data used as input to the vertex shader.
 struct VertexShaderInput
 {
@@ -33,7 +38,9 @@ PixelShaderInput main(VertexShaderInput input)
 	pos = mul(pos, model);
 	pos = mul(pos, view);
 	pos = mul(pos, projection);
-	output.pos = pos;
+
+	// z = w puts the skybox on the far plane, behind everything drawn before it.
+	output.pos = pos.xyww;
 
 	// Pass the color through without modification.
 	output.uv = input.uv;
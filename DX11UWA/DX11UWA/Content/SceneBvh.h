@@ -0,0 +1,962 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cfloat>
+#include "BoundingVolumes.h"
+#include "FrustumCulling.h"
+
+// Dynamic bounding volume hierarchy over scene objects, one object per leaf. A full build
+// uses binned SAH; objects can then be inserted, removed and refit one at a time, with
+// tree rotations keeping the surface area heuristic cost down as the tree changes. Every
+// query counts the nodes it visits.
+namespace DX11UWA
+{
+	static const int BvhNullNode = -1;
+
+	// Centroid bins per axis tried by the SAH build.
+	static const unsigned int BvhSahBins = 12;
+
+	struct BvhNode
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+		int Parent;
+		// Both BvhNullNode for a leaf.
+		int Left;
+		int Right;
+		unsigned int Object;
+
+		bool IsLeaf() const
+		{
+			return Left == BvhNullNode;
+		}
+	};
+
+	// Entries a traversal keeps inline before spilling to the heap.
+	static const unsigned int BvhInlineStackSize = 64;
+
+	// Traversal stack for the tree walks. Inserts and rotations put no bound on the tree's
+	// height, so entries past the inline ones spill into a vector instead of overrunning it.
+	template <typename T>
+	class BvhTraversalStack
+	{
+	public:
+		bool Empty() const
+		{
+			return Count == 0;
+		}
+
+		void Push(const T& Value)
+		{
+			if (Count < BvhInlineStackSize)
+			{
+				Inline[Count] = Value;
+			}
+			else
+			{
+				Spill.push_back(Value);
+			}
+			Count++;
+		}
+
+		T Pop()
+		{
+			Count--;
+			if (Count < BvhInlineStackSize)
+			{
+				return Inline[Count];
+			}
+
+			T Value = Spill.back();
+			Spill.pop_back();
+			return Value;
+		}
+
+	private:
+		T Inline[BvhInlineStackSize];
+		std::vector<T> Spill;
+		unsigned int Count = 0;
+	};
+
+	struct BvhQueryStats
+	{
+		unsigned int NodesVisited = 0;
+		unsigned int ObjectsFound = 0;
+	};
+
+	static float BoxSurfaceArea(const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max)
+	{
+		float x = Max.x - Min.x, y = Max.y - Min.y, z = Max.z - Min.z;
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+	static void BoxUnion(const DirectX::XMFLOAT3& MinA, const DirectX::XMFLOAT3& MaxA, const DirectX::XMFLOAT3& MinB, const DirectX::XMFLOAT3& MaxB,
+		DirectX::XMFLOAT3* Min, DirectX::XMFLOAT3* Max)
+	{
+		*Min = DirectX::XMFLOAT3(std::min(MinA.x, MinB.x), std::min(MinA.y, MinB.y), std::min(MinA.z, MinB.z));
+		*Max = DirectX::XMFLOAT3(std::max(MaxA.x, MaxB.x), std::max(MaxA.y, MaxB.y), std::max(MaxA.z, MaxB.z));
+	}
+
+	static float BoxUnionArea(const BvhNode& a, const BvhNode& b)
+	{
+		DirectX::XMFLOAT3 Min, Max;
+		BoxUnion(a.Min, a.Max, b.Min, b.Max, &Min, &Max);
+		return BoxSurfaceArea(Min, Max);
+	}
+
+	struct SceneBvh
+	{
+		std::vector<BvhNode> Nodes;
+		std::vector<int> FreeNodes;
+		// Leaf of each object id, or BvhNullNode when the object is not in the tree.
+		std::vector<int> ObjectLeaves;
+		int Root = BvhNullNode;
+		unsigned int ObjectCount = 0;
+
+		void Clear()
+		{
+			Nodes.clear();
+			FreeNodes.clear();
+			ObjectLeaves.clear();
+			Root = BvhNullNode;
+			ObjectCount = 0;
+		}
+
+		bool Contains(unsigned int Object) const
+		{
+			return Object < ObjectLeaves.size() && ObjectLeaves[Object] != BvhNullNode;
+		}
+
+		// Replaces the tree with objects 0 to Count - 1 built top-down with binned SAH.
+		void Build(const DirectX::XMFLOAT3* Mins, const DirectX::XMFLOAT3* Maxs, unsigned int Count)
+		{
+			Clear();
+			if (Count == 0)
+			{
+				return;
+			}
+
+			Nodes.reserve(2 * Count - 1);
+			ObjectLeaves.assign(Count, BvhNullNode);
+			ObjectCount = Count;
+
+			std::vector<unsigned int> Objects(Count);
+			std::vector<DirectX::XMFLOAT3> Centroids(Count);
+			for (unsigned int i = 0; i < Count; i++)
+			{
+				Objects[i] = i;
+				Centroids[i] = DirectX::XMFLOAT3(0.5f * (Mins[i].x + Maxs[i].x), 0.5f * (Mins[i].y + Maxs[i].y), 0.5f * (Mins[i].z + Maxs[i].z));
+			}
+
+			Root = BuildRange(Mins, Maxs, Centroids.data(), Objects.data(), 0, Count, BvhNullNode);
+		}
+
+		// Adds an object as a new leaf next to the sibling that raises the SAH cost least.
+		void Insert(unsigned int Object, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max)
+		{
+			if (Object >= ObjectLeaves.size())
+			{
+				ObjectLeaves.resize(Object + 1, BvhNullNode);
+			}
+			else if (ObjectLeaves[Object] != BvhNullNode)
+			{
+				Refit(Object, Min, Max);
+				return;
+			}
+
+			int Leaf = AllocateNode();
+			Nodes[Leaf].Min = Min;
+			Nodes[Leaf].Max = Max;
+			Nodes[Leaf].Object = Object;
+			ObjectLeaves[Object] = Leaf;
+			ObjectCount++;
+
+			InsertLeaf(Leaf);
+		}
+
+		void Remove(unsigned int Object)
+		{
+			if (!Contains(Object))
+			{
+				return;
+			}
+
+			int Leaf = ObjectLeaves[Object];
+			RemoveLeaf(Leaf);
+			FreeNode(Leaf);
+			ObjectLeaves[Object] = BvhNullNode;
+			ObjectCount--;
+		}
+
+		// Moves an object's box after its transform changed and refits the ancestors.
+		void Refit(unsigned int Object, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max)
+		{
+			if (!Contains(Object))
+			{
+				Insert(Object, Min, Max);
+				return;
+			}
+
+			int Leaf = ObjectLeaves[Object];
+			Nodes[Leaf].Min = Min;
+			Nodes[Leaf].Max = Max;
+			RefitAncestors(Nodes[Leaf].Parent, false);
+		}
+
+		// SAH cost relative to the root: the summed area of the internal nodes over the root's area.
+		float Cost() const
+		{
+			if (Root == BvhNullNode)
+			{
+				return 0.0f;
+			}
+
+			double Area = 0.0;
+			BvhTraversalStack<int> Stack;
+			Stack.Push(Root);
+			while (!Stack.Empty())
+			{
+				const BvhNode& Node = Nodes[Stack.Pop()];
+				if (!Node.IsLeaf())
+				{
+					Area += BoxSurfaceArea(Node.Min, Node.Max);
+					Stack.Push(Node.Left);
+					Stack.Push(Node.Right);
+				}
+			}
+			return (float)(Area / fmaxf(BoxSurfaceArea(Nodes[Root].Min, Nodes[Root].Max), FLT_MIN));
+		}
+
+		// Appends the objects whose boxes are not entirely behind one of the planes. Planes
+		// a node is wholly in front of are dropped for its subtree, and a subtree inside all
+		// six is taken without further tests.
+		void QueryFrustum(const DirectX::XMFLOAT4 Planes[6], std::vector<unsigned int>* Objects, BvhQueryStats* Stats = nullptr) const
+		{
+			if (Root == BvhNullNode)
+			{
+				return;
+			}
+
+			struct Entry
+			{
+				int Node;
+				unsigned int PlaneMask;
+			};
+
+			BvhTraversalStack<Entry> Stack;
+			Stack.Push({ Root, 0x3F });
+
+			unsigned int Visited = 0;
+			size_t FirstFound = Objects->size();
+
+			while (!Stack.Empty())
+			{
+				Entry Current = Stack.Pop();
+				const BvhNode& Node = Nodes[Current.Node];
+				Visited++;
+
+				unsigned int Mask = Current.PlaneMask;
+				bool Outside = false;
+
+				float cx = 0.5f * (Node.Min.x + Node.Max.x), cy = 0.5f * (Node.Min.y + Node.Max.y), cz = 0.5f * (Node.Min.z + Node.Max.z);
+				float ex = 0.5f * (Node.Max.x - Node.Min.x), ey = 0.5f * (Node.Max.y - Node.Min.y), ez = 0.5f * (Node.Max.z - Node.Min.z);
+
+				for (unsigned int p = 0; p < 6 && !Outside; p++)
+				{
+					if ((Mask & (1u << p)) == 0)
+					{
+						continue;
+					}
+
+					const DirectX::XMFLOAT4& Plane = Planes[p];
+					float Distance = Plane.x * cx + Plane.y * cy + Plane.z * cz + Plane.w;
+					float Reach = fabsf(Plane.x) * ex + fabsf(Plane.y) * ey + fabsf(Plane.z) * ez;
+
+					if (Distance + Reach < 0.0f)
+					{
+						Outside = true;
+					}
+					else if (Distance - Reach >= 0.0f)
+					{
+						Mask &= ~(1u << p);
+					}
+				}
+
+				if (Outside)
+				{
+					continue;
+				}
+
+				if (Node.IsLeaf())
+				{
+					Objects->push_back(Node.Object);
+				}
+				else if (Mask == 0)
+				{
+					Visited += CollectSubtree(Node.Left, Objects) + CollectSubtree(Node.Right, Objects);
+				}
+				else
+				{
+					Stack.Push({ Node.Left, Mask });
+					Stack.Push({ Node.Right, Mask });
+				}
+			}
+
+			if (Stats != nullptr)
+			{
+				Stats->NodesVisited += Visited;
+				Stats->ObjectsFound += (unsigned int)(Objects->size() - FirstFound);
+			}
+		}
+
+		// Appends the objects whose boxes overlap the sphere, e.g. the reach of a light.
+		void QuerySphere(const DirectX::XMFLOAT3& Center, float Radius, std::vector<unsigned int>* Objects, BvhQueryStats* Stats = nullptr) const
+		{
+			if (Root == BvhNullNode)
+			{
+				return;
+			}
+
+			BvhTraversalStack<int> Stack;
+			Stack.Push(Root);
+
+			unsigned int Visited = 0;
+			size_t FirstFound = Objects->size();
+			float RadiusSq = Radius * Radius;
+
+			while (!Stack.Empty())
+			{
+				const BvhNode& Node = Nodes[Stack.Pop()];
+				Visited++;
+
+				float dx = std::max(std::max(Node.Min.x - Center.x, Center.x - Node.Max.x), 0.0f);
+				float dy = std::max(std::max(Node.Min.y - Center.y, Center.y - Node.Max.y), 0.0f);
+				float dz = std::max(std::max(Node.Min.z - Center.z, Center.z - Node.Max.z), 0.0f);
+				if (dx * dx + dy * dy + dz * dz > RadiusSq)
+				{
+					continue;
+				}
+
+				if (Node.IsLeaf())
+				{
+					Objects->push_back(Node.Object);
+				}
+				else
+				{
+					Stack.Push(Node.Left);
+					Stack.Push(Node.Right);
+				}
+			}
+
+			if (Stats != nullptr)
+			{
+				Stats->NodesVisited += Visited;
+				Stats->ObjectsFound += (unsigned int)(Objects->size() - FirstFound);
+			}
+		}
+
+		// Nearest hit along Origin + t * Direction for t in [0, MaxT]. HitObject(Object, BoxT, &t)
+		// is called for each object whose box the ray enters before the best hit so far, and
+		// returns whether the object itself is hit, at t. Children are visited nearest first.
+		template <typename HitFunction>
+		bool RayCast(const DirectX::XMFLOAT3& Origin, const DirectX::XMFLOAT3& Direction, float MaxT, HitFunction HitObject,
+			unsigned int* Object, float* T, BvhQueryStats* Stats = nullptr) const
+		{
+			if (Root == BvhNullNode)
+			{
+				return false;
+			}
+
+			DirectX::XMFLOAT3 Inverse(1.0f / Direction.x, 1.0f / Direction.y, 1.0f / Direction.z);
+
+			struct Entry
+			{
+				int Node;
+				float Entry;
+			};
+
+			BvhTraversalStack<Entry> Stack;
+
+			unsigned int Visited = 0;
+			float BestT = MaxT;
+			bool Hit = false;
+
+			float RootT;
+			if (RayBox(Nodes[Root], Origin, Inverse, BestT, &RootT))
+			{
+				Stack.Push({ Root, RootT });
+			}
+
+			while (!Stack.Empty())
+			{
+				Entry Current = Stack.Pop();
+				if (Current.Entry > BestT)
+				{
+					continue;
+				}
+
+				const BvhNode& Node = Nodes[Current.Node];
+				Visited++;
+
+				if (Node.IsLeaf())
+				{
+					float ObjectT = BestT;
+					if (HitObject(Node.Object, Current.Entry, &ObjectT) && ObjectT <= BestT)
+					{
+						BestT = ObjectT;
+						*Object = Node.Object;
+						Hit = true;
+					}
+					continue;
+				}
+
+				float LeftT, RightT;
+				bool LeftHit = RayBox(Nodes[Node.Left], Origin, Inverse, BestT, &LeftT);
+				bool RightHit = RayBox(Nodes[Node.Right], Origin, Inverse, BestT, &RightT);
+
+				// Push the farther child first so the nearer one is popped next.
+				if (LeftHit && RightHit)
+				{
+					bool LeftFirst = LeftT <= RightT;
+					Stack.Push(LeftFirst ? Entry{ Node.Right, RightT } : Entry{ Node.Left, LeftT });
+					Stack.Push(LeftFirst ? Entry{ Node.Left, LeftT } : Entry{ Node.Right, RightT });
+				}
+				else if (LeftHit)
+				{
+					Stack.Push({ Node.Left, LeftT });
+				}
+				else if (RightHit)
+				{
+					Stack.Push({ Node.Right, RightT });
+				}
+			}
+
+			if (Hit)
+			{
+				*T = BestT;
+			}
+
+			if (Stats != nullptr)
+			{
+				Stats->NodesVisited += Visited;
+				Stats->ObjectsFound += Hit ? 1 : 0;
+			}
+
+			return Hit;
+		}
+
+		// Nearest object box along the ray.
+		bool RayCast(const DirectX::XMFLOAT3& Origin, const DirectX::XMFLOAT3& Direction, float MaxT, unsigned int* Object, float* T, BvhQueryStats* Stats = nullptr) const
+		{
+			return RayCast(Origin, Direction, MaxT, [](unsigned int, float BoxT, float* ObjectT) { *ObjectT = BoxT; return true; }, Object, T, Stats);
+		}
+
+		// Slab test. Entry is where the ray enters the box, clamped to 0 when it starts inside.
+		static bool RayBox(const BvhNode& Node, const DirectX::XMFLOAT3& Origin, const DirectX::XMFLOAT3& Inverse, float MaxT, float* Entry)
+		{
+			float t1 = (Node.Min.x - Origin.x) * Inverse.x, t2 = (Node.Max.x - Origin.x) * Inverse.x;
+			float Near = fminf(t1, t2), Far = fmaxf(t1, t2);
+
+			t1 = (Node.Min.y - Origin.y) * Inverse.y; t2 = (Node.Max.y - Origin.y) * Inverse.y;
+			Near = fmaxf(Near, fminf(t1, t2)); Far = fminf(Far, fmaxf(t1, t2));
+
+			t1 = (Node.Min.z - Origin.z) * Inverse.z; t2 = (Node.Max.z - Origin.z) * Inverse.z;
+			Near = fmaxf(Near, fminf(t1, t2)); Far = fminf(Far, fmaxf(t1, t2));
+
+			Near = fmaxf(Near, 0.0f);
+			*Entry = Near;
+			return Near <= Far && Near <= MaxT;
+		}
+
+	private:
+		int AllocateNode()
+		{
+			int Index;
+			if (!FreeNodes.empty())
+			{
+				Index = FreeNodes.back();
+				FreeNodes.pop_back();
+			}
+			else
+			{
+				Index = (int)Nodes.size();
+				Nodes.push_back(BvhNode());
+			}
+
+			BvhNode& Node = Nodes[Index];
+			Node.Parent = BvhNullNode;
+			Node.Left = BvhNullNode;
+			Node.Right = BvhNullNode;
+			Node.Object = 0;
+			return Index;
+		}
+
+		void FreeNode(int Index)
+		{
+			FreeNodes.push_back(Index);
+		}
+
+		void SetChildren(int Parent, int Left, int Right)
+		{
+			BvhNode& Node = Nodes[Parent];
+			Node.Left = Left;
+			Node.Right = Right;
+			Nodes[Left].Parent = Parent;
+			Nodes[Right].Parent = Parent;
+			BoxUnion(Nodes[Left].Min, Nodes[Left].Max, Nodes[Right].Min, Nodes[Right].Max, &Node.Min, &Node.Max);
+		}
+
+		unsigned int CollectSubtree(int Index, std::vector<unsigned int>* Objects) const
+		{
+			BvhTraversalStack<int> Stack;
+			Stack.Push(Index);
+			unsigned int Visited = 0;
+
+			while (!Stack.Empty())
+			{
+				const BvhNode& Node = Nodes[Stack.Pop()];
+				Visited++;
+
+				if (Node.IsLeaf())
+				{
+					Objects->push_back(Node.Object);
+				}
+				else
+				{
+					Stack.Push(Node.Left);
+					Stack.Push(Node.Right);
+				}
+			}
+
+			return Visited;
+		}
+
+		int BuildRange(const DirectX::XMFLOAT3* Mins, const DirectX::XMFLOAT3* Maxs, const DirectX::XMFLOAT3* Centroids, unsigned int* Objects,
+			unsigned int Begin, unsigned int End, int Parent)
+		{
+			if (End - Begin == 1)
+			{
+				int Leaf = AllocateNode();
+				Nodes[Leaf].Min = Mins[Objects[Begin]];
+				Nodes[Leaf].Max = Maxs[Objects[Begin]];
+				Nodes[Leaf].Object = Objects[Begin];
+				Nodes[Leaf].Parent = Parent;
+				ObjectLeaves[Objects[Begin]] = Leaf;
+				return Leaf;
+			}
+
+			DirectX::XMFLOAT3 CentroidMin(FLT_MAX, FLT_MAX, FLT_MAX), CentroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (unsigned int i = Begin; i < End; i++)
+			{
+				BoxUnion(CentroidMin, CentroidMax, Centroids[Objects[i]], Centroids[Objects[i]], &CentroidMin, &CentroidMax);
+			}
+
+			// Sweep the bins of each axis for the cheapest split: area times object count on
+			// either side.
+			int BestAxis = -1;
+			unsigned int BestSplit = 0;
+			float BestCost = FLT_MAX;
+
+			for (int Axis = 0; Axis < 3; Axis++)
+			{
+				float AxisMin = (&CentroidMin.x)[Axis];
+				float AxisExtent = (&CentroidMax.x)[Axis] - AxisMin;
+				if (AxisExtent <= 0.0f)
+				{
+					continue;
+				}
+
+				struct Bin
+				{
+					DirectX::XMFLOAT3 Min, Max;
+					unsigned int Count;
+				};
+
+				Bin Bins[BvhSahBins];
+				for (unsigned int b = 0; b < BvhSahBins; b++)
+				{
+					Bins[b] = { DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX), 0 };
+				}
+
+				float BinScale = BvhSahBins / AxisExtent;
+				for (unsigned int i = Begin; i < End; i++)
+				{
+					unsigned int o = Objects[i];
+					unsigned int b = std::min((unsigned int)(((&Centroids[o].x)[Axis] - AxisMin) * BinScale), BvhSahBins - 1);
+					BoxUnion(Bins[b].Min, Bins[b].Max, Mins[o], Maxs[o], &Bins[b].Min, &Bins[b].Max);
+					Bins[b].Count++;
+				}
+
+				float RightArea[BvhSahBins];
+				unsigned int RightCount[BvhSahBins];
+				DirectX::XMFLOAT3 Min(FLT_MAX, FLT_MAX, FLT_MAX), Max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				unsigned int Count = 0;
+				for (unsigned int b = BvhSahBins - 1; b > 0; b--)
+				{
+					BoxUnion(Min, Max, Bins[b].Min, Bins[b].Max, &Min, &Max);
+					Count += Bins[b].Count;
+					RightArea[b] = Count > 0 ? BoxSurfaceArea(Min, Max) : 0.0f;
+					RightCount[b] = Count;
+				}
+
+				Min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+				Max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				Count = 0;
+				for (unsigned int b = 0; b + 1 < BvhSahBins; b++)
+				{
+					BoxUnion(Min, Max, Bins[b].Min, Bins[b].Max, &Min, &Max);
+					Count += Bins[b].Count;
+					if (Count == 0 || RightCount[b + 1] == 0)
+					{
+						continue;
+					}
+
+					float Cost = BoxSurfaceArea(Min, Max) * Count + RightArea[b + 1] * RightCount[b + 1];
+					if (Cost < BestCost)
+					{
+						BestCost = Cost;
+						BestAxis = Axis;
+						BestSplit = b + 1;
+					}
+				}
+			}
+
+			unsigned int Middle;
+			if (BestAxis < 0)
+			{
+				// Every centroid coincides: any split is as good as another.
+				Middle = Begin + (End - Begin) / 2;
+			}
+			else
+			{
+				float AxisMin = (&CentroidMin.x)[BestAxis];
+				float BinScale = BvhSahBins / ((&CentroidMax.x)[BestAxis] - AxisMin);
+				unsigned int* Split = std::partition(Objects + Begin, Objects + End, [&](unsigned int o)
+				{
+					return std::min((unsigned int)(((&Centroids[o].x)[BestAxis] - AxisMin) * BinScale), BvhSahBins - 1) < BestSplit;
+				});
+				Middle = (unsigned int)(Split - Objects);
+			}
+
+			int Node = AllocateNode();
+			Nodes[Node].Parent = Parent;
+			int Left = BuildRange(Mins, Maxs, Centroids, Objects, Begin, Middle, Node);
+			int Right = BuildRange(Mins, Maxs, Centroids, Objects, Middle, End, Node);
+			SetChildren(Node, Left, Right);
+			return Node;
+		}
+
+		// Walks down from the root towards the sibling with the lowest SAH cost increase
+		// (Box2D's dynamic tree descent): at each node, either pair the leaf with the node
+		// itself or descend into the child whose box grows least.
+		void InsertLeaf(int Leaf)
+		{
+			if (Root == BvhNullNode)
+			{
+				Root = Leaf;
+				Nodes[Leaf].Parent = BvhNullNode;
+				return;
+			}
+
+			int Index = Root;
+			while (!Nodes[Index].IsLeaf())
+			{
+				const BvhNode& Node = Nodes[Index];
+				float Area = BoxSurfaceArea(Node.Min, Node.Max);
+				float CombinedArea = BoxUnionArea(Node, Nodes[Leaf]);
+
+				float Cost = 2.0f * CombinedArea;
+				float Inheritance = 2.0f * (CombinedArea - Area);
+
+				auto ChildCost = [&](int Child)
+				{
+					const BvhNode& c = Nodes[Child];
+					float Grown = BoxUnionArea(c, Nodes[Leaf]);
+					return (c.IsLeaf() ? Grown : Grown - BoxSurfaceArea(c.Min, c.Max)) + Inheritance;
+				};
+
+				float LeftCost = ChildCost(Node.Left);
+				float RightCost = ChildCost(Node.Right);
+
+				if (Cost < LeftCost && Cost < RightCost)
+				{
+					break;
+				}
+
+				Index = LeftCost < RightCost ? Node.Left : Node.Right;
+			}
+
+			int Sibling = Index;
+			int OldParent = Nodes[Sibling].Parent;
+			int NewParent = AllocateNode();
+			Nodes[NewParent].Parent = OldParent;
+
+			if (OldParent != BvhNullNode)
+			{
+				if (Nodes[OldParent].Left == Sibling) Nodes[OldParent].Left = NewParent;
+				else Nodes[OldParent].Right = NewParent;
+			}
+			else
+			{
+				Root = NewParent;
+			}
+
+			SetChildren(NewParent, Sibling, Leaf);
+			RefitAncestors(OldParent, true);
+		}
+
+		void RemoveLeaf(int Leaf)
+		{
+			if (Leaf == Root)
+			{
+				Root = BvhNullNode;
+				return;
+			}
+
+			int Parent = Nodes[Leaf].Parent;
+			int GrandParent = Nodes[Parent].Parent;
+			int Sibling = Nodes[Parent].Left == Leaf ? Nodes[Parent].Right : Nodes[Parent].Left;
+
+			if (GrandParent != BvhNullNode)
+			{
+				if (Nodes[GrandParent].Left == Parent) Nodes[GrandParent].Left = Sibling;
+				else Nodes[GrandParent].Right = Sibling;
+				Nodes[Sibling].Parent = GrandParent;
+				FreeNode(Parent);
+				RefitAncestors(GrandParent, true);
+			}
+			else
+			{
+				Root = Sibling;
+				Nodes[Sibling].Parent = BvhNullNode;
+				FreeNode(Parent);
+			}
+		}
+
+		// Recomputes boxes from Index up to the root, optionally rotating each node.
+		void RefitAncestors(int Index, bool Rotate)
+		{
+			while (Index != BvhNullNode)
+			{
+				if (Rotate)
+				{
+					RotateNode(Index);
+				}
+
+				BvhNode& Node = Nodes[Index];
+				BoxUnion(Nodes[Node.Left].Min, Nodes[Node.Left].Max, Nodes[Node.Right].Min, Nodes[Node.Right].Max, &Node.Min, &Node.Max);
+				Index = Node.Parent;
+			}
+		}
+
+		// Tries swapping one child of the node with a grandchild under the other child
+		// (Kopta et al., "Fast, Effective BVH Updates for Animated Scenes") and keeps the
+		// swap that shrinks the affected child's area the most.
+		void RotateNode(int Index)
+		{
+			int Left = Nodes[Index].Left;
+			int Right = Nodes[Index].Right;
+
+			int BestChild = BvhNullNode;
+			int BestGrandChild = BvhNullNode;
+			float BestSaving = 0.0f;
+
+			auto Consider = [&](int Child, int Other)
+			{
+				if (Nodes[Other].IsLeaf())
+				{
+					return;
+				}
+
+				float Area = BoxSurfaceArea(Nodes[Other].Min, Nodes[Other].Max);
+				int GrandChildren[2] = { Nodes[Other].Left, Nodes[Other].Right };
+				for (int g = 0; g < 2; g++)
+				{
+					// Child and GrandChildren[g] trade places; Other then holds Child and the remaining grandchild.
+					float Saving = Area - BoxUnionArea(Nodes[Child], Nodes[GrandChildren[1 - g]]);
+					if (Saving > BestSaving)
+					{
+						BestSaving = Saving;
+						BestChild = Child;
+						BestGrandChild = GrandChildren[g];
+					}
+				}
+			};
+
+			Consider(Left, Right);
+			Consider(Right, Left);
+
+			if (BestChild == BvhNullNode)
+			{
+				return;
+			}
+
+			int Other = BestChild == Left ? Right : Left;
+			int Remaining = Nodes[Other].Left == BestGrandChild ? Nodes[Other].Right : Nodes[Other].Left;
+
+			SetChildren(Other, BestChild, Remaining);
+			if (BestChild == Left) SetChildren(Index, BestGrandChild, Other);
+			else SetChildren(Index, Other, BestGrandChild);
+		}
+	};
+
+	// Builds, queries and edits a BVH over ObjectCount random boxes, checking every query
+	// against brute force, and reports timings, SAH cost and nodes visited per query.
+	static void ReportSceneBvh(unsigned int ObjectCount = 100000, unsigned int QueryCount = 100)
+	{
+		using namespace DirectX;
+		using Clock = std::chrono::high_resolution_clock;
+		auto Milliseconds = [](Clock::time_point Start) { return std::chrono::duration<double, std::milli>(Clock::now() - Start).count(); };
+
+		std::mt19937 Random(4321);
+		std::uniform_real_distribution<float> Coordinate(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> Size(0.5f, 5.0f);
+		std::uniform_real_distribution<float> Angle(-XM_PI, XM_PI);
+
+		std::vector<XMFLOAT3> Mins(ObjectCount), Maxs(ObjectCount);
+		auto RandomBox = [&](unsigned int i)
+		{
+			XMFLOAT3 c(Coordinate(Random), Coordinate(Random), Coordinate(Random));
+			float s = Size(Random);
+			Mins[i] = XMFLOAT3(c.x - s, c.y - s, c.z - s);
+			Maxs[i] = XMFLOAT3(c.x + s, c.y + s, c.z + s);
+		};
+		for (unsigned int i = 0; i < ObjectCount; i++)
+		{
+			RandomBox(i);
+		}
+
+		char Line[256];
+		bool Correct = true;
+
+		SceneBvh Tree;
+		auto Start = Clock::now();
+		Tree.Build(Mins.data(), Maxs.data(), ObjectCount);
+		double BuildMs = Milliseconds(Start);
+		float BuildCost = Tree.Cost();
+
+		SceneBvh Inserted;
+		Start = Clock::now();
+		for (unsigned int i = 0; i < ObjectCount; i++)
+		{
+			Inserted.Insert(i, Mins[i], Maxs[i]);
+		}
+		double InsertMs = Milliseconds(Start);
+
+		sprintf_s(Line, "BVH: %u objects, SAH build %.2f ms (cost %.1f), one-by-one insert %.2f ms (cost %.1f)\n",
+			ObjectCount, BuildMs, BuildCost, InsertMs, Inserted.Cost());
+		OutputDebugStringA(Line);
+
+		// Half of the objects drift a little and are refit in place; a quarter jump to new
+		// places, which a refit handles badly, so they are removed and inserted again.
+		std::uniform_real_distribution<float> Drift(-1.0f, 1.0f);
+		Start = Clock::now();
+		for (unsigned int i = 1; i < ObjectCount; i += 2)
+		{
+			XMFLOAT3 d(Drift(Random), Drift(Random), Drift(Random));
+			Mins[i] = XMFLOAT3(Mins[i].x + d.x, Mins[i].y + d.y, Mins[i].z + d.z);
+			Maxs[i] = XMFLOAT3(Maxs[i].x + d.x, Maxs[i].y + d.y, Maxs[i].z + d.z);
+			Tree.Refit(i, Mins[i], Maxs[i]);
+		}
+		double RefitMs = Milliseconds(Start);
+		float RefitCost = Tree.Cost();
+
+		Start = Clock::now();
+		for (unsigned int i = 0; i < ObjectCount; i += 4)
+		{
+			Tree.Remove(i);
+		}
+		for (unsigned int i = 0; i < ObjectCount; i += 4)
+		{
+			RandomBox(i);
+			Tree.Insert(i, Mins[i], Maxs[i]);
+		}
+		double ReinsertMs = Milliseconds(Start);
+
+		sprintf_s(Line, "BVH: refit %u drifting objects %.2f ms (cost %.1f), remove and reinsert %u moved objects %.2f ms (cost %.1f)\n",
+			ObjectCount / 2, RefitMs, RefitCost, (ObjectCount + 3) / 4, ReinsertMs, Tree.Cost());
+		OutputDebugStringA(Line);
+
+		XMMATRIX Projection = XMMatrixPerspectiveFovLH(70.0f * XM_PI / 180.0f, 16.0f / 9.0f, 0.01f, 400.0f);
+		std::vector<unsigned int> Found, Expected;
+		BvhQueryStats FrustumStats, RayStats, SphereStats;
+		double FrustumMs = 0.0, RayMs = 0.0, SphereMs = 0.0;
+
+		for (unsigned int q = 0; q < QueryCount; q++)
+		{
+			XMFLOAT3 Eye(0.2f * Coordinate(Random), 0.2f * Coordinate(Random), 0.2f * Coordinate(Random));
+			float Yaw = Angle(Random), Pitch = 0.25f * Angle(Random);
+			XMFLOAT3 Forward(cosf(Pitch) * sinf(Yaw), sinf(Pitch), cosf(Pitch) * cosf(Yaw));
+
+			// Frustum
+			XMFLOAT4 Planes[6];
+			XMVECTOR EyeVector = XMLoadFloat3(&Eye);
+			GetFrustumPlanes(XMMatrixMultiply(XMMatrixLookAtLH(EyeVector, XMVectorAdd(EyeVector, XMLoadFloat3(&Forward)), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)), Projection), Planes);
+
+			Found.clear();
+			Start = Clock::now();
+			Tree.QueryFrustum(Planes, &Found, &FrustumStats);
+			FrustumMs += Milliseconds(Start);
+
+			Expected.clear();
+			for (unsigned int i = 0; i < ObjectCount; i++)
+			{
+				bool Outside = false;
+				for (unsigned int p = 0; p < 6 && !Outside; p++)
+				{
+					const XMFLOAT4& P = Planes[p];
+					float d = P.x * (P.x > 0.0f ? Maxs[i].x : Mins[i].x) + P.y * (P.y > 0.0f ? Maxs[i].y : Mins[i].y) + P.z * (P.z > 0.0f ? Maxs[i].z : Mins[i].z) + P.w;
+					Outside = d < 0.0f;
+				}
+				if (!Outside) Expected.push_back(i);
+			}
+			std::sort(Found.begin(), Found.end());
+			Correct = Correct && Found == Expected;
+
+			// Ray
+			unsigned int HitObject = 0;
+			float HitT = 0.0f;
+			Start = Clock::now();
+			bool Hit = Tree.RayCast(Eye, Forward, 2000.0f, &HitObject, &HitT, &RayStats);
+			RayMs += Milliseconds(Start);
+
+			float NearestT = FLT_MAX;
+			XMFLOAT3 Inverse(1.0f / Forward.x, 1.0f / Forward.y, 1.0f / Forward.z);
+			for (unsigned int i = 0; i < ObjectCount; i++)
+			{
+				BvhNode Box;
+				Box.Min = Mins[i];
+				Box.Max = Maxs[i];
+				float t;
+				if (SceneBvh::RayBox(Box, Eye, Inverse, 2000.0f, &t)) NearestT = fminf(NearestT, t);
+			}
+			Correct = Correct && Hit == (NearestT != FLT_MAX) && (!Hit || HitT == NearestT);
+
+			// Sphere
+			Found.clear();
+			Start = Clock::now();
+			Tree.QuerySphere(Eye, 20.0f, &Found, &SphereStats);
+			SphereMs += Milliseconds(Start);
+
+			size_t SphereExpected = 0;
+			for (unsigned int i = 0; i < ObjectCount; i++)
+			{
+				float dx = fmaxf(fmaxf(Mins[i].x - Eye.x, Eye.x - Maxs[i].x), 0.0f);
+				float dy = fmaxf(fmaxf(Mins[i].y - Eye.y, Eye.y - Maxs[i].y), 0.0f);
+				float dz = fmaxf(fmaxf(Mins[i].z - Eye.z, Eye.z - Maxs[i].z), 0.0f);
+				SphereExpected += dx * dx + dy * dy + dz * dz <= 400.0f;
+			}
+			Correct = Correct && Found.size() == SphereExpected;
+		}
+
+		sprintf_s(Line, "BVH: frustum %.3f ms, %u nodes visited, %u objects per query\n",
+			FrustumMs / QueryCount, FrustumStats.NodesVisited / QueryCount, FrustumStats.ObjectsFound / QueryCount);
+		OutputDebugStringA(Line);
+		sprintf_s(Line, "BVH: ray %.4f ms, %u nodes visited; sphere %.4f ms, %u nodes visited, %u objects per query; %s brute force\n",
+			RayMs / QueryCount, RayStats.NodesVisited / QueryCount, SphereMs / QueryCount, SphereStats.NodesVisited / QueryCount,
+			SphereStats.ObjectsFound / QueryCount, Correct ? "matches" : "DIFFERS FROM");
+		OutputDebugStringA(Line);
+	}
+}
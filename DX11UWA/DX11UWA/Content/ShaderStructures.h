@@ -1,7 +1,5 @@
 ﻿#pragma once
 
-#define LIGHT_AMOUNT 3
-
 namespace DX11UWA
 {
 	// Constant buffer used to send MVP matrices to the vertex shader.
@@ -12,6 +10,19 @@ namespace DX11UWA
 		DirectX::XMFLOAT4X4 projection;
 	};
 
+	// Per frame half of the camera constants, vertex shader register b0.
+	struct ViewProjectionConstantBuffer
+	{
+		DirectX::XMFLOAT4X4 view;
+		DirectX::XMFLOAT4X4 projection;
+	};
+
+	// Per object half, vertex shader register b2; b1 holds the quantization constants.
+	struct ModelConstantBuffer
+	{
+		DirectX::XMFLOAT4X4 model;
+	};
+
 	struct Lights
 	{
 		DirectX::XMFLOAT4 pos;
@@ -29,10 +40,24 @@ namespace DX11UWA
 		DirectX::XMINT4 padding;
 	};
 
+	// Pixel shader register b1. The lights themselves are in a buffer at t2 and every
+	// cluster's list of them at t3 and t4; see ClusteredLighting.h.
 	struct LightProp
 	{
 		DirectX::XMFLOAT4 CameraPos;
-		Lights LightArray[LIGHT_AMOUNT];
+		// Clusters per pixel in x and y, then the scale and bias from log view depth to slice.
+		DirectX::XMFLOAT4 ClusterScale;
+		DirectX::XMUINT4 ClusterCount;
+		// x is 1 when every draw brings its own light list at b2 instead; see LightSelection.h.
+		DirectX::XMUINT4 LightSelection;
+	};
+
+	// Per draw light list, pixel shader register b2: the count in x, then one light index in
+	// the x of each of OBJECT_LIGHTS slots.
+	struct ObjectLightConstantBuffer
+	{
+		DirectX::XMUINT4 LightCount;
+		DirectX::XMUINT4 LightIndices[8];
 	};
 
 	struct VertexPosition
@@ -54,11 +79,30 @@ namespace DX11UWA
 		DirectX::XMFLOAT3 normal;
 	};
 
+	// tangent.w is the handedness: bitangent = cross(normal, tangent.xyz) * tangent.w.
 	struct VertexPositionUVNormalTan
 	{
 		DirectX::XMFLOAT3 pos;
 		DirectX::XMFLOAT3 uv;
 		DirectX::XMFLOAT3 normal;
-		DirectX::XMFLOAT3 tangent;
+		DirectX::XMFLOAT4 tangent;
+	};
+
+	// Compact 20-byte form of VertexPositionUVNormalTan. Positions are 16-bit unorm within
+	// the mesh bounds with the tangent handedness in w, UVs are half floats, and the normal
+	// and tangent are octahedral-encoded 16-bit snorm pairs.
+	struct VertexQuantized
+	{
+		unsigned short pos[4];
+		unsigned short uv[2];
+		short normal[2];
+		short tangent[2];
+	};
+
+	// Constant buffer used to decode VertexQuantized positions: pos = unorm * scale + offset.
+	struct QuantizationConstantBuffer
+	{
+		DirectX::XMFLOAT4 positionScale;
+		DirectX::XMFLOAT4 positionOffset;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,626 @@
+#pragma once
+#include "CommandBuffer.h"
+
+// Redundant state filtering between a command buffer and a device context. The filter
+// shadows every binding it has forwarded and drops calls that would set what is already
+// bound. Command replay goes through ContextCommandBackend, which talks to any context
+// type with the calls of MockDeviceContext: D3D11Context on the device, or the mock itself
+// headless, which records the calls it receives and the state bound at every draw.
+namespace DX11UWA
+{
+	enum StateCall
+	{
+		StateCallInputLayout,
+		StateCallTopology,
+		StateCallVertexShader,
+		StateCallPixelShader,
+		StateCallVertexBuffer,
+		StateCallIndexBuffer,
+		StateCallConstantBuffer,
+		StateCallTextures,
+		StateCallSamplers,
+		StateCallDepthState,
+		StateCallCount,
+	};
+
+	// Slots the filter shadows. Bindings past them are always forwarded.
+	static const unsigned int StateFilterVertexBuffers = 4;
+	static const unsigned int StateFilterConstantBuffers = 8;
+	static const unsigned int StateFilterTextures = 8;
+	static const unsigned int StateFilterSamplers = 4;
+	static const unsigned int StateFilterStages = 2;
+
+	class RedundantStateFilter
+	{
+	public:
+		unsigned int Forwarded[StateCallCount] = {};
+		unsigned int Eliminated[StateCallCount] = {};
+
+		// Forgets every binding, so the next call for each goes through. Anything else that
+		// touches the context between frames makes the shadow stale.
+		void Invalidate()
+		{
+			Known = Shadow();
+		}
+
+		void ResetCounts()
+		{
+			std::fill(Forwarded, Forwarded + StateCallCount, 0u);
+			std::fill(Eliminated, Eliminated + StateCallCount, 0u);
+		}
+
+		unsigned int GetForwarded() const
+		{
+			return Sum(Forwarded);
+		}
+
+		unsigned int GetEliminated() const
+		{
+			return Sum(Eliminated);
+		}
+
+		// Each of these returns whether the call has to reach the context.
+		bool SetInputLayout(ID3D11InputLayout* InputLayout)
+		{
+			return Update(StateCallInputLayout, Known.HasInputLayout, Known.InputLayout, InputLayout);
+		}
+
+		bool SetTopology(unsigned int Topology)
+		{
+			return Update(StateCallTopology, Known.HasTopology, Known.Topology, Topology);
+		}
+
+		bool SetVertexShader(ID3D11VertexShader* Shader)
+		{
+			return Update(StateCallVertexShader, Known.HasVertexShader, Known.VertexShader, Shader);
+		}
+
+		bool SetPixelShader(ID3D11PixelShader* Shader)
+		{
+			return Update(StateCallPixelShader, Known.HasPixelShader, Known.PixelShader, Shader);
+		}
+
+		bool SetDepthState(ID3D11DepthStencilState* State, unsigned int StencilRef)
+		{
+			DepthBinding Binding = { State, StencilRef };
+			return Update(StateCallDepthState, Known.HasDepthState, Known.DepthState, Binding);
+		}
+
+		bool SetVertexBuffer(unsigned int Slot, ID3D11Buffer* Buffer, unsigned int Stride, unsigned int Offset)
+		{
+			if (Slot >= StateFilterVertexBuffers)
+			{
+				return Forward(StateCallVertexBuffer);
+			}
+
+			VertexBinding Binding = { Buffer, Stride, Offset };
+			return Update(StateCallVertexBuffer, Known.HasVertexBuffer[Slot], Known.VertexBuffers[Slot], Binding);
+		}
+
+		bool SetIndexBuffer(ID3D11Buffer* Buffer, unsigned int Format, unsigned int Offset)
+		{
+			VertexBinding Binding = { Buffer, Format, Offset };
+			return Update(StateCallIndexBuffer, Known.HasIndexBuffer, Known.IndexBuffer, Binding);
+		}
+
+		bool SetConstantBuffer(unsigned int Stage, unsigned int Slot, ID3D11Buffer* Buffer, unsigned int FirstConstant, unsigned int ConstantCount)
+		{
+			if (Stage >= StateFilterStages || Slot >= StateFilterConstantBuffers)
+			{
+				return Forward(StateCallConstantBuffer);
+			}
+
+			VertexBinding Binding = { Buffer, FirstConstant, ConstantCount };
+			return Update(StateCallConstantBuffer, Known.HasConstantBuffer[Stage][Slot], Known.ConstantBuffers[Stage][Slot], Binding);
+		}
+
+		// Narrows Slot and Count to the run of views that differ from what is bound.
+		bool SetTextures(unsigned int Stage, unsigned int* Slot, unsigned int* Count, ID3D11ShaderResourceView* const** Views)
+		{
+			return UpdateRange(StateCallTextures, Stage, Slot, Count, Views, StateFilterTextures, Known.HasTexture, Known.Textures);
+		}
+
+		bool SetSamplers(unsigned int Stage, unsigned int* Slot, unsigned int* Count, ID3D11SamplerState* const** Samplers)
+		{
+			return UpdateRange(StateCallSamplers, Stage, Slot, Count, Samplers, StateFilterSamplers, Known.HasSampler, Known.Samplers);
+		}
+
+	private:
+		// A buffer and two numbers: stride and offset, format and offset, or a constant range.
+		struct VertexBinding
+		{
+			ID3D11Buffer* Buffer;
+			unsigned int A;
+			unsigned int B;
+
+			bool operator==(const VertexBinding& Other) const
+			{
+				return Buffer == Other.Buffer && A == Other.A && B == Other.B;
+			}
+		};
+
+		struct DepthBinding
+		{
+			ID3D11DepthStencilState* State;
+			unsigned int StencilRef;
+
+			bool operator==(const DepthBinding& Other) const
+			{
+				return State == Other.State && StencilRef == Other.StencilRef;
+			}
+		};
+
+		struct Shadow
+		{
+			bool HasInputLayout = false, HasTopology = false, HasVertexShader = false, HasPixelShader = false, HasIndexBuffer = false, HasDepthState = false;
+			bool HasVertexBuffer[StateFilterVertexBuffers] = {};
+			bool HasConstantBuffer[StateFilterStages][StateFilterConstantBuffers] = {};
+			bool HasTexture[StateFilterStages][StateFilterTextures] = {};
+			bool HasSampler[StateFilterStages][StateFilterSamplers] = {};
+
+			ID3D11InputLayout* InputLayout = nullptr;
+			unsigned int Topology = 0;
+			ID3D11VertexShader* VertexShader = nullptr;
+			ID3D11PixelShader* PixelShader = nullptr;
+			VertexBinding IndexBuffer = {};
+			DepthBinding DepthState = {};
+			VertexBinding VertexBuffers[StateFilterVertexBuffers] = {};
+			VertexBinding ConstantBuffers[StateFilterStages][StateFilterConstantBuffers] = {};
+			ID3D11ShaderResourceView* Textures[StateFilterStages][StateFilterTextures] = {};
+			ID3D11SamplerState* Samplers[StateFilterStages][StateFilterSamplers] = {};
+		};
+
+		static unsigned int Sum(const unsigned int* Counts)
+		{
+			unsigned int Total = 0;
+			for (unsigned int i = 0; i < StateCallCount; i++)
+			{
+				Total += Counts[i];
+			}
+			return Total;
+		}
+
+		bool Forward(StateCall Call)
+		{
+			Forwarded[Call]++;
+			return true;
+		}
+
+		template <typename T>
+		bool Update(StateCall Call, bool& Has, T& Bound, const T& Value)
+		{
+			if (Has && Bound == Value)
+			{
+				Eliminated[Call]++;
+				return false;
+			}
+
+			Has = true;
+			Bound = Value;
+			return Forward(Call);
+		}
+
+		template <typename T, unsigned int Slots>
+		bool UpdateRange(StateCall Call, unsigned int Stage, unsigned int* Slot, unsigned int* Count, T* const** Values, unsigned int,
+			bool (&Has)[StateFilterStages][Slots], T* (&Bound)[StateFilterStages][Slots])
+		{
+			if (Stage >= StateFilterStages || *Slot + *Count > Slots)
+			{
+				return Forward(Call);
+			}
+
+			unsigned int First = *Count, Last = 0;
+			for (unsigned int i = 0; i < *Count; i++)
+			{
+				unsigned int s = *Slot + i;
+				if (!Has[Stage][s] || Bound[Stage][s] != (*Values)[i])
+				{
+					First = std::min(First, i);
+					Last = i;
+					Has[Stage][s] = true;
+					Bound[Stage][s] = (*Values)[i];
+				}
+			}
+
+			if (First == *Count)
+			{
+				Eliminated[Call]++;
+				return false;
+			}
+
+			*Slot += First;
+			*Values += First;
+			*Count = Last - First + 1;
+			return Forward(Call);
+		}
+
+		Shadow Known;
+	};
+
+	// Replays commands onto Target, through Filter when there is one.
+	template <typename Context>
+	class ContextCommandBackend
+	{
+	public:
+		ContextCommandBackend(Context& DeviceContext, RedundantStateFilter* StateFilter = nullptr) : Target(DeviceContext), Filter(StateFilter)
+		{
+		}
+
+		void Execute(const SetPipelineCommand& Command)
+		{
+			if (Filter == nullptr || Filter->SetInputLayout(Command.InputLayout))
+			{
+				Target.SetInputLayout(Command.InputLayout);
+			}
+			if (Filter == nullptr || Filter->SetTopology(Command.Topology))
+			{
+				Target.SetTopology(Command.Topology);
+			}
+			if (Filter == nullptr || Filter->SetVertexShader(Command.VertexShader))
+			{
+				Target.SetVertexShader(Command.VertexShader);
+			}
+			if (Filter == nullptr || Filter->SetPixelShader(Command.PixelShader))
+			{
+				Target.SetPixelShader(Command.PixelShader);
+			}
+		}
+
+		void Execute(const SetVertexBufferCommand& Command)
+		{
+			if (Filter == nullptr || Filter->SetVertexBuffer(Command.Slot, Command.Buffer, Command.Stride, Command.Offset))
+			{
+				Target.SetVertexBuffer(Command.Slot, Command.Buffer, Command.Stride, Command.Offset);
+			}
+		}
+
+		void Execute(const SetIndexBufferCommand& Command)
+		{
+			if (Filter == nullptr || Filter->SetIndexBuffer(Command.Buffer, Command.Format, Command.Offset))
+			{
+				Target.SetIndexBuffer(Command.Buffer, Command.Format, Command.Offset);
+			}
+		}
+
+		void Execute(const SetConstantBufferCommand& Command)
+		{
+			if (Filter == nullptr || Filter->SetConstantBuffer(Command.Stage, Command.Slot, Command.Buffer, Command.FirstConstant, Command.ConstantCount))
+			{
+				Target.SetConstantBuffer(Command.Stage, Command.Slot, Command.Buffer, Command.FirstConstant, Command.ConstantCount);
+			}
+		}
+
+		void Execute(const SetTexturesCommand& Command)
+		{
+			unsigned int Slot = Command.Slot, Count = Command.Count;
+			ID3D11ShaderResourceView* const* Views = Command.Views;
+			if (Filter == nullptr || Filter->SetTextures(Command.Stage, &Slot, &Count, &Views))
+			{
+				Target.SetTextures(Command.Stage, Slot, Count, Views);
+			}
+		}
+
+		void Execute(const SetSamplersCommand& Command)
+		{
+			unsigned int Slot = Command.Slot, Count = Command.Count;
+			ID3D11SamplerState* const* Samplers = Command.Samplers;
+			if (Filter == nullptr || Filter->SetSamplers(Command.Stage, &Slot, &Count, &Samplers))
+			{
+				Target.SetSamplers(Command.Stage, Slot, Count, Samplers);
+			}
+		}
+
+		void Execute(const SetDepthStateCommand& Command)
+		{
+			if (Filter == nullptr || Filter->SetDepthState(Command.State, Command.StencilRef))
+			{
+				Target.SetDepthState(Command.State, Command.StencilRef);
+			}
+		}
+
+		void Execute(const UpdateConstantsCommand& Command, const void* Data)
+		{
+			Target.UpdateConstants(Command.Buffer, Data, Command.Size);
+		}
+
+		void Execute(const WriteConstantsCommand& Command, const void* Data)
+		{
+			Target.WriteConstants(Command.Buffer, Command.Offset, Command.Discard != 0, Data, Command.Size);
+		}
+
+		void Execute(const WriteBufferCommand& Command, const void* Data)
+		{
+			Target.WriteBuffer(Command.Buffer, Command.Offset, Command.Discard != 0, Data, Command.Size);
+		}
+
+		void Execute(const DrawIndexedCommand& Command)
+		{
+			Target.DrawIndexed(Command.IndexCount, Command.StartIndex, Command.BaseVertex);
+		}
+
+		void Execute(const DrawIndexedInstancedCommand& Command)
+		{
+			Target.DrawIndexedInstanced(Command.IndexCount, Command.InstanceCount, Command.StartIndex, Command.BaseVertex, Command.StartInstance);
+		}
+
+		void Execute(const ClearDepthCommand& Command)
+		{
+			Target.ClearDepth(Command.View, Command.Depth);
+		}
+
+	private:
+		Context& Target;
+		RedundantStateFilter* Filter;
+	};
+
+	// A device context that only remembers. It counts the calls it gets and snapshots the
+	// bound state at every draw, so two replays can be checked to draw under the same state.
+	class MockDeviceContext
+	{
+	public:
+		static const unsigned int Slots = 8;
+
+		struct State
+		{
+			ID3D11InputLayout* InputLayout = nullptr;
+			ID3D11VertexShader* VertexShader = nullptr;
+			ID3D11PixelShader* PixelShader = nullptr;
+			ID3D11Buffer* VertexBuffers[Slots] = {};
+			ID3D11Buffer* IndexBuffer = nullptr;
+			ID3D11Buffer* ConstantBuffers[StateFilterStages][Slots] = {};
+			ID3D11ShaderResourceView* Textures[StateFilterStages][Slots] = {};
+			ID3D11SamplerState* Samplers[StateFilterStages][Slots] = {};
+			ID3D11DepthStencilState* DepthState = nullptr;
+			unsigned int StencilRef = 0;
+			unsigned int Topology = 0;
+			unsigned int Strides[Slots] = {};
+			unsigned int Offsets[Slots] = {};
+			unsigned int IndexFormat = 0;
+			unsigned int IndexOffset = 0;
+			unsigned int ConstantRanges[StateFilterStages][Slots][2] = {};
+
+			bool operator==(const State& Other) const
+			{
+				return InputLayout == Other.InputLayout && VertexShader == Other.VertexShader && PixelShader == Other.PixelShader &&
+					std::equal(VertexBuffers, VertexBuffers + Slots, Other.VertexBuffers) && IndexBuffer == Other.IndexBuffer &&
+					std::equal(&ConstantBuffers[0][0], &ConstantBuffers[0][0] + StateFilterStages * Slots, &Other.ConstantBuffers[0][0]) &&
+					std::equal(&Textures[0][0], &Textures[0][0] + StateFilterStages * Slots, &Other.Textures[0][0]) &&
+					std::equal(&Samplers[0][0], &Samplers[0][0] + StateFilterStages * Slots, &Other.Samplers[0][0]) &&
+					DepthState == Other.DepthState && StencilRef == Other.StencilRef && Topology == Other.Topology && std::equal(Strides, Strides + Slots, Other.Strides) && std::equal(Offsets, Offsets + Slots, Other.Offsets) &&
+					IndexFormat == Other.IndexFormat && IndexOffset == Other.IndexOffset &&
+					std::equal(&ConstantRanges[0][0][0], &ConstantRanges[0][0][0] + StateFilterStages * Slots * 2, &Other.ConstantRanges[0][0][0]);
+			}
+		};
+
+		unsigned int Calls[StateCallCount] = {};
+		unsigned int Draws = 0;
+		State Bound;
+		std::vector<State> DrawStates;
+
+		unsigned int GetStateCalls() const
+		{
+			unsigned int Total = 0;
+			for (unsigned int i = 0; i < StateCallCount; i++)
+			{
+				Total += Calls[i];
+			}
+			return Total;
+		}
+
+		void SetInputLayout(ID3D11InputLayout* InputLayout)
+		{
+			Calls[StateCallInputLayout]++;
+			Bound.InputLayout = InputLayout;
+		}
+
+		void SetTopology(unsigned int Topology)
+		{
+			Calls[StateCallTopology]++;
+			Bound.Topology = Topology;
+		}
+
+		void SetVertexShader(ID3D11VertexShader* Shader)
+		{
+			Calls[StateCallVertexShader]++;
+			Bound.VertexShader = Shader;
+		}
+
+		void SetPixelShader(ID3D11PixelShader* Shader)
+		{
+			Calls[StateCallPixelShader]++;
+			Bound.PixelShader = Shader;
+		}
+
+		void SetVertexBuffer(unsigned int Slot, ID3D11Buffer* Buffer, unsigned int Stride, unsigned int Offset)
+		{
+			Calls[StateCallVertexBuffer]++;
+			if (Slot < Slots)
+			{
+				Bound.VertexBuffers[Slot] = Buffer;
+				Bound.Strides[Slot] = Stride;
+				Bound.Offsets[Slot] = Offset;
+			}
+		}
+
+		void SetIndexBuffer(ID3D11Buffer* Buffer, unsigned int Format, unsigned int Offset)
+		{
+			Calls[StateCallIndexBuffer]++;
+			Bound.IndexBuffer = Buffer;
+			Bound.IndexFormat = Format;
+			Bound.IndexOffset = Offset;
+		}
+
+		void SetConstantBuffer(unsigned int Stage, unsigned int Slot, ID3D11Buffer* Buffer, unsigned int FirstConstant, unsigned int ConstantCount)
+		{
+			Calls[StateCallConstantBuffer]++;
+			if (Stage < StateFilterStages && Slot < Slots)
+			{
+				Bound.ConstantBuffers[Stage][Slot] = Buffer;
+				Bound.ConstantRanges[Stage][Slot][0] = FirstConstant;
+				Bound.ConstantRanges[Stage][Slot][1] = ConstantCount;
+			}
+		}
+
+		void SetTextures(unsigned int Stage, unsigned int Slot, unsigned int Count, ID3D11ShaderResourceView* const* Views)
+		{
+			Calls[StateCallTextures]++;
+			for (unsigned int i = 0; i < Count && Stage < StateFilterStages && Slot + i < Slots; i++)
+			{
+				Bound.Textures[Stage][Slot + i] = Views[i];
+			}
+		}
+
+		void SetSamplers(unsigned int Stage, unsigned int Slot, unsigned int Count, ID3D11SamplerState* const* Samplers)
+		{
+			Calls[StateCallSamplers]++;
+			for (unsigned int i = 0; i < Count && Stage < StateFilterStages && Slot + i < Slots; i++)
+			{
+				Bound.Samplers[Stage][Slot + i] = Samplers[i];
+			}
+		}
+
+		void SetDepthState(ID3D11DepthStencilState* State, unsigned int StencilRef)
+		{
+			Calls[StateCallDepthState]++;
+			Bound.DepthState = State;
+			Bound.StencilRef = StencilRef;
+		}
+
+		void UpdateConstants(ID3D11Buffer*, const void*, unsigned int)
+		{
+		}
+
+		void WriteConstants(ID3D11Buffer*, unsigned int, bool, const void*, unsigned int)
+		{
+		}
+
+		void WriteBuffer(ID3D11Buffer*, unsigned int, bool, const void*, unsigned int)
+		{
+		}
+
+		void DrawIndexed(unsigned int, unsigned int, int)
+		{
+			Draws++;
+			DrawStates.push_back(Bound);
+		}
+
+		void DrawIndexedInstanced(unsigned int, unsigned int, unsigned int, int, unsigned int)
+		{
+			Draws++;
+			DrawStates.push_back(Bound);
+		}
+
+		void ClearDepth(ID3D11DepthStencilView*, float)
+		{
+		}
+	};
+
+	// Records a frame shaped like the scene renderer's (ground, ObjectCount castles sharing
+	// one pipeline, with the cluster index buffer swapped in and out for every other castle,
+	// then the skybox), replays it onto two mock contexts with and without the filter, and reports
+	// how many state calls the filter dropped. Fails if any draw sees different state.
+	static bool ReportStateFilter(unsigned int ObjectCount = 256, unsigned int Repeats = 20)
+	{
+		auto Fake = [](size_t Id) { return (void*)(0x1000 + 0x100 * Id); };
+
+		ID3D11InputLayout* SkyLayout = (ID3D11InputLayout*)Fake(1);
+		ID3D11InputLayout* ModelLayout = (ID3D11InputLayout*)Fake(2);
+		ID3D11VertexShader* SkyVertexShader = (ID3D11VertexShader*)Fake(3);
+		ID3D11VertexShader* ModelVertexShader = (ID3D11VertexShader*)Fake(4);
+		ID3D11PixelShader* SkyPixelShader = (ID3D11PixelShader*)Fake(5);
+		ID3D11PixelShader* ModelPixelShader = (ID3D11PixelShader*)Fake(6);
+		ID3D11SamplerState* Sampler = (ID3D11SamplerState*)Fake(7);
+		ID3D11ShaderResourceView* SkyViews[1] = { (ID3D11ShaderResourceView*)Fake(8) };
+		ID3D11ShaderResourceView* GroundViews[2] = { (ID3D11ShaderResourceView*)Fake(9), (ID3D11ShaderResourceView*)Fake(10) };
+		ID3D11ShaderResourceView* CastleViews[2] = { (ID3D11ShaderResourceView*)Fake(11), (ID3D11ShaderResourceView*)Fake(12) };
+		const unsigned int TriangleList = 4, R16 = 57;
+		unsigned char Constants[192] = {};
+
+		CommandBuffer Commands;
+		Commands.SetConstantBuffer(CommandStagePixel, 1, (ID3D11Buffer*)Fake(24));
+
+		for (unsigned int Mesh = 0; Mesh < 2; Mesh++)
+		{
+			ID3D11Buffer* Vertices = (ID3D11Buffer*)Fake(30 + Mesh);
+			ID3D11Buffer* Indices = (ID3D11Buffer*)Fake(32 + Mesh);
+			ID3D11Buffer* ClusterIndices = (ID3D11Buffer*)Fake(34 + Mesh);
+			ID3D11Buffer* ObjectConstants = (ID3D11Buffer*)Fake(36 + Mesh);
+
+			Commands.SetPipeline(ModelLayout, ModelVertexShader, ModelPixelShader, TriangleList);
+			Commands.SetDepthState(nullptr);
+			Commands.SetVertexBuffer(0, Vertices, 52);
+			Commands.SetIndexBuffer(Indices, R16);
+			Commands.SetConstantBuffer(CommandStageVertex, 0, ObjectConstants);
+			Commands.SetConstantBuffer(CommandStageVertex, 1, (ID3D11Buffer*)Fake(38 + Mesh));
+			Commands.SetTextures(CommandStagePixel, 0, 2, Mesh == 0 ? GroundViews : CastleViews);
+			Commands.SetSamplers(CommandStagePixel, 0, 1, &Sampler);
+
+			for (unsigned int Object = 0; Object < (Mesh == 0 ? 1 : ObjectCount); Object++)
+			{
+				Commands.UpdateConstants(ObjectConstants, Constants, sizeof(Constants));
+				if (Object % 2 == 0)
+				{
+					Commands.SetIndexBuffer(ClusterIndices, R16);
+					Commands.DrawIndexed(300, 0, 0);
+					Commands.SetIndexBuffer(Indices, R16);
+				}
+				else
+				{
+					Commands.DrawIndexed(900, 0, 0);
+				}
+			}
+		}
+
+		Commands.SetPipeline(SkyLayout, SkyVertexShader, SkyPixelShader, TriangleList);
+		Commands.SetDepthState((ID3D11DepthStencilState*)Fake(23));
+		Commands.SetVertexBuffer(0, (ID3D11Buffer*)Fake(21), 24);
+		Commands.SetIndexBuffer((ID3D11Buffer*)Fake(22), R16);
+		Commands.SetConstantBuffer(CommandStageVertex, 0, (ID3D11Buffer*)Fake(20));
+		Commands.SetTextures(CommandStagePixel, 0, 1, SkyViews);
+		Commands.SetSamplers(CommandStagePixel, 0, 1, &Sampler);
+		Commands.UpdateConstants((ID3D11Buffer*)Fake(20), Constants, sizeof(Constants));
+		Commands.DrawIndexed(36, 0, 0);
+
+		MockDeviceContext Plain, Filtered;
+		RedundantStateFilter Filter;
+		double PlainSeconds = 1e30, FilteredSeconds = 1e30;
+		bool Valid = true;
+
+		for (unsigned int r = 0; r < Repeats; r++)
+		{
+			Plain = MockDeviceContext();
+			auto Start = std::chrono::high_resolution_clock::now();
+			ContextCommandBackend<MockDeviceContext> PlainBackend(Plain);
+			Valid = Commands.Replay(PlainBackend) && Valid;
+			PlainSeconds = std::min(PlainSeconds, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+
+			Filtered = MockDeviceContext();
+			Filter.Invalidate();
+			Filter.ResetCounts();
+			Start = std::chrono::high_resolution_clock::now();
+			ContextCommandBackend<MockDeviceContext> FilteredBackend(Filtered, &Filter);
+			Valid = Commands.Replay(FilteredBackend) && Valid;
+			FilteredSeconds = std::min(FilteredSeconds, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count());
+		}
+
+		Valid = Valid && Plain.DrawStates == Filtered.DrawStates && Filter.GetForwarded() == Filtered.GetStateCalls() &&
+			Filter.GetForwarded() + Filter.GetEliminated() == Plain.GetStateCalls();
+
+		const char* CallNames[StateCallCount] = { "input layout", "topology", "vertex shader", "pixel shader", "vertex buffer", "index buffer",
+			"constant buffer", "textures", "samplers", "depth state" };
+
+		char Line[256];
+		sprintf_s(Line, "State filter: %u draws, %u of %u state calls eliminated, replay %.3f ms unfiltered, %.3f ms filtered, %s\n",
+			Plain.Draws, Filter.GetEliminated(), Plain.GetStateCalls(), PlainSeconds * 1000.0, FilteredSeconds * 1000.0,
+			Valid ? "same state at every draw" : "STATE MISMATCH");
+		OutputDebugStringA(Line);
+
+		for (unsigned int c = 0; c < StateCallCount; c++)
+		{
+			sprintf_s(Line, "State filter: %s %u of %u eliminated\n", CallNames[c], Filter.Eliminated[c], Plain.Calls[c]);
+			OutputDebugStringA(Line);
+		}
+
+		return Valid;
+	}
+}
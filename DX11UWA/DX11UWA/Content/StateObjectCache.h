@@ -0,0 +1,235 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+// Sampler, blend, rasterizer and depth stencil state objects, created once per distinct
+// descriptor and shared after that. Each kind lives in a StateObjectTable keyed by a hash of
+// the whole descriptor, so a lookup is a hash and a compare; the table owns the objects
+// until Clear.
+namespace DX11UWA
+{
+	// FNV-1a over the descriptor's bytes. Descriptors are normalized first, so padding is zero.
+	template <typename Desc>
+	static size_t HashStateDesc(const Desc& Description)
+	{
+		const unsigned char* Bytes = (const unsigned char*)&Description;
+		unsigned long long Hash = 14695981039346656037ull;
+		for (size_t i = 0; i < sizeof(Desc); i++)
+		{
+			Hash = (Hash ^ Bytes[i]) * 1099511628211ull;
+		}
+		return (size_t)Hash;
+	}
+
+	template <typename Desc, typename State>
+	class StateObjectTable
+	{
+	public:
+		unsigned int Hits = 0;
+		unsigned int Misses = 0;
+
+		StateObjectTable() = default;
+		StateObjectTable(const StateObjectTable&) = delete;
+		StateObjectTable& operator=(const StateObjectTable&) = delete;
+
+		~StateObjectTable()
+		{
+			Clear();
+		}
+
+		// Returns the object made for Description, calling Create(const Desc*, State**) the
+		// first time it is asked for. Returns null if Create fails; that is not cached.
+		template <typename CreateState>
+		State* Get(const Desc& Description, CreateState&& Create)
+		{
+			size_t Hash = HashStateDesc(Description);
+			auto Range = Objects.equal_range(Hash);
+			for (auto It = Range.first; It != Range.second; ++It)
+			{
+				if (memcmp(&It->second.Description, &Description, sizeof(Desc)) == 0)
+				{
+					Hits++;
+					return It->second.Object;
+				}
+			}
+
+			Misses++;
+			State* Object = nullptr;
+			Create(&Description, &Object);
+			if (Object != nullptr)
+			{
+				Objects.emplace(Hash, Entry{ Description, Object });
+			}
+			return Object;
+		}
+
+		size_t GetCount() const
+		{
+			return Objects.size();
+		}
+
+		// Releases every object. Pointers handed out before are no longer valid.
+		void Clear()
+		{
+			for (auto& Pair : Objects)
+			{
+				Pair.second.Object->Release();
+			}
+			Objects.clear();
+		}
+
+	private:
+		struct Entry
+		{
+			Desc Description;
+			State* Object;
+		};
+
+		std::unordered_multimap<size_t, Entry> Objects;
+	};
+
+	class StateObjectCache
+	{
+	public:
+		ID3D11SamplerState* GetSamplerState(ID3D11Device* Device, const D3D11_SAMPLER_DESC& Description)
+		{
+			return Samplers.Get(Description, [Device](const D3D11_SAMPLER_DESC* Desc, ID3D11SamplerState** State) { Device->CreateSamplerState(Desc, State); });
+		}
+
+		ID3D11BlendState* GetBlendState(ID3D11Device* Device, const D3D11_BLEND_DESC& Description)
+		{
+			// Each render target's write mask is followed by padding.
+			D3D11_BLEND_DESC Normalized;
+			memset(&Normalized, 0, sizeof(Normalized));
+			Normalized.AlphaToCoverageEnable = Description.AlphaToCoverageEnable;
+			Normalized.IndependentBlendEnable = Description.IndependentBlendEnable;
+			for (unsigned int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+			{
+				const D3D11_RENDER_TARGET_BLEND_DESC& Target = Description.RenderTarget[i];
+				D3D11_RENDER_TARGET_BLEND_DESC& Copy = Normalized.RenderTarget[i];
+				Copy.BlendEnable = Target.BlendEnable;
+				Copy.SrcBlend = Target.SrcBlend;
+				Copy.DestBlend = Target.DestBlend;
+				Copy.BlendOp = Target.BlendOp;
+				Copy.SrcBlendAlpha = Target.SrcBlendAlpha;
+				Copy.DestBlendAlpha = Target.DestBlendAlpha;
+				Copy.BlendOpAlpha = Target.BlendOpAlpha;
+				Copy.RenderTargetWriteMask = Target.RenderTargetWriteMask;
+			}
+
+			return Blends.Get(Normalized, [Device](const D3D11_BLEND_DESC* Desc, ID3D11BlendState** State) { Device->CreateBlendState(Desc, State); });
+		}
+
+		ID3D11RasterizerState* GetRasterizerState(ID3D11Device* Device, const D3D11_RASTERIZER_DESC& Description)
+		{
+			return Rasterizers.Get(Description, [Device](const D3D11_RASTERIZER_DESC* Desc, ID3D11RasterizerState** State) { Device->CreateRasterizerState(Desc, State); });
+		}
+
+		ID3D11DepthStencilState* GetDepthStencilState(ID3D11Device* Device, const D3D11_DEPTH_STENCIL_DESC& Description)
+		{
+			// The two stencil masks are followed by padding.
+			D3D11_DEPTH_STENCIL_DESC Normalized;
+			memset(&Normalized, 0, sizeof(Normalized));
+			Normalized.DepthEnable = Description.DepthEnable;
+			Normalized.DepthWriteMask = Description.DepthWriteMask;
+			Normalized.DepthFunc = Description.DepthFunc;
+			Normalized.StencilEnable = Description.StencilEnable;
+			Normalized.StencilReadMask = Description.StencilReadMask;
+			Normalized.StencilWriteMask = Description.StencilWriteMask;
+			Normalized.FrontFace = Description.FrontFace;
+			Normalized.BackFace = Description.BackFace;
+
+			return DepthStencils.Get(Normalized, [Device](const D3D11_DEPTH_STENCIL_DESC* Desc, ID3D11DepthStencilState** State) { Device->CreateDepthStencilState(Desc, State); });
+		}
+
+		unsigned int GetHits() const
+		{
+			return Samplers.Hits + Blends.Hits + Rasterizers.Hits + DepthStencils.Hits;
+		}
+
+		unsigned int GetMisses() const
+		{
+			return Samplers.Misses + Blends.Misses + Rasterizers.Misses + DepthStencils.Misses;
+		}
+
+		size_t GetCount() const
+		{
+			return Samplers.GetCount() + Blends.GetCount() + Rasterizers.GetCount() + DepthStencils.GetCount();
+		}
+
+		void ResetCounts()
+		{
+			Samplers.Hits = Samplers.Misses = 0;
+			Blends.Hits = Blends.Misses = 0;
+			Rasterizers.Hits = Rasterizers.Misses = 0;
+			DepthStencils.Hits = DepthStencils.Misses = 0;
+		}
+
+		void Clear()
+		{
+			Samplers.Clear();
+			Blends.Clear();
+			Rasterizers.Clear();
+			DepthStencils.Clear();
+		}
+
+	private:
+		StateObjectTable<D3D11_SAMPLER_DESC, ID3D11SamplerState> Samplers;
+		StateObjectTable<D3D11_BLEND_DESC, ID3D11BlendState> Blends;
+		StateObjectTable<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> Rasterizers;
+		StateObjectTable<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> DepthStencils;
+	};
+
+	// Asks a fresh cache for SamplerCount distinct samplers, plus a blend, rasterizer and depth
+	// stencil state, Repeats times each, and reports the lookup cost against calling
+	// CreateSamplerState (which the runtime deduplicates, but only after a driver call) for
+	// the same descriptors.
+	static void ReportStateObjectCache(ID3D11Device* Device, unsigned int SamplerCount = 64, unsigned int Repeats = 1000)
+	{
+		StateObjectCache Cache;
+		std::vector<D3D11_SAMPLER_DESC> Descs(SamplerCount, CD3D11_SAMPLER_DESC(D3D11_DEFAULT));
+		for (unsigned int i = 0; i < SamplerCount; i++)
+		{
+			Descs[i].MaxAnisotropy = 1 + i % 16;
+			Descs[i].MipLODBias = (float)(i / 16);
+		}
+
+		auto Start = std::chrono::high_resolution_clock::now();
+		for (unsigned int r = 0; r < Repeats; r++)
+		{
+			for (const D3D11_SAMPLER_DESC& Desc : Descs)
+			{
+				Cache.GetSamplerState(Device, Desc);
+			}
+			Cache.GetBlendState(Device, CD3D11_BLEND_DESC(D3D11_DEFAULT));
+			Cache.GetRasterizerState(Device, CD3D11_RASTERIZER_DESC(D3D11_DEFAULT));
+			Cache.GetDepthStencilState(Device, CD3D11_DEPTH_STENCIL_DESC(D3D11_DEFAULT));
+		}
+		double CacheSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+		unsigned int CreateRepeats = std::min(Repeats, 20u);
+		Start = std::chrono::high_resolution_clock::now();
+		for (unsigned int r = 0; r < CreateRepeats; r++)
+		{
+			for (const D3D11_SAMPLER_DESC& Desc : Descs)
+			{
+				ID3D11SamplerState* State = nullptr;
+				Device->CreateSamplerState(&Desc, &State);
+				if (State != nullptr)
+				{
+					State->Release();
+				}
+			}
+		}
+		double CreateSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+		char Line[256];
+		sprintf_s(Line, "State objects: %u hits, %u misses, %zu objects, %.1f ns per cached lookup, %.1f ns per CreateSamplerState\n", Cache.GetHits(),
+			Cache.GetMisses(), Cache.GetCount(), CacheSeconds * 1e9 / (Cache.GetHits() + Cache.GetMisses()), CreateSeconds * 1e9 / (CreateRepeats * SamplerCount));
+		OutputDebugStringA(Line);
+	}
+}
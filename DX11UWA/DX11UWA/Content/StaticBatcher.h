@@ -0,0 +1,236 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "MeshCache.h"
+
+// Static meshes merged at load time. Copies of meshes that share a material and whose box
+// centres fall in the same cell of a square grid on the XZ plane are transformed to world
+// space and appended to one vertex and one 32-bit index stream, a level of detail at a time,
+// so a cell draws a level with one draw instead of one per copy and submesh. Every cell keeps
+// its own bounds and level table, so it still culls and picks a level of detail as a whole.
+namespace DX11UWA
+{
+	struct StaticBatchSource
+	{
+		const CookedMesh* Mesh;
+		DirectX::XMFLOAT4X4 World;
+		unsigned int Material;
+	};
+
+	// One cell's merged copies. Lods has an entry per level of the most detailed source mesh,
+	// indexes the set's Submeshes and holds world space errors, so it can be handed to the same
+	// level selection and draw code as a mesh's own. Levels before the batcher's FirstLod
+	// have no submeshes, only the copies' index count; when one of them is picked the copies
+	// draw one by one.
+	struct StaticBatch
+	{
+		unsigned int Material;
+		int CellX;
+		int CellZ;
+		MeshBounds Bounds;
+		std::vector<CookedLod> Lods;
+		std::vector<unsigned int> Sources;
+	};
+
+	struct StaticBatchSet
+	{
+		std::vector<VertexPositionUVNormalTan> Vertices;
+		std::vector<unsigned int> Indices;
+		std::vector<CookedSubmesh> Submeshes;
+		std::vector<StaticBatch> Batches;
+		// The batch of every source, or ~0u for a source that was left out.
+		std::vector<unsigned int> SourceBatches;
+
+		void Clear()
+		{
+			Vertices.clear();
+			Indices.clear();
+			Submeshes.clear();
+			Batches.clear();
+			SourceBatches.clear();
+		}
+	};
+
+	// Merges Sources into Out, by material and CellSize x CellSize cell, from level FirstLod on.
+	// Sources that are not cooked to CookedVertexFull or have no level FirstLod are left out.
+	// A source with fewer levels than the most detailed in its cell repeats its coarsest.
+	static void BuildStaticBatches(const StaticBatchSource* Sources, unsigned int SourceCount, float CellSize, unsigned int FirstLod, StaticBatchSet* Out)
+	{
+		using namespace DirectX;
+
+		struct CellSource
+		{
+			unsigned int Material;
+			int X;
+			int Z;
+			unsigned int Source;
+			XMFLOAT3 Min;
+			XMFLOAT3 Max;
+		};
+
+		Out->Clear();
+		Out->SourceBatches.assign(SourceCount, ~0u);
+
+		std::vector<CellSource> Cells;
+		std::vector<unsigned int> Remap;
+		for (unsigned int s = 0; s < SourceCount; s++)
+		{
+			const CookedMesh* Mesh = Sources[s].Mesh;
+			if (Mesh == nullptr || Mesh->VertexFormat != CookedVertexFull || Mesh->LodCount <= FirstLod)
+			{
+				continue;
+			}
+
+			CellSource Cell;
+			TransformBoundingBox(Mesh->Bounds.Min, Mesh->Bounds.Max, XMLoadFloat4x4(&Sources[s].World), &Cell.Min, &Cell.Max);
+			Cell.Material = Sources[s].Material;
+			Cell.X = (int)floorf(0.5f * (Cell.Min.x + Cell.Max.x) / CellSize);
+			Cell.Z = (int)floorf(0.5f * (Cell.Min.z + Cell.Max.z) / CellSize);
+			Cell.Source = s;
+			Cells.push_back(Cell);
+		}
+
+		std::sort(Cells.begin(), Cells.end(), [](const CellSource& a, const CellSource& b)
+		{
+			if (a.Material != b.Material) return a.Material < b.Material;
+			if (a.X != b.X) return a.X < b.X;
+			if (a.Z != b.Z) return a.Z < b.Z;
+			return a.Source < b.Source;
+		});
+
+		for (size_t First = 0; First < Cells.size();)
+		{
+			size_t Last = First + 1;
+			while (Last < Cells.size() && Cells[Last].Material == Cells[First].Material && Cells[Last].X == Cells[First].X && Cells[Last].Z == Cells[First].Z)
+			{
+				Last++;
+			}
+
+			StaticBatch Batch;
+			Batch.Material = Cells[First].Material;
+			Batch.CellX = Cells[First].X;
+			Batch.CellZ = Cells[First].Z;
+
+			unsigned int LodCount = 0;
+			XMFLOAT3 Min = Cells[First].Min, Max = Cells[First].Max;
+			for (size_t c = First; c < Last; c++)
+			{
+				LodCount = std::max(LodCount, Sources[Cells[c].Source].Mesh->LodCount);
+				XMStoreFloat3(&Min, XMVectorMin(XMLoadFloat3(&Min), XMLoadFloat3(&Cells[c].Min)));
+				XMStoreFloat3(&Max, XMVectorMax(XMLoadFloat3(&Max), XMLoadFloat3(&Cells[c].Max)));
+				Batch.Sources.push_back(Cells[c].Source);
+				Out->SourceBatches[Cells[c].Source] = (unsigned int)Out->Batches.size();
+			}
+
+			Batch.Bounds.Min = Min;
+			Batch.Bounds.Max = Max;
+			XMStoreFloat3(&Batch.Bounds.Center, XMVectorScale(XMVectorAdd(XMLoadFloat3(&Min), XMLoadFloat3(&Max)), 0.5f));
+			Batch.Bounds.Radius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&Max), XMLoadFloat3(&Min))));
+
+			for (unsigned int Lod = 0; Lod < LodCount; Lod++)
+			{
+				CookedLod Level = { (unsigned int)Out->Submeshes.size(), 0, 0, 0.0f };
+				CookedSubmesh Merged = { (unsigned int)Out->Indices.size(), 0, (unsigned int)Out->Vertices.size(), 0 };
+
+				for (size_t c = First; c < Last; c++)
+				{
+					const CookedMesh& Mesh = *Sources[Cells[c].Source].Mesh;
+					const CookedLod& SourceLevel = Mesh.Lods[std::min(Lod, Mesh.LodCount - 1)];
+					XMMATRIX World = XMLoadFloat4x4(&Sources[Cells[c].Source].World);
+
+					float Scale = sqrtf(std::max(XMVectorGetX(XMVector3LengthSq(World.r[0])), std::max(XMVectorGetX(XMVector3LengthSq(World.r[1])), XMVectorGetX(XMVector3LengthSq(World.r[2])))));
+					Level.Error = std::max(Level.Error, SourceLevel.Error * Scale);
+					Level.IndexCount += SourceLevel.IndexCount;
+					if (Lod < FirstLod)
+					{
+						continue;
+					}
+
+					const VertexPositionUVNormalTan* SourceVertices = (const VertexPositionUVNormalTan*)Mesh.Vertices;
+					for (unsigned int s = SourceLevel.SubmeshStart; s < SourceLevel.SubmeshStart + SourceLevel.SubmeshCount; s++)
+					{
+						const CookedSubmesh& Part = Mesh.Submeshes[s];
+
+						// Levels share one vertex stream, so only the vertices this level's indices
+						// reach are copied. They get the transforms NormalTexturingVertexShader
+						// applies, so a merged copy shades exactly like one drawn on its own.
+						Remap.assign(Part.VertexCount, ~0u);
+						for (unsigned int i = Part.IndexStart; i < Part.IndexStart + Part.IndexCount; i++)
+						{
+							unsigned int Local = Mesh.IndexStride == 2 ? ((const unsigned short*)Mesh.Indices)[i] : ((const unsigned int*)Mesh.Indices)[i];
+							if (Remap[Local] == ~0u)
+							{
+								VertexPositionUVNormalTan Vertex = SourceVertices[Part.BaseVertex + Local];
+								XMStoreFloat3(&Vertex.pos, XMVector3Transform(XMLoadFloat3(&Vertex.pos), World));
+								XMStoreFloat3(&Vertex.normal, XMVector3TransformNormal(XMLoadFloat3(&Vertex.normal), World));
+								float Handedness = Vertex.tangent.w;
+								XMStoreFloat4(&Vertex.tangent, XMVector3TransformNormal(XMLoadFloat4(&Vertex.tangent), World));
+								Vertex.tangent.w = Handedness;
+
+								Remap[Local] = (unsigned int)Out->Vertices.size() - Merged.BaseVertex;
+								Out->Vertices.push_back(Vertex);
+							}
+							Out->Indices.push_back(Remap[Local]);
+						}
+					}
+				}
+
+				if (Lod >= FirstLod)
+				{
+					Merged.IndexCount = (unsigned int)Out->Indices.size() - Merged.IndexStart;
+					Merged.VertexCount = (unsigned int)Out->Vertices.size() - Merged.BaseVertex;
+					Out->Submeshes.push_back(Merged);
+					Level.SubmeshCount = 1;
+				}
+				Batch.Lods.push_back(Level);
+			}
+
+			Out->Batches.push_back(Batch);
+			First = Last;
+		}
+	}
+
+	// Reports, for every merged level, the draws a frame of all of Set's sources at that level
+	// takes one by one (a draw per submesh) against batched (a draw per cell).
+	static void ReportStaticBatches(const char* Name, const StaticBatchSource* Sources, const StaticBatchSet& Set)
+	{
+		unsigned int Copies = 0, LodCount = 0;
+		for (const StaticBatch& Batch : Set.Batches)
+		{
+			Copies += (unsigned int)Batch.Sources.size();
+			LodCount = std::max(LodCount, (unsigned int)Batch.Lods.size());
+		}
+
+		char Line[256];
+		sprintf_s(Line, "Static batches: %s, %u copies in %u cells, %.1f KB of vertices and indices\n", Name, Copies, (unsigned int)Set.Batches.size(),
+			(Set.Vertices.size() * sizeof(VertexPositionUVNormalTan) + Set.Indices.size() * sizeof(unsigned int)) / 1024.0);
+		OutputDebugStringA(Line);
+
+		for (unsigned int Lod = 0; Lod < LodCount; Lod++)
+		{
+			unsigned int Single = 0, Batched = 0;
+			for (const StaticBatch& Batch : Set.Batches)
+			{
+				if (Lod >= Batch.Lods.size() || Batch.Lods[Lod].SubmeshCount == 0)
+				{
+					continue;
+				}
+
+				Batched += Batch.Lods[Lod].SubmeshCount;
+				for (unsigned int Source : Batch.Sources)
+				{
+					const CookedMesh& Mesh = *Sources[Source].Mesh;
+					Single += Mesh.Lods[std::min(Lod, Mesh.LodCount - 1)].SubmeshCount;
+				}
+			}
+
+			if (Batched > 0)
+			{
+				sprintf_s(Line, "Static batches: %s level %u, %u draws one by one, %u batched (%.1fx fewer)\n", Name, Lod, Single, Batched, (double)Single / Batched);
+				OutputDebugStringA(Line);
+			}
+		}
+	}
+}
@@ -0,0 +1,258 @@
+#pragma once
+#include "OBJModelLoader.h"
+
+// Per-vertex tangent frames for normal mapping (Lengyel, "Computing Tangent Space Basis
+// Vectors for an Arbitrary Mesh"). Tangents come out unit length, orthogonal to the
+// normal, with w = +1 or -1 giving the sign of the bitangent: B = cross(N, T) * w.
+namespace DX11UWA
+{
+	// Triangles per job in the per-triangle pass, and vertices per job in the gather pass.
+	static const unsigned int TangentTriangleBatch = 4096;
+	static const unsigned int TangentVertexBatch = 4096;
+
+	// UV gradients of one triangle: the directions of increasing u (S) and v (T).
+	struct TriangleGradient
+	{
+		XMFLOAT4 Sdir;
+		XMFLOAT4 Tdir;
+	};
+
+	// Fills the tangent of every vertex from pos, uv and normal. Work is split in two
+	// passes so no two threads ever write the same memory: first each triangle's UV
+	// gradients are computed four triangles at a time, then every vertex sums the
+	// gradients of the triangles around it. The result does not depend on ThreadCount.
+	static void BuildTangentFrames(VertexPositionUVNormalTan* Vertices, unsigned int VertexCount, const unsigned int* Indices, unsigned int IndexCount, unsigned int ThreadCount = 0)
+	{
+		unsigned int TriangleCount = IndexCount / 3;
+		unsigned int PaddedCount = (TriangleCount + 3) & ~3u;
+
+		// Padded to whole groups of four.
+		vector<TriangleGradient> Gradients(PaddedCount);
+
+		unsigned int TriangleJobs = (PaddedCount + TangentTriangleBatch - 1) / TangentTriangleBatch;
+
+		DX::ParallelFor(TriangleJobs, ThreadCount, [&](unsigned int Job)
+		{
+			unsigned int Begin = Job * TangentTriangleBatch;
+			unsigned int End = min(Begin + TangentTriangleBatch, PaddedCount);
+
+			for (unsigned int t = Begin; t < End; t += 4)
+			{
+				// Gather four triangles into lanes; padding lanes repeat the last triangle.
+				XMFLOAT4 E1[3], E2[3], UV1[2], UV2[2];
+				float* Lanes[10] = { &E1[0].x, &E1[1].x, &E1[2].x, &E2[0].x, &E2[1].x, &E2[2].x, &UV1[0].x, &UV1[1].x, &UV2[0].x, &UV2[1].x };
+
+				for (unsigned int Lane = 0; Lane < 4; Lane++)
+				{
+					unsigned int Triangle = min(t + Lane, TriangleCount - 1);
+					const VertexPositionUVNormalTan& A = Vertices[Indices[Triangle * 3]];
+					const VertexPositionUVNormalTan& B = Vertices[Indices[Triangle * 3 + 1]];
+					const VertexPositionUVNormalTan& C = Vertices[Indices[Triangle * 3 + 2]];
+
+					Lanes[0][Lane] = B.pos.x - A.pos.x;
+					Lanes[1][Lane] = B.pos.y - A.pos.y;
+					Lanes[2][Lane] = B.pos.z - A.pos.z;
+					Lanes[3][Lane] = C.pos.x - A.pos.x;
+					Lanes[4][Lane] = C.pos.y - A.pos.y;
+					Lanes[5][Lane] = C.pos.z - A.pos.z;
+					Lanes[6][Lane] = B.uv.x - A.uv.x;
+					Lanes[7][Lane] = B.uv.y - A.uv.y;
+					Lanes[8][Lane] = C.uv.x - A.uv.x;
+					Lanes[9][Lane] = C.uv.y - A.uv.y;
+				}
+
+				XMVECTOR S1 = XMLoadFloat4(&UV1[0]);
+				XMVECTOR T1 = XMLoadFloat4(&UV1[1]);
+				XMVECTOR S2 = XMLoadFloat4(&UV2[0]);
+				XMVECTOR T2 = XMLoadFloat4(&UV2[1]);
+
+				// Triangles without a usable UV mapping contribute nothing.
+				XMVECTOR Det = XMVectorSubtract(XMVectorMultiply(S1, T2), XMVectorMultiply(S2, T1));
+				XMVECTOR Degenerate = XMVectorNearEqual(Det, XMVectorZero(), XMVectorReplicate(1e-20f));
+				XMVECTOR R = XMVectorSelect(XMVectorReciprocal(Det), XMVectorZero(), Degenerate);
+
+				// Lanes are computed per axis, then written back one triangle at a time so the
+				// gather pass reads a single record per adjacent triangle.
+				XMFLOAT4 Sdir[3], Tdir[3];
+				for (unsigned int Axis = 0; Axis < 3; Axis++)
+				{
+					XMVECTOR X1 = XMLoadFloat4(&E1[Axis]);
+					XMVECTOR X2 = XMLoadFloat4(&E2[Axis]);
+
+					XMStoreFloat4(&Sdir[Axis], XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(T2, X1), XMVectorMultiply(T1, X2)), R));
+					XMStoreFloat4(&Tdir[Axis], XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(S1, X2), XMVectorMultiply(S2, X1)), R));
+				}
+
+				for (unsigned int Lane = 0; Lane < 4; Lane++)
+				{
+					const float* S[3] = { &Sdir[0].x, &Sdir[1].x, &Sdir[2].x };
+					const float* T[3] = { &Tdir[0].x, &Tdir[1].x, &Tdir[2].x };
+					Gradients[t + Lane].Sdir = XMFLOAT4(S[0][Lane], S[1][Lane], S[2][Lane], 0.0f);
+					Gradients[t + Lane].Tdir = XMFLOAT4(T[0][Lane], T[1][Lane], T[2][Lane], 0.0f);
+				}
+			}
+		});
+
+		// Vertex -> triangle adjacency in one flat array.
+		vector<unsigned int> TriangleStart(VertexCount + 1, 0);
+		for (unsigned int i = 0; i < TriangleCount * 3; i++)
+		{
+			TriangleStart[Indices[i] + 1]++;
+		}
+		for (unsigned int v = 0; v < VertexCount; v++)
+		{
+			TriangleStart[v + 1] += TriangleStart[v];
+		}
+
+		vector<unsigned int> Adjacency(TriangleCount * 3);
+		vector<unsigned int> Fill(TriangleStart.begin(), TriangleStart.end() - 1);
+		for (unsigned int i = 0; i < TriangleCount * 3; i++)
+		{
+			Adjacency[Fill[Indices[i]]++] = i / 3;
+		}
+
+		unsigned int VertexJobs = (VertexCount + TangentVertexBatch - 1) / TangentVertexBatch;
+
+		DX::ParallelFor(VertexJobs, ThreadCount, [&](unsigned int Job)
+		{
+			unsigned int Begin = Job * TangentVertexBatch;
+			unsigned int End = min(Begin + TangentVertexBatch, VertexCount);
+
+			for (unsigned int v = Begin; v < End; v++)
+			{
+				XMVECTOR Sdir = XMVectorZero();
+				XMVECTOR Tdir = XMVectorZero();
+
+				for (unsigned int a = TriangleStart[v]; a < TriangleStart[v + 1]; a++)
+				{
+					const TriangleGradient& Gradient = Gradients[Adjacency[a]];
+					Sdir = XMVectorAdd(Sdir, XMLoadFloat4(&Gradient.Sdir));
+					Tdir = XMVectorAdd(Tdir, XMLoadFloat4(&Gradient.Tdir));
+				}
+
+				XMVECTOR N = XMVector3Normalize(XMLoadFloat3(&Vertices[v].normal));
+
+				// Gram-Schmidt: remove the normal component, then normalize.
+				XMVECTOR Tangent = XMVectorSubtract(Sdir, XMVectorMultiply(N, XMVector3Dot(N, Sdir)));
+
+				if (XMVectorGetX(XMVector3LengthSq(Tangent)) < 1e-20f)
+				{
+					// No UV gradient here: any direction perpendicular to the normal will do.
+					XMVECTOR Axis = fabsf(Vertices[v].normal.x) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+					Tangent = XMVector3Cross(N, Axis);
+				}
+
+				Tangent = XMVector3Normalize(Tangent);
+
+				float Handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(N, Tangent), Tdir)) < 0.0f ? -1.0f : 1.0f;
+
+				XMFLOAT3 Out;
+				XMStoreFloat3(&Out, Tangent);
+				Vertices[v].tangent = { Out.x, Out.y, Out.z, Handedness };
+			}
+		});
+	}
+
+	// The tangent loop the renderer used before BuildTangentFrames, kept only so
+	// ReportTangentGeneration can compare against it. It writes cross(S, N) summed per
+	// corner, without normalizing, orthogonalizing or a handedness.
+	static void BuildTangentsReference(const VertexPositionUVNormalTan* ModelVertices, XMFLOAT3* Tangents, const unsigned int* ModelIndices, unsigned int ModelIndicesSize)
+	{
+		for (unsigned int i = 0; i + 2 < ModelIndicesSize; i += 3)
+		{
+			float x1 = ModelVertices[ModelIndices[i + 1]].pos.x - ModelVertices[ModelIndices[i]].pos.x;
+			float x2 = ModelVertices[ModelIndices[i + 2]].pos.x - ModelVertices[ModelIndices[i]].pos.x;
+			float y1 = ModelVertices[ModelIndices[i + 1]].pos.y - ModelVertices[ModelIndices[i]].pos.y;
+			float y2 = ModelVertices[ModelIndices[i + 2]].pos.y - ModelVertices[ModelIndices[i]].pos.y;
+			float z1 = ModelVertices[ModelIndices[i + 1]].pos.z - ModelVertices[ModelIndices[i]].pos.z;
+			float z2 = ModelVertices[ModelIndices[i + 2]].pos.z - ModelVertices[ModelIndices[i]].pos.z;
+
+			float s1 = ModelVertices[ModelIndices[i + 1]].uv.x - ModelVertices[ModelIndices[i]].uv.x;
+			float s2 = ModelVertices[ModelIndices[i + 2]].uv.x - ModelVertices[ModelIndices[i]].uv.x;
+			float t1 = ModelVertices[ModelIndices[i + 1]].uv.y - ModelVertices[ModelIndices[i]].uv.y;
+			float t2 = ModelVertices[ModelIndices[i + 2]].uv.y - ModelVertices[ModelIndices[i]].uv.y;
+
+			float r = 1.0f / ((s1 * t2) - (s2 * t1));
+
+			XMFLOAT3 Sdir = { (((t2 * x1) - (t1 * x2)) * r), (((t2 * y1) - (t1 * y2)) * r), (((t2 * z1) - (t1 * z2)) * r) };
+
+			XMVECTOR S = XMLoadFloat3(&Sdir);
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				XMVECTOR N = XMLoadFloat3(&ModelVertices[ModelIndices[i + c]].normal);
+				XMVECTOR Tangent = XMVector3Cross(S, N) + XMLoadFloat3(&Tangents[ModelIndices[i + c]]);
+				XMStoreFloat3(&Tangents[ModelIndices[i + c]], Tangent);
+			}
+		}
+	}
+
+	// Times the reference loop against BuildTangentFrames on one OBJ, single-threaded and
+	// on all cores, and reports how far the tangents are from a valid frame.
+	static void ReportTangentGeneration(const char* filepath)
+	{
+		ObjectData Mesh;
+		if (!LoadOBJFile(filepath, &Mesh))
+		{
+			return;
+		}
+
+		unsigned int VertexCount = (unsigned int)Mesh.MeshVerts.size();
+		unsigned int IndexCount = (unsigned int)Mesh.MeshIndecies.size();
+
+		vector<VertexPositionUVNormalTan> Vertices(VertexCount);
+		for (unsigned int v = 0; v < VertexCount; v++)
+		{
+			Vertices[v].pos = Mesh.MeshVerts[v].Position;
+			Vertices[v].uv = Mesh.MeshVerts[v].UVW;
+			Vertices[v].normal = Mesh.MeshVerts[v].Normals;
+			Vertices[v].tangent = { 0.0f, 0.0f, 0.0f, 1.0f };
+		}
+
+		// Best of a few runs, in milliseconds.
+		auto Time = [](auto&& Body) -> double
+		{
+			double Best = 1e30;
+			for (unsigned int Run = 0; Run < 5; Run++)
+			{
+				auto Start = chrono::high_resolution_clock::now();
+				Body();
+				Best = min(Best, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count());
+			}
+			return Best;
+		};
+
+		vector<XMFLOAT3> Reference(VertexCount);
+		double ReferenceMs = Time([&]()
+		{
+			fill(Reference.begin(), Reference.end(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+			BuildTangentsReference(Vertices.data(), Reference.data(), Mesh.MeshIndecies.data(), IndexCount);
+		});
+		double SingleMs = Time([&]() { BuildTangentFrames(Vertices.data(), VertexCount, Mesh.MeshIndecies.data(), IndexCount, 1); });
+		double ParallelMs = Time([&]() { BuildTangentFrames(Vertices.data(), VertexCount, Mesh.MeshIndecies.data(), IndexCount, 0); });
+
+		// Mean |dot(N, T)| of the normalized vectors: 0 for an orthogonal frame.
+		double ReferenceSkew = 0.0;
+		double FrameSkew = 0.0;
+		unsigned int Mirrored = 0;
+
+		for (unsigned int v = 0; v < VertexCount; v++)
+		{
+			XMVECTOR N = XMVector3Normalize(XMLoadFloat3(&Vertices[v].normal));
+			XMVECTOR R = XMVector3Normalize(XMLoadFloat3(&Reference[v]));
+			XMFLOAT3 T3(Vertices[v].tangent.x, Vertices[v].tangent.y, Vertices[v].tangent.z);
+
+			ReferenceSkew += fabsf(XMVectorGetX(XMVector3Dot(N, R)));
+			FrameSkew += fabsf(XMVectorGetX(XMVector3Dot(N, XMLoadFloat3(&T3))));
+			Mirrored += Vertices[v].tangent.w < 0.0f;
+		}
+
+		char Line[256];
+		sprintf_s(Line, "%s: tangents for %u vertices: reference loop %.3f ms, frames %.3f ms (1 thread), %.3f ms (%u threads), %.1fx\n",
+			filepath, VertexCount, ReferenceMs, SingleMs, ParallelMs, DX::ResolveWorkerCount(0), ReferenceMs / max(ParallelMs, 1e-6));
+		OutputDebugStringA(Line);
+
+		sprintf_s(Line, "%s: mean |N.T| reference %.4f, frames %.4f; %u mirrored vertices\n",
+			filepath, VertexCount > 0 ? ReferenceSkew / VertexCount : 0.0, VertexCount > 0 ? FrameSkew / VertexCount : 0.0, Mirrored);
+		OutputDebugStringA(Line);
+	}
+}
@@ -0,0 +1,906 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cfloat>
+#include <cmath>
+#if defined(_XM_SSE_INTRINSICS_)
+#include <xmmintrin.h>
+#endif
+#include "SceneBvh.h"
+
+// Bounding volume hierarchy over the triangles of one mesh, for ray picking and line of
+// sight tests. It is built as a binary tree with binned SAH, then collapsed to four
+// children per node so one SSE slab test covers a whole node. Leaves are packets of up to
+// four triangles stored side by side, tested against the ray together. Nodes and packets
+// are plain arrays, so a cooked mesh can store them in its cache image.
+namespace DX11UWA
+{
+	// Set on a child that is a packet rather than another node.
+	static const unsigned int TriangleBvhLeaf = 0x80000000;
+	// An unused child slot (with an inverted box) or a padding lane of a packet.
+	static const unsigned int TriangleBvhNone = 0xFFFFFFFF;
+
+	// Triangles per leaf; one packet.
+	static const unsigned int TriangleBvhPacketSize = 4;
+
+	// Binary build depth past which splits fall back to the object median, which bounds
+	// the depth of the collapsed tree and so the traversal stack.
+	static const unsigned int TriangleBvhMaxSahDepth = 64;
+	static const unsigned int TriangleBvhStackSize = 256;
+
+	// Four child boxes, one per lane.
+	struct TriangleBvhNode
+	{
+		float MinX[4], MinY[4], MinZ[4];
+		float MaxX[4], MaxY[4], MaxZ[4];
+		unsigned int Child[4];
+	};
+
+	// Up to four triangles as their first vertex and two edges. Padding lanes are
+	// degenerate, so they never hit.
+	struct TrianglePacket
+	{
+		float V0X[4], V0Y[4], V0Z[4];
+		float E1X[4], E1Y[4], E1Z[4];
+		float E2X[4], E2Y[4], E2Z[4];
+		unsigned int Triangle[4];
+	};
+
+	// Hit at Origin + Distance * Direction. U and V weigh the triangle's second and third
+	// vertices; the first has 1 - U - V.
+	struct TriangleHit
+	{
+		float Distance;
+		unsigned int Triangle;
+		float U;
+		float V;
+	};
+
+	struct TriangleBvhStats
+	{
+		unsigned int NodesVisited = 0;
+		unsigned int PacketsTested = 0;
+	};
+
+	enum TriangleBvhPath
+	{
+		TriangleBvhScalar,
+		TriangleBvhSSE,
+	};
+
+#if defined(_XM_SSE_INTRINSICS_)
+	static const TriangleBvhPath TriangleBvhBest = TriangleBvhSSE;
+#else
+	static const TriangleBvhPath TriangleBvhBest = TriangleBvhScalar;
+#endif
+
+	// The ray as every test wants it. Nearest and farthest slab planes are picked by the
+	// sign of each direction component, so an inverted (empty) box always misses.
+	struct TriangleBvhRay
+	{
+		float Origin[3];
+		float Direction[3];
+		float Inverse[3];
+		bool Negative[3];
+	};
+
+	// Lane-wise max and min with the semantics of _mm_max_ps and _mm_min_ps: the second
+	// operand wins when either is NaN, so the scalar and SSE paths agree bit for bit.
+	static float TriangleBvhMax(float a, float b)
+	{
+		return a > b ? a : b;
+	}
+
+	static float TriangleBvhMin(float a, float b)
+	{
+		return a < b ? a : b;
+	}
+
+	// Slab tests of the four children. Returns a bit per child the ray enters before MaxT,
+	// with where it enters in Near.
+	static unsigned int IntersectTriangleBvhNodeScalar(const TriangleBvhNode& Node, const TriangleBvhRay& Ray, float MaxT, float Near[4])
+	{
+		const float* Mins[3] = { Node.MinX, Node.MinY, Node.MinZ };
+		const float* Maxs[3] = { Node.MaxX, Node.MaxY, Node.MaxZ };
+		unsigned int Mask = 0;
+
+		for (unsigned int Lane = 0; Lane < 4; Lane++)
+		{
+			float Enter = 0.0f, Exit = MaxT;
+			for (unsigned int Axis = 0; Axis < 3; Axis++)
+			{
+				float NearPlane = Ray.Negative[Axis] ? Maxs[Axis][Lane] : Mins[Axis][Lane];
+				float FarPlane = Ray.Negative[Axis] ? Mins[Axis][Lane] : Maxs[Axis][Lane];
+				Enter = TriangleBvhMax((NearPlane - Ray.Origin[Axis]) * Ray.Inverse[Axis], Enter);
+				Exit = TriangleBvhMin((FarPlane - Ray.Origin[Axis]) * Ray.Inverse[Axis], Exit);
+			}
+
+			Near[Lane] = Enter;
+			Mask |= (Enter <= Exit ? 1u : 0u) << Lane;
+		}
+
+		return Mask;
+	}
+
+	// Moller-Trumbore against the four triangles of a packet. Returns a bit per triangle
+	// hit in [0, MaxT), with the distance and barycentrics of each.
+	static unsigned int IntersectTrianglePacketScalar(const TrianglePacket& Packet, const TriangleBvhRay& Ray, float MaxT, float T[4], float U[4], float V[4])
+	{
+		const float* D = Ray.Direction;
+		unsigned int Mask = 0;
+
+		for (unsigned int Lane = 0; Lane < 4; Lane++)
+		{
+			float E1X = Packet.E1X[Lane], E1Y = Packet.E1Y[Lane], E1Z = Packet.E1Z[Lane];
+			float E2X = Packet.E2X[Lane], E2Y = Packet.E2Y[Lane], E2Z = Packet.E2Z[Lane];
+
+			float PX = D[1] * E2Z - D[2] * E2Y;
+			float PY = D[2] * E2X - D[0] * E2Z;
+			float PZ = D[0] * E2Y - D[1] * E2X;
+			float Det = E1X * PX + E1Y * PY + E1Z * PZ;
+			float InverseDet = 1.0f / Det;
+
+			float TX = Ray.Origin[0] - Packet.V0X[Lane];
+			float TY = Ray.Origin[1] - Packet.V0Y[Lane];
+			float TZ = Ray.Origin[2] - Packet.V0Z[Lane];
+			float LaneU = (TX * PX + TY * PY + TZ * PZ) * InverseDet;
+
+			float QX = TY * E1Z - TZ * E1Y;
+			float QY = TZ * E1X - TX * E1Z;
+			float QZ = TX * E1Y - TY * E1X;
+			float LaneV = (D[0] * QX + D[1] * QY + D[2] * QZ) * InverseDet;
+			float LaneT = (E2X * QX + E2Y * QY + E2Z * QZ) * InverseDet;
+
+			T[Lane] = LaneT;
+			U[Lane] = LaneU;
+			V[Lane] = LaneV;
+
+			bool Hit = Det != 0.0f && LaneU >= 0.0f && LaneV >= 0.0f && LaneU + LaneV <= 1.0f && LaneT >= 0.0f && LaneT < MaxT;
+			Mask |= (Hit ? 1u : 0u) << Lane;
+		}
+
+		return Mask;
+	}
+
+#if defined(_XM_SSE_INTRINSICS_)
+	static unsigned int IntersectTriangleBvhNodeSSE(const TriangleBvhNode& Node, const TriangleBvhRay& Ray, float MaxT, float Near[4])
+	{
+		const float* Mins[3] = { Node.MinX, Node.MinY, Node.MinZ };
+		const float* Maxs[3] = { Node.MaxX, Node.MaxY, Node.MaxZ };
+
+		__m128 Enter = _mm_setzero_ps();
+		__m128 Exit = _mm_set1_ps(MaxT);
+
+		for (unsigned int Axis = 0; Axis < 3; Axis++)
+		{
+			__m128 NearPlane = _mm_loadu_ps(Ray.Negative[Axis] ? Maxs[Axis] : Mins[Axis]);
+			__m128 FarPlane = _mm_loadu_ps(Ray.Negative[Axis] ? Mins[Axis] : Maxs[Axis]);
+			__m128 Origin = _mm_set1_ps(Ray.Origin[Axis]);
+			__m128 Inverse = _mm_set1_ps(Ray.Inverse[Axis]);
+			Enter = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(NearPlane, Origin), Inverse), Enter);
+			Exit = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(FarPlane, Origin), Inverse), Exit);
+		}
+
+		_mm_storeu_ps(Near, Enter);
+		return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(Enter, Exit));
+	}
+
+	static unsigned int IntersectTrianglePacketSSE(const TrianglePacket& Packet, const TriangleBvhRay& Ray, float MaxT, float T[4], float U[4], float V[4])
+	{
+		__m128 DX = _mm_set1_ps(Ray.Direction[0]), DY = _mm_set1_ps(Ray.Direction[1]), DZ = _mm_set1_ps(Ray.Direction[2]);
+		__m128 E1X = _mm_loadu_ps(Packet.E1X), E1Y = _mm_loadu_ps(Packet.E1Y), E1Z = _mm_loadu_ps(Packet.E1Z);
+		__m128 E2X = _mm_loadu_ps(Packet.E2X), E2Y = _mm_loadu_ps(Packet.E2Y), E2Z = _mm_loadu_ps(Packet.E2Z);
+
+		__m128 PX = _mm_sub_ps(_mm_mul_ps(DY, E2Z), _mm_mul_ps(DZ, E2Y));
+		__m128 PY = _mm_sub_ps(_mm_mul_ps(DZ, E2X), _mm_mul_ps(DX, E2Z));
+		__m128 PZ = _mm_sub_ps(_mm_mul_ps(DX, E2Y), _mm_mul_ps(DY, E2X));
+		__m128 Det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(E1X, PX), _mm_mul_ps(E1Y, PY)), _mm_mul_ps(E1Z, PZ));
+		__m128 InverseDet = _mm_div_ps(_mm_set1_ps(1.0f), Det);
+
+		__m128 TX = _mm_sub_ps(_mm_set1_ps(Ray.Origin[0]), _mm_loadu_ps(Packet.V0X));
+		__m128 TY = _mm_sub_ps(_mm_set1_ps(Ray.Origin[1]), _mm_loadu_ps(Packet.V0Y));
+		__m128 TZ = _mm_sub_ps(_mm_set1_ps(Ray.Origin[2]), _mm_loadu_ps(Packet.V0Z));
+		__m128 LaneU = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(TX, PX), _mm_mul_ps(TY, PY)), _mm_mul_ps(TZ, PZ)), InverseDet);
+
+		__m128 QX = _mm_sub_ps(_mm_mul_ps(TY, E1Z), _mm_mul_ps(TZ, E1Y));
+		__m128 QY = _mm_sub_ps(_mm_mul_ps(TZ, E1X), _mm_mul_ps(TX, E1Z));
+		__m128 QZ = _mm_sub_ps(_mm_mul_ps(TX, E1Y), _mm_mul_ps(TY, E1X));
+		__m128 LaneV = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(DX, QX), _mm_mul_ps(DY, QY)), _mm_mul_ps(DZ, QZ)), InverseDet);
+		__m128 LaneT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(E2X, QX), _mm_mul_ps(E2Y, QY)), _mm_mul_ps(E2Z, QZ)), InverseDet);
+
+		_mm_storeu_ps(T, LaneT);
+		_mm_storeu_ps(U, LaneU);
+		_mm_storeu_ps(V, LaneV);
+
+		__m128 Zero = _mm_setzero_ps();
+		__m128 Hit = _mm_and_ps(_mm_cmpneq_ps(Det, Zero), _mm_cmpge_ps(LaneU, Zero));
+		Hit = _mm_and_ps(Hit, _mm_cmpge_ps(LaneV, Zero));
+		Hit = _mm_and_ps(Hit, _mm_cmple_ps(_mm_add_ps(LaneU, LaneV), _mm_set1_ps(1.0f)));
+		Hit = _mm_and_ps(Hit, _mm_cmpge_ps(LaneT, Zero));
+		Hit = _mm_and_ps(Hit, _mm_cmplt_ps(LaneT, _mm_set1_ps(MaxT)));
+		return (unsigned int)_mm_movemask_ps(Hit);
+	}
+#endif
+
+	// Largest number of entries TriangleBvh::Trace can hold on its stack for a tree whose
+	// children all come after their parent. Each node popped pushes at most four children,
+	// so a tree with Levels levels of nodes needs at most 1 + 3 * Levels.
+	static unsigned int GetTriangleBvhStackNeed(const TriangleBvhNode* Nodes, unsigned int NodeCount)
+	{
+		if (NodeCount == 0)
+		{
+			return 1;
+		}
+
+		std::vector<unsigned int> Levels(NodeCount, 0);
+		Levels[0] = 1;
+		unsigned int Deepest = 1;
+		for (unsigned int n = 0; n < NodeCount; n++)
+		{
+			for (unsigned int Lane = 0; Lane < 4; Lane++)
+			{
+				unsigned int Child = Nodes[n].Child[Lane];
+				if (Child != TriangleBvhNone && !(Child & TriangleBvhLeaf))
+				{
+					Levels[Child] = std::max(Levels[Child], Levels[n] + 1);
+					Deepest = std::max(Deepest, Levels[Child]);
+				}
+			}
+		}
+
+		return 1 + 3 * Deepest;
+	}
+
+	// Builds the nodes and packets over TriangleCount triangles, three entries of Indices
+	// each. Node 0 is the root; packets name their triangles by position in Indices / 3.
+	static void BuildTriangleBvh(const DirectX::XMFLOAT3* Positions, const unsigned int* Indices, unsigned int TriangleCount,
+		std::vector<TriangleBvhNode>* Nodes, std::vector<TrianglePacket>* Packets)
+	{
+		using namespace DirectX;
+
+		Nodes->clear();
+		Packets->clear();
+		if (TriangleCount == 0)
+		{
+			return;
+		}
+
+		struct BinaryNode
+		{
+			XMFLOAT3 Min, Max;
+			unsigned int Left, Right;
+			// Triangle range in Order for a leaf, Count 0 otherwise.
+			unsigned int First, Count;
+		};
+
+		std::vector<XMFLOAT3> Mins(TriangleCount), Maxs(TriangleCount), Centroids(TriangleCount);
+		std::vector<unsigned int> Order(TriangleCount);
+
+		for (unsigned int t = 0; t < TriangleCount; t++)
+		{
+			const XMFLOAT3& a = Positions[Indices[3 * t]];
+			const XMFLOAT3& b = Positions[Indices[3 * t + 1]];
+			const XMFLOAT3& c = Positions[Indices[3 * t + 2]];
+			BoxUnion(a, a, b, b, &Mins[t], &Maxs[t]);
+			BoxUnion(Mins[t], Maxs[t], c, c, &Mins[t], &Maxs[t]);
+			Centroids[t] = XMFLOAT3(0.5f * (Mins[t].x + Maxs[t].x), 0.5f * (Mins[t].y + Maxs[t].y), 0.5f * (Mins[t].z + Maxs[t].z));
+			Order[t] = t;
+		}
+
+		std::vector<BinaryNode> Binary;
+		Binary.reserve(2 * TriangleCount / TriangleBvhPacketSize + 1);
+
+		struct Task
+		{
+			unsigned int Node, Begin, End, Depth;
+		};
+
+		std::vector<Task> Tasks;
+		Binary.push_back(BinaryNode());
+		Tasks.push_back({ 0, 0, TriangleCount, 0 });
+
+		while (!Tasks.empty())
+		{
+			Task Current = Tasks.back();
+			Tasks.pop_back();
+
+			XMFLOAT3 Min(FLT_MAX, FLT_MAX, FLT_MAX), Max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			XMFLOAT3 CentroidMin(FLT_MAX, FLT_MAX, FLT_MAX), CentroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (unsigned int i = Current.Begin; i < Current.End; i++)
+			{
+				unsigned int t = Order[i];
+				BoxUnion(Min, Max, Mins[t], Maxs[t], &Min, &Max);
+				BoxUnion(CentroidMin, CentroidMax, Centroids[t], Centroids[t], &CentroidMin, &CentroidMax);
+			}
+
+			BinaryNode& Node = Binary[Current.Node];
+			Node.Min = Min;
+			Node.Max = Max;
+			Node.Left = Node.Right = TriangleBvhNone;
+			Node.First = Current.Begin;
+			Node.Count = Current.End - Current.Begin;
+
+			// A whole packet costs about as much to test as one triangle.
+			if (Node.Count <= TriangleBvhPacketSize)
+			{
+				continue;
+			}
+
+			int BestAxis = -1;
+			unsigned int BestSplit = 0;
+			float BestCost = FLT_MAX;
+
+			for (int Axis = 0; Axis < 3 && Current.Depth < TriangleBvhMaxSahDepth; Axis++)
+			{
+				float AxisMin = (&CentroidMin.x)[Axis];
+				float AxisExtent = (&CentroidMax.x)[Axis] - AxisMin;
+				if (AxisExtent <= 0.0f)
+				{
+					continue;
+				}
+
+				struct Bin
+				{
+					XMFLOAT3 Min, Max;
+					unsigned int Count;
+				};
+
+				Bin Bins[BvhSahBins];
+				for (unsigned int b = 0; b < BvhSahBins; b++)
+				{
+					Bins[b] = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX), 0 };
+				}
+
+				float BinScale = BvhSahBins / AxisExtent;
+				for (unsigned int i = Current.Begin; i < Current.End; i++)
+				{
+					unsigned int t = Order[i];
+					unsigned int b = std::min((unsigned int)(((&Centroids[t].x)[Axis] - AxisMin) * BinScale), BvhSahBins - 1);
+					BoxUnion(Bins[b].Min, Bins[b].Max, Mins[t], Maxs[t], &Bins[b].Min, &Bins[b].Max);
+					Bins[b].Count++;
+				}
+
+				float RightArea[BvhSahBins];
+				unsigned int RightCount[BvhSahBins];
+				XMFLOAT3 SideMin(FLT_MAX, FLT_MAX, FLT_MAX), SideMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				unsigned int Count = 0;
+				for (unsigned int b = BvhSahBins - 1; b > 0; b--)
+				{
+					BoxUnion(SideMin, SideMax, Bins[b].Min, Bins[b].Max, &SideMin, &SideMax);
+					Count += Bins[b].Count;
+					RightArea[b] = Count > 0 ? BoxSurfaceArea(SideMin, SideMax) : 0.0f;
+					RightCount[b] = Count;
+				}
+
+				SideMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+				SideMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				Count = 0;
+				for (unsigned int b = 0; b + 1 < BvhSahBins; b++)
+				{
+					BoxUnion(SideMin, SideMax, Bins[b].Min, Bins[b].Max, &SideMin, &SideMax);
+					Count += Bins[b].Count;
+					if (Count == 0 || RightCount[b + 1] == 0)
+					{
+						continue;
+					}
+
+					// Packets, not triangles, are what a leaf costs.
+					float Cost = BoxSurfaceArea(SideMin, SideMax) * ((Count + TriangleBvhPacketSize - 1) / TriangleBvhPacketSize) +
+						RightArea[b + 1] * ((RightCount[b + 1] + TriangleBvhPacketSize - 1) / TriangleBvhPacketSize);
+					if (Cost < BestCost)
+					{
+						BestCost = Cost;
+						BestAxis = Axis;
+						BestSplit = b + 1;
+					}
+				}
+			}
+
+			unsigned int Middle;
+			if (BestAxis < 0)
+			{
+				// Too deep, or every centroid coincides: split at the median of the longest axis.
+				int Axis = 0;
+				XMFLOAT3 Extent(CentroidMax.x - CentroidMin.x, CentroidMax.y - CentroidMin.y, CentroidMax.z - CentroidMin.z);
+				Axis = Extent.y > Extent.x ? 1 : 0;
+				Axis = Extent.z > (&Extent.x)[Axis] ? 2 : Axis;
+
+				Middle = Current.Begin + (Current.End - Current.Begin) / 2;
+				std::nth_element(Order.begin() + Current.Begin, Order.begin() + Middle, Order.begin() + Current.End, [&](unsigned int a, unsigned int b)
+				{
+					return (&Centroids[a].x)[Axis] < (&Centroids[b].x)[Axis];
+				});
+			}
+			else
+			{
+				float AxisMin = (&CentroidMin.x)[BestAxis];
+				float BinScale = BvhSahBins / ((&CentroidMax.x)[BestAxis] - AxisMin);
+				auto Split = std::partition(Order.begin() + Current.Begin, Order.begin() + Current.End, [&](unsigned int t)
+				{
+					return std::min((unsigned int)(((&Centroids[t].x)[BestAxis] - AxisMin) * BinScale), BvhSahBins - 1) < BestSplit;
+				});
+				Middle = (unsigned int)(Split - Order.begin());
+			}
+
+			unsigned int Left = (unsigned int)Binary.size();
+			Binary[Current.Node].Count = 0;
+			Binary[Current.Node].Left = Left;
+			Binary[Current.Node].Right = Left + 1;
+			Binary.push_back(BinaryNode());
+			Binary.push_back(BinaryNode());
+			Tasks.push_back({ Left + 1, Middle, Current.End, Current.Depth + 1 });
+			Tasks.push_back({ Left, Current.Begin, Middle, Current.Depth + 1 });
+		}
+
+		// Collapse: each wide node takes a binary node's children and keeps opening the
+		// largest of them that is not a leaf until it has four. Nodes are written parent
+		// first, so a node's subtree follows it in memory.
+		Nodes->reserve(Binary.size() / 2 + 1);
+		Packets->reserve(TriangleCount / 2 + 1);
+
+		struct Collapse
+		{
+			unsigned int Binary;
+			unsigned int Parent;
+			unsigned int Lane;
+		};
+
+		std::vector<Collapse> Pending;
+		Pending.push_back({ 0, TriangleBvhNone, 0 });
+
+		while (!Pending.empty())
+		{
+			Collapse Current = Pending.back();
+			Pending.pop_back();
+
+			unsigned int Slots[4];
+			unsigned int SlotCount = 0;
+			const BinaryNode& Root = Binary[Current.Binary];
+			if (Root.Count > 0)
+			{
+				Slots[SlotCount++] = Current.Binary;
+			}
+			else
+			{
+				Slots[SlotCount++] = Root.Left;
+				Slots[SlotCount++] = Root.Right;
+			}
+
+			while (SlotCount < 4)
+			{
+				int Largest = -1;
+				float LargestArea = -1.0f;
+				for (unsigned int s = 0; s < SlotCount; s++)
+				{
+					const BinaryNode& Slot = Binary[Slots[s]];
+					float Area = BoxSurfaceArea(Slot.Min, Slot.Max);
+					if (Slot.Count == 0 && Area > LargestArea)
+					{
+						Largest = (int)s;
+						LargestArea = Area;
+					}
+				}
+
+				if (Largest < 0)
+				{
+					break;
+				}
+
+				unsigned int Opened = Slots[Largest];
+				Slots[Largest] = Binary[Opened].Left;
+				Slots[SlotCount++] = Binary[Opened].Right;
+			}
+
+			unsigned int Index = (unsigned int)Nodes->size();
+			if (Current.Parent != TriangleBvhNone)
+			{
+				(*Nodes)[Current.Parent].Child[Current.Lane] = Index;
+			}
+
+			TriangleBvhNode Node;
+			for (unsigned int Lane = 0; Lane < 4; Lane++)
+			{
+				Node.MinX[Lane] = Node.MinY[Lane] = Node.MinZ[Lane] = FLT_MAX;
+				Node.MaxX[Lane] = Node.MaxY[Lane] = Node.MaxZ[Lane] = -FLT_MAX;
+				Node.Child[Lane] = TriangleBvhNone;
+			}
+
+			for (unsigned int Lane = 0; Lane < SlotCount; Lane++)
+			{
+				const BinaryNode& Slot = Binary[Slots[Lane]];
+				Node.MinX[Lane] = Slot.Min.x;
+				Node.MinY[Lane] = Slot.Min.y;
+				Node.MinZ[Lane] = Slot.Min.z;
+				Node.MaxX[Lane] = Slot.Max.x;
+				Node.MaxY[Lane] = Slot.Max.y;
+				Node.MaxZ[Lane] = Slot.Max.z;
+
+				if (Slot.Count == 0)
+				{
+					Pending.push_back({ Slots[Lane], Index, Lane });
+					continue;
+				}
+
+				TrianglePacket Packet = {};
+				for (unsigned int p = 0; p < TriangleBvhPacketSize; p++)
+				{
+					Packet.Triangle[p] = TriangleBvhNone;
+				}
+
+				for (unsigned int p = 0; p < Slot.Count; p++)
+				{
+					unsigned int t = Order[Slot.First + p];
+					const XMFLOAT3& a = Positions[Indices[3 * t]];
+					const XMFLOAT3& b = Positions[Indices[3 * t + 1]];
+					const XMFLOAT3& c = Positions[Indices[3 * t + 2]];
+
+					Packet.V0X[p] = a.x;
+					Packet.V0Y[p] = a.y;
+					Packet.V0Z[p] = a.z;
+					Packet.E1X[p] = b.x - a.x;
+					Packet.E1Y[p] = b.y - a.y;
+					Packet.E1Z[p] = b.z - a.z;
+					Packet.E2X[p] = c.x - a.x;
+					Packet.E2Y[p] = c.y - a.y;
+					Packet.E2Z[p] = c.z - a.z;
+					Packet.Triangle[p] = t;
+				}
+
+				Node.Child[Lane] = (unsigned int)Packets->size() | TriangleBvhLeaf;
+				Packets->push_back(Packet);
+			}
+
+			Nodes->push_back(Node);
+		}
+	}
+
+	// A built hierarchy: nodes and packets owned elsewhere, by the builder's vectors or a
+	// cooked cache image.
+	struct TriangleBvh
+	{
+		const TriangleBvhNode* Nodes = nullptr;
+		const TrianglePacket* Packets = nullptr;
+		unsigned int NodeCount = 0;
+		unsigned int PacketCount = 0;
+
+		// Nearest triangle along Origin + t * Direction for t in [0, MaxT). Distances are in
+		// units of Direction's length, so a ray transformed into object space keeps them.
+		bool RayCast(const DirectX::XMFLOAT3& Origin, const DirectX::XMFLOAT3& Direction, float MaxT, TriangleHit* Hit,
+			TriangleBvhStats* Stats = nullptr, TriangleBvhPath Path = TriangleBvhBest) const
+		{
+			return Trace(Origin, Direction, MaxT, false, Hit, Stats, Path);
+		}
+
+		// Whether any triangle lies on the segment Origin + t * Direction, t in [0, MaxT).
+		// Stops at the first hit found rather than the nearest.
+		bool Occluded(const DirectX::XMFLOAT3& Origin, const DirectX::XMFLOAT3& Direction, float MaxT,
+			TriangleBvhStats* Stats = nullptr, TriangleBvhPath Path = TriangleBvhBest) const
+		{
+			TriangleHit Hit;
+			return Trace(Origin, Direction, MaxT, true, &Hit, Stats, Path);
+		}
+
+		size_t GetMemorySize() const
+		{
+			return sizeof(TriangleBvhNode) * NodeCount + sizeof(TrianglePacket) * PacketCount;
+		}
+
+	private:
+		bool Trace(const DirectX::XMFLOAT3& Origin, const DirectX::XMFLOAT3& Direction, float MaxT, bool AnyHit, TriangleHit* Hit,
+			TriangleBvhStats* Stats, TriangleBvhPath Path) const
+		{
+			if (NodeCount == 0)
+			{
+				return false;
+			}
+
+			TriangleBvhRay Ray;
+			const float* From = &Origin.x;
+			const float* Towards = &Direction.x;
+			for (unsigned int Axis = 0; Axis < 3; Axis++)
+			{
+				Ray.Origin[Axis] = From[Axis];
+				Ray.Direction[Axis] = Towards[Axis];
+				Ray.Inverse[Axis] = 1.0f / Towards[Axis];
+				Ray.Negative[Axis] = Ray.Inverse[Axis] < 0.0f;
+			}
+
+			struct Entry
+			{
+				unsigned int Child;
+				float Near;
+			};
+
+			Entry Stack[TriangleBvhStackSize];
+			unsigned int Top = 0;
+			Stack[Top++] = { 0, 0.0f };
+
+			unsigned int NodesVisited = 0, PacketsTested = 0;
+			float BestT = MaxT;
+			bool Found = false;
+
+			while (Top > 0)
+			{
+				Entry Current = Stack[--Top];
+				if (Current.Near > BestT)
+				{
+					continue;
+				}
+
+				if (Current.Child & TriangleBvhLeaf)
+				{
+					const TrianglePacket& Packet = Packets[Current.Child & ~TriangleBvhLeaf];
+					PacketsTested++;
+
+					float T[4], U[4], V[4];
+					unsigned int Mask;
+#if defined(_XM_SSE_INTRINSICS_)
+					if (Path == TriangleBvhSSE)
+					{
+						Mask = IntersectTrianglePacketSSE(Packet, Ray, BestT, T, U, V);
+					}
+					else
+#endif
+					{
+						Mask = IntersectTrianglePacketScalar(Packet, Ray, BestT, T, U, V);
+					}
+
+					for (unsigned int Lane = 0; Lane < 4; Lane++)
+					{
+						if ((Mask >> Lane & 1) && T[Lane] < BestT)
+						{
+							BestT = T[Lane];
+							*Hit = { T[Lane], Packet.Triangle[Lane], U[Lane], V[Lane] };
+							Found = true;
+						}
+					}
+
+					if (Found && AnyHit)
+					{
+						break;
+					}
+					continue;
+				}
+
+				const TriangleBvhNode& Node = Nodes[Current.Child];
+				NodesVisited++;
+
+				float Near[4];
+				unsigned int Mask;
+#if defined(_XM_SSE_INTRINSICS_)
+				if (Path == TriangleBvhSSE)
+				{
+					Mask = IntersectTriangleBvhNodeSSE(Node, Ray, BestT, Near);
+				}
+				else
+#endif
+				{
+					Mask = IntersectTriangleBvhNodeScalar(Node, Ray, BestT, Near);
+				}
+
+				// Push the children farthest first so the nearest is popped next.
+				Entry Hits[4];
+				unsigned int HitCount = 0;
+				for (unsigned int Lane = 0; Lane < 4; Lane++)
+				{
+					if (Mask >> Lane & 1)
+					{
+						unsigned int i = HitCount++;
+						for (; i > 0 && Hits[i - 1].Near < Near[Lane]; i--)
+						{
+							Hits[i] = Hits[i - 1];
+						}
+						Hits[i] = { Node.Child[Lane], Near[Lane] };
+					}
+				}
+
+				for (unsigned int i = 0; i < HitCount; i++)
+				{
+					Stack[Top++] = Hits[i];
+				}
+			}
+
+			if (Stats != nullptr)
+			{
+				Stats->NodesVisited += NodesVisited;
+				Stats->PacketsTested += PacketsTested;
+			}
+
+			return Found;
+		}
+	};
+
+	// Casts RayCount rays from a sphere around the box at random points inside it, on every
+	// path, and reports rays per second, nodes and packets per ray, and whether the paths
+	// and a brute force test of every packet agree.
+	static bool ReportTriangleBvhRays(const char* Name, const TriangleBvh& Bvh, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max,
+		unsigned int RayCount = 100000, unsigned int BruteForceRays = 500)
+	{
+		using namespace DirectX;
+
+		const TriangleBvhPath Paths[] = { TriangleBvhScalar, TriangleBvhSSE };
+		const char* PathNames[] = { "scalar", "SSE" };
+		const unsigned int PathCount = (unsigned int)TriangleBvhBest + 1;
+
+		XMVECTOR BoxMin = XMLoadFloat3(&Min), BoxMax = XMLoadFloat3(&Max);
+		XMVECTOR Center = XMVectorScale(XMVectorAdd(BoxMin, BoxMax), 0.5f);
+		float Radius = 2.0f * XMVectorGetX(XMVector3Length(XMVectorSubtract(BoxMax, Center))) + 1.0f;
+
+		std::mt19937 Random(4321);
+		std::uniform_real_distribution<float> Unit(0.0f, 1.0f);
+		std::normal_distribution<float> Normal(0.0f, 1.0f);
+
+		std::vector<XMFLOAT3> Origins(RayCount), Directions(RayCount);
+		for (unsigned int r = 0; r < RayCount; r++)
+		{
+			XMVECTOR Outward = XMVector3Normalize(XMVectorSet(Normal(Random), Normal(Random), Normal(Random), 0.0f));
+			XMVECTOR Start = XMVectorAdd(Center, XMVectorScale(Outward, Radius));
+			XMVECTOR Target = XMVectorLerpV(BoxMin, BoxMax, XMVectorSet(Unit(Random), Unit(Random), Unit(Random), 0.0f));
+			XMStoreFloat3(&Origins[r], Start);
+			XMStoreFloat3(&Directions[r], XMVector3Normalize(XMVectorSubtract(Target, Start)));
+		}
+
+		std::vector<TriangleHit> Hits[2];
+		double Seconds[2] = { 0.0, 0.0 };
+		TriangleBvhStats Stats;
+		unsigned int HitCount = 0;
+
+		for (unsigned int p = 0; p < PathCount; p++)
+		{
+			Hits[p].assign(RayCount, { FLT_MAX, TriangleBvhNone, 0.0f, 0.0f });
+			TriangleBvhStats PathStats;
+
+			auto Start = std::chrono::high_resolution_clock::now();
+			for (unsigned int r = 0; r < RayCount; r++)
+			{
+				Bvh.RayCast(Origins[r], Directions[r], FLT_MAX, &Hits[p][r], &PathStats, Paths[p]);
+			}
+			Seconds[p] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+
+			if (p == 0)
+			{
+				Stats = PathStats;
+			}
+		}
+
+		unsigned int PathMismatches = 0;
+		for (unsigned int r = 0; r < RayCount; r++)
+		{
+			HitCount += Hits[0][r].Triangle != TriangleBvhNone;
+			for (unsigned int p = 1; p < PathCount; p++)
+			{
+				const TriangleHit& a = Hits[0][r];
+				const TriangleHit& b = Hits[p][r];
+				PathMismatches += a.Distance != b.Distance || a.Triangle != b.Triangle || a.U != b.U || a.V != b.V;
+			}
+		}
+
+		double OccludedSeconds = 0.0;
+		unsigned int OccludedCount = 0, OccludedMismatches = 0;
+		{
+			auto Start = std::chrono::high_resolution_clock::now();
+			for (unsigned int r = 0; r < RayCount; r++)
+			{
+				bool Blocked = Bvh.Occluded(Origins[r], Directions[r], Radius);
+				OccludedCount += Blocked;
+				OccludedMismatches += Blocked != (Hits[0][r].Distance < Radius);
+			}
+			OccludedSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - Start).count();
+		}
+
+		// Brute force over every packet. Where two triangles tie (a ray through a shared edge)
+		// either may be reported, so only the distances have to match.
+		unsigned int BruteMismatches = 0;
+		BruteForceRays = std::min(BruteForceRays, RayCount);
+		for (unsigned int r = 0; r < BruteForceRays; r++)
+		{
+			TriangleBvhRay Ray;
+			for (unsigned int Axis = 0; Axis < 3; Axis++)
+			{
+				Ray.Origin[Axis] = (&Origins[r].x)[Axis];
+				Ray.Direction[Axis] = (&Directions[r].x)[Axis];
+				Ray.Inverse[Axis] = 1.0f / Ray.Direction[Axis];
+				Ray.Negative[Axis] = Ray.Inverse[Axis] < 0.0f;
+			}
+
+			float BestT = FLT_MAX;
+			for (unsigned int k = 0; k < Bvh.PacketCount; k++)
+			{
+				float T[4], U[4], V[4];
+				unsigned int Mask = IntersectTrianglePacketScalar(Bvh.Packets[k], Ray, BestT, T, U, V);
+				for (unsigned int Lane = 0; Lane < 4; Lane++)
+				{
+					if ((Mask >> Lane & 1) && T[Lane] < BestT)
+					{
+						BestT = T[Lane];
+					}
+				}
+			}
+
+			BruteMismatches += BestT != Hits[0][r].Distance;
+		}
+
+		char Line[256];
+		sprintf_s(Line, "%s: triangle BVH with %u nodes and %u packets (%.1f KB), %.1f%% of %u rays hit, %.1f nodes and %.1f packets per ray\n",
+			Name, Bvh.NodeCount, Bvh.PacketCount, Bvh.GetMemorySize() / 1024.0, 100.0 * HitCount / std::max(RayCount, 1u), RayCount,
+			(double)Stats.NodesVisited / std::max(RayCount, 1u), (double)Stats.PacketsTested / std::max(RayCount, 1u));
+		OutputDebugStringA(Line);
+
+		for (unsigned int p = 0; p < PathCount; p++)
+		{
+			sprintf_s(Line, "%s: nearest hit, %s %.3f ms (%.2f M rays/s)\n", Name, PathNames[p], Seconds[p] * 1000.0, RayCount / std::max(Seconds[p], 1e-9) / 1000000.0);
+			OutputDebugStringA(Line);
+		}
+
+		sprintf_s(Line, "%s: any hit, %s %.3f ms (%.2f M rays/s), %u rays blocked\n", Name, PathNames[PathCount - 1], OccludedSeconds * 1000.0,
+			RayCount / std::max(OccludedSeconds, 1e-9) / 1000000.0, OccludedCount);
+		OutputDebugStringA(Line);
+
+		bool Agree = PathMismatches == 0 && BruteMismatches == 0 && OccludedMismatches == 0;
+		sprintf_s(Line, "%s: %s (%u path mismatches, %u of %u rays differ from brute force, %u any hit mismatches)\n", Name,
+			Agree ? "paths agree" : "MISMATCH", PathMismatches, BruteMismatches, BruteForceRays, OccludedMismatches);
+		OutputDebugStringA(Line);
+
+		return Agree;
+	}
+
+	// Builds the hierarchy of a rolling height field of 2 * GridSize^2 triangles, the size
+	// of a production mesh, and reports the build time and ray throughput.
+	static bool ReportTriangleBvh(unsigned int GridSize = 500, unsigned int RayCount = 100000)
+	{
+		using namespace DirectX;
+
+		unsigned int Side = GridSize + 1;
+		std::vector<XMFLOAT3> Positions((size_t)Side * Side);
+		std::vector<unsigned int> Indices;
+		Indices.reserve((size_t)GridSize * GridSize * 6);
+
+		std::mt19937 Random(99);
+		std::uniform_real_distribution<float> Bump(-0.05f, 0.05f);
+		float Spacing = 100.0f / GridSize;
+
+		for (unsigned int z = 0; z < Side; z++)
+		{
+			for (unsigned int x = 0; x < Side; x++)
+			{
+				float X = x * Spacing - 50.0f, Z = z * Spacing - 50.0f;
+				Positions[z * Side + x] = XMFLOAT3(X, 4.0f * sinf(0.15f * X) * cosf(0.11f * Z) + Bump(Random), Z);
+			}
+		}
+
+		for (unsigned int z = 0; z < GridSize; z++)
+		{
+			for (unsigned int x = 0; x < GridSize; x++)
+			{
+				unsigned int i = z * Side + x;
+				unsigned int Quad[6] = { i, i + Side, i + 1, i + 1, i + Side, i + Side + 1 };
+				Indices.insert(Indices.end(), Quad, Quad + 6);
+			}
+		}
+
+		std::vector<TriangleBvhNode> Nodes;
+		std::vector<TrianglePacket> Packets;
+		unsigned int TriangleCount = (unsigned int)(Indices.size() / 3);
+
+		auto BuildStart = std::chrono::high_resolution_clock::now();
+		BuildTriangleBvh(Positions.data(), Indices.data(), TriangleCount, &Nodes, &Packets);
+		double BuildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - BuildStart).count();
+
+		TriangleBvh Bvh;
+		Bvh.Nodes = Nodes.data();
+		Bvh.Packets = Packets.data();
+		Bvh.NodeCount = (unsigned int)Nodes.size();
+		Bvh.PacketCount = (unsigned int)Packets.size();
+
+		char Line[256];
+		sprintf_s(Line, "Triangle BVH: %u triangles built in %.1f ms, %.1f triangles per packet\n", TriangleCount, BuildSeconds * 1000.0,
+			(double)TriangleCount / std::max(Bvh.PacketCount, 1u));
+		OutputDebugStringA(Line);
+
+		XMFLOAT3 Min, Max;
+		ComputeBoundingBox((const char*)Positions.data(), sizeof(XMFLOAT3), Positions.size(), &Min, &Max);
+		return ReportTriangleBvhRays("Triangle BVH", Bvh, Min, Max, RayCount);
+	}
+}
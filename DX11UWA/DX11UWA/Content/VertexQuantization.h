@@ -0,0 +1,90 @@
+#pragma once
+#include <DirectXPackedVector.h>
+#include "ShaderStructures.h"
+
+// Encoding of VertexPositionUVNormalTan into the compact VertexQuantized layout. The
+// matching decode lives in QuantizedVertexShader.hlsl.
+namespace DX11UWA
+{
+	static unsigned short QuantizeUnorm16(float v)
+	{
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		return (unsigned short)(v * 65535.0f + 0.5f);
+	}
+
+	static short QuantizeSnorm16(float v)
+	{
+		v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+		return (short)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+	}
+
+	// Projects a direction onto the octahedron and unfolds the lower half over the upper,
+	// giving two values in [-1, 1]. A zero vector encodes as +Z.
+	static void EncodeOctahedral(const DirectX::XMFLOAT3& v, short Out[2])
+	{
+		float Sum = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+		if (Sum <= 0.0f)
+		{
+			Out[0] = 0;
+			Out[1] = 0;
+			return;
+		}
+
+		float x = v.x / Sum;
+		float y = v.y / Sum;
+
+		if (v.z < 0.0f)
+		{
+			float FoldX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float FoldY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = FoldX;
+			y = FoldY;
+		}
+
+		Out[0] = QuantizeSnorm16(x);
+		Out[1] = QuantizeSnorm16(y);
+	}
+
+	// Inverse of EncodeOctahedral, used to measure the encoding error.
+	static DirectX::XMFLOAT3 DecodeOctahedral(const short In[2])
+	{
+		float x = In[0] / 32767.0f;
+		float y = In[1] / 32767.0f;
+		float z = 1.0f - fabsf(x) - fabsf(y);
+
+		float t = z < 0.0f ? -z : 0.0f;
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+
+		float Length = sqrtf(x * x + y * y + z * z);
+		return DirectX::XMFLOAT3(x / Length, y / Length, z / Length);
+	}
+
+	// Position scale and offset that map the unorm range onto the bounds.
+	static QuantizationConstantBuffer GetQuantizationConstants(const DirectX::XMFLOAT3& BoundsMin, const DirectX::XMFLOAT3& BoundsMax)
+	{
+		QuantizationConstantBuffer Constants;
+		Constants.positionScale = DirectX::XMFLOAT4(BoundsMax.x - BoundsMin.x, BoundsMax.y - BoundsMin.y, BoundsMax.z - BoundsMin.z, 0.0f);
+		Constants.positionOffset = DirectX::XMFLOAT4(BoundsMin.x, BoundsMin.y, BoundsMin.z, 0.0f);
+		return Constants;
+	}
+
+	static VertexQuantized QuantizeVertex(const VertexPositionUVNormalTan& In, const QuantizationConstantBuffer& Constants)
+	{
+		const DirectX::XMFLOAT4& Scale = Constants.positionScale;
+		const DirectX::XMFLOAT4& Offset = Constants.positionOffset;
+
+		VertexQuantized Out;
+		Out.pos[0] = Scale.x > 0.0f ? QuantizeUnorm16((In.pos.x - Offset.x) / Scale.x) : 0;
+		Out.pos[1] = Scale.y > 0.0f ? QuantizeUnorm16((In.pos.y - Offset.y) / Scale.y) : 0;
+		Out.pos[2] = Scale.z > 0.0f ? QuantizeUnorm16((In.pos.z - Offset.z) / Scale.z) : 0;
+		Out.pos[3] = In.tangent.w < 0.0f ? 65535 : 0;
+
+		Out.uv[0] = DirectX::PackedVector::XMConvertFloatToHalf(In.uv.x);
+		Out.uv[1] = DirectX::PackedVector::XMConvertFloatToHalf(In.uv.y);
+
+		EncodeOctahedral(In.normal, Out.normal);
+		EncodeOctahedral(DirectX::XMFLOAT3(In.tangent.x, In.tangent.y, In.tangent.z), Out.tangent);
+		return Out;
+	}
+}
@@ -0,0 +1,93 @@
+// Headless runner for the Report* self-checks and benchmarks in DX11UWA/Content. The
+// reports print to standard output and the runner exits non-zero when a check fails, so
+// ctest runs each one by name:
+//
+//   ReportTests [name [argument]]
+//
+// With no name every test runs. The argument, when a test takes one, is a file path and
+// defaults to the matching file under DX11UWA_ASSET_DIR.
+#include <DirectXMath.h>
+#include <cstdio>
+#include <cstring>
+
+#include "ClusteredLighting.h"
+#include "CommandBuffer.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+
+#if !defined(DX11UWA_ASSET_DIR)
+#define DX11UWA_ASSET_DIR "../DX11UWA/Assets/"
+#endif
+
+using namespace DX11UWA;
+
+namespace
+{
+	struct ReportTest
+	{
+		const char* Name;
+		bool (*Run)(const char* Argument);
+	};
+
+	bool RunLightClustering(const char*)
+	{
+		return ReportLightClustering();
+	}
+
+	bool RunCommandBuffer(const char*)
+	{
+		return ReportCommandBuffer();
+	}
+
+	bool RunFrustumCulling(const char*)
+	{
+		return ReportFrustumCulling();
+	}
+
+	// Fails when the rendered depth buffer does not match the reference image, or when
+	// the reference cannot be read.
+	bool RunOcclusionCulling(const char* ReferencePath)
+	{
+		return ReportOcclusionCulling(ReferencePath != nullptr ? ReferencePath : DX11UWA_ASSET_DIR "OcclusionReference.pgm");
+	}
+
+	const ReportTest Tests[] =
+	{
+		{ "CommandBuffer", RunCommandBuffer },
+		{ "FrustumCulling", RunFrustumCulling },
+		{ "LightClustering", RunLightClustering },
+		{ "OcclusionCulling", RunOcclusionCulling },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	SetReportWriter(WriteReportToStdout);
+
+	const char* Name = argc > 1 ? argv[1] : nullptr;
+	const char* Argument = argc > 2 ? argv[2] : nullptr;
+
+	unsigned int Ran = 0;
+	unsigned int Failed = 0;
+	for (const ReportTest& Test : Tests)
+	{
+		if (Name != nullptr && strcmp(Name, Test.Name) != 0)
+		{
+			continue;
+		}
+
+		bool Passed = Test.Run(Argument);
+		printf("%s: %s\n", Test.Name, Passed ? "passed" : "FAILED");
+		fflush(stdout);
+		Ran++;
+		Failed += Passed ? 0 : 1;
+	}
+
+	if (Ran == 0)
+	{
+		fprintf(stderr, "No test named %s\n", Name);
+		return 2;
+	}
+
+	return Failed == 0 ? 0 : 1;
+}